@@ -15,7 +15,13 @@
 #include "launcher/Service.h"
 #include "launcher/EventLog.h"
 #include "launcher/Native.h"
+#include "launcher/Placement.h"
+#include "launcher/ReadAhead.h"
+#include "launcher/Startup.h"
+#include "launcher/LaunchServer.h"
+#include "java/Preload.h"
 #include "common/Registry.h"
+#include "common/Timing.h"
 
 #define CONSOLE_TITLE                       ":console.title"
 #define PROCESS_PRIORITY                    ":process.priority"
@@ -38,6 +44,9 @@ namespace
     UINT  progargsOffset = 0;
 
     bool  workingDirectorySet = false;
+
+    // Started by a launcher with single.instance=server to run its launches
+    bool  serveLaunches = false;
 }
 
 void WinRun4J::SetWorkingDirectory(dictionary* ini, bool defaultToIniDir)
@@ -93,6 +102,121 @@ void WinRun4J::SetProcessPriority(dictionary* ini)
         SetPriorityClass(GetCurrentProcess(), p);
 }
 
+// Processor groups and NUMA node masks by group are Windows 7 and later;
+// before that there is the one group GetSystemInfo reports
+static bool GetPlacementTopology(void* /*ctx*/, PlacementTopology& topology)
+{
+    typedef WORD (WINAPI *LPFNGetActiveProcessorGroupCount)();
+    typedef DWORD (WINAPI *LPFNGetActiveProcessorCount)(WORD group);
+    typedef BOOL (WINAPI *LPFNGetProcessGroupAffinity)(HANDLE process, PUSHORT count, PUSHORT groups);
+    typedef BOOL (WINAPI *LPFNGetNumaNodeProcessorMaskEx)(USHORT node, PGROUP_AFFINITY affinity);
+    HINSTANCE hKernel32 = GetModuleHandleA("kernel32");
+    LPFNGetActiveProcessorGroupCount lpfnGetActiveProcessorGroupCount =
+        (LPFNGetActiveProcessorGroupCount)GetProcAddress(hKernel32, "GetActiveProcessorGroupCount");
+    LPFNGetActiveProcessorCount lpfnGetActiveProcessorCount =
+        (LPFNGetActiveProcessorCount)GetProcAddress(hKernel32, "GetActiveProcessorCount");
+    LPFNGetProcessGroupAffinity lpfnGetProcessGroupAffinity =
+        (LPFNGetProcessGroupAffinity)GetProcAddress(hKernel32, "GetProcessGroupAffinity");
+    LPFNGetNumaNodeProcessorMaskEx lpfnGetNumaNodeProcessorMaskEx =
+        (LPFNGetNumaNodeProcessorMaskEx)GetProcAddress(hKernel32, "GetNumaNodeProcessorMaskEx");
+
+    if (lpfnGetActiveProcessorGroupCount && lpfnGetActiveProcessorCount) {
+        topology.groupCount = lpfnGetActiveProcessorGroupCount();
+        if (topology.groupCount > PLACEMENT_MAX_GROUPS)
+            topology.groupCount = PLACEMENT_MAX_GROUPS;
+        for (unsigned g = 0; g < topology.groupCount; g++)
+            topology.groupCpus[g] = lpfnGetActiveProcessorCount((WORD)g);
+    } else {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        topology.groupCount = 1;
+        topology.groupCpus[0] = si.dwNumberOfProcessors;
+    }
+
+    USHORT groups[PLACEMENT_MAX_GROUPS], groupCount = PLACEMENT_MAX_GROUPS;
+    if (lpfnGetProcessGroupAffinity &&
+        lpfnGetProcessGroupAffinity(GetCurrentProcess(), &groupCount, groups) && groupCount > 0)
+        topology.currentGroup = groups[0];
+
+    ULONG highest;
+    if (GetNumaHighestNodeNumber(&highest)) {
+        for (ULONG n = 0; n <= highest && n < PLACEMENT_MAX_NODES; n++) {
+            PlacementNode& node = topology.nodes[topology.nodeCount++];
+            GROUP_AFFINITY ga;
+            ULONGLONG mask;
+            if (lpfnGetNumaNodeProcessorMaskEx) {
+                if (lpfnGetNumaNodeProcessorMaskEx((USHORT)n, &ga)) {
+                    node.group = ga.Group;
+                    node.mask = ga.Mask;
+                }
+            } else if (GetNumaNodeProcessorMask((UCHAR)n, &mask)) {
+                node.mask = mask;
+            }
+        }
+    }
+
+    return topology.groupCount > 0;
+}
+
+/*
+ * Within the group the process is in, the process affinity mask holds every
+ * thread the VM will start. Moving to another group needs the CPU set masks of
+ * Windows 11; before that only the thread that starts the VM can be moved.
+ */
+static bool SetPlacementAffinity(void* /*ctx*/, unsigned group, unsigned long long mask)
+{
+    typedef BOOL (WINAPI *LPFNGetProcessGroupAffinity)(HANDLE process, PUSHORT count, PUSHORT groups);
+    typedef BOOL (WINAPI *LPFNSetThreadGroupAffinity)(HANDLE thread, const GROUP_AFFINITY* affinity, PGROUP_AFFINITY previous);
+    typedef BOOL (WINAPI *LPFNSetProcessDefaultCpuSetMasks)(HANDLE process, PGROUP_AFFINITY masks, USHORT count);
+    HINSTANCE hKernel32 = GetModuleHandleA("kernel32");
+    LPFNGetProcessGroupAffinity lpfnGetProcessGroupAffinity =
+        (LPFNGetProcessGroupAffinity)GetProcAddress(hKernel32, "GetProcessGroupAffinity");
+    LPFNSetThreadGroupAffinity lpfnSetThreadGroupAffinity =
+        (LPFNSetThreadGroupAffinity)GetProcAddress(hKernel32, "SetThreadGroupAffinity");
+    LPFNSetProcessDefaultCpuSetMasks lpfnSetProcessDefaultCpuSetMasks =
+        (LPFNSetProcessDefaultCpuSetMasks)GetProcAddress(hKernel32, "SetProcessDefaultCpuSetMasks");
+
+    USHORT groups[PLACEMENT_MAX_GROUPS], groupCount = PLACEMENT_MAX_GROUPS;
+    bool inGroup = !lpfnGetProcessGroupAffinity ||
+        (lpfnGetProcessGroupAffinity(GetCurrentProcess(), &groupCount, groups) &&
+         groupCount == 1 && groups[0] == group);
+    if (inGroup)
+        return SetProcessAffinityMask(GetCurrentProcess(), (DWORD_PTR)mask) != 0;
+
+    if (!lpfnSetThreadGroupAffinity)
+        return false;
+
+    GROUP_AFFINITY ga;
+    memset(&ga, 0, sizeof(ga));
+    ga.Group = (WORD)group;
+    ga.Mask = (KAFFINITY)mask;
+    if (lpfnSetProcessDefaultCpuSetMasks && !lpfnSetProcessDefaultCpuSetMasks(GetCurrentProcess(), &ga, 1))
+        Log::Warning("Could not set the default CPU sets of the process");
+    return lpfnSetThreadGroupAffinity(GetCurrentThread(), &ga, NULL) != 0;
+}
+
+static const PlacementProvider placementProvider = { GetPlacementTopology, SetPlacementAffinity, NULL };
+
+void WinRun4J::SetProcessAffinity(dictionary* ini)
+{
+    PlacementRequest request;
+    request.mask  = iniparser_getstr(ini, (char*)PROCESS_AFFINITY);
+    request.group = iniparser_getint(ini, (char*)PROCESS_GROUP, -1);
+    request.node  = iniparser_getint(ini, (char*)PROCESS_NUMA_NODE, -1);
+    if (!Placement::IsRequested(request))
+        return;
+
+    PlacementResult result;
+    int error = Placement::Apply(placementProvider, request, result);
+    if (error) {
+        Log::Warning("Could not set the process affinity: %s", Placement::GetError(error));
+        return;
+    }
+
+    Log::Info("Process affinity: group %u, mask 0x%llx (%u processors), NUMA node %d",
+              result.group, result.mask, result.cpus, result.node);
+}
+
 int WinRun4J::DoBuiltInCommand(HINSTANCE hInstance)
 {
     char* lpArg1 = progargs[0];
@@ -140,6 +264,17 @@ int WinRun4J::DoBuiltInCommand(HINSTANCE hInstance)
         return WinRun4J::ExecuteINI(hInstance, ini);
     }
 
+    if (StartsWith(lpArg1, (char*)"--WinRun4J:LaunchServer")) {
+        if (progargsCount < 2) {
+            Log::Error("INI file not specified");
+            return 1;
+        }
+        dictionary* ini = INI::LoadIniFile(hInstance, progargs[1]);
+        progargsOffset = 2;
+        serveLaunches = true;
+        return WinRun4J::ExecuteINI(hInstance, ini);
+    }
+
     if (StartsWith(lpArg1, (char*)"--WinRun4J:Version")) {
         Log::Info("0.4.6\n");
         return 0;
@@ -161,11 +296,209 @@ dictionary* WinRun4J::LoadIniFile(HINSTANCE hInstance)
     return ini;
 }
 
-int WinRun4J::StartVM(dictionary* ini)
+struct StartupThread {
+    void (*fn)(void* arg);
+    void* arg;
+};
+
+static DWORD WINAPI StartupThreadProc(LPVOID param)
+{
+    StartupThread* thread = (StartupThread*)param;
+    thread->fn(thread->arg);
+    free(thread);
+    return 0;
+}
+
+static void* StartStartupThread(void* /*ctx*/, void (*fn)(void* arg), void* arg)
+{
+    StartupThread* thread = (StartupThread*)malloc(sizeof(StartupThread));
+    if (!thread)
+        return NULL;
+    thread->fn  = fn;
+    thread->arg = arg;
+    HANDLE h = CreateThread(NULL, 0, StartupThreadProc, thread, 0, NULL);
+    if (!h)
+        free(thread);
+    return h;
+}
+
+static int WaitStartupThread(void* /*ctx*/, void** threads, int count)
+{
+    DWORD index = WaitForMultipleObjects(count, (HANDLE*)threads, FALSE, INFINITE) - WAIT_OBJECT_0;
+    if (index >= (DWORD)count) {
+        index = 0;
+        WaitForSingleObject(threads[0], INFINITE);
+    }
+    CloseHandle(threads[index]);
+    return (int)index;
+}
+
+static double GetStartupTime(void* /*ctx*/)
+{
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart * 1000.0 / (double)freq.QuadPart;
+}
+
+static const StartupRunner startupRunner = { StartStartupThread, WaitStartupThread, GetStartupTime, NULL };
+
+// What the startup phases share. Each writes only its own part, and reads
+// what another wrote only when it depends on that phase.
+struct StartupState {
+    HINSTANCE hInstance;
+    dictionary* ini;
+    bool splash;
+    char* vmlibrary;
+    const char* classpath;
+};
+
+static bool ShowSplashPhase(void* arg)
+{
+    StartupState* state = (StartupState*)arg;
+    if (state->splash) {
+        Timing::Begin("splash");
+        SplashScreen::ShowSplashImage(state->hInstance, state->ini);
+        Timing::End("splash");
+    }
+    return true;
+}
+
+static bool FindVMPhase(void* arg)
+{
+    StartupState* state = (StartupState*)arg;
+    Timing::Begin("vm.find");
+    state->vmlibrary = VM::FindJavaVMLibrary(state->ini);
+    Timing::End("vm.find");
+    if (state->vmlibrary)
+        Log::Info("Found VM: %s", state->vmlibrary);
+    return state->vmlibrary != NULL;
+}
+
+static bool LoadVMPhase(void* arg)
+{
+    Timing::Begin("vm.load");
+    bool loaded = VM::LoadJavaVMLibrary(((StartupState*)arg)->vmlibrary);
+    Timing::End("vm.load");
+    return loaded;
+}
+
+static bool ClassPathPhase(void* arg)
+{
+    StartupState* state = (StartupState*)arg;
+    Timing::Begin("classpath");
+    INI::GetNumberedKeysFromIni(state->ini, VM_ARG, &vmargs, vmargsCount);
+    Classpath::BuildClassPath(state->ini, &vmargs, vmargsCount);
+    Timing::End("classpath");
+    if (vmargsCount > 0 && !strncmp(vmargs[vmargsCount - 1], CLASS_PATH_ARG, strlen(CLASS_PATH_ARG)))
+        state->classpath = vmargs[vmargsCount - 1] + strlen(CLASS_PATH_ARG);
+    return true;
+}
+
+static bool VMArgsPhase(void* arg)
+{
+    StartupState* state = (StartupState*)arg;
+    Timing::Begin("vm.args");
+    VM::ExtractSpecificVMArgs(state->ini, &vmargs, vmargsCount, state->vmlibrary);
+    Timing::End("vm.args");
+    return true;
+}
+
+static void* OpenReadAheadFile(void* /*ctx*/, const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    return file == INVALID_HANDLE_VALUE ? NULL : file;
+}
+
+static int ReadReadAheadFile(void* /*ctx*/, void* file, char* buffer, int size)
+{
+    DWORD read = 0;
+    if (!ReadFile((HANDLE)file, buffer, (DWORD)size, &read, NULL))
+        return 0;
+    return (int)read;
+}
+
+static void CloseReadAheadFile(void* /*ctx*/, void* file)
+{
+    CloseHandle((HANDLE)file);
+}
+
+static const ReadAheadProvider readAheadProvider = { OpenReadAheadFile, ReadReadAheadFile, CloseReadAheadFile, NULL };
+
+static DWORD WINAPI ReadAheadThreadProc(LPVOID param)
+{
+    ReadAhead* readAhead = (ReadAhead*)param;
+    char* buffer = (char*)malloc(READ_AHEAD_BLOCK);
+    if (buffer) {
+        double start = Timing::Now();
+        Timing::Begin("readahead");
+        ReadAheadResult result;
+        readAhead->Run(readAheadProvider, buffer, READ_AHEAD_BLOCK, result);
+        Timing::End("readahead");
+        Log::Info("Read ahead %.1f MB in %.1f ms: %d files, %d cut short by the budget, %d not found",
+                  (double)result.bytes / (1024 * 1024), Timing::Now() - start, result.files, result.partial,
+                  result.missing);
+        free(buffer);
+    }
+    delete readAhead;
+    return 0;
+}
+
+// Reads jvm.dll, its runtime image and the classpath jars into the file cache
+// on a thread of its own. The phase does not wait for it; creating the VM and
+// loading the main class go on while it reads, and find the files cached.
+static bool ReadAheadPhase(void* arg)
+{
+    StartupState* state = (StartupState*)arg;
+    int budget = iniparser_getint(state->ini, (char*)STARTUP_READ_AHEAD, 0);
+    if (budget <= 0)
+        return true;
+
+    ReadAhead* readAhead = new ReadAhead((unsigned long long)budget * 1024 * 1024);
+    readAhead->AddVM(state->vmlibrary);
+    readAhead->AddList(state->classpath, ';');
+    HANDLE h = CreateThread(NULL, 0, ReadAheadThreadProc, readAhead, 0, NULL);
+    if (!h) {
+        delete readAhead;
+        return true;
+    }
+    CloseHandle(h);
+    return true;
+}
+
+enum { SPLASH_PHASE, FIND_VM_PHASE, LOAD_VM_PHASE, CLASS_PATH_PHASE, VM_ARGS_PHASE, READ_AHEAD_PHASE, STARTUP_PHASES };
+
+int WinRun4J::StartVM(HINSTANCE hInstance, dictionary* ini, bool splash)
 {
     bool showErrorPopup = iniparser_getboolean(ini, (char*)ERROR_MESSAGES_SHOW_POPUP, 1);
 
-    char* vmlibrary = VM::FindJavaVMLibrary(ini);
+    // Loading jvm.dll only needs the VM found, and the vm args need the
+    // classpath as well, so the VM and the classpath are found at once
+    StartupState state = { hInstance, ini, splash, NULL, NULL };
+    StartupPhase phases[STARTUP_PHASES] = {
+        { "splash", 0, ShowSplashPhase, &state },
+        { "find vm", 0, FindVMPhase, &state },
+        { "load vm", 1 << FIND_VM_PHASE, LoadVMPhase, &state },
+        { "classpath", 0, ClassPathPhase, &state },
+        { "vm args", (1 << FIND_VM_PHASE) | (1 << CLASS_PATH_PHASE), VMArgsPhase, &state },
+        { "read ahead", (1 << FIND_VM_PHASE) | (1 << CLASS_PATH_PHASE), ReadAheadPhase, &state },
+    };
+    bool parallel = iniparser_getboolean(ini, (char*)STARTUP_PARALLEL, 1) != 0;
+    StartupTiming timing;
+    Startup::Run(startupRunner, phases, STARTUP_PHASES, parallel, timing);
+
+    for (int i = 0; i < STARTUP_PHASES; i++) {
+        Log::Info("Startup phase %s: %s, %.1f to %.1f ms", phases[i].name,
+                  Startup::GetStateName(phases[i].state), phases[i].start, phases[i].end);
+    }
+    if (parallel)
+        Log::Info("Startup phases took %.1f ms, %.1f ms less than one after another",
+                  timing.elapsed, timing.serial - timing.elapsed);
+    else
+        Log::Info("Startup phases took %.1f ms", timing.elapsed);
+
+    char* vmlibrary = state.vmlibrary;
     if (!vmlibrary) {
         char* javaNotFound = iniparser_getstring(ini,
             (char*)ERROR_MESSAGES_JAVA_NOT_FOUND,
@@ -177,31 +510,13 @@ int WinRun4J::StartVM(dictionary* ini)
         return 1;
     }
 
-    Log::Info("Found VM: %s", vmlibrary);
-
-    INI::GetNumberedKeysFromIni(ini, VM_ARG, &vmargs, vmargsCount);
-
-    Classpath::BuildClassPath(ini, &vmargs, vmargsCount);
-
-    VM::ExtractSpecificVMArgs(ini, &vmargs, vmargsCount);
-
     if (vmargsCount > 0)
         Log::Info("VM Args:");
 
-    const int log_chunk = MAX_LOG_LENGTH - 100;
     for (UINT i = 0; i < vmargsCount; i++) {
-		char const * text = vmargs[i];
-		size_t len = strlen(text);
-		size_t pos = 0;
-		while (pos < len) {
-			char buf[log_chunk + 1];
-			size_t remaining = len - pos;
-			size_t chunk = remaining < log_chunk ? remaining : log_chunk;
-			memcpy(buf, text + pos, chunk);
-			buf[chunk] = '\0';
-			Log::Info("vmarg.%d=%s", i, buf);
-			pos += chunk;
-		}
+        char name[32];
+        sprintf_s(name, sizeof(name), "vmarg.%d=", i);
+        Log::InfoLong(name, vmargs[i]);
     }
 
     vmargs[vmargsCount] = NULL;
@@ -248,7 +563,9 @@ void WinRun4J::ProcessCommandLineArgs(dictionary* ini)
     UINT vmMax = INI::GetNumberedKeysMax(ini, (char*)":vmarg");
 
     char entryName[MAX_PATH];
+    int  unset = 0;
 
+    ini->layer = DICT_ORIGIN_CMDLINE;
     for (UINT i = progargsOffset; i < progargsCount; i++) {
         char* arg = progargs[i];
 
@@ -277,6 +594,7 @@ void WinRun4J::ProcessCommandLineArgs(dictionary* ini)
             } else {
                 strcpy_s(entryName + offset, MAX_PATH - offset, nmptr);
                 iniparser_unset(ini, entryName);
+                unset++;
             }
 
         } else if (allowVmargs && (StartsWith(arg, (char*)"-X") || StartsWith(arg, (char*)"-D"))) {
@@ -288,6 +606,11 @@ void WinRun4J::ProcessCommandLineArgs(dictionary* ini)
             iniparser_setstr(ini, entryName, arg);
         }
     }
+
+    if (unset) {
+        sprintf_s(entryName, "%d", unset);
+        iniparser_setstr(ini, (char*)CMDLINE_UNSET, entryName);
+    }
 }
 
 int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
@@ -296,9 +619,12 @@ int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
         return 1;
 
     ProcessCommandLineArgs(ini);
+    INI::LogOrigins(ini);
+    Timing::SetSink(ini);
 
-    if (Shell::CheckSingleInstance(ini))
-        return 0;
+    int exitCode = 0;
+    if (!serveLaunches && Shell::CheckSingleInstance(ini, exitCode))
+        return exitCode;
 
     char* serviceCls = iniparser_getstr(ini, (char*)SERVICE_CLASS);
     char* mainCls    = iniparser_getstr(ini, (char*)MAIN_CLASS);
@@ -309,20 +635,26 @@ int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
 
     WinRun4J::SetWorkingDirectory(ini, defaultToIniDir);
 
-    if (!serviceMode)
-        SplashScreen::ShowSplashImage(hInstance, ini);
-
     WinRun4J::SetProcessPriority(ini);
+    WinRun4J::SetProcessAffinity(ini);
 
-    int result = WinRun4J::StartVM(ini);
+    int result = WinRun4J::StartVM(hInstance, ini, !serviceMode && !serveLaunches);
     if (result)
         return result;
 
+    // From here Java threads may read the INI
+    INI::PublishSnapshot(ini);
+
     JNIEnv* env = VM::GetJNIEnv();
 
+    Timing::Begin("jni.init");
     JNI::Init(env);
-    if (!iniparser_getboolean(ini, (char*)DISABLE_NATIVE_METHODS, 0))
+    Timing::End("jni.init");
+    if (!iniparser_getboolean(ini, (char*)DISABLE_NATIVE_METHODS, 0)) {
         Native::RegisterNatives(env);
+        JNI::LoadIndexedClassLoader(env);
+    }
+    Preload::Start(env, ini);
 
     bool ddeInit = DDE::Initialize(hInstance, env, ini);
 
@@ -340,6 +672,8 @@ int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
 
     if (serviceMode)
         result = Service::Run(hInstance, ini, (int)argc, argv);
+    else if (serveLaunches)
+        result = LaunchServer::Run(env, ini, mainCls);
     else
         result = JNI::RunMainClass(env, mainCls, (int)argc, argv);
 
@@ -351,7 +685,9 @@ int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
 
     WinRun4J::FreeArgs();
 
+    Preload::Stop();
     result |= VM::CleanupVM();
+    Timing::Flush();
 
     Log::Close();
 
@@ -365,6 +701,7 @@ int WinRun4J::ExecuteINI(HINSTANCE hInstance, dictionary* ini)
 
 int main(int /*argc*/, char* /*argv*/[])
 {
+    Timing::Init();
     HINSTANCE hInstance = (HINSTANCE)GetModuleHandleA(NULL);
     LPSTR lpCmdLine = StripArg0(GetCommandLineA());
 
@@ -372,6 +709,7 @@ int main(int /*argc*/, char* /*argv*/[])
 
 int __stdcall WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR lpCmdLine, int /*nCmdShow*/)
 {
+    Timing::Init();
     lpCmdLine = StripArg0(GetCommandLineA());
 
 #endif
@@ -30,10 +30,11 @@ class WinRun4J
 public:
 	static void SetWorkingDirectory(dictionary* ini, bool defaultToIniDir = false);
 	static void SetProcessPriority(dictionary* ini);
+	static void SetProcessAffinity(dictionary* ini);
 	static int DoBuiltInCommand(HINSTANCE hInstance);
 	static void ProcessCommandLineArgs(dictionary* ini);
 	static dictionary* LoadIniFile(HINSTANCE hInstance);
-	static int StartVM(dictionary* ini);
+	static int StartVM(HINSTANCE hInstance, dictionary* ini, bool splash);
 	static void FreeArgs();
 	static int ExecuteINI(HINSTANCE hInstance);
 	static int ExecuteINI(HINSTANCE hInstance, dictionary* ini);
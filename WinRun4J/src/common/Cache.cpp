@@ -0,0 +1,201 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Cache.h"
+#include "Log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_DIR "WinRun4J"
+
+/*
+ * Builds <cache dir>\<hash of key>.<ext>. The cache directory is
+ * %LOCALAPPDATA%\WinRun4J, or under the temp directory when there is no
+ * local application data folder. It is created by Write.
+ */
+bool Cache::GetPath(const char* key, const char* ext, char* path, size_t len)
+{
+    char dir[MAX_PATH];
+    DWORD dlen = GetEnvironmentVariable("LOCALAPPDATA", dir, MAX_PATH);
+    if (dlen == 0 || dlen >= MAX_PATH) {
+        dlen = GetTempPath(MAX_PATH, dir);
+        if (dlen == 0 || dlen >= MAX_PATH)
+            return false;
+    }
+
+    if (dir[dlen - 1] == '\\')
+        dir[--dlen] = 0;
+    return sprintf_s(path, len, "%s\\%s\\%016llx.%s", dir, CACHE_DIR, HashString(key), ext) > 0;
+}
+
+// FNV-1a
+ULONGLONG Cache::Hash(const void* data, size_t len, ULONGLONG hash)
+{
+    const BYTE* p = (const BYTE*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ULONGLONG Cache::HashString(const char* str, ULONGLONG hash)
+{
+    return str ? Hash(str, strlen(str), hash) : hash;
+}
+
+void Cache::GetStamp(const char* file, CacheStamp& stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+
+    stamp.size = CACHE_MISSING;
+    stamp.time = 0;
+    stamp.hash = 0;
+    if (!file || !GetFileAttributesEx(file, GetFileExInfoStandard, &fad))
+        return;
+
+    stamp.size = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    stamp.time = ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+
+    DWORD size;
+    const BYTE* view = Map(file, size);
+    stamp.hash = Hash(view, view ? size : 0);
+    Unmap(view);
+}
+
+/*
+ * A file is unchanged if its size and time match. If only the time differs
+ * (eg. the file was copied or touched) the content hash decides.
+ */
+bool Cache::IsCurrent(const char* file, const CacheStamp& stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+
+    if (!file || !GetFileAttributesEx(file, GetFileExInfoStandard, &fad))
+        return stamp.size == CACHE_MISSING;
+
+    ULONGLONG size = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    ULONGLONG time = ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    if (size != stamp.size)
+        return false;
+    if (time == stamp.time)
+        return true;
+
+    DWORD vsize;
+    const BYTE* view = Map(file, vsize);
+    bool same = Hash(view, view ? vsize : 0) == stamp.hash;
+    Unmap(view);
+    return same;
+}
+
+/*
+ * Maps a whole file read-only, NULL if it is missing or empty. A copy on
+ * write view can be edited in place without changing the file.
+ */
+const BYTE* Cache::Map(const char* file, DWORD& size, bool copyOnWrite)
+{
+    size = 0;
+    HANDLE hFile = CreateFile(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    const BYTE* view = NULL;
+    size = GetFileSize(hFile, NULL);
+    if (size != 0 && size != INVALID_FILE_SIZE) {
+        HANDLE hMap = CreateFileMapping(hFile, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (hMap) {
+            view = (const BYTE*)MapViewOfFile(hMap, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hMap);
+        }
+    }
+    CloseHandle(hFile);
+
+    if (!view)
+        size = 0;
+    return view;
+}
+
+void Cache::Unmap(const BYTE* view)
+{
+    if (view)
+        UnmapViewOfFile(view);
+}
+
+/*
+ * Writes to a temporary file beside the target and renames it into place,
+ * so a reader never maps a partly written cache.
+ */
+bool Cache::Write(const char* file, const void* data, DWORD size)
+{
+    char tmp[MAX_PATH];
+    if (sprintf_s(tmp, sizeof(tmp), "%s.%lu.tmp", file, GetCurrentProcessId()) < 0)
+        return false;
+
+    // Create the cache directory on first use
+    char dir[MAX_PATH];
+    GetFileDirectory((LPSTR)file, dir);
+    CreateDirectory(dir, NULL);
+
+    HANDLE hFile = CreateFile(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        Log::Warning("Could not create cache file: %s", tmp);
+        return false;
+    }
+
+    DWORD written = 0;
+    BOOL ok = WriteFile(hFile, data, size, &written, NULL) && written == size;
+    CloseHandle(hFile);
+
+    if (!ok || !MoveFileEx(tmp, file, MOVEFILE_REPLACE_EXISTING)) {
+        Log::Warning("Could not write cache file: %s", file);
+        DeleteFile(tmp);
+        return false;
+    }
+    return true;
+}
+
+// Callers delete the cache of an option that is off on every launch, so a
+// file that is not there is only looked for
+void Cache::Delete(const char* file)
+{
+    if (file && GetFileAttributes(file) != INVALID_FILE_ATTRIBUTES && DeleteFile(file))
+        Log::Info("Deleted cache file: %s", file);
+}
+
+// Returns the offset of the string in the blob, CACHE_NO_STRING for NULL
+DWORD Cache::AddString(CacheBlob& blob, const char* str)
+{
+    if (!str)
+        return CACHE_NO_STRING;
+
+    DWORD len = (DWORD)strlen(str) + 1;
+    if (blob.len + len > blob.size) {
+        DWORD size = blob.size ? blob.size : 4096;
+        while (blob.len + len > size)
+            size *= 2;
+        char* p = (char*)realloc(blob.data, size);
+        if (!p) {
+            blob.failed = true;
+            return CACHE_NO_STRING;
+        }
+        blob.data = p;
+        blob.size = size;
+    }
+    memcpy(&blob.data[blob.len], str, len);
+    blob.len += len;
+    return blob.len - len;
+}
+
+const char* Cache::GetString(const BYTE* view, DWORD size, DWORD offset)
+{
+    return offset < size ? (const char*)&view[offset] : NULL;
+}
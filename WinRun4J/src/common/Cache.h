@@ -0,0 +1,52 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "Runtime.h"
+
+// Per-user cache files (%LOCALAPPDATA%\WinRun4J) that are written once and
+// mapped read-only on later starts. Each cache records stamps of the inputs
+// it was built from and is discarded when any of them change.
+
+#define CACHE_MISSING   ((ULONGLONG)-1)
+#define CACHE_HASH_SEED 14695981039346656037ULL
+#define CACHE_NO_STRING ((DWORD)-1)
+
+struct CacheStamp {
+	ULONGLONG size;		// CACHE_MISSING if the file does not exist
+	ULONGLONG time;		// Last write time
+	ULONGLONG hash;		// Content hash
+};
+
+// Strings of a cache file being built, referred to by offset
+struct CacheBlob {
+	char* data;
+	DWORD len;
+	DWORD size;
+	bool  failed;
+};
+
+struct Cache {
+	static bool GetPath(const char* key, const char* ext, char* path, size_t len);
+	static ULONGLONG Hash(const void* data, size_t len, ULONGLONG hash = CACHE_HASH_SEED);
+	static ULONGLONG HashString(const char* str, ULONGLONG hash = CACHE_HASH_SEED);
+	static void GetStamp(const char* file, CacheStamp& stamp);
+	static bool IsCurrent(const char* file, const CacheStamp& stamp);
+	static const BYTE* Map(const char* file, DWORD& size, bool copyOnWrite = false);
+	static void Unmap(const BYTE* view);
+	static bool Write(const char* file, const void* data, DWORD size);
+	static void Delete(const char* file);
+	static DWORD AddString(CacheBlob& blob, const char* str);
+	static const char* GetString(const BYTE* view, DWORD size, DWORD offset);
+};
+
+#endif // CACHE_H
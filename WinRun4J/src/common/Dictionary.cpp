@@ -24,44 +24,487 @@ iniparser is distributed under an MIT license.
 #define ASCIILINESZ         1024
 #define INI_INVALID_KEY     ((char*)-1)
 
-static void *mem_double(void *ptr, int size)
-{
-    void *newptr;
+#define ARENAMINSZ          4096
+#define ARENAMAXSZ          65536
+
+#define SECMINSZ            16
+#define NUMMINSZ            16
+
+/* Private: arena block, string data follows the header */
+typedef struct _dict_block_ {
+    struct _dict_block_ *next;
+    int                  size;
+    int                  used;
+} dict_block;
+
+/* Private: section table entry, its keys are chained through link */
+typedef struct _dict_section_ {
+    char    *name;
+    int      len;
+    unsigned hash;
+    int      header;    /* Entry holding the [section] itself, or -1 */
+    int      head;      /* First and last key entries, or -1 */
+    int      tail;
+    int      count;
+} dict_section;
+
+/* Private: section membership and numbered key index of an entry */
+typedef struct _dict_link_ {
+    int sec;            /* Section index, -1 if not linked */
+    int prev;
+    int next;
+    int num;            /* Numbered key base, -1 if not numbered */
+    int number;
+} dict_link;
+
+/* Private: entries "base.N" of one base key, sorted by N */
+typedef struct _dict_numbered_ {
+    char    *name;
+    int      len;
+    unsigned hash;
+    int      count;
+    int      size;
+    int     *number;
+    int     *entry;
+} dict_numbered;
 
-    newptr = calloc(2 * size, 1);
-    if (newptr && ptr) {
-        memcpy(newptr, ptr, size);
-    }
-    free(ptr);
-    return newptr;
-}
+static dictionary_stats g_stats;
 
-unsigned dictionary_hash(char *key)
+/* Private: one-at-a-time hash, split so a key can be hashed in pieces */
+static unsigned hash_add(unsigned hash, const char *s, int len)
 {
-    int      len;
-    unsigned hash;
-    int      i;
+    int i;
 
-    len = (int)strlen(key);
-    for (hash = 0, i = 0; i < len; i++) {
-        hash += (unsigned)key[i];
+    for (i = 0; i < len; i++) {
+        hash += (unsigned)s[i];
         hash += (hash << 10);
         hash ^= (hash >> 6);
     }
+    return hash;
+}
+
+static unsigned hash_end(unsigned hash)
+{
     hash += (hash << 3);
     hash ^= (hash >> 11);
     hash += (hash << 15);
     return hash;
 }
 
+unsigned dictionary_hash(char *key)
+{
+    return hash_end(hash_add(0, key, (int)strlen(key)));
+}
+
+/* Private: take len bytes of string storage from the arena */
+static char *dictionary_alloc(dictionary *d, int len)
+{
+    dict_block *b = d->arena;
+    int         size;
+    char       *p;
+
+    if (b == NULL || b->used + len > b->size) {
+        size = b ? b->size * 2 : ARENAMINSZ;
+        if (size > ARENAMAXSZ)
+            size = ARENAMAXSZ;
+        if (size < len)
+            size = len;
+
+        g_stats.allocs++;
+        g_stats.blocks++;
+        b = (dict_block *)malloc(sizeof(dict_block) + size);
+        if (!b)
+            return NULL;
+        b->size = size;
+        b->used = 0;
+
+        /* Large strings get a block of their own behind the current one */
+        if (d->arena && len > d->arena->size / 2) {
+            b->next = d->arena->next;
+            d->arena->next = b;
+        } else {
+            b->next = d->arena;
+            d->arena = b;
+        }
+    }
+
+    p = (char *)(b + 1) + b->used;
+    b->used += len;
+    g_stats.bytes += len;
+    return p;
+}
+
+/* Private: copy a string into the arena, rounding the space up for reuse */
+static char *dictionary_strdup(dictionary *d, char *s, int *cap)
+{
+    int   len = (int)strlen(s) + 1;
+    int   size = (len + 7) & ~7;
+    char *p = dictionary_alloc(d, size);
+
+    if (p) {
+        memcpy(p, s, len);
+        if (cap)
+            *cap = size;
+    }
+    return p;
+}
+
+/* Private: index slot markers */
+#define SLOT_EMPTY          -1
+#define SLOT_DELETED        -2
+#define SLOTMINSZ           256
+
+/* Private: find the index slot holding key, or -1 if not present */
+static int dictionary_lookup(dictionary *d, char *key, unsigned hash)
+{
+    unsigned mask = (unsigned)d->nslot - 1;
+    unsigned pos  = hash & mask;
+    int      e;
+
+    while ((e = d->slot[pos]) != SLOT_EMPTY) {
+        if (e != SLOT_DELETED && d->hash[e] == hash && !strcmp(key, d->key[e]))
+            return (int)pos;
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+/* Private: as dictionary_lookup for the key "sec:key" without building it */
+static int dictionary_lookup_sec(dictionary *d, const char *sec, int seclen,
+                                 const char *key, unsigned hash)
+{
+    unsigned mask = (unsigned)d->nslot - 1;
+    unsigned pos  = hash & mask;
+    char    *k;
+    int      e;
+
+    while ((e = d->slot[pos]) != SLOT_EMPTY) {
+        if (e != SLOT_DELETED && d->hash[e] == hash) {
+            k = d->key[e];
+            if (!strncmp(k, sec, seclen) && k[seclen] == ':' && !strcmp(k + seclen + 1, key))
+                return (int)pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+/* Private: find a section by name, or -1 */
+static int dictionary_findsec(dictionary *d, const char *name, int len, unsigned hash)
+{
+    dict_section *s;
+    int           i;
+
+    if (len == 0)
+        return 0;
+
+    /* Newest first: a parser adds keys to the section it has just created */
+    for (i = d->nsec - 1; i > 0; i--) {
+        s = &d->sec[i];
+        if (s->hash == hash && s->len == len && !memcmp(s->name, name, len))
+            return i;
+    }
+    return -1;
+}
+
+/* Private: append a section to the table */
+static int dictionary_addsec(dictionary *d, const char *name, int len, unsigned hash)
+{
+    dict_section *s;
+    char         *p;
+
+    if (d->nsec == d->secsize) {
+        g_stats.allocs++;
+        s = (dict_section *)realloc(d->sec, d->secsize * 2 * sizeof(dict_section));
+        if (!s)
+            return -1;
+        d->sec = s;
+        d->secsize *= 2;
+    }
+
+    p = dictionary_alloc(d, len + 1);
+    if (!p)
+        return -1;
+    memcpy(p, name, len);
+    p[len] = 0;
+
+    s = &d->sec[d->nsec];
+    s->name   = p;
+    s->len    = len;
+    s->hash   = hash;
+    s->header = -1;
+    s->head   = -1;
+    s->tail   = -1;
+    s->count  = 0;
+    return d->nsec++;
+}
+
+/* Private: remove an empty section, renumbering the ones after it */
+static void dictionary_dropsec(dictionary *d, int sec)
+{
+    int i;
+
+    memmove(&d->sec[sec], &d->sec[sec + 1], (d->nsec - sec - 1) * sizeof(dict_section));
+    d->nsec--;
+    for (i = 0; i < d->n; i++) {
+        if (d->link[i].sec > sec)
+            d->link[i].sec--;
+    }
+}
+
+/* Private: split "base.N" into base length and N; N is -1 when the key is
+   not numbered. Only the plain decimal form ("1", never "01") counts, as
+   that is the form callers would build */
+static int dictionary_keynumber(const char *key, int *baselen)
+{
+    int len = (int)strlen(key);
+    int i   = len;
+
+    while (i > 0 && key[i - 1] >= '0' && key[i - 1] <= '9')
+        i--;
+    if (i == len || len - i > 9 || i == 0 || key[i - 1] != '.')
+        return -1;
+    if (key[i] == '0' && len - i > 1)
+        return -1;
+    *baselen = i - 1;
+    return atoi(key + i);
+}
+
+/* Private: find a numbered key base, or -1 */
+static int dictionary_findnum(dictionary *d, const char *name, int len, unsigned hash)
+{
+    dict_numbered *b;
+    int            i;
+
+    /* Newest first, as for sections */
+    for (i = d->nnum - 1; i >= 0; i--) {
+        b = &d->num[i];
+        if (b->hash == hash && b->len == len && !memcmp(b->name, name, len))
+            return i;
+    }
+    return -1;
+}
+
+/* Private: position of number in a base, or where it would be inserted */
+static int dictionary_numpos(dict_numbered *b, int number)
+{
+    int lo = 0;
+    int hi = b->count;
+    int mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (b->number[mid] < number)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Private: add entry e to the numbered key index if its key is "base.N" */
+static void dictionary_linknum(dictionary *d, int e)
+{
+    dict_link     *l = &d->link[e];
+    dict_numbered *b;
+    unsigned       hash;
+    int            len;
+    int            i;
+    int            pos;
+    int            size;
+    void          *p;
+
+    l->num = -1;
+    if ((l->number = dictionary_keynumber(d->key[e], &len)) < 0)
+        return;
+
+    hash = hash_end(hash_add(0, d->key[e], len));
+    i    = dictionary_findnum(d, d->key[e], len, hash);
+    if (i < 0) {
+        if (d->nnum == d->numsize) {
+            g_stats.allocs++;
+            p = realloc(d->num, d->numsize * 2 * sizeof(dict_numbered));
+            if (!p)
+                return;
+            d->num = (dict_numbered *)p;
+            d->numsize *= 2;
+        }
+        b = &d->num[d->nnum];
+        memset(b, 0, sizeof(dict_numbered));
+        b->name = d->key[e];    /* Keys stay in the arena until dictionary_del */
+        b->len  = len;
+        b->hash = hash;
+        i = d->nnum++;
+    }
+    b = &d->num[i];
+
+    if (b->count == b->size) {
+        size = b->size ? b->size * 2 : NUMMINSZ;
+        g_stats.allocs += 2;
+        if ((p = realloc(b->number, size * sizeof(int))) == NULL)
+            return;
+        b->number = (int *)p;
+        if ((p = realloc(b->entry, size * sizeof(int))) == NULL)
+            return;
+        b->entry = (int *)p;
+        b->size  = size;
+    }
+
+    /* Numbers usually arrive in order, so this is normally an append */
+    pos = b->count > 0 && b->number[b->count - 1] < l->number ? b->count : dictionary_numpos(b, l->number);
+    memmove(&b->number[pos + 1], &b->number[pos], (b->count - pos) * sizeof(int));
+    memmove(&b->entry[pos + 1], &b->entry[pos], (b->count - pos) * sizeof(int));
+    b->number[pos] = l->number;
+    b->entry[pos]  = e;
+    b->count++;
+    l->num = i;
+}
+
+/* Private: take entry e out of the numbered key index */
+static void dictionary_unlinknum(dictionary *d, int e)
+{
+    dict_link     *l = &d->link[e];
+    dict_numbered *b;
+    int            pos;
+
+    if (l->num < 0)
+        return;
+    b   = &d->num[l->num];
+    pos = dictionary_numpos(b, l->number);
+    memmove(&b->number[pos], &b->number[pos + 1], (b->count - pos - 1) * sizeof(int));
+    memmove(&b->entry[pos], &b->entry[pos + 1], (b->count - pos - 1) * sizeof(int));
+    b->count--;
+}
+
+/* Private: add entry e to the section named by its key */
+static void dictionary_link(dictionary *d, int e)
+{
+    char         *key   = d->key[e];
+    char         *colon = strchr(key, ':');
+    int           len   = colon ? (int)(colon - key) : (int)strlen(key);
+    unsigned      hash  = hash_end(hash_add(0, key, len));
+    dict_link    *l     = &d->link[e];
+    dict_section *s;
+    int           i;
+
+    l->prev = -1;
+    l->next = -1;
+    l->sec  = -1;
+
+    i = dictionary_findsec(d, key, len, hash);
+    if (i < 0 && (i = dictionary_addsec(d, key, len, hash)) < 0)
+        return;
+    l->sec = i;
+    s = &d->sec[i];
+
+    if (colon == NULL) {
+        s->header = e;
+        return;
+    }
+
+    l->prev = s->tail;
+    if (s->tail >= 0)
+        d->link[s->tail].next = e;
+    else
+        s->head = e;
+    s->tail = e;
+    s->count++;
+}
+
+/* Private: take entry e out of its section */
+static void dictionary_unlink(dictionary *d, int e)
+{
+    dict_link    *l = &d->link[e];
+    dict_section *s;
+
+    if (l->sec < 0)
+        return;
+    s = &d->sec[l->sec];
+
+    if (s->header == e) {
+        s->header = -1;
+        return;
+    }
+
+    if (l->prev >= 0)
+        d->link[l->prev].next = l->next;
+    else
+        s->head = l->next;
+    if (l->next >= 0)
+        d->link[l->next].prev = l->prev;
+    else
+        s->tail = l->prev;
+    s->count--;
+}
+
+/* Private: entry from has moved to index to, repoint its section chain
+   and numbered key index */
+static void dictionary_relink(dictionary *d, int from, int to)
+{
+    dict_link    *l = &d->link[to];
+    dict_section *s;
+
+    *l = d->link[from];
+    if (l->num >= 0)
+        d->num[l->num].entry[dictionary_numpos(&d->num[l->num], l->number)] = to;
+    if (l->sec < 0)
+        return;
+    s = &d->sec[l->sec];
+
+    if (s->header == from) {
+        s->header = to;
+        return;
+    }
+
+    if (l->prev >= 0)
+        d->link[l->prev].next = to;
+    else
+        s->head = to;
+    if (l->next >= 0)
+        d->link[l->next].prev = to;
+    else
+        s->tail = to;
+}
+
+/* Private: rebuild the slot index at the given size, dropping deleted slots */
+static int dictionary_reindex(dictionary *d, int nslot)
+{
+    int     *slot;
+    unsigned mask;
+    unsigned pos;
+    int      i;
+
+    g_stats.allocs++;
+    slot = (int *)malloc(nslot * sizeof(int));
+    if (!slot)
+        return 0;
+    memset(slot, 0xff, nslot * sizeof(int)); /* SLOT_EMPTY */
+
+    mask = (unsigned)nslot - 1;
+    for (i = 0; i < d->n; i++) {
+        pos = d->hash[i] & mask;
+        while (slot[pos] != SLOT_EMPTY)
+            pos = (pos + 1) & mask;
+        slot[pos] = i;
+    }
+
+    free(d->slot);
+    d->slot  = slot;
+    d->nslot = nslot;
+    d->used  = d->n;
+    return 1;
+}
+
 dictionary *dictionary_new(int size)
 {
     dictionary *d;
+    int         nslot;
 
     /* If no size was specified, allocate space for DICTMINSZ */
     if (size < DICTMINSZ)
         size = DICTMINSZ;
 
+    g_stats.allocs += 9;
     d = (dictionary *)calloc(1, sizeof(dictionary));
     if (!d)
         return NULL;
@@ -70,8 +513,20 @@ dictionary *dictionary_new(int size)
     d->val  = (char **)calloc(size, sizeof(char *));
     d->key  = (char **)calloc(size, sizeof(char *));
     d->hash = (unsigned int *)calloc(size, sizeof(unsigned));
-
-    if (!d->val || !d->key || !d->hash) {
+    d->vcap = (int *)calloc(size, sizeof(int));
+    d->link = (dict_link *)calloc(size, sizeof(dict_link));
+    d->origin = (int *)calloc(size, sizeof(int));
+    d->sec  = (dict_section *)calloc(SECMINSZ, sizeof(dict_section));
+    d->secsize = SECMINSZ;
+    d->num  = (dict_numbered *)calloc(NUMMINSZ, sizeof(dict_numbered));
+    d->numsize = NUMMINSZ;
+
+    /* Keep the index at most half full for the initial size */
+    for (nslot = SLOTMINSZ; nslot < size * 2; nslot *= 2)
+        ;
+
+    if (!d->val || !d->key || !d->hash || !d->vcap || !d->link || !d->origin || !d->sec || !d->num ||
+        !dictionary_reindex(d, nslot) || dictionary_addsec(d, "", 0, hash_end(0)) != 0) {
         dictionary_del(d);
         return NULL;
     }
@@ -81,44 +536,43 @@ dictionary *dictionary_new(int size)
 
 void dictionary_del(dictionary *d)
 {
-    int i;
+    dict_block *b;
+    int         i;
 
     if (d == NULL)
         return;
 
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] != NULL)
-            free(d->key[i]);
-        if (d->val[i] != NULL)
-            free(d->val[i]);
+    while ((b = d->arena) != NULL) {
+        d->arena = b->next;
+        free(b);
     }
     free(d->val);
     free(d->key);
     free(d->hash);
+    free(d->vcap);
+    free(d->slot);
+    free(d->link);
+    free(d->origin);
+    free(d->sec);
+    for (i = 0; i < d->nnum; i++) {
+        free(d->num[i].number);
+        free(d->num[i].entry);
+    }
+    free(d->num);
     free(d);
 }
 
 char *dictionary_get(dictionary *d, char *key, char *def)
 {
-    unsigned hash;
-    int      i;
+    int pos;
 
     if (d == NULL || key == NULL)
         return def;
 
-    hash = dictionary_hash(key);
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] == NULL)
-            continue;
-        /* Compare hash */
-        if (hash == d->hash[i]) {
-            /* Compare string, to avoid hash collisions */
-            if (!strcmp(key, d->key[i])) {
-                return d->val[i];
-            }
-        }
-    }
-    return def;
+    pos = dictionary_lookup(d, key, dictionary_hash(key));
+    if (pos < 0)
+        return def;
+    return d->val[d->slot[pos]];
 }
 
 char dictionary_getchar(dictionary *d, char *key, char def)
@@ -154,96 +608,262 @@ double dictionary_getdouble(dictionary *d, char *key, double def)
     }
 }
 
-void dictionary_set(dictionary *d, char *key, char *val)
+/* Private: grow the entry arrays to hold size entries */
+static int dictionary_grow(dictionary *d, int size)
 {
-    int      i;
-    unsigned hash;
+    char     **val;
+    char     **key;
+    unsigned  *hash;
+    int       *vcap;
+    dict_link *link;
+    int       *origin;
+
+    g_stats.allocs += 6;
+    val    = (char **)calloc(size, sizeof(char *));
+    key    = (char **)calloc(size, sizeof(char *));
+    hash   = (unsigned *)calloc(size, sizeof(unsigned));
+    vcap   = (int *)calloc(size, sizeof(int));
+    link   = (dict_link *)calloc(size, sizeof(dict_link));
+    origin = (int *)calloc(size, sizeof(int));
+    if (!val || !key || !hash || !vcap || !link || !origin) {
+        free(val);
+        free(key);
+        free(hash);
+        free(vcap);
+        free(link);
+        free(origin);
+        return 0;
+    }
 
-    if (d == NULL || key == NULL)
-        return;
+    memcpy(val, d->val, d->n * sizeof(char *));
+    memcpy(key, d->key, d->n * sizeof(char *));
+    memcpy(hash, d->hash, d->n * sizeof(unsigned));
+    memcpy(vcap, d->vcap, d->n * sizeof(int));
+    memcpy(link, d->link, d->n * sizeof(dict_link));
+    memcpy(origin, d->origin, d->n * sizeof(int));
+    free(d->val);
+    free(d->key);
+    free(d->hash);
+    free(d->vcap);
+    free(d->link);
+    free(d->origin);
+    d->val    = val;
+    d->key    = key;
+    d->hash   = hash;
+    d->vcap   = vcap;
+    d->link   = link;
+    d->origin = origin;
+    d->size   = size;
+    return 1;
+}
 
-    /* Compute hash for this key */
-    hash = dictionary_hash(key);
+/*
+ * Private: set key to val, copying both into the arena unless copy is 0.
+ * Returns the entry, or -1 if it could not be added.
+ */
+static int dictionary_put(dictionary *d, char *key, unsigned hash, char *val, int copy)
+{
+    unsigned mask;
+    unsigned pos;
+    int      free_pos;
+    int      e;
+    int      len;
 
     /* Find if value is already in dictionary */
-    if (d->n > 0) {
-        for (i = 0; i < d->size; i++) {
-            if (d->key[i] == NULL)
-                continue;
-            if (hash == d->hash[i]) { /* Same hash value */
-                if (!strcmp(key, d->key[i])) { /* Same key */
-                    /* Found a value: modify and return */
-                    if (d->val[i] != NULL)
-                        free(d->val[i]);
-                    d->val[i] = val ? _strdup(val) : NULL;
-                    /* Value has been modified: return */
-                    return;
-                }
-            }
+    e = dictionary_lookup(d, key, hash);
+    if (e >= 0) {
+        /* Found a value: overwrite in place if it fits */
+        e = d->slot[e];
+        d->origin[e] = d->layer;
+        if (!copy) {
+            d->val[e] = val;
+            d->vcap[e] = 0;
+        } else if (val == NULL) {
+            d->val[e] = NULL;
+            d->vcap[e] = 0;
+        } else if (d->val[e] != NULL && (len = (int)strlen(val) + 1) <= d->vcap[e]) {
+            memmove(d->val[e], val, len);
+            g_stats.inplace++;
+        } else {
+            d->val[e] = dictionary_strdup(d, val, &d->vcap[e]);
         }
+        return e;
     }
 
     /* Add a new value */
     /* See if dictionary needs to grow */
     if (d->n == d->size) {
+        /* Reached maximum size: double the dictionary */
+        if (!dictionary_grow(d, d->size * 2))
+            return -1;
+    }
 
-        /* Reached maximum size: reallocate dictionary */
-        d->val  = (char **)mem_double(d->val,  d->size * sizeof(char *));
-        d->key  = (char **)mem_double(d->key,  d->size * sizeof(char *));
-        d->hash = (unsigned int *)mem_double(d->hash, d->size * sizeof(unsigned));
+    /* Keep the index below 3/4 occupancy, counting deleted slots */
+    if ((d->used + 1) * 4 >= d->nslot * 3) {
+        if (!dictionary_reindex(d, (d->n + 1) * 2 >= d->nslot ? d->nslot * 2 : d->nslot))
+            return -1;
+    }
 
-        /* Double size */
-        d->size *= 2;
+    /* Reuse the first deleted slot on the probe path, else the empty one */
+    mask     = (unsigned)d->nslot - 1;
+    pos      = hash & mask;
+    free_pos = -1;
+    while (d->slot[pos] != SLOT_EMPTY) {
+        if (free_pos < 0 && d->slot[pos] == SLOT_DELETED)
+            free_pos = (int)pos;
+        pos = (pos + 1) & mask;
+    }
+    if (free_pos < 0) {
+        free_pos = (int)pos;
+        d->used++;
     }
 
-    /* Insert key in the first empty slot */
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] == NULL) {
-            /* Add key here */
-            break;
-        }
+    /* Append entry */
+    e = d->n++;
+    d->slot[free_pos] = e;
+    if (copy) {
+        d->key[e] = dictionary_strdup(d, key, NULL);
+        d->val[e] = val ? dictionary_strdup(d, val, &d->vcap[e]) : NULL;
+    } else {
+        d->key[e]  = key;
+        d->val[e]  = val;
+        d->vcap[e] = 0;
     }
+    d->hash[e]   = hash;
+    d->origin[e] = d->layer;
+    dictionary_link(d, e);
+    dictionary_linknum(d, e);
+    return e;
+}
 
-    /* Copy key */
-    d->key[i]  = _strdup(key);
-    d->val[i]  = val ? _strdup(val) : NULL;
-    d->hash[i] = hash;
-    d->n++;
+void dictionary_set(dictionary *d, char *key, char *val)
+{
+    if (d == NULL || key == NULL)
+        return;
+    dictionary_put(d, key, dictionary_hash(key), val, 1);
+}
+
+/*
+ * Adds key and val without copying them; they must outlive the dictionary
+ * (eg. strings in a mapped cache file) and hash must be dictionary_hash(key).
+ * A later dictionary_set of the key copies the new value as usual.
+ */
+void dictionary_setref(dictionary *d, char *key, unsigned hash, char *val)
+{
+    if (d == NULL || key == NULL)
+        return;
+    dictionary_put(d, key, hash, val, 0);
 }
 
 void dictionary_unset(dictionary *d, char *key)
 {
-    unsigned hash;
-    int      i;
+    int pos;
+    int e;
+    int last;
+    int sec;
 
     if (d == NULL || key == NULL)
         return;
 
-    hash = dictionary_hash(key);
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] == NULL)
-            continue;
-        /* Compare hash */
-        if (hash == d->hash[i]) {
-            /* Compare string, to avoid hash collisions */
-            if (!strcmp(key, d->key[i])) {
-                /* Found key */
-                break;
-            }
-        }
-    }
-    if (i >= d->size)
+    pos = dictionary_lookup(d, key, dictionary_hash(key));
+    if (pos < 0)
         /* Key not found */
         return;
 
-    free(d->key[i]);
-    d->key[i] = NULL;
-    if (d->val[i] != NULL) {
-        free(d->val[i]);
-        d->val[i] = NULL;
+    e = d->slot[pos];
+    d->slot[pos] = SLOT_DELETED;
+    sec = d->link[e].sec;
+    dictionary_unlink(d, e);
+    dictionary_unlinknum(d, e);
+
+    /* Move the last entry into the hole to keep entries packed; the
+       strings themselves stay in the arena until dictionary_del */
+    last = d->n - 1;
+    if (e != last) {
+        pos = dictionary_lookup(d, d->key[last], d->hash[last]);
+        d->slot[pos] = e;
+        d->key[e]  = d->key[last];
+        d->val[e]  = d->val[last];
+        d->hash[e] = d->hash[last];
+        d->vcap[e] = d->vcap[last];
+        d->origin[e] = d->origin[last];
+        dictionary_relink(d, last, e);
     }
-    d->hash[i] = 0;
+    d->key[last]  = NULL;
+    d->val[last]  = NULL;
+    d->hash[last] = 0;
+    d->vcap[last] = 0;
+    d->origin[last] = DICT_ORIGIN_NONE;
     d->n--;
+
+    /* Forget named sections once their last entry has gone */
+    if (sec > 0 && d->sec[sec].count == 0 && d->sec[sec].header < 0)
+        dictionary_dropsec(d, sec);
+}
+
+/*
+ * Merges every entry of src into dst in one pass. The stored hashes of src
+ * are reused and dst is grown once up front. With DICT_MERGE_KEEP keys that
+ * dst already has are left alone. Merged entries keep their origin in src.
+ * Returns the number of entries taken from src.
+ */
+int dictionary_merge(dictionary *dst, dictionary *src, int policy)
+{
+    int size;
+    int nslot;
+    int count;
+    int e;
+    int i;
+
+    if (dst == NULL || src == NULL)
+        return 0;
+
+    /* Room for every key of src, as if none were in dst yet */
+    for (size = dst->size; size < dst->n + src->n; size *= 2)
+        ;
+    if (size != dst->size && !dictionary_grow(dst, size))
+        return 0;
+    for (nslot = dst->nslot; (dst->n + src->n) * 4 >= nslot * 3; nslot *= 2)
+        ;
+    if (nslot != dst->nslot && !dictionary_reindex(dst, nslot))
+        return 0;
+
+    count = 0;
+    for (i = 0; i < src->n; i++) {
+        if (policy == DICT_MERGE_KEEP && dictionary_lookup(dst, src->key[i], src->hash[i]) >= 0)
+            continue;
+        e = dictionary_put(dst, src->key[i], src->hash[i], src->val[i], 1);
+        if (e < 0)
+            break;
+        dst->origin[e] = src->origin[i];
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Marks every entry, and those set from now on, as coming from origin. Used
+ * on a dictionary just loaded from a single source.
+ */
+void dictionary_setorigin(dictionary *d, int origin)
+{
+    int i;
+
+    if (d == NULL)
+        return;
+    for (i = 0; i < d->n; i++)
+        d->origin[i] = origin;
+    d->layer = origin;
+}
+
+int dictionary_getorigin(dictionary *d, char *key)
+{
+    int pos;
+
+    if (d == NULL || key == NULL)
+        return DICT_ORIGIN_NONE;
+    pos = dictionary_lookup(d, key, dictionary_hash(key));
+    return pos < 0 ? DICT_ORIGIN_NONE : d->origin[d->slot[pos]];
 }
 
 void dictionary_setint(dictionary *d, char *key, int val)
@@ -281,65 +901,72 @@ void dictionary_dump(dictionary *d, FILE *out)
     }
 }
 
-/* Private: add an entry to the dictionary */
-static void iniparser_add_entry(
-    dictionary *d,
-    char       *sec,
-    char       *key,
-    char       *val)
+void dictionary_getstats(dictionary_stats *stats)
 {
-    char longkey[2 * ASCIILINESZ + 1];
-
-    /* Make a key as section:keyword */
-    if (key != NULL) {
-        sprintf_s(longkey, sizeof(longkey), "%s:%s", sec, key);
-    } else {
-        strcpy_s(longkey, sizeof(longkey), sec);
-    }
-
-    /* Add (key,val) to dictionary */
-    dictionary_set(d, longkey, val);
+    if (stats)
+        *stats = g_stats;
 }
 
+/* Named sections, the global section is not counted */
 int iniparser_getnsec(dictionary *d)
 {
-    int i;
-    int nsec;
-
     if (d == NULL)
         return -1;
-    nsec = 0;
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] == NULL)
-            continue;
-        if (strchr(d->key[i], ':') == NULL) {
-            nsec++;
-        }
-    }
-    return nsec;
+    return d->nsec - 1;
 }
 
 char *iniparser_getsecname(dictionary *d, int n)
 {
-    int i;
-    int foundsec;
-
-    if (d == NULL || n < 0)
-        return NULL;
-    foundsec = 0;
-    for (i = 0; i < d->size; i++) {
-        if (d->key[i] == NULL)
-            continue;
-        if (strchr(d->key[i], ':') == NULL) {
-            foundsec++;
-            if (foundsec > n)
-                break;
-        }
-    }
-    if (foundsec <= n) {
+    if (d == NULL || n < 0 || n >= d->nsec - 1)
         return NULL;
+    return d->sec[n + 1].name;
+}
+
+/* Private: load the current entry of an iterator */
+static int iniparser_secentry(dictionary *d, dictionary_iter *it)
+{
+    if (it->entry < 0) {
+        it->key = NULL;
+        it->val = NULL;
+        return 0;
     }
-    return d->key[i];
+    it->key = d->key[it->entry] + d->sec[it->sec].len + 1;
+    it->val = d->val[it->entry];
+    return 1;
+}
+
+/*
+ * Walk the keys of a section (NULL or "" for the global one) in the order
+ * they were added:
+ *
+ *     for (ok = iniparser_secfirst(d, "Sec", &it); ok; ok = iniparser_secnext(d, &it))
+ *
+ * The dictionary must not be modified during the walk.
+ */
+int iniparser_secfirst(dictionary *d, const char *sec, dictionary_iter *it)
+{
+    int len;
+
+    if (it == NULL)
+        return 0;
+    it->sec   = 0;
+    it->entry = -1;
+    if (d == NULL)
+        return iniparser_secentry(d, it);
+
+    len = sec ? (int)strlen(sec) : 0;
+    it->sec = dictionary_findsec(d, sec, len, hash_end(hash_add(0, sec, len)));
+    if (it->sec >= 0)
+        it->entry = d->sec[it->sec].head;
+    return iniparser_secentry(d, it);
+}
+
+int iniparser_secnext(dictionary *d, dictionary_iter *it)
+{
+    if (d == NULL || it == NULL || it->entry < 0)
+        return 0;
+    it->entry = d->link[it->entry].next;
+    return iniparser_secentry(d, it);
 }
 
 void iniparser_dump(dictionary *d, FILE *f)
@@ -361,17 +988,13 @@ void iniparser_dump(dictionary *d, FILE *f)
 
 void iniparser_dump_ini(dictionary *d, FILE *f)
 {
-    int   i, j;
-    char  keym[ASCIILINESZ + 1];
-    int   nsec;
-    char *secname;
-    int   seclen;
+    int           i, j;
+    dict_section *s;
 
     if (d == NULL || f == NULL)
         return;
 
-    nsec = iniparser_getnsec(d);
-    if (nsec < 1) {
+    if (d->nsec < 2) {
         /* No section in file: dump all keys as they are */
         for (i = 0; i < d->size; i++) {
             if (d->key[i] == NULL)
@@ -380,20 +1003,14 @@ void iniparser_dump_ini(dictionary *d, FILE *f)
         }
         return;
     }
-    for (i = 0; i < nsec; i++) {
-        secname = iniparser_getsecname(d, i);
-        seclen  = (int)strlen(secname);
-        fprintf(f, "\n[%s]\n", secname);
-        sprintf_s(keym, sizeof(keym), "%s:", secname);
-        for (j = 0; j < d->size; j++) {
-            if (d->key[j] == NULL)
-                continue;
-            if (!strncmp(d->key[j], keym, seclen + 1)) {
-                fprintf(f,
-                        "%-30s = %s\n",
-                        d->key[j] + seclen + 1,
-                        d->val[j] ? d->val[j] : "");
-            }
+    for (i = 1; i < d->nsec; i++) {
+        s = &d->sec[i];
+        fprintf(f, "\n[%s]\n", s->name);
+        for (j = s->head; j >= 0; j = d->link[j].next) {
+            fprintf(f,
+                    "%-30s = %s\n",
+                    d->key[j] + s->len + 1,
+                    d->val[j] ? d->val[j] : "");
         }
     }
     fprintf(f, "\n");
@@ -406,31 +1023,36 @@ char *iniparser_getstr(dictionary *d, const char *key)
 
 char *iniparser_getstring(dictionary *d, const char *key, char *def)
 {
-    char *lc_key;
-    char *sval;
-
     if (d == NULL || key == NULL)
         return def;
 
-    lc_key = _strdup(key);
-    if (!lc_key)
-        return def;
-
-    sval = dictionary_get(d, lc_key, def);
-    free(lc_key);
-    return sval;
+    return dictionary_get(d, (char *)key, def);
 }
 
-int iniparser_getint(dictionary *d, const char *key, int notfound)
+/* Private: value conversions shared by the plain and section getters */
+static int ini_toint(char *str, int notfound)
 {
-    char *str;
-
-    str = iniparser_getstring(d, key, INI_INVALID_KEY);
     if (str == INI_INVALID_KEY)
         return notfound;
     return (int)strtol(str, NULL, 0);
 }
 
+static int ini_toboolean(char *c, int notfound)
+{
+    if (c == INI_INVALID_KEY)
+        return notfound;
+    if (c[0] == 'y' || c[0] == 'Y' || c[0] == '1' || c[0] == 't' || c[0] == 'T')
+        return 1;
+    if (c[0] == 'n' || c[0] == 'N' || c[0] == '0' || c[0] == 'f' || c[0] == 'F')
+        return 0;
+    return notfound;
+}
+
+int iniparser_getint(dictionary *d, const char *key, int notfound)
+{
+    return ini_toint(iniparser_getstring(d, key, INI_INVALID_KEY), notfound);
+}
+
 double iniparser_getdouble(dictionary *d, char *key, double notfound)
 {
     char *str;
@@ -443,20 +1065,40 @@ double iniparser_getdouble(dictionary *d, char *key, double notfound)
 
 int iniparser_getboolean(dictionary *d, const char *key, int notfound)
 {
-    char *c;
-    int   ret;
+    return ini_toboolean(iniparser_getstring(d, key, INI_INVALID_KEY), notfound);
+}
 
-    c = iniparser_getstring(d, key, INI_INVALID_KEY);
-    if (c == INI_INVALID_KEY)
-        return notfound;
-    if (c[0] == 'y' || c[0] == 'Y' || c[0] == '1' || c[0] == 't' || c[0] == 'T') {
-        ret = 1;
-    } else if (c[0] == 'n' || c[0] == 'N' || c[0] == '0' || c[0] == 'f' || c[0] == 'F') {
-        ret = 0;
-    } else {
-        ret = notfound;
-    }
-    return ret;
+/* Look up "sec:key" without building the key; a NULL section is global */
+char *iniparser_getsecstring(dictionary *d, const char *sec, const char *key, char *def)
+{
+    int      seclen;
+    unsigned hash;
+    int      pos;
+
+    if (d == NULL || key == NULL)
+        return def;
+    if (sec == NULL)
+        sec = "";
+
+    seclen = (int)strlen(sec);
+    hash   = hash_add(0, sec, seclen);
+    hash   = hash_add(hash, ":", 1);
+    hash   = hash_end(hash_add(hash, key, (int)strlen(key)));
+
+    pos = dictionary_lookup_sec(d, sec, seclen, key, hash);
+    if (pos < 0)
+        return def;
+    return d->val[d->slot[pos]];
+}
+
+int iniparser_getsecint(dictionary *d, const char *sec, const char *key, int notfound)
+{
+    return ini_toint(iniparser_getsecstring(d, sec, key, INI_INVALID_KEY), notfound);
+}
+
+int iniparser_getsecboolean(dictionary *d, const char *sec, const char *key, int notfound)
+{
+    return ini_toboolean(iniparser_getsecstring(d, sec, key, INI_INVALID_KEY), notfound);
 }
 
 int iniparser_find_entry(dictionary *ini, char *entry)
@@ -479,133 +1121,251 @@ void iniparser_unset(dictionary *ini, char *entry)
     dictionary_unset(ini, entry);
 }
 
-void parse_line(char *sec, char *lin, dictionary *d)
-{
-    char  key[ASCIILINESZ + 1];
-    char  val[ASCIILINESZ + 1];
-    char *wher;
-
-    wher = strskp(lin); /* Skip leading spaces */
-    if (*wher == ';' || *wher == '#' || *wher == 0)
-        return; /* Comment lines */
-    else {
-    	if (sscanf_s(wher, "[%[^]]", sec, ASCIILINESZ + 1 /*sizeof sec buffer*/) == 1) {
-    	    iniparser_add_entry(d, sec, NULL, NULL);
-    	}
-    	else if (sscanf_s(wher,
-    	                  "%[^=] = \"%[^\"]\"",
-    	                  key, (unsigned)sizeof(key),
-    	                  val, (unsigned)sizeof(val)) == 2
-    	      || sscanf_s(wher,
-    	                  "%[^=] = '%[^\']'",
-    	                  key, (unsigned)sizeof(key),
-    	                  val, (unsigned)sizeof(val)) == 2
-    	      || sscanf_s(wher,
-    	                  "%[^=] = %[^;#]",
-    	                  key, (unsigned)sizeof(key),
-    	                  val, (unsigned)sizeof(val)) == 2)
-    	{
-    	    strcpy_s(key, sizeof(key), strcrop(key));
-
-    	    if (!strcmp(val, "\"\"") || !strcmp(val, "''")) {
-    	        val[0] = 0;
-    	    } else {
-    	        strcpy_s(val, sizeof(val), strcrop(val));
-    	    }
-
-    	    iniparser_add_entry(d, sec, key, val);
-
-    	    if (sec && !strcmp(sec, "WinRun4J"))
-    	        iniparser_add_entry(d, "", key, val);
-    	}
+/* Private: string view into the text being parsed */
+typedef struct {
+    const char *p;
+    int         len;
+} ini_view;
+
+/* Private: growable buffer used to build NUL-terminated keys and values */
+typedef struct {
+    char *buf;
+    int   size;
+} ini_scratch;
+
+static int ini_isspace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+/* Private: drop trailing whitespace from a view */
+static void ini_rtrim(ini_view *v)
+{
+    while (v->len > 0 && ini_isspace(v->p[v->len - 1]))
+        v->len--;
+}
+
+/* Private: materialize "sec:key" and the value, then add them */
+static void iniparser_commit(dictionary *d, ini_scratch *s, const ini_view *sec,
+                             const ini_view *key, const ini_view *val)
+{
+    int   need = sec->len + 1 + (key ? key->len + 1 + val->len + 1 : 0);
+    char *p;
+
+    if (need > s->size) {
+        p = (char *)realloc(s->buf, need * 2);
+        if (!p)
+            return;
+        s->buf  = p;
+        s->size = need * 2;
     }
+
+    p = s->buf;
+    memcpy(p, sec->p, sec->len);
+    p += sec->len;
+    if (key == NULL) {
+        /* Section entry */
+        *p = 0;
+        dictionary_set(d, s->buf, NULL);
+        return;
+    }
+    *p++ = ':';
+    memcpy(p, key->p, key->len);
+    p += key->len;
+    *p++ = 0;
+    memcpy(p, val->p, val->len);
+    p[val->len] = 0;
+    dictionary_set(d, s->buf, p);
 }
 
-dictionary *iniparser_load(char *ininame, bool isbuffer)
+/*
+ * Single pass over the whole INI text. Lines are tokenized in place (the
+ * text may be a read-only mapping or resource) and only the final key and
+ * value are copied, so there is no limit on line length.
+ */
+static void iniparser_parse(dictionary *d, const char *text, size_t size)
 {
-    dictionary *d;
-    char        sec[ASCIILINESZ + 1];
-    char        lin[ASCIILINESZ + 1];
-    FILE       *ini = NULL;
-    int         lineno;
-    int         pos = 0;
-
-    memset(lin, 0, sizeof(lin));
-    memset(sec, 0, sizeof(sec));
-
-    if (!isbuffer) {
-        if (fopen_s(&ini, ininame, "r") != 0) {
-            ini = NULL;
-            return NULL;
+    static const ini_view global   = { "", 0 };
+    static const ini_view winrun4j = { "WinRun4J", 8 };
+    const char  *end = text + size;
+    const char  *lin;
+    const char  *eol;
+    const char  *c;
+    ini_view     sec = global;
+    ini_view     key;
+    ini_view     val;
+    ini_scratch  scratch = { NULL, 0 };
+
+    for (lin = text; lin < end; lin = eol + 1) {
+        eol = (const char *)memchr(lin, '\n', end - lin);
+        if (eol == NULL)
+            eol = end;
+
+        /* Skip leading spaces and comment lines */
+        c = lin;
+        while (c < eol && ini_isspace(*c))
+            c++;
+        if (c == eol || *c == ';' || *c == '#')
+            continue;
+
+        /* [section] - the name runs to the closing bracket or end of line */
+        if (*c == '[' && c + 1 < eol && c[1] != ']') {
+            sec.p = ++c;
+            while (c < eol && *c != ']')
+                c++;
+            sec.len = (int)(c - sec.p);
+            if (c == eol)
+                ini_rtrim(&sec);
+            iniparser_commit(d, &scratch, &sec, NULL, NULL);
+            continue;
         }
+
+        /* key = value */
+        key.p = c;
+        while (c < eol && *c != '=')
+            c++;
+        if (c == eol || c == key.p)
+            continue;
+        key.len = (int)(c - key.p);
+        ini_rtrim(&key);
+
+        c++;
+        while (c < eol && ini_isspace(*c))
+            c++;
+
+        if (c < eol && (*c == '"' || *c == '\'')) {
+            /* Quoted value, closing quote optional */
+            char q = *c++;
+            val.p = c;
+            while (c < eol && *c != q)
+                c++;
+        } else {
+            /* Plain value up to an inline comment */
+            val.p = c;
+            while (c < eol && *c != ';' && *c != '#')
+                c++;
+            if (c == val.p)
+                continue;
+        }
+        val.len = (int)(c - val.p);
+        ini_rtrim(&val);
+
+        iniparser_commit(d, &scratch, &sec, &key, &val);
+
+        /* Keys in the WinRun4J section are also visible without a section */
+        if (sec.len == winrun4j.len && !memcmp(sec.p, winrun4j.p, winrun4j.len))
+            iniparser_commit(d, &scratch, &global, &key, &val);
     }
 
-    if (isbuffer && !ininame) {
+    free(scratch.buf);
+}
+
+dictionary *iniparser_loadbuffer(const char *buffer, size_t size)
+{
+    dictionary *d;
+
+    if (buffer == NULL)
         return NULL;
-    }
 
-    /*
-     * Initialize a new dictionary entry
-     */
     d = dictionary_new(0);
-    if (!d) {
-        if (ini)
-            fclose(ini);
+    if (d)
+        iniparser_parse(d, buffer, size);
+    return d;
+}
+
+dictionary *iniparser_load(char *ininame, bool isbuffer)
+{
+    dictionary *d;
+    HANDLE      hFile;
+    HANDLE      hMap;
+    DWORD       size;
+    const char *view;
+
+    if (ininame == NULL)
         return NULL;
-    }
 
-    lineno = 0;
-    while ((isbuffer ? sgets(ininame, &pos, lin, ASCIILINESZ) : fgets(lin, ASCIILINESZ, ini)) != NULL) {
-        lineno++;
-        parse_line(sec, lin, d);
-        memset(lin, 0, sizeof(lin));
-    }
+    if (isbuffer)
+        return iniparser_loadbuffer(ininame, strlen(ininame));
+
+    hFile = CreateFileA(ininame, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
 
-    if (strlen(lin) != 0)
-        parse_line(sec, lin, d);
+    /* Zero length files cannot be mapped */
+    size = GetFileSize(hFile, NULL);
+    if (size == 0 || size == INVALID_FILE_SIZE) {
+        CloseHandle(hFile);
+        return size == 0 ? dictionary_new(0) : NULL;
+    }
 
-    if (ini)
-        fclose(ini);
+    d    = NULL;
+    hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMap != NULL) {
+        view = (const char *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        if (view != NULL) {
+            d = iniparser_loadbuffer(view, size);
+            UnmapViewOfFile(view);
+        }
+        CloseHandle(hMap);
+    }
+    CloseHandle(hFile);
 
     return d;
 }
 
 int dictionary_find_max(dictionary* d, const char* keyName)
 {
+    dict_numbered *b;
+    int            len;
+    int            i;
+
     if (!d || !keyName)
         return 0;
 
-    int maxIndex = 0;
-    size_t baseLen = strlen(keyName);
-
-    // Iterate over all keys in the dictionary
-    for (int i = 0; i < d->n; i++) {
-        const char* key = d->key[i];
-        if (!key)
-            continue;
+    len = (int)strlen(keyName);
+    i   = dictionary_findnum(d, keyName, len, hash_end(hash_add(0, keyName, len)));
+    if (i < 0)
+        return 0;
+    b = &d->num[i];
+    return b->count > 0 ? b->number[b->count - 1] : 0;
+}
 
-        // Must start with keyName + "."
-        if (strncmp(key, keyName, baseLen) != 0)
-            continue;
-        if (key[baseLen] != '.')
-            continue;
+/*
+ * Values of base.N for N >= first in numeric order, skipping gaps and
+ * undefined values. Fills at most size values and returns how many were
+ * written, or with a NULL vals returns how many there are.
+ */
+int iniparser_getnumbered(dictionary *d, const char *base, int first, char **vals, int size)
+{
+    dict_numbered *b;
+    char          *v;
+    int            len;
+    int            count;
+    int            i;
 
-        // Extract number after the dot
-        const char* numStr = key + baseLen + 1;
-        if (*numStr == '\0')
-            continue;
+    if (d == NULL || base == NULL)
+        return 0;
 
-        char* end = NULL;
-        long idx = strtol(numStr, &end, 10);
+    len = (int)strlen(base);
+    i   = dictionary_findnum(d, base, len, hash_end(hash_add(0, base, len)));
+    if (i < 0)
+        return 0;
+    b = &d->num[i];
 
-        // Must be a pure integer
-        if (end == numStr || *end != '\0')
+    count = 0;
+    for (i = dictionary_numpos(b, first); i < b->count; i++) {
+        v = d->val[b->entry[i]];
+        if (v == NULL)
             continue;
-
-        if (idx > maxIndex)
-            maxIndex = (int)idx;
+        if (vals != NULL) {
+            if (count == size)
+                break;
+            vals[count] = v;
+        }
+        count++;
     }
-    return maxIndex;
+    return count;
 }
 
 void iniparser_freedict(dictionary *d)
@@ -14,14 +14,87 @@ iniparser is distributed under an MIT license.
 #include <stdio.h>
 #include <ctype.h>
 
+/*
+ * Entries are kept packed in [0, n) in key/val/hash; the Java INI class reads
+ * n and key by offset so new members must only be appended. Lookups go
+ * through the slot index rather than scanning the entries.
+ *
+ * Key and value strings live in a per-dictionary arena that is released as a
+ * whole by dictionary_del. Each key is copied in once; a value is overwritten
+ * in place when the new value fits in vcap, otherwise a new copy is taken
+ * from the arena.
+ *
+ * Each entry also belongs to the section named by its key prefix ("sec:key",
+ * or "sec" for the section entry itself). Sections are kept in a table in
+ * order of first appearance, index 0 being the global ("") section, and the
+ * keys of a section are chained in insertion order so they can be walked
+ * without scanning the other entries.
+ *
+ * Keys ending in ".N" (classpath.1, vmarg.2, ...) are also indexed by their
+ * base key with the numbers kept sorted, so a numbered list is read without
+ * probing for each number.
+ *
+ * Every entry records the layer it came from (embedded INI, INI file, ...).
+ * Entries take the dictionary's current layer when they are set, and keep
+ * the layer of the source dictionary when they are merged in.
+ */
+struct _dict_block_ ;
+struct _dict_section_ ;
+struct _dict_link_ ;
+struct _dict_numbered_ ;
+
+/* Layers an INI is assembled from, in the order they are applied */
+#define DICT_ORIGIN_NONE		0
+#define DICT_ORIGIN_EMBEDDED	1
+#define DICT_ORIGIN_FILE		2
+#define DICT_ORIGIN_EXTERNAL	3
+#define DICT_ORIGIN_REGISTRY	4
+#define DICT_ORIGIN_MODULE		5
+#define DICT_ORIGIN_CMDLINE		6
+#define DICT_ORIGIN_COUNT		7
+
+/* dictionary_merge policies */
+#define DICT_MERGE_OVERRIDE		0	/* Values from src replace existing ones */
+#define DICT_MERGE_KEEP			1	/* Existing values are kept */
+
 typedef struct _dictionary_ {
 	int				n ;		/** Number of entries in dictionary */
 	int				size ;	/** Storage size */
 	char 		**	val ;	/** List of string values */
 	char 		**  key ;	/** List of string keys */
 	unsigned	 *	hash ;	/** List of hash values for keys */
+	int			 *	slot ;	/** Open addressed hash index into key/val/hash */
+	int				nslot ;	/** Size of hash index (power of two) */
+	int				used ;	/** Number of live and deleted slots in index */
+	int			 *	vcap ;	/** Bytes available in place for each value */
+	struct _dict_block_ * arena ;	/** String storage, current block first */
+	struct _dict_section_ * sec ;	/** Section table, global section first */
+	int				nsec ;	/** Number of sections in table */
+	int				secsize ;	/** Storage size of section table */
+	struct _dict_link_ * link ;	/** Section membership of each entry */
+	struct _dict_numbered_ * num ;	/** Numbered key index, one per base key */
+	int				nnum ;	/** Number of base keys in index */
+	int				numsize ;	/** Storage size of numbered key index */
+	int			 *	origin ;	/** Layer each entry came from, DICT_ORIGIN_* */
+	int				layer ;	/** Origin given to entries as they are set */
 } dictionary ;
 
+/* Position within a section, see iniparser_secfirst */
+typedef struct _dictionary_iter_ {
+	int				sec ;	/** Section being walked */
+	int				entry ;	/** Current entry in key/val, -1 at the end */
+	const char	 *	key ;	/** Current key without the section prefix */
+	const char	 *	val ;	/** Current value, may be NULL */
+} dictionary_iter ;
+
+/* Allocation counters, summed over all dictionaries in the process */
+typedef struct _dictionary_stats_ {
+	int				allocs ;	/** Heap allocations made for dictionaries */
+	int				blocks ;	/** Arena blocks among those allocations */
+	size_t			bytes ;		/** Arena bytes handed out to strings */
+	int				inplace ;	/** Values replaced without new storage */
+} dictionary_stats ;
+
 // Dictionary 
 
 unsigned dictionary_hash(char * key);
@@ -32,15 +105,22 @@ char dictionary_getchar(dictionary * d, char * key, char def) ;
 int dictionary_getint(dictionary * d, char * key, int def);
 double dictionary_getdouble(dictionary * d, char * key, double def);
 void dictionary_set(dictionary * vd, char * key, char * val);
+void dictionary_setref(dictionary * d, char * key, unsigned hash, char * val);
 void dictionary_unset(dictionary * d, char * key);
+int dictionary_merge(dictionary * dst, dictionary * src, int policy);
+void dictionary_setorigin(dictionary * d, int origin);
+int dictionary_getorigin(dictionary * d, char * key);
 void dictionary_setint(dictionary * d, char * key, int val);
 void dictionary_setdouble(dictionary * d, char * key, double val);
 void dictionary_dump(dictionary * d, FILE * out);
+void dictionary_getstats(dictionary_stats * stats);
 
 // Ini parser
 
 int iniparser_getnsec(dictionary * d);
 char * iniparser_getsecname(dictionary * d, int n);
+int iniparser_secfirst(dictionary * d, const char * sec, dictionary_iter * it);
+int iniparser_secnext(dictionary * d, dictionary_iter * it);
 void iniparser_dump_ini(dictionary * d, FILE * f);
 void iniparser_dump(dictionary * d, FILE * f);
 char * iniparser_getstr(dictionary * d, const char * key);
@@ -48,11 +128,16 @@ char * iniparser_getstring(dictionary * d, const char * key, char * def);
 int iniparser_getint(dictionary * d, const char * key, int notfound);
 double iniparser_getdouble(dictionary * d, char * key, double notfound);
 int iniparser_getboolean(dictionary * d, const char * key, int notfound);
+char * iniparser_getsecstring(dictionary * d, const char * sec, const char * key, char * def);
+int iniparser_getsecint(dictionary * d, const char * sec, const char * key, int notfound);
+int iniparser_getsecboolean(dictionary * d, const char * sec, const char * key, int notfound);
 int iniparser_setstr(dictionary * ini, char * entry, char * val);
 void iniparser_unset(dictionary * ini, char * entry);
 int iniparser_find_entry(dictionary * ini, char * entry) ;
 dictionary * iniparser_load(char * ininame, bool isbuffer = false);
+dictionary * iniparser_loadbuffer(const char * buffer, size_t size);
 int dictionary_find_max(dictionary* d, const char* keyName);
+int iniparser_getnumbered(dictionary * d, const char * base, int first, char ** vals, int size);
 void iniparser_freedict(dictionary * d);
 
 // Strlib 
@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Expand.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REG_PREFIX     "$REG{"
+#define REG_PREFIX_LEN 5
+#define ENV_KIND       '%'
+#define REG_KIND       '$'
+#define MIN_BUFFER     256
+
+struct ExpandCacheEntry {
+    unsigned hash;
+    char     kind;
+    char*    name;
+    char*    value; // NULL when the name is not defined
+};
+
+static char* DupString(const char* s, size_t len)
+{
+    char* d = (char*)malloc(len + 1);
+    if (d) {
+        memcpy(d, s, len);
+        d[len] = 0;
+    }
+    return d;
+}
+
+Expander::Expander(const ExpandProvider& provider)
+    : provider(provider), cache(NULL), cacheCount(0), cacheSize(0),
+      out(NULL), outLen(0), outSize(0), value(NULL), valueSize(0),
+      replaced(false), failed(false), lookups(0), hits(0)
+{
+}
+
+Expander::~Expander()
+{
+    for (int i = 0; i < cacheCount; i++) {
+        free(cache[i].name);
+        free(cache[i].value);
+    }
+    free(cache);
+    free(out);
+    free(value);
+}
+
+bool Expander::HasVariables(const char* value)
+{
+    return value && (strchr(value, '%') || strstr(value, REG_PREFIX));
+}
+
+const char* Expander::Expand(const char* value)
+{
+    if (!HasVariables(value))
+        return NULL;
+
+    outLen   = 0;
+    replaced = false;
+    failed   = false;
+    Parse(value, 0);
+
+    return replaced && !failed ? out : NULL;
+}
+
+void Expander::Append(const char* s, int len)
+{
+    if (outLen + len + 1 > outSize) {
+        int size = outSize ? outSize : MIN_BUFFER;
+        while (outLen + len + 1 > size)
+            size *= 2;
+        char* p = (char*)realloc(out, size);
+        if (!p) {
+            failed = true;
+            return;
+        }
+        out     = p;
+        outSize = size;
+    }
+    memcpy(out + outLen, s, len);
+    outLen += len;
+    out[outLen] = 0;
+}
+
+// Appends the expansion of p up to term (or the end of the string) and
+// returns a pointer to the terminating character
+const char* Expander::Parse(const char* p, char term)
+{
+    const char* lit = p;
+
+    while (*p && *p != term) {
+        if (*p == '%') {
+            const char* e = p + 1;
+            while (*e && *e != '%' && *e != term)
+                e++;
+
+            // "%%" and an unterminated '%' are left as they are
+            if (*e != '%' || e == p + 1) {
+                p += *e == '%' ? 2 : 1;
+                continue;
+            }
+
+            Append(lit, (int)(p - lit));
+            int start = outLen;
+            Append(p + 1, (int)(e - p - 1));
+            const char* v = failed ? NULL : Lookup(ENV_KIND, out + start);
+            outLen = start;
+            if (v) {
+                Append(v, (int)strlen(v));
+                replaced = true;
+            } else {
+                Append(p, (int)(e + 1 - p));
+            }
+            p = lit = e + 1;
+        } else if (provider.reg && !strncmp(p, REG_PREFIX, REG_PREFIX_LEN)) {
+            Append(lit, (int)(p - lit));
+
+            // The key may itself contain references, expand them first
+            int start = outLen;
+            const char* e = Parse(p + REG_PREFIX_LEN, '}');
+            if (*e != '}') {
+                outLen = start;
+                Append(p, (int)(e - p));
+                p = lit = e;
+                continue;
+            }
+
+            const char* v = failed ? NULL : Lookup(REG_KIND, out + start);
+            outLen = start;
+            if (v) {
+                Append(v, (int)strlen(v));
+                replaced = true;
+            } else {
+                Append(p, (int)(e + 1 - p));
+            }
+            p = lit = e + 1;
+        } else {
+            p++;
+        }
+    }
+
+    Append(lit, (int)(p - lit));
+    return p;
+}
+
+const char* Expander::Lookup(char kind, const char* name)
+{
+    unsigned hash = (unsigned char)kind;
+    for (const char* c = name; *c; c++)
+        hash = hash * 31 + (unsigned char)*c;
+
+    for (int i = 0; i < cacheCount; i++) {
+        ExpandCacheEntry* c = &cache[i];
+        if (c->hash == hash && c->kind == kind && !strcmp(c->name, name)) {
+            hits++;
+            return c->value;
+        }
+    }
+
+    lookups++;
+    ExpandLookup fn = kind == ENV_KIND ? provider.env : provider.reg;
+    int len = -1;
+    while (fn) {
+        if (valueSize == 0 || len >= valueSize) {
+            int size = len >= valueSize ? len + 1 : MIN_BUFFER;
+            char* p = (char*)realloc(value, size);
+            if (!p)
+                return NULL;
+            value     = p;
+            valueSize = size;
+        }
+        len = fn(provider.ctx, name, value, valueSize);
+        if (len < valueSize)
+            break;
+    }
+
+    if (cacheCount == cacheSize) {
+        int size = cacheSize ? cacheSize * 2 : 16;
+        ExpandCacheEntry* p = (ExpandCacheEntry*)realloc(cache, size * sizeof(ExpandCacheEntry));
+        if (!p)
+            return NULL;
+        cache     = p;
+        cacheSize = size;
+    }
+
+    ExpandCacheEntry* c = &cache[cacheCount];
+    c->hash  = hash;
+    c->kind  = kind;
+    c->name  = DupString(name, strlen(name));
+    c->value = len >= 0 ? DupString(value, len) : NULL;
+    if (!c->name) {
+        free(c->value);
+        return NULL;
+    }
+    cacheCount++;
+
+    return c->value;
+}
+
+void Expander::GetCacheEntry(int i, char& kind, const char*& name, const char*& value) const
+{
+    kind  = cache[i].kind;
+    name  = cache[i].name;
+    value = cache[i].value;
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+// Expands %NAME% environment references and $REG{ROOT\key:value} registry
+// references in INI values. References may be repeated and nested, eg.
+// $REG{HKCU\Software\%APP%:dir}. Substituted text is not scanned again.
+
+// Copies the value of name into buf (NUL terminated) and returns its length,
+// or -1 if it is not defined. When the length is >= size the value did not
+// fit and the lookup is repeated with a larger buffer.
+typedef int (*ExpandLookup)(void* ctx, const char* name, char* buf, int size);
+
+struct ExpandProvider {
+	ExpandLookup env;	// %NAME%
+	ExpandLookup reg;	// $REG{...}, NULL to leave registry references alone
+	void* ctx;
+};
+
+struct ExpandCacheEntry;
+
+class Expander {
+public:
+	Expander(const ExpandProvider& provider);
+	~Expander();
+
+	// Quick test for values that have nothing to expand
+	static bool HasVariables(const char* value);
+
+	// Returns the expanded value, valid until the next call, or NULL if no
+	// reference in the value could be replaced
+	const char* Expand(const char* value);
+
+	int GetLookups() const { return lookups; }
+	int GetCacheHits() const { return hits; }
+
+	// The names looked up so far and their values (NULL if undefined), for
+	// callers that need to know what the expanded values depended on. kind
+	// is '%' for environment and '$' for registry lookups.
+	int GetCacheCount() const { return cacheCount; }
+	void GetCacheEntry(int i, char& kind, const char*& name, const char*& value) const;
+
+private:
+	const char* Parse(const char* p, char term);
+	const char* Lookup(char kind, const char* name);
+	void Append(const char* s, int len);
+
+	ExpandProvider provider;
+
+	// Lookup results for the life of the expander, undefined names included
+	ExpandCacheEntry* cache;
+	int cacheCount;
+	int cacheSize;
+
+	// Output being built and the buffer handed to the lookups
+	char* out;
+	int outLen;
+	int outSize;
+	char* value;
+	int valueSize;
+
+	bool replaced;
+	bool failed;
+	int lookups;
+	int hits;
+};
+
+#endif // EXPAND_H
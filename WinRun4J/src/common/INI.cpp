@@ -9,17 +9,43 @@
  *******************************************************************************/
 
 #include "INI.h"
+#include "Cache.h"
 #include "Log.h"
+#include "Snapshot.h"
+#include "Timing.h"
 
 #define ALLOW_INI_OVERRIDE    ":ini.override"
 #define INI_FILE_LOCATION     ":ini.file.location"
 #define INI_REGISTRY_LOCATION ":ini.registry.location"
+#define INI_CACHE             ":ini.cache"
+
+#define INI_CACHE_EXT       "inicache"
+#define INI_CACHE_MAGIC     MAKEFOURCC('W','4','J','C')
+#define INI_CACHE_VERSION   2
+
+// Kinds of input recorded in the INI cache
+#define INI_SOURCE_RESOURCE 0
+#define INI_SOURCE_FILE     1
+#define INI_SOURCE_REGKEY   2
+#define INI_SOURCE_ENV      3
+#define INI_SOURCE_REG      4
+
+// What the INI was resolved from
+struct IniSources {
+    const char* embedded;         // Embedded INI text, NULL if none
+    size_t      embeddedLen;
+    const char* iniFile;          // INI file beside the exe, if it was read
+    char*       fileLocation;     // ini.file.location, if set
+    char*       registryLocation; // ini.registry.location, if set
+};
 
 static dictionary* g_ini = NULL;
 
+// What readers on other threads see once the VM is running
+static IniSnapshot* volatile g_snapshot = NULL;
+
 UINT INI::GetNumberedKeysMax(dictionary* ini, TCHAR* keyName)
 {
-    // Use the new helper that scans the dictionary once (O(n))
     int max = dictionary_find_max(ini, keyName);
 
     // Preserve original return type and semantics
@@ -31,59 +57,30 @@ void INI::GetNumberedKeysFromIni(dictionary* ini,
                                  TCHAR*** entries,
                                  UINT& index)
 {
-    UINT i = 0;
-    TCHAR entryName[MAX_PATH];
-
-    unsigned max = dictionary_find_max(ini, keyName);
+    // The numbered key index returns keyName.1, keyName.2, ... in order,
+    // so size the array once and copy straight into it
+    UINT count = iniparser_getnumbered(ini, keyName, 1, NULL, 0);
 
-    while (true)
-    {
-        // Build key: keyName.N
-#ifdef UNICODE
-    	_snwprintf_s(entryName, MAX_PATH, _TRUNCATE, L"%s.%u", keyName, i + 1);
-#else
-    	_snprintf_s(entryName, MAX_PATH, _TRUNCATE, "%s.%u", keyName, i + 1);
-#endif
+    TCHAR** newArr = (TCHAR**)realloc(*entries, sizeof(TCHAR*) * (index + count + 1));
+    if (!newArr)
+        return;
 
-        TCHAR* entry = iniparser_getstr(ini, entryName);
+    *entries = newArr;
+    count = iniparser_getnumbered(ini, keyName, 1, &newArr[index], count);
 
-        if (entry != NULL)
-        {
-            // Duplicate the string
+    for (UINT i = 0; i < count; i++) {
 #ifdef UNICODE
-            TCHAR* dup = _wcsdup(entry);
+        TCHAR* dup = _wcsdup(newArr[index]);
 #else
-            TCHAR* dup = _strdup(entry);
+        TCHAR* dup = _strdup(newArr[index]);
 #endif
-            if (!dup)
-                return;
-
-            // Grow array
-            TCHAR** newArr = (TCHAR**)realloc(*entries, sizeof(TCHAR*) * (index + 1));
-            if (!newArr)
-            {
-                free(dup);
-                return;
-            }
-
-            *entries = newArr;
-            (*entries)[index++] = dup;
-        }
-
-        i++;
-
-        // Stop after a gap beyond max
-        if (i > max)
+        if (!dup)
             break;
+        newArr[index++] = dup;
     }
 
     // NULL-terminate the array
-    TCHAR** newArr = (TCHAR**)realloc(*entries, sizeof(TCHAR*) * (index + 1));
-    if (!newArr)
-        return;
-
-    *entries = newArr;
-    (*entries)[index] = NULL;
+    newArr[index] = NULL;
 }
 
 void INI::SetNumberedKeys(dictionary* ini, TCHAR* keyName, TCHAR** entries, UINT count)
@@ -95,6 +92,9 @@ void INI::SetNumberedKeys(dictionary* ini, TCHAR* keyName, TCHAR** entries, UINT
         sprintf_s(entryName, sizeof(entryName), "%s.%d", keyName, i + max + 1);
         iniparser_setstr(ini, entryName, entries[i]);
     }
+
+    if (ini == g_ini && g_snapshot)
+        PublishSnapshot(ini);
 }
 
 /* 
@@ -122,73 +122,110 @@ dictionary* INI::LoadIniFile(HINSTANCE hInstance)
 dictionary* INI::LoadIniFile(HINSTANCE hInstance, LPSTR inifile)
 {
     dictionary* ini = NULL;
+    Timing::Begin("ini");
 
     // Set DIR environment variable so that it can be used in the INI file
     TCHAR inidir[MAX_PATH];
     GetFileDirectory(inifile, inidir);
     SetEnvironmentVariable("INI_DIR", inidir);
 
-    // First attempt to load INI from exe
+    // Find the INI embedded in the exe, if any
+    IniSources sources = { 0 };
     HRSRC hi = FindResource(hInstance, MAKEINTRESOURCE(1), RT_INI_FILE);
     if (hi) {
         HGLOBAL hg = LoadResource(hInstance, hi);
         PBYTE   pb = (PBYTE)LockResource(hg);
         DWORD*  pd = (DWORD*)pb;
         if (pd && *pd == INI_RES_MAGIC) {
-            ini = iniparser_load((char*)&pb[RES_MAGIC_SIZE], true);
-            if (!ini) {
-                Log::Warning("Could not load embedded INI file");
-            }
+            // Parse straight out of the locked resource, stopping at the terminator
+            const char* text = (const char*)&pb[RES_MAGIC_SIZE];
+            DWORD size = SizeofResource(hInstance, hi) - RES_MAGIC_SIZE;
+            sources.embedded    = text;
+            sources.embeddedLen = strnlen(text, size);
         }
     }
 
-    // Check if we have already loaded an embedded INI file - if so
-    // then we only need to load and merge the INI file (if present)
-    if (ini && iniparser_getboolean(ini, (char*)ALLOW_INI_OVERRIDE, 1)) {
-        dictionary* ini2 = iniparser_load(inifile);
-        if (ini2) {
-            for (int i = 0; i < ini2->n; i++) {
-                char* key   = ini2->key[i];
-                char* value = ini2->val[i];
-                iniparser_setstr(ini, key, value);
+    // Use the snapshot from an earlier start while everything it was
+    // resolved from is unchanged
+    char cacheFile[MAX_PATH];
+    bool hasCacheFile = Cache::GetPath(inifile, INI_CACHE_EXT, cacheFile, sizeof(cacheFile));
+    if (hasCacheFile)
+        ini = LoadCache(cacheFile, sources);
+
+    bool cached = ini != NULL;
+    if (!cached) {
+        // Environment and registry variables are expanded in each layer
+        // before it is merged, sharing lookups between the layers
+        ExpandProvider provider = { GetEnvironmentValue, GetRegistryValue, NULL };
+        Expander expander(provider);
+
+        if (sources.embedded) {
+            ini = iniparser_loadbuffer(sources.embedded, sources.embeddedLen);
+            if (ini) {
+                dictionary_setorigin(ini, DICT_ORIGIN_EMBEDDED);
+                ExpandVariables(ini, expander);
+            } else {
+                Log::Warning("Could not load embedded INI file");
             }
-            iniparser_freedict(ini2);
         }
-    } else if (!ini) {
-        ini = iniparser_load(inifile);
-        if (ini == NULL) {
-            Log::Error("Could not load INI file: %s", inifile);
-            return NULL;
-        }
-    }
-
-    // Expand environment variables
-    ExpandVariables(ini);
 
-    // Expand registry variables
-    ExpandRegistryVariables(ini);
+        // Check if we have already loaded an embedded INI file - if so
+        // then we only need to load and merge the INI file (if present)
+        if (ini && iniparser_getboolean(ini, (char*)ALLOW_INI_OVERRIDE, 1)) {
+            sources.iniFile = inifile;
+            dictionary* ini2 = iniparser_load(inifile);
+            if (ini2) {
+                dictionary_setorigin(ini2, DICT_ORIGIN_FILE);
+                ExpandVariables(ini2, expander);
+                dictionary_merge(ini, ini2, DICT_MERGE_OVERRIDE);
+                iniparser_freedict(ini2);
+            }
+        } else if (!ini) {
+            sources.iniFile = inifile;
+            ini = iniparser_load(inifile);
+            if (ini == NULL) {
+                Log::Error("Could not load INI file: %s", inifile);
+                Timing::End("ini");
+                return NULL;
+            }
+            dictionary_setorigin(ini, DICT_ORIGIN_FILE);
+            ExpandVariables(ini, expander);
+        }
 
-    // Now check if we have an external file to load
-    char* iniFileLocation = iniparser_getstr(ini, (char*)INI_FILE_LOCATION);
-    if (iniFileLocation) {
-        Log::Info("Loading INI keys from file location: %s", iniFileLocation);
-        dictionary* ini3 = iniparser_load(iniFileLocation);
-        if (ini3) {
-            ExpandVariables(ini3);
-            for (int i = 0; i < ini3->n; i++) {
-                char* key   = ini3->key[i];
-                char* value = ini3->val[i];
-                iniparser_setstr(ini, key, value);
+        // Now check if we have an external file to load
+        char* iniFileLocation = iniparser_getstr(ini, (char*)INI_FILE_LOCATION);
+        if (iniFileLocation) {
+            sources.fileLocation = _strdup(iniFileLocation);
+            Log::Info("Loading INI keys from file location: %s", iniFileLocation);
+            dictionary* ini3 = iniparser_load(iniFileLocation);
+            if (ini3) {
+                dictionary_setorigin(ini3, DICT_ORIGIN_EXTERNAL);
+                ExpandVariables(ini3, expander);
+                dictionary_merge(ini, ini3, DICT_MERGE_OVERRIDE);
+                iniparser_freedict(ini3);
+            } else {
+                Log::Warning("Could not load INI keys from file: %s", iniFileLocation);
             }
-            iniparser_freedict(ini3);
-        } else {
-            Log::Warning("Could not load INI keys from file: %s", iniFileLocation);
         }
-    }
 
-    // Attempt to parse registry location to include keys if present
-    ParseRegistryKeys(ini);
+        // Attempt to parse registry location to include keys if present
+        char* iniRegistryLocation = iniparser_getstr(ini, (char*)INI_REGISTRY_LOCATION);
+        if (iniRegistryLocation)
+            sources.registryLocation = _strdup(iniRegistryLocation);
+        ParseRegistryKeys(ini);
+
+        // Only keep a snapshot for as long as it is asked for
+        if (hasCacheFile) {
+            if (iniparser_getboolean(ini, (char*)INI_CACHE, 0))
+                SaveCache(cacheFile, ini, sources, expander);
+            else
+                Cache::Delete(cacheFile);
+        }
+        free(sources.fileLocation);
+        free(sources.registryLocation);
+    }
 
+    ini->layer = DICT_ORIGIN_MODULE;
     iniparser_setstr(ini, (char*)MODULE_INI, inifile);
     iniparser_setstr(ini, (char*)INI_DIR, inidir);
 
@@ -211,56 +248,54 @@ dictionary* INI::LoadIniFile(HINSTANCE hInstance, LPSTR inifile)
     Log::Info("Module INI: %s", inifile);
     Log::Info("Module Dir: %s", filedir);
     Log::Info("INI Dir: %s", filedir);
+    if (cached)
+        Log::Info("INI loaded from cache: %s", cacheFile);
+
+    dictionary_stats stats;
+    dictionary_getstats(&stats);
+    Log::Info("INI loaded: %d keys, %d allocations (%d arena blocks, %d bytes), %d in-place updates",
+              ini->n, stats.allocs, stats.blocks, (int)stats.bytes, stats.inplace);
 
     // Store a reference to be used by JNI functions
     g_ini = ini;
 
+    Timing::End("ini");
     return ini;
 }
 
+// Keys are given in ":key" form and looked up in the section directly,
+// falling back to the main section value when asked to
 char* INI::GetString(dictionary* ini, const TCHAR* section, const TCHAR* key, TCHAR* defValue, bool defFromMainSection)
 {
-    char tmp[MAX_PATH];
-    tmp[0] = 0;
-
-    if (section)
-        strcat_s(tmp, sizeof(tmp), section);
-    strcat_s(tmp, sizeof(tmp), key);
+    if (!section)
+        return iniparser_getstring(ini, key, defValue);
 
-    if (section && defFromMainSection)
+    if (defFromMainSection)
         defValue = iniparser_getstring(ini, key, defValue);
 
-    return iniparser_getstring(ini, tmp, defValue);
+    return iniparser_getsecstring(ini, section, key[0] == ':' ? key + 1 : key, defValue);
 }
 
 int INI::GetInteger(dictionary* ini, const TCHAR* section, const TCHAR* key, int defValue, bool defFromMainSection)
 {
-    char tmp[MAX_PATH];
-    tmp[0] = 0;
+    if (!section)
+        return iniparser_getint(ini, key, defValue);
 
-    if (section)
-        strcat_s(tmp, sizeof(tmp), section);
-    strcat_s(tmp, sizeof(tmp), key);
-
-    if (section && defFromMainSection)
+    if (defFromMainSection)
         defValue = iniparser_getint(ini, key, defValue);
 
-    return iniparser_getint(ini, tmp, defValue);
+    return iniparser_getsecint(ini, section, key[0] == ':' ? key + 1 : key, defValue);
 }
 
 bool INI::GetBoolean(dictionary* ini, const TCHAR* section, const TCHAR* key, bool defValue, bool defFromMainSection)
 {
-    char tmp[MAX_PATH];
-    tmp[0] = 0;
-
-    if (section)
-        strcat_s(tmp, sizeof(tmp), section);
-    strcat_s(tmp, sizeof(tmp), key);
+    if (!section)
+        return iniparser_getboolean(ini, key, defValue) != 0;
 
-    if (section && defFromMainSection)
-        defValue = iniparser_getboolean(ini, key, defValue);
+    if (defFromMainSection)
+        defValue = iniparser_getboolean(ini, key, defValue) != 0;
 
-    return iniparser_getboolean(ini, tmp, defValue);
+    return iniparser_getsecboolean(ini, section, key[0] == ':' ? key + 1 : key, defValue) != 0;
 }
 
 void INI::ParseRegistryKeys(dictionary* ini)
@@ -273,37 +308,17 @@ void INI::ParseRegistryKeys(dictionary* ini)
 
     Log::Info("Loading INI keys from registry: %s", iniRegistryLocation);
 
-    // find root key
-    int len   = (int)strlen(iniRegistryLocation);
-    int slash = 0;
-    while (slash < len && iniRegistryLocation[slash] != '\\')
-        slash++;
-
-    if (slash == len) {
-        Log::Warning("Unable to parse registry location (%s) - keys not included", iniRegistryLocation);
-        return;
-    }
-
-    char* rootKey = _strdup(iniRegistryLocation);
-    if (!rootKey) {
-        Log::Warning("Out of memory duplicating registry root key");
-        return;
-    }
-    rootKey[slash] = 0;
-
-    HKEY hKey = GetHKey(rootKey);
-    free(rootKey);
-
-    if (hKey == 0) {
-        Log::Warning("Unrecognized registry root key");
+    HKEY subKey;
+    if (!OpenRegistryLocation(iniRegistryLocation, subKey, true))
         return;
-    }
 
-    HKEY subKey;
-    if (RegOpenKeyEx(hKey, &iniRegistryLocation[slash + 1], 0, KEY_READ, &subKey) != ERROR_SUCCESS) {
-        Log::Warning("Unable to open registry location (%s)", iniRegistryLocation);
+    // Collect the values first and merge them in as one layer
+    dictionary* reg = dictionary_new(0);
+    if (!reg) {
+        RegCloseKey(subKey);
         return;
     }
+    dictionary_setorigin(reg, DICT_ORIGIN_REGISTRY);
 
     DWORD index   = 0;
     char  name[MAX_PATH + 2];
@@ -325,13 +340,44 @@ void INI::ParseRegistryKeys(dictionary* ini)
         if (type == REG_DWORD) {
             DWORD val = *((LPDWORD)data);
             sprintf_s(data, sizeof(data), "%d", val);
-            iniparser_setstr(ini, key, data);
+            iniparser_setstr(reg, key, data);
         } else if (type == REG_SZ && dataLen > 1) {
-            iniparser_setstr(ini, key, data);
+            iniparser_setstr(reg, key, data);
         }
 
         index++;
     }
+
+    RegCloseKey(subKey);
+    dictionary_merge(ini, reg, DICT_MERGE_OVERRIDE);
+    iniparser_freedict(reg);
+}
+
+// Opens "ROOT\key" for reading
+bool INI::OpenRegistryLocation(const char* location, HKEY& subKey, bool warn)
+{
+    const char* slash = strchr(location, '\\');
+    if (!slash) {
+        if (warn)
+            Log::Warning("Unable to parse registry location (%s) - keys not included", location);
+        return false;
+    }
+
+    char rootKey[MAX_PATH];
+    StrTruncate(rootKey, (LPSTR)location, min((size_t)(slash - location) + 1, sizeof(rootKey)));
+    HKEY hKey = GetHKey(rootKey);
+    if (hKey == 0) {
+        if (warn)
+            Log::Warning("Unrecognized registry root key");
+        return false;
+    }
+
+    if (RegOpenKeyEx(hKey, slash + 1, 0, KEY_READ, &subKey) != ERROR_SUCCESS) {
+        if (warn)
+            Log::Warning("Unable to open registry location (%s)", location);
+        return false;
+    }
+    return true;
 }
 
 HKEY INI::GetHKey(char* key)
@@ -354,128 +400,386 @@ HKEY INI::GetHKey(char* key)
     return hKey;
 }
 
-int INI::GetRegistryValue(char* input, char* output, int len)
+int INI::GetEnvironmentValue(void* /*ctx*/, const char* name, char* output, int len)
 {
-    Log::Info("GetRegistryValue input (%s), output (%s), len (%d)", input, output, len);
+    output[0] = 0;
+    DWORD size = GetEnvironmentVariable(name, output, (DWORD)len);
+    if (size == 0 && GetLastError() == ERROR_ENVVAR_NOT_FOUND)
+        return -1;
+    return (int)size;
+}
 
-    char rootKey[4096];
-    strcpy_s(rootKey, sizeof(rootKey), input);
+/*
+ * Looks up "ROOT\key:valueName" for $REG{...} references. Returns the
+ * length of the value, the size required if output is too small, or -1.
+ */
+int INI::GetRegistryValue(void* /*ctx*/, const char* input, char* output, int len)
+{
+    char* rootKey = _strdup(input);
+    if (!rootKey)
+        return -1;
 
     char* slash = strchr(rootKey, '\\');
-    if (slash == NULL) {
-        Log::Warning("Invalid registry key, no backslash found (%s)", input);
-        return ERROR_INVALID_DATA;
-    }
-    *slash = 0;
-    char* key = slash + 1;
-
-    Log::Info("GetRegistryValue rootKey (%s)", rootKey);
-
-    HKEY hKey = GetHKey(rootKey);
-
-    Log::Info("GetRegistryValue full key (%s)", key);
-
-    char* colon = strchr(key, ':');
+    char* colon = slash ? strchr(slash, ':') : NULL;
     if (colon == NULL) {
-        Log::Warning("Invalid registry key, no key name found (%s)", input);
-        return ERROR_INVALID_DATA;
+        Log::Warning("Invalid registry key, expected ROOT\\key:name (%s)", input);
+        free(rootKey);
+        return -1;
     }
-
+    *slash = 0;
     *colon = 0;
 
-    Log::Info("GetRegistryValue stripped key (%s)", key);
-
-    char* valueName = colon + 1;
-
-    Log::Info("GetRegistryValue valueName (%s)", valueName);
-
+    HKEY hKey = GetHKey(rootKey);
     HKEY subKey;
-    long result = RegOpenKeyEx(hKey, key, 0, KEY_READ | KEY_WOW64_64KEY, &subKey);
+    long result = RegOpenKeyEx(hKey, slash + 1, 0, KEY_READ | KEY_WOW64_64KEY, &subKey);
     if (result != ERROR_SUCCESS) {
         Log::Warning("Unable to open registry key (%s) error (%d)", input, result);
-        return ERROR_INVALID_DATA;
+        free(rootKey);
+        return -1;
     }
 
     DWORD type;
     DWORD size = (DWORD)len;
-    if (RegQueryValueEx(subKey, valueName, NULL, &type, (LPBYTE)output, &size) != ERROR_SUCCESS) {
-        Log::Warning("Unable to get registry value (%s)", input);
-        return ERROR_INVALID_DATA;
-    }
+    result = RegQueryValueEx(subKey, colon + 1, NULL, &type, (LPBYTE)output, &size);
+    RegCloseKey(subKey);
+    free(rootKey);
 
-    if (type != REG_DWORD && type != REG_SZ) {
-        return ERROR_INVALID_DATA;
+    if (result == ERROR_MORE_DATA && type == REG_SZ)
+        return (int)size;
+    if (result != ERROR_SUCCESS || (type != REG_DWORD && type != REG_SZ)) {
+        Log::Warning("Unable to get registry value (%s)", input);
+        return -1;
     }
 
     if (type == REG_DWORD) {
         DWORD val = *((LPDWORD)output);
         sprintf_s(output, (size_t)len, "%d", val);
+    } else if (size == 0 || output[size - 1] != 0) {
+        // Value stored without its terminator
+        if ((int)size >= len)
+            return (int)size;
+        output[size] = 0;
     }
 
-    return ERROR_SUCCESS;
+    Log::Info("Registry variable %s = %s", input, output);
+    return (int)strlen(output);
 }
 
-void INI::ExpandRegistryVariables(dictionary* ini)
+// Expands the values that contain variables, leaving all others untouched
+void INI::ExpandVariables(dictionary* ini, Expander& expander)
 {
-    char tmp[4096];
-    char result[4096];
-    int  len = (int)sizeof(result);
-
-    for (int i = 0; i < ini->size; i++) {
-        char* key   = ini->key[i];
-        char* value = ini->val[i];
-        if (value == NULL) {
-            continue;
+    int count = 0;
+
+    Timing::Begin("expand");
+    for (int i = 0; i < ini->n; i++) {
+        const char* value = expander.Expand(ini->val[i]);
+        if (value) {
+            iniparser_setstr(ini, ini->key[i], (char*)value);
+            count++;
         }
+    }
+    Timing::End("expand");
 
-        strcpy_s(tmp, sizeof(tmp), value);
-        char* expansionStart = strstr(tmp, "$REG{");
-        if (expansionStart == NULL) {
-            continue;
+    Log::Info("Expanded %d values, %d variable lookups (%d cached)",
+              count, expander.GetLookups(), expander.GetCacheHits());
+}
+
+/*
+ * INI cache file layout: header, inputs, entries and then the strings they
+ * refer to by offset from the start of the file. The file ends with a NUL so
+ * that every string in it is terminated.
+ */
+struct IniCacheHeader {
+    DWORD magic;
+    DWORD version;
+    DWORD size;
+    DWORD inputs;
+    DWORD entries;
+    DWORD reserved;
+};
+
+struct IniCacheInput {
+    DWORD      type;
+    DWORD      name;
+    DWORD      value; // CACHE_NO_STRING if undefined
+    DWORD      reserved;
+    CacheStamp stamp;
+};
+
+struct IniCacheEntry {
+    DWORD key;
+    DWORD val; // CACHE_NO_STRING if NULL
+    DWORD hash;
+    DWORD origin;
+};
+
+// The snapshot stays mapped for the life of the process
+static const BYTE* g_iniCache = NULL;
+
+dictionary* INI::LoadCache(const char* cacheFile, const IniSources& sources)
+{
+    DWORD size;
+    const BYTE* view = Cache::Map(cacheFile, size, true);
+    if (!view)
+        return NULL;
+
+    const IniCacheHeader* header = (const IniCacheHeader*)view;
+    if (size < sizeof(IniCacheHeader) || header->magic != INI_CACHE_MAGIC ||
+        header->version != INI_CACHE_VERSION || header->size != size || view[size - 1] != 0 ||
+        sizeof(IniCacheHeader) + (ULONGLONG)header->inputs * sizeof(IniCacheInput) +
+        (ULONGLONG)header->entries * sizeof(IniCacheEntry) > size) {
+        Cache::Unmap(view);
+        return NULL;
+    }
+
+    const IniCacheInput* inputs = (const IniCacheInput*)&header[1];
+    for (DWORD i = 0; i < header->inputs; i++) {
+        if (!IsCacheInputCurrent(view, size, inputs[i], sources)) {
+            Cache::Unmap(view);
+            return NULL;
         }
-        char* keyStart = expansionStart + 5;
-        *expansionStart = 0;
-        char* regEnd = strchr(keyStart, '}');
-        if (regEnd == NULL) {
-            continue;
+    }
+
+    // Keys and values are used in place, only later changes are copied
+    const IniCacheEntry* entries = (const IniCacheEntry*)&inputs[header->inputs];
+    dictionary* ini = dictionary_new(header->entries);
+    if (!ini) {
+        Cache::Unmap(view);
+        return NULL;
+    }
+    for (DWORD i = 0; i < header->entries; i++) {
+        const char* key = Cache::GetString(view, size, entries[i].key);
+        if (key) {
+            ini->layer = (int)entries[i].origin;
+            dictionary_setref(ini, (char*)key, entries[i].hash,
+                              (char*)Cache::GetString(view, size, entries[i].val));
         }
-        *regEnd = 0;
-        if (GetRegistryValue(keyStart, result, len) == ERROR_SUCCESS) {
-            char ev[4096];
-            strcpy_s(ev, sizeof(ev), tmp);
-            strcat_s(ev, sizeof(ev), result);
-            strcat_s(ev, sizeof(ev), regEnd + 1);
-            Log::Info("Reg: %s = '%s' to '%s'", key, value, ev);
-            iniparser_setstr(ini, key, ev);
+    }
+
+    g_iniCache = view;
+    return ini;
+}
+
+bool INI::IsCacheInputCurrent(const BYTE* view, DWORD size, const IniCacheInput& input, const IniSources& sources)
+{
+    const char* name  = Cache::GetString(view, size, input.name);
+    const char* value = Cache::GetString(view, size, input.value);
+    CacheStamp  stamp;
+
+    switch (input.type) {
+    case INI_SOURCE_RESOURCE:
+        if (!sources.embedded)
+            return input.stamp.size == CACHE_MISSING;
+        return input.stamp.size == sources.embeddedLen &&
+               input.stamp.hash == Cache::Hash(sources.embedded, sources.embeddedLen);
+
+    case INI_SOURCE_FILE:
+        return name && Cache::IsCurrent(name, input.stamp);
+
+    case INI_SOURCE_REGKEY:
+        if (!name)
+            return false;
+        GetRegistryStamp(name, stamp);
+        return stamp.size == input.stamp.size && stamp.time == input.stamp.time;
+
+    case INI_SOURCE_ENV:
+    case INI_SOURCE_REG: {
+        if (!name)
+            return false;
+
+        // Look the variable up again and compare it with the value it
+        // had when the INI was expanded
+        ExpandLookup lookup = input.type == INI_SOURCE_ENV ? GetEnvironmentValue : GetRegistryValue;
+        char  buf[MAX_PATH];
+        char* current = buf;
+        int   len     = lookup(NULL, name, buf, sizeof(buf));
+        if (len >= (int)sizeof(buf)) {
+            current = (char*)malloc(len + 1);
+            int max = len;
+            len = current ? lookup(NULL, name, current, max + 1) : -1;
+            if (len > max)
+                len = -1;
         }
+        bool same = len < 0 ? value == NULL : value && strcmp(current, value) == 0;
+        if (current != buf)
+            free(current);
+        return same;
     }
+    }
+
+    return false;
 }
 
-void INI::ExpandVariables(dictionary* ini)
+void INI::SaveCache(const char* cacheFile, dictionary* ini, const IniSources& sources, const Expander& expander)
 {
-    char tmp[4096];
-
-    for (int i = 0; i < ini->size; i++) {
-        char* key   = ini->key[i];
-        char* value = ini->val[i];
-        if (!value)
-            continue;
-
-        DWORD size = ExpandEnvironmentStrings(value, tmp, (DWORD)sizeof(tmp));
-        if (size == 0 || size > sizeof(tmp)) {
-            Log::Warning("Could not expand variable: %s", value);
-            continue;
+    IniCacheInput* inputs  = (IniCacheInput*)calloc(4 + expander.GetCacheCount(), sizeof(IniCacheInput));
+    IniCacheEntry* entries = (IniCacheEntry*)malloc((ini->n ? ini->n : 1) * sizeof(IniCacheEntry));
+    CacheBlob      blob    = { 0 };
+    DWORD          count   = 0;
+
+    if (!inputs || !entries) {
+        free(inputs);
+        free(entries);
+        return;
+    }
+
+    // Where the INI text came from
+    inputs[count].type = INI_SOURCE_RESOURCE;
+    inputs[count].name = CACHE_NO_STRING;
+    inputs[count].value = CACHE_NO_STRING;
+    inputs[count].stamp.size = sources.embedded ? sources.embeddedLen : CACHE_MISSING;
+    inputs[count].stamp.hash = sources.embedded ? Cache::Hash(sources.embedded, sources.embeddedLen) : 0;
+    count++;
+
+    const char* files[] = { sources.iniFile, sources.fileLocation };
+    for (int i = 0; i < 2; i++) {
+        if (files[i]) {
+            inputs[count].type = INI_SOURCE_FILE;
+            inputs[count].name = Cache::AddString(blob, files[i]);
+            inputs[count].value = CACHE_NO_STRING;
+            Cache::GetStamp(files[i], inputs[count].stamp);
+            count++;
         }
-        iniparser_setstr(ini, key, tmp);
     }
+
+    if (sources.registryLocation) {
+        inputs[count].type = INI_SOURCE_REGKEY;
+        inputs[count].name = Cache::AddString(blob, sources.registryLocation);
+        inputs[count].value = CACHE_NO_STRING;
+        GetRegistryStamp(sources.registryLocation, inputs[count].stamp);
+        count++;
+    }
+
+    // Every variable used during expansion, defined or not
+    for (int i = 0; i < expander.GetCacheCount(); i++) {
+        char        kind;
+        const char* name;
+        const char* value;
+        expander.GetCacheEntry(i, kind, name, value);
+        inputs[count].type = kind == '%' ? INI_SOURCE_ENV : INI_SOURCE_REG;
+        inputs[count].name = Cache::AddString(blob, name);
+        inputs[count].value = Cache::AddString(blob, value);
+        count++;
+    }
+
+    for (int i = 0; i < ini->n; i++) {
+        entries[i].key = Cache::AddString(blob, ini->key[i]);
+        entries[i].val = Cache::AddString(blob, ini->val[i]);
+        entries[i].hash = ini->hash[i];
+        entries[i].origin = (DWORD)ini->origin[i];
+    }
+
+    // Offsets so far are relative to the strings, move them past the tables
+    DWORD base = (DWORD)(sizeof(IniCacheHeader) + count * sizeof(IniCacheInput) + ini->n * sizeof(IniCacheEntry));
+    for (DWORD i = 0; i < count; i++) {
+        if (inputs[i].name != CACHE_NO_STRING)
+            inputs[i].name += base;
+        if (inputs[i].value != CACHE_NO_STRING)
+            inputs[i].value += base;
+    }
+    for (int i = 0; i < ini->n; i++) {
+        if (entries[i].key != CACHE_NO_STRING)
+            entries[i].key += base;
+        if (entries[i].val != CACHE_NO_STRING)
+            entries[i].val += base;
+    }
+
+    // The final NUL terminates the last string, see above
+    Cache::AddString(blob, "");
+    BYTE* data = blob.failed ? NULL : (BYTE*)malloc(base + blob.len);
+    if (data) {
+        IniCacheHeader header = { INI_CACHE_MAGIC, INI_CACHE_VERSION, base + blob.len, count, (DWORD)ini->n, 0 };
+        memcpy(data, &header, sizeof(header));
+        memcpy(&data[sizeof(header)], inputs, count * sizeof(IniCacheInput));
+        memcpy(&data[sizeof(header) + count * sizeof(IniCacheInput)], entries, ini->n * sizeof(IniCacheEntry));
+        memcpy(&data[base], blob.data, blob.len);
+        if (Cache::Write(cacheFile, data, header.size))
+            Log::Info("Saved INI cache: %s", cacheFile);
+    }
+
+    free(data);
+    free(blob.data);
+    free(entries);
+    free(inputs);
+}
+
+// The last write time of a registry key, which changes when any of its values do
+void INI::GetRegistryStamp(const char* location, CacheStamp& stamp)
+{
+    HKEY     subKey;
+    FILETIME time;
+
+    stamp.size = CACHE_MISSING;
+    stamp.time = 0;
+    stamp.hash = 0;
+    if (!OpenRegistryLocation(location, subKey, false))
+        return;
+
+    if (RegQueryInfoKey(subKey, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &time) == ERROR_SUCCESS) {
+        stamp.size = 0;
+        stamp.time = ((ULONGLONG)time.dwHighDateTime << 32) | time.dwLowDateTime;
+    }
+    RegCloseKey(subKey);
+}
+
+// Logs how many keys each layer contributed
+void INI::LogOrigins(dictionary* ini)
+{
+    static const char* names[DICT_ORIGIN_COUNT] = {
+        "none", "embedded", "file", "external", "registry", "module", "command line"
+    };
+    int counts[DICT_ORIGIN_COUNT] = { 0 };
+
+    for (int i = 0; i < ini->n; i++) {
+        if (ini->origin[i] >= 0 && ini->origin[i] < DICT_ORIGIN_COUNT)
+            counts[ini->origin[i]]++;
+    }
+
+    char text[MAX_PATH];
+    int  len = 0;
+    for (int i = DICT_ORIGIN_EMBEDDED; i < DICT_ORIGIN_COUNT; i++) {
+        if (counts[i]) {
+            int r = sprintf_s(&text[len], sizeof(text) - len, "%s%d %s", len ? ", " : "", counts[i], names[i]);
+            if (r > 0)
+                len += r;
+        }
+    }
+    Log::Info("INI keys by source: %s", len ? text : "none");
+}
+
+/*
+ * Freezes the INI into a snapshot for readers on other threads. Called once
+ * the VM has started, and again by anything that changes the INI after that
+ * (changes are made from one thread). The replaced snapshot is not freed as
+ * a reader may still be using it or hold one of its strings.
+ */
+void INI::PublishSnapshot(dictionary* ini)
+{
+    IniSnapshot* s = Snapshot::Create(ini, g_snapshot);
+    if (!s) {
+        Log::Warning("Could not create INI snapshot");
+        return;
+    }
+    InterlockedExchangePointer((PVOID volatile*)&g_snapshot, s);
+}
+
+const IniSnapshot* INI::GetSnapshot()
+{
+    return g_snapshot;
 }
 
-extern "C" __declspec(dllexport) dictionary* __cdecl INI_GetDictionary()
+// Returns the snapshot once published, which starts like a dictionary
+// (n, size, val, key) as INI.getPropertyKeys expects
+extern "C" __declspec(dllexport) const void* __cdecl INI_GetDictionary()
 {
-    return g_ini;
+    IniSnapshot* s = g_snapshot;
+    return s ? (const void*)s : (const void*)g_ini;
 }
 
 extern "C" __declspec(dllexport) const char* __cdecl INI_GetProperty(const char* key)
 {
+    IniSnapshot* s = g_snapshot;
+    if (s)
+        return Snapshot::Get(s, key);
     return iniparser_getstr(g_ini, (char*)key);
 }
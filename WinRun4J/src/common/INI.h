@@ -13,6 +13,12 @@
 
 #include "Runtime.h"
 #include "Dictionary.h"
+#include "Expand.h"
+
+struct CacheStamp;
+struct IniSources;
+struct IniCacheInput;
+struct IniSnapshot;
 
 // Internal keys
 #define MODULE_NAME "WinRun4J:module.name"
@@ -20,6 +26,9 @@
 #define MODULE_DIR  "WinRun4J:module.dir"
 #define INI_DIR     "WinRun4J:ini.dir"
 
+// How many keys -W on the command line removed, which leaves no key behind
+#define CMDLINE_UNSET "WinRun4J:cmdline.unset"
+
 // Ini keys
 #define WORKING_DIR   ":working.directory"
 #define LOG_FILE      ":log"
@@ -43,15 +52,23 @@ public:
 	static char* GetString(dictionary* ini, const TCHAR* section, const TCHAR* key, TCHAR* defValue, bool defFromMainSection = true);
 	static int   GetInteger(dictionary* ini, const TCHAR* section, const TCHAR* key, int defValue, bool defFromMainSection = true);
 	static bool  GetBoolean(dictionary* ini, const TCHAR* section, const TCHAR* key, bool defValue, bool defFromMainSection = true);
+	static void  LogOrigins(dictionary* ini);
+	static void  PublishSnapshot(dictionary* ini);
+	static const IniSnapshot* GetSnapshot();
 
 private:
 	static bool StrTrimInChars(LPSTR trimChars, char c);
 	static void StrTrim(LPSTR str, LPSTR trimChars);
-	static void ExpandVariables(dictionary* ini);
-	static void ExpandRegistryVariables(dictionary* ini);
-	static int GetRegistryValue(char* input, char* output, int len);
+	static void ExpandVariables(dictionary* ini, Expander& expander);
+	static int GetEnvironmentValue(void* ctx, const char* name, char* output, int len);
+	static int GetRegistryValue(void* ctx, const char* input, char* output, int len);
 	static void ParseRegistryKeys(dictionary* ini);
+	static bool OpenRegistryLocation(const char* location, HKEY& subKey, bool warn);
+	static void GetRegistryStamp(const char* location, CacheStamp& stamp);
 	static HKEY GetHKey(char* key);
+	static dictionary* LoadCache(const char* cacheFile, const IniSources& sources);
+	static bool IsCacheInputCurrent(const BYTE* view, DWORD size, const IniCacheInput& input, const IniSources& sources);
+	static void SaveCache(const char* cacheFile, dictionary* ini, const IniSources& sources, const Expander& expander);
 };
 
 #endif // INI_H
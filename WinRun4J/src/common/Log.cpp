@@ -9,7 +9,9 @@
  *******************************************************************************/
 
 #include "Log.h"
+#include "StringBuilder.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <io.h>
 #include <VersionHelpers.h>
@@ -31,7 +33,9 @@ namespace
     char*         g_logRollPrefix     = NULL;
     char*         g_logRollSuffix     = NULL;
     bool          g_logOverwrite      = false;
-    volatile bool g_logRolling        = false;
+    bool          g_logRolling        = false;
+    CRITICAL_SECTION g_logLock;
+    volatile LONG g_logLockState      = 0;     // 0 none, 1 initializing, 2 ready
     LoggingLevel  g_logLevel          = none;
     bool          g_error             = false;
     char          g_errorText[MAX_PATH];
@@ -40,6 +44,22 @@ namespace
 
 typedef BOOL (_stdcall *FPTR_AttachConsole) ( DWORD );
 
+// Lines are written, and the file rolled, from any thread and before Init,
+// so the lock is made by whichever comes first
+static void EnterLogLock()
+{
+    if (g_logLockState != 2) {
+        if (InterlockedCompareExchange(&g_logLockState, 1, 0) == 0) {
+            InitializeCriticalSection(&g_logLock);
+            InterlockedExchange(&g_logLockState, 2);
+        } else {
+            while (g_logLockState != 2)
+                Sleep(0);
+        }
+    }
+    EnterCriticalSection(&g_logLock);
+}
+
 #define LOG_OVERWRITE_OPTION        ":log.overwrite"
 #define LOG_FILE_AND_CONSOLE        ":log.file.and.console"
 #define LOG_ROLL_SIZE               ":log.roll.size"
@@ -225,33 +245,57 @@ void Log::LogIt(LoggingLevel loggingLevel, const char* marker, const char* forma
     if (!format)
         return;
 
-    char tmp[4096];
-    vsprintf_s(tmp, sizeof(tmp), format, args);
-
-    if (g_logToDebugMonitor) {
-        char tmp2[4096];
-        sprintf_s(tmp2, sizeof(tmp2), "%s %s\n", marker ? marker : "", tmp);
-        OutputDebugStringA(tmp2);
+    // Most lines fit on the stack, longer ones are measured and allocated
+    char tmp[MAX_LOG_LENGTH];
+    va_list measure;
+    va_copy(measure, args);
+    int len = _vscprintf(format, measure);
+    va_end(measure);
+    if (len < 0)
+        return;
+    if (len < (int)sizeof(tmp)) {
+        vsprintf_s(tmp, sizeof(tmp), format, args);
+        WriteLine(marker, tmp, NULL);
+        return;
     }
 
-    DWORD dwWritten;
+    char* text = (char*)malloc(len + 1);
+    if (!text)
+        return;
+    vsprintf_s(text, len + 1, format, args);
+    WriteLine(marker, text, NULL);
+    free(text);
+}
 
+/*
+ * Writes "marker text value" as one line. The value is written as it is,
+ * however long, so long classpaths and vm args are not cut or split.
+ */
+void Log::WriteLine(const char* marker, const char* text, const char* value)
+{
+    StringBuilder line;
     if (marker) {
-        WriteFile(g_logfileHandle, marker, (DWORD)strlen(marker), &dwWritten, NULL);
-        WriteFile(g_logfileHandle, " ", 1, &dwWritten, NULL);
+        line.Append(marker);
+        line.Append(' ');
     }
-    WriteFile(g_logfileHandle, tmp, (DWORD)strlen(tmp), &dwWritten, NULL);
-    WriteFile(g_logfileHandle, "\r\n", 2, &dwWritten, NULL);
+    line.Append(text);
+    line.Append(value);
+    line.Append("\r\n", 2);
+    if (line.Failed())
+        return;
+
+    if (g_logToDebugMonitor)
+        OutputDebugStringA(line.Get());
+
+    // The lock is taken again by the line RollLog writes on the same thread
+    EnterLogLock();
+    DWORD dwWritten;
+    WriteFile(g_logfileHandle, line.Get(), (DWORD)line.Length(), &dwWritten, NULL);
     FlushFileBuffers(g_logfileHandle);
 
     // Check if we also log to console if we have a log file
     if (g_haveLogFile && g_logFileAndConsole) {
-        if (marker) {
-            WriteFile(g_stdHandle, marker, (DWORD)strlen(marker), &dwWritten, NULL);
-            WriteFile(g_stdHandle, " ", 1, &dwWritten, NULL);
-        }
-        WriteFile(g_stdHandle, tmp, (DWORD)strlen(tmp), &dwWritten, NULL);
-        WriteFile(g_stdHandle, "\r\n", 2, &dwWritten, NULL);
+        WriteFile(g_stdHandle, line.Get(), (DWORD)line.Length(), &dwWritten, NULL);
         FlushFileBuffers(g_stdHandle);
     }
 
@@ -264,6 +308,7 @@ void Log::LogIt(LoggingLevel loggingLevel, const char* marker, const char* forma
         }
         g_logRolling = false;
     }
+    LeaveCriticalSection(&g_logLock);
 }
 
 void Log::SetLevel(LoggingLevel loggingLevel) 
@@ -312,12 +357,20 @@ void Log::Error(const char* format, ...)
     }
 }
 
+void Log::InfoLong(const char* text, const char* value)
+{
+    if (g_logLevel <= info && text)
+        WriteLine("[info]", text, value);
+}
+
 void Log::Close() 
 {
+    EnterLogLock();
     if (g_logfileHandle) {
         CloseHandle(g_logfileHandle);
         g_logfileHandle = NULL;
     }
+    LeaveCriticalSection(&g_logLock);
 }
 
 extern "C" __declspec(dllexport) void Log_LogIt(int level, const char* marker, const char* format)
@@ -26,10 +26,13 @@ struct Log {
 	static void Info(const char* format, ...);
 	static void Warning(const char* format, ...);
 	static void Error(const char* format, ...);
+	// Logs text followed by a value of any length, unformatted
+	static void InfoLong(const char* text, const char* value);
 	static void Close();
 	static void LogIt(LoggingLevel loggingLevel, const char* marker, const char* format, va_list args);
 
 private:
+	static void WriteLine(const char* marker, const char* text, const char* value);
 	static void RedirectIOToConsole();
 	static void RollLog();
 };
@@ -0,0 +1,186 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "PhaseTimes.h"
+#include <stdio.h>
+#include <string.h>
+
+PhaseTimes::PhaseTimes() : count(0)
+{
+    memset(phases, 0, sizeof(phases));
+}
+
+PhaseTime* PhaseTimes::Lookup(const char* name, bool add)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(phases[i].name, name) == 0)
+            return &phases[i];
+    }
+    if (!add || count >= PHASE_TIMES_MAX)
+        return NULL;
+
+    PhaseTime* phase = &phases[count++];
+    memset(phase, 0, sizeof(PhaseTime));
+    phase->name = name;
+    return phase;
+}
+
+const PhaseTime* PhaseTimes::Find(const char* name) const
+{
+    return const_cast<PhaseTimes*>(this)->Lookup(name, false);
+}
+
+void PhaseTimes::Begin(const char* name, double now)
+{
+    PhaseTime* phase = Lookup(name, true);
+    if (!phase || phase->running)
+        return;
+    if (phase->runs == 0)
+        phase->start = now;
+    phase->begun = now;
+    phase->running = true;
+}
+
+void PhaseTimes::End(const char* name, double now)
+{
+    PhaseTime* phase = Lookup(name, false);
+    if (!phase || !phase->running)
+        return;
+    phase->duration += now - phase->begun;
+    phase->runs++;
+    phase->running = false;
+}
+
+void PhaseTimes::Mark(const char* name, double now)
+{
+    PhaseTime* phase = Lookup(name, true);
+    if (!phase || phase->runs > 0 || phase->running)
+        return;
+    phase->start = now;
+    phase->runs = 1;
+}
+
+void PhaseTimes::Add(const char* name, double start, double duration)
+{
+    PhaseTime* phase = Lookup(name, true);
+    if (!phase || phase->running)
+        return;
+    if (phase->runs == 0)
+        phase->start = start;
+    phase->duration += duration;
+    phase->runs++;
+}
+
+// Finished, and not written since it last ran
+static bool IsUnwritten(const PhaseTime& phase)
+{
+    return !phase.running && phase.runs > phase.written;
+}
+
+int PhaseTimes::GetUnwritten() const
+{
+    int unwritten = 0;
+    for (int i = 0; i < count; i++) {
+        if (IsUnwritten(phases[i]))
+            unwritten++;
+    }
+    return unwritten;
+}
+
+void PhaseTimes::SetWritten()
+{
+    for (int i = 0; i < count; i++) {
+        if (!phases[i].running)
+            phases[i].written = phases[i].runs;
+    }
+}
+
+// A JSON string (or the same for CSV, which quotes the same way bar the
+// escapes), eg. a module path with its backslashes
+static void AppendQuoted(StringBuilder& out, const char* str, bool json)
+{
+    out.Append('"');
+    for (const char* p = str ? str : ""; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (!json) {
+            if (c == '"')
+                out.Append('"');
+            out.Append((char)c);
+        } else if (c == '"' || c == '\\') {
+            out.Append('\\');
+            out.Append((char)c);
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out.Append(esc);
+        } else {
+            out.Append((char)c);
+        }
+    }
+    out.Append('"');
+}
+
+static void AppendNumber(StringBuilder& out, double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.3f", value);
+    out.Append(text);
+}
+
+void PhaseTimes::Format(StringBuilder& out, int format, const PhaseLaunch& launch, bool unwritten, bool header) const
+{
+    char pid[16];
+    snprintf(pid, sizeof(pid), "%lu", launch.pid);
+
+    if (format == PHASE_TIMES_CSV) {
+        if (header)
+            out.Append("pid,started,module,phase,start,ms\r\n");
+        for (int i = 0; i < count; i++) {
+            if (phases[i].running || (unwritten && !IsUnwritten(phases[i])))
+                continue;
+            out.Append(pid);
+            out.Append(',');
+            out.Append(launch.started ? launch.started : "");
+            out.Append(',');
+            AppendQuoted(out, launch.module, false);
+            out.Append(',');
+            out.Append(phases[i].name);
+            out.Append(',');
+            AppendNumber(out, phases[i].start);
+            out.Append(',');
+            AppendNumber(out, phases[i].duration);
+            out.Append("\r\n");
+        }
+        return;
+    }
+
+    out.Append("{\"pid\":");
+    out.Append(pid);
+    out.Append(",\"started\":");
+    AppendQuoted(out, launch.started, true);
+    out.Append(",\"module\":");
+    AppendQuoted(out, launch.module, true);
+    out.Append(",\"phases\":{");
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        if (phases[i].running || (unwritten && !IsUnwritten(phases[i])))
+            continue;
+        if (!first)
+            out.Append(',');
+        first = false;
+        AppendQuoted(out, phases[i].name, true);
+        out.Append(":{\"start\":");
+        AppendNumber(out, phases[i].start);
+        out.Append(",\"ms\":");
+        AppendNumber(out, phases[i].duration);
+        out.Append('}');
+    }
+    out.Append("}}\r\n");
+}
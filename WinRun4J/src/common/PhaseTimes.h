@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef PHASE_TIMES_H
+#define PHASE_TIMES_H
+
+#include "StringBuilder.h"
+
+// The times of the phases of a launch, written out as a JSON line or CSV
+// rows. Times are in milliseconds from the start of the launcher.
+
+#define PHASE_TIMES_MAX 32
+
+#define PHASE_TIMES_JSON 0
+#define PHASE_TIMES_CSV  1
+
+struct PhaseTime {
+	const char* name;   // Not copied, phases are named by literals
+	double start;       // When it first began
+	double duration;    // Every time it ran, added up
+	double begun;       // When it last began, while running
+	int runs;
+	int written;        // Runs already written out
+	bool running;
+};
+
+// What the lines of one launch share so they can be matched up later
+struct PhaseLaunch {
+	unsigned long pid;
+	const char* started;    // When the launcher started, eg. 2024-05-01T10:00:00.000Z
+	const char* module;
+};
+
+class PhaseTimes {
+public:
+	PhaseTimes();
+
+	// A phase that runs more than once (eg. expanding each INI layer) adds
+	// up; Begin on one that is running, or End on one that is not, is ignored
+	void Begin(const char* name, double now);
+	void End(const char* name, double now);
+
+	// A point in time, eg. the first callback; only the first is kept
+	void Mark(const char* name, double now);
+
+	// A phase timed elsewhere, eg. the process starting before the launcher
+	void Add(const char* name, double start, double duration);
+
+	int GetCount() const { return count; }
+	const PhaseTime* Get(int i) const { return i >= 0 && i < count ? &phases[i] : NULL; }
+	const PhaseTime* Find(const char* name) const;
+
+	// Appends the phases as one JSON line
+	// ({"pid":..,"started":..,"module":..,"phases":{"ini":{"start":..,"ms":..},..}})
+	// or as one "pid,started,module,phase,start,ms" row each, with a header
+	// row first if asked. Phases still running are left out, and so are the
+	// ones written already if only the unwritten are asked for.
+	void Format(StringBuilder& out, int format, const PhaseLaunch& launch, bool unwritten, bool header) const;
+
+	// The finished phases not written since they last ran, and marking them
+	// written. A phase that finishes late, or runs again, is written by a
+	// later flush (again with its new total).
+	int GetUnwritten() const;
+	void SetWritten();
+
+private:
+	PhaseTime* Lookup(const char* name, bool add);
+
+	PhaseTime phases[PHASE_TIMES_MAX];
+	int count;
+};
+
+#endif // PHASE_TIMES_H
@@ -80,7 +80,7 @@ jobjectArray Registry::GetSubKeyNames(JNIEnv* env, jobject /*self*/, jlong handl
 
     char tmp[MAX_PATH];
 
-    jclass clazz = env->FindClass("java/lang/String");
+    jclass clazz = JNI::GetCache().stringClass;
     if (!clazz)
         return NULL;
 
@@ -111,7 +111,7 @@ jobjectArray Registry::GetValueNames(JNIEnv* env, jobject /*self*/, jlong handle
 
     char tmp[MAX_PATH];
 
-    jclass clazz = env->FindClass("java/lang/String");
+    jclass clazz = JNI::GetCache().stringClass;
     if (!clazz)
         return NULL;
 
@@ -305,7 +305,7 @@ jobjectArray Registry::GetMultiString(JNIEnv* env, jobject /*self*/, jlong paren
         p += l + 1;
     }
 
-    jclass clazz = env->FindClass("java/lang/String");
+    jclass clazz = JNI::GetCache().stringClass;
     if (!clazz)
         return 0;
 
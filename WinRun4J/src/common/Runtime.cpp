@@ -340,6 +340,28 @@ extern void _cdecl GetFileNameSansExtension(LPSTR filename, LPSTR output)
     }
 }
 
+// ------------------------------------------------------------
+// GetFullPathFrom
+// ------------------------------------------------------------
+// A relative path is joined onto dir (which ends with a slash, as INI_DIR
+// does) rather than resolved against the current directory, which may be
+// changed by another thread. With no dir it is the current directory.
+extern DWORD _cdecl GetFullPathFrom(LPSTR dir, LPSTR path, LPSTR output, DWORD len)
+{
+    if (!path || !output || len == 0)
+        return 0;
+
+    bool relative = path[0] != '\\' && path[0] != '/' && (path[0] == 0 || path[1] != ':');
+    if (!dir || !relative)
+        return GetFullPathNameA(path, len, output, NULL);
+
+    char joined[MAX_PATH];
+    if (strlen(dir) + strlen(path) >= sizeof(joined))
+        return 0;
+    sprintf_s(joined, sizeof(joined), "%s%s", dir, path);
+    return GetFullPathNameA(joined, len, output, NULL);
+}
+
 // ------------------------------------------------------------
 // strrev
 // ------------------------------------------------------------
@@ -34,5 +34,6 @@ extern void _cdecl GetFileDirectory(LPSTR filename, LPSTR output);
 extern void _cdecl GetFileName(LPSTR filename, LPSTR output);
 extern void _cdecl GetFileExtension(LPSTR filename, LPSTR output);
 extern void _cdecl GetFileNameSansExtension(LPSTR filename, LPSTR output);
+extern DWORD _cdecl GetFullPathFrom(LPSTR dir, LPSTR path, LPSTR output, DWORD len);
 
 #endif 
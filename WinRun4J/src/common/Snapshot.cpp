@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct SnapshotEntry {
+    unsigned    hash;
+    const char* key;
+    const char* val;
+};
+
+static int CompareEntries(const void* a, const void* b)
+{
+    const SnapshotEntry* x = (const SnapshotEntry*)a;
+    const SnapshotEntry* y = (const SnapshotEntry*)b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+IniSnapshot* Snapshot::Create(dictionary* d, IniSnapshot* prev)
+{
+    int n = d ? d->n : 0;
+    SnapshotEntry* entries = (SnapshotEntry*)malloc((n ? n : 1) * sizeof(SnapshotEntry));
+    if (!entries)
+        return NULL;
+
+    size_t strings = 0;
+    for (int i = 0; i < n; i++) {
+        entries[i].hash = d->hash[i];
+        entries[i].key = d->key[i];
+        entries[i].val = d->val[i];
+        strings += strlen(d->key[i]) + 1;
+        if (d->val[i])
+            strings += strlen(d->val[i]) + 1;
+    }
+    qsort(entries, n, sizeof(SnapshotEntry), CompareEntries);
+
+    size_t size = sizeof(IniSnapshot) + 2 * n * sizeof(char*) + n * sizeof(unsigned) + strings;
+    IniSnapshot* s = (IniSnapshot*)malloc(size);
+    if (!s) {
+        free(entries);
+        return NULL;
+    }
+
+    s->n    = n;
+    s->size = (int)size;
+    s->val  = (char**)&s[1];
+    s->key  = &s->val[n];
+    s->hash = (unsigned*)&s->key[n];
+    s->prev = prev;
+
+    char* p = (char*)&s->hash[n];
+    for (int i = 0; i < n; i++) {
+        s->hash[i] = entries[i].hash;
+
+        size_t len = strlen(entries[i].key) + 1;
+        memcpy(p, entries[i].key, len);
+        s->key[i] = p;
+        p += len;
+
+        s->val[i] = NULL;
+        if (entries[i].val) {
+            len = strlen(entries[i].val) + 1;
+            memcpy(p, entries[i].val, len);
+            s->val[i] = p;
+            p += len;
+        }
+    }
+
+    free(entries);
+    return s;
+}
+
+void Snapshot::Free(IniSnapshot* s)
+{
+    while (s) {
+        IniSnapshot* prev = s->prev;
+        free(s);
+        s = prev;
+    }
+}
+
+const char* Snapshot::Get(const IniSnapshot* s, const char* key)
+{
+    if (!s || !key)
+        return NULL;
+
+    // Find the first entry with the hash, then check the names of those
+    // that share it. The search halves the range without branching on the
+    // comparison, which a branch predictor cannot guess.
+    unsigned hash = dictionary_hash((char*)key);
+    int      lo   = 0;
+    int      len  = s->n;
+    while (len > 1) {
+        int half = len / 2;
+        lo  += s->hash[lo + half - 1] < hash ? half : 0;
+        len -= half;
+    }
+    if (len == 1 && s->hash[lo] < hash)
+        lo++;
+    for (; lo < s->n && s->hash[lo] == hash; lo++) {
+        if (!strcmp(s->key[lo], key))
+            return s->val[lo];
+    }
+    return NULL;
+}
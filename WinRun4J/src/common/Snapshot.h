@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Dictionary.h"
+
+// An immutable copy of a dictionary for readers on other threads. Keys are
+// sorted by hash (then by name) so a lookup is a binary search over a compact
+// array of hashes. The snapshot is one allocation: the header, the value, key
+// and hash arrays, then the strings. A snapshot is never changed
+// once created, so any number of threads can read it without locking.
+//
+// The leading members are laid out like the start of dictionary so that
+// INI.getPropertyKeys, which reads n and key by offset, works on either.
+
+struct IniSnapshot {
+	int n;				// Number of keys
+	int size;			// Bytes in the allocation
+	char** val;			// Values in key order, NULL where the dictionary has none
+	char** key;			// Keys in hash order
+	unsigned* hash;		// dictionary_hash of each key, ascending
+	IniSnapshot* prev;	// Snapshot this one replaced, see Snapshot::Create
+};
+
+struct Snapshot {
+	// Copies d, returns NULL if out of memory. prev is kept for readers
+	// that may still be using the snapshot being replaced.
+	static IniSnapshot* Create(dictionary* d, IniSnapshot* prev = NULL);
+
+	// Frees s and every snapshot it replaced
+	static void Free(IniSnapshot* s);
+
+	static const char* Get(const IniSnapshot* s, const char* key);
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "StringBuilder.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_BUFFER 256
+
+StringBuilder::StringBuilder(size_t capacity)
+    : data(NULL), len(0), size(0), failed(false)
+{
+    if (capacity)
+        Reserve(capacity);
+}
+
+StringBuilder::~StringBuilder()
+{
+    free(data);
+}
+
+bool StringBuilder::Reserve(size_t extra)
+{
+    if (failed)
+        return false;
+    if (len + extra + 1 <= size)
+        return true;
+
+    size_t n = size ? size : MIN_BUFFER;
+    while (n < len + extra + 1)
+        n *= 2;
+    char* p = (char*)realloc(data, n);
+    if (!p) {
+        failed = true;
+        return false;
+    }
+    data = p;
+    size = n;
+    return true;
+}
+
+void StringBuilder::Append(const char* s, size_t slen)
+{
+    if (!Reserve(slen))
+        return;
+    memcpy(data + len, s, slen);
+    len += slen;
+    data[len] = 0;
+}
+
+void StringBuilder::Append(const char* s)
+{
+    if (s)
+        Append(s, strlen(s));
+}
+
+void StringBuilder::Append(char c)
+{
+    Append(&c, 1);
+}
+
+void StringBuilder::Join(const char* const* strs, int count, char sep)
+{
+    // Size it once up front
+    size_t total = count > 0 ? count - 1 : 0;
+    for (int i = 0; i < count; i++)
+        total += strs[i] ? strlen(strs[i]) : 0;
+    if (!Reserve(total))
+        return;
+
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            Append(sep);
+        Append(strs[i]);
+    }
+}
+
+char* StringBuilder::Detach()
+{
+    char* p = failed ? NULL : data;
+    if (failed)
+        free(data);
+    else if (!p)
+        p = (char*)calloc(1, 1);
+    data   = NULL;
+    len    = 0;
+    size   = 0;
+    failed = false;
+    return p;
+}
@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+
+#include <stddef.h>
+
+// A string that is appended to in place, growing by doubling so that
+// building it takes time linear in its length. Once an allocation fails the
+// builder stops appending and Failed() returns true.
+class StringBuilder {
+public:
+	StringBuilder(size_t capacity = 0);
+	~StringBuilder();
+
+	void Append(const char* s);
+	void Append(const char* s, size_t len);
+	void Append(char c);
+
+	// Appends the strings with sep between them
+	void Join(const char* const* strs, int count, char sep);
+
+	// The string so far, never NULL
+	const char* Get() const { return data ? data : ""; }
+	size_t Length() const { return len; }
+	bool Failed() const { return failed; }
+
+	// Hands the string to the caller (to free), NULL if building it failed
+	char* Detach();
+
+private:
+	bool Reserve(size_t extra);
+
+	char* data;
+	size_t len;
+	size_t size;
+	bool failed;
+};
+
+#endif // STRING_BUILDER_H
@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Timing.h"
+#include "PhaseTimes.h"
+#include "Log.h"
+#include "INI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    bool             g_initialized = false;
+    CRITICAL_SECTION g_lock;
+    LARGE_INTEGER    g_origin;
+    double           g_ticksPerMilli = 1;
+    PhaseTimes       g_times;
+    PhaseLaunch      g_launch;
+    char             g_started[32];
+    char             g_module[MAX_PATH];
+    char*            g_sink = NULL;
+    int              g_format = PHASE_TIMES_JSON;
+}
+
+static ULONGLONG ToULL(const FILETIME& ft)
+{
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// Drops the line end; the log adds its own
+static void TrimLine(char* line)
+{
+    size_t len = line ? strlen(line) : 0;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = 0;
+}
+
+void Timing::Init()
+{
+    if (g_initialized)
+        return;
+
+    InitializeCriticalSection(&g_lock);
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&g_origin);
+    g_ticksPerMilli = (double)freq.QuadPart / 1000.0;
+
+    FILETIME now, creation, exit, kernel, user;
+    SYSTEMTIME st;
+    GetSystemTimeAsFileTime(&now);
+    FileTimeToSystemTime(&now, &st);
+    sprintf_s(g_started, sizeof(g_started), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+              st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+    GetModuleFileNameA(NULL, g_module, MAX_PATH);
+
+    g_launch.pid     = GetCurrentProcessId();
+    g_launch.started = g_started;
+    g_launch.module  = g_module;
+
+    // Loading the exe and its DLLs happens before the launcher has a clock
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user) && ToULL(now) > ToULL(creation)) {
+        double loading = (double)(ToULL(now) - ToULL(creation)) / 10000.0;
+        g_times.Add("process", -loading, loading);
+    }
+
+    g_initialized = true;
+}
+
+void Timing::SetSink(dictionary* ini)
+{
+    char* sink = iniparser_getstr(ini, (char*)STARTUP_TIMING);
+    char* format = iniparser_getstr(ini, (char*)STARTUP_TIMING_FORMAT);
+    if (!g_initialized || !sink)
+        return;
+
+    EnterCriticalSection(&g_lock);
+    free(g_sink);
+    g_sink = _strdup(sink);
+    g_format = format && _stricmp(format, "csv") == 0 ? PHASE_TIMES_CSV : PHASE_TIMES_JSON;
+    LeaveCriticalSection(&g_lock);
+}
+
+double Timing::Now()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart - g_origin.QuadPart) / g_ticksPerMilli;
+}
+
+void Timing::Begin(const char* phase)
+{
+    if (!g_initialized)
+        return;
+    EnterCriticalSection(&g_lock);
+    g_times.Begin(phase, Now());
+    LeaveCriticalSection(&g_lock);
+}
+
+void Timing::End(const char* phase)
+{
+    if (!g_initialized)
+        return;
+    EnterCriticalSection(&g_lock);
+    g_times.End(phase, Now());
+    LeaveCriticalSection(&g_lock);
+}
+
+void Timing::Mark(const char* phase)
+{
+    if (!g_initialized)
+        return;
+    EnterCriticalSection(&g_lock);
+    g_times.Mark(phase, Now());
+    LeaveCriticalSection(&g_lock);
+}
+
+void Timing::Flush()
+{
+    if (!g_initialized)
+        return;
+
+    EnterCriticalSection(&g_lock);
+    if (!g_sink || g_times.GetUnwritten() == 0) {
+        LeaveCriticalSection(&g_lock);
+        return;
+    }
+
+    // Each flush is one write, so launches appending to the same file at
+    // the same time do not mix their lines
+    HANDLE file = INVALID_HANDLE_VALUE;
+    bool toLog = _stricmp(g_sink, "log") == 0;
+    bool header = false;
+    if (!toLog) {
+        file = CreateFileA(g_sink, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        header = file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size) && size.QuadPart == 0;
+    }
+
+    StringBuilder out;
+    g_times.Format(out, g_format, g_launch, true, header);
+    g_times.SetWritten();
+    LeaveCriticalSection(&g_lock);
+
+    if (toLog) {
+        char* line = out.Detach();
+        TrimLine(line);
+        if (line)
+            Log::InfoLong("Startup timing: ", line);
+        free(line);
+    } else if (file == INVALID_HANDLE_VALUE) {
+        Log::Warning("Could not write startup timing to %s", g_sink);
+    } else {
+        DWORD written;
+        WriteFile(file, out.Get(), (DWORD)out.Length(), &written, NULL);
+        CloseHandle(file);
+    }
+}
+
+char* Timing::GetJSON()
+{
+    if (!g_initialized)
+        return NULL;
+
+    StringBuilder out;
+    EnterCriticalSection(&g_lock);
+    g_times.Format(out, PHASE_TIMES_JSON, g_launch, false, false);
+    LeaveCriticalSection(&g_lock);
+
+    char* json = out.Detach();
+    TrimLine(json);
+    return json;
+}
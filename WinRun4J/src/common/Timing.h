@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "Runtime.h"
+#include "Dictionary.h"
+
+// Where the times of the launch phases go: a file the launch is appended to,
+// or "log". The format is "json" (one line per launch) or "csv".
+#define STARTUP_TIMING        ":startup.timing"
+#define STARTUP_TIMING_FORMAT ":startup.timing.format"
+
+// Times the phases of the launch from when the launcher started, on the
+// high resolution clock. Phases may be timed from any thread.
+struct Timing {
+	static void Init();
+	static void SetSink(dictionary* ini);
+
+	// Milliseconds since Init
+	static double Now();
+
+	static void Begin(const char* phase);
+	static void End(const char* phase);
+	static void Mark(const char* phase);
+
+	// Writes the phases finished since the last flush to the sink, once the
+	// launch is up (the main method about to be called, or the first
+	// service or DDE callback) and again as it ends, for the phases that
+	// were still running on other threads
+	static void Flush();
+
+	// Every phase so far as a JSON line, for Java (to free)
+	static char* GetJSON();
+};
+
+#endif // TIMING_H
@@ -0,0 +1,476 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "ClassIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Zip records, see the PKWARE APPNOTE
+#define ZIP_END_SIG         0x06054b50
+#define ZIP_END_SIZE        22
+#define ZIP_MAX_COMMENT     65535
+#define ZIP64_LOCATOR_SIG   0x07064b50
+#define ZIP64_LOCATOR_SIZE  20
+#define ZIP64_END_SIG       0x06064b50
+#define ZIP64_END_SIZE      56
+#define ZIP_CENTRAL_SIG     0x02014b50
+#define ZIP_CENTRAL_SIZE    46
+
+#define MIN_JARS     64
+#define MIN_ENTRIES  256
+#define MIN_STRINGS  16384
+
+struct ClassIndexEntry {
+    unsigned name;
+    int      len;
+    unsigned hash;
+    int*     jars;
+    int      count;
+    int      size;
+};
+
+static inline unsigned Read16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline unsigned Read32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static inline unsigned long long Read64(const unsigned char* p)
+{
+    return Read32(p) | ((unsigned long long)Read32(p + 4) << 32);
+}
+
+// FNV-1a, with the high bits folded in as the table uses the low ones
+static unsigned Hash(const char* s, int len)
+{
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+    return hash ^ (hash >> 16);
+}
+
+// Compares a stored name with a key that is not terminated
+static int CompareName(const char* name, const char* key, int len)
+{
+    int c = strncmp(name, key, len);
+    return c ? c : (unsigned char)name[len];
+}
+
+static inline size_t Align(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+ClassIndex::ClassIndex() :
+    header(NULL), jars(NULL), packages(NULL), refs(NULL), base(NULL), owned(NULL),
+    newJars(NULL), jarCount(0), jarSize(0), entries(NULL), entryCount(0), entrySize(0),
+    table(NULL), tableSize(0), strings(NULL), stringLen(0), stringSize(0), failed(false)
+{
+}
+
+ClassIndex::~ClassIndex()
+{
+    for (int i = 0; i < entryCount; i++)
+        free(entries[i].jars);
+    free(entries);
+    free(table);
+    free(newJars);
+    free(strings);
+    free(owned);
+}
+
+int ClassIndex::Store(const char* s, int len)
+{
+    if (stringLen + len + 1 > stringSize) {
+        int size = stringSize ? stringSize : MIN_STRINGS;
+        while (stringLen + len + 1 > size)
+            size *= 2;
+        char* p = (char*)realloc(strings, size);
+        if (!p) {
+            failed = true;
+            return -1;
+        }
+        strings = p;
+        stringSize = size;
+    }
+    memcpy(&strings[stringLen], s, len);
+    strings[stringLen + len] = 0;
+    stringLen += len + 1;
+    return stringLen - len - 1;
+}
+
+int ClassIndex::AddJar(const char* path, unsigned long long size, unsigned long long time)
+{
+    if (jarCount == jarSize) {
+        int n = jarSize ? jarSize * 2 : MIN_JARS;
+        ClassIndexJar* p = (ClassIndexJar*)realloc(newJars, n * sizeof(ClassIndexJar));
+        if (!p) {
+            failed = true;
+            return -1;
+        }
+        newJars = p;
+        jarSize = n;
+    }
+
+    int offset = Store(path, (int)strlen(path));
+    if (offset < 0)
+        return -1;
+
+    ClassIndexJar& jar = newJars[jarCount];
+    jar.path = (unsigned)offset;
+    jar.indexed = 1;
+    jar.size = size;
+    jar.time = time;
+    return jarCount++;
+}
+
+void ClassIndex::SetUnindexed(int jar)
+{
+    if (jar >= 0 && jar < jarCount)
+        newJars[jar].indexed = 0;
+}
+
+// Finds or adds a package in the hash table, -1 if out of memory
+int ClassIndex::Intern(const char* name, int len, unsigned hash)
+{
+    if (entryCount * 2 >= tableSize) {
+        int size = tableSize ? tableSize * 2 : MIN_ENTRIES * 2;
+        int* t = (int*)malloc(size * sizeof(int));
+        if (!t) {
+            failed = true;
+            return -1;
+        }
+        memset(t, -1, size * sizeof(int));
+        for (int i = 0; i < entryCount; i++) {
+            int slot = entries[i].hash & (size - 1);
+            while (t[slot] >= 0)
+                slot = (slot + 1) & (size - 1);
+            t[slot] = i;
+        }
+        free(table);
+        table = t;
+        tableSize = size;
+    }
+
+    int slot = hash & (tableSize - 1);
+    for (; table[slot] >= 0; slot = (slot + 1) & (tableSize - 1)) {
+        ClassIndexEntry& e = entries[table[slot]];
+        if (e.hash == hash && e.len == len && !memcmp(&strings[e.name], name, len))
+            return table[slot];
+    }
+
+    if (entryCount == entrySize) {
+        int n = entrySize ? entrySize * 2 : MIN_ENTRIES;
+        ClassIndexEntry* p = (ClassIndexEntry*)realloc(entries, n * sizeof(ClassIndexEntry));
+        if (!p) {
+            failed = true;
+            return -1;
+        }
+        entries = p;
+        entrySize = n;
+    }
+
+    int offset = Store(name, len);
+    if (offset < 0)
+        return -1;
+
+    ClassIndexEntry& e = entries[entryCount];
+    e.name = (unsigned)offset;
+    e.len = len;
+    e.hash = hash;
+    e.jars = NULL;
+    e.count = 0;
+    e.size = 0;
+    table[slot] = entryCount;
+    return entryCount++;
+}
+
+void ClassIndex::AddPackage(int jar, const char* name, int len)
+{
+    if (jar < 0 || jar >= jarCount)
+        return;
+
+    int i = Intern(name, len, Hash(name, len));
+    if (i < 0)
+        return;
+
+    // Jars are added in order, so a repeat is always the last one
+    ClassIndexEntry& e = entries[i];
+    if (e.count > 0 && e.jars[e.count - 1] == jar)
+        return;
+
+    if (e.count == e.size) {
+        int n = e.size ? e.size * 2 : 2;
+        int* p = (int*)realloc(e.jars, n * sizeof(int));
+        if (!p) {
+            failed = true;
+            return;
+        }
+        e.jars = p;
+        e.size = n;
+    }
+    e.jars[e.count++] = jar;
+}
+
+/*
+ * Walks the central directory, found from the end of central directory
+ * record (or its zip64 form) at the end of the file. Every directory that
+ * holds a file is a package, except META-INF which the class loader never
+ * looks in for classes.
+ */
+bool ClassIndex::AddZip(int jar, const unsigned char* data, size_t size)
+{
+    if (!data || size < ZIP_END_SIZE) {
+        SetUnindexed(jar);
+        return false;
+    }
+
+    size_t min = size > ZIP_END_SIZE + ZIP_MAX_COMMENT ? size - ZIP_END_SIZE - ZIP_MAX_COMMENT : 0;
+    size_t end = size - ZIP_END_SIZE;
+    while (Read32(&data[end]) != ZIP_END_SIG) {
+        if (end == min) {
+            SetUnindexed(jar);
+            return false;
+        }
+        end--;
+    }
+
+    unsigned long long dirSize = Read32(&data[end + 12]);
+    unsigned long long dirOffset = Read32(&data[end + 16]);
+    if (dirSize == 0xFFFFFFFF || dirOffset == 0xFFFFFFFF) {
+        const unsigned char* loc = end >= ZIP64_LOCATOR_SIZE ? &data[end - ZIP64_LOCATOR_SIZE] : NULL;
+        unsigned long long rec = loc && Read32(loc) == ZIP64_LOCATOR_SIG ? Read64(loc + 8) : size;
+        if (size < ZIP64_END_SIZE || rec > size - ZIP64_END_SIZE || Read32(&data[rec]) != ZIP64_END_SIG) {
+            SetUnindexed(jar);
+            return false;
+        }
+        dirSize = Read64(&data[rec + 40]);
+        dirOffset = Read64(&data[rec + 48]);
+    }
+
+    if (dirOffset > end || dirSize > end - dirOffset) {
+        SetUnindexed(jar);
+        return false;
+    }
+
+    // Entries of a package are usually together, so skip repeats cheaply
+    const unsigned char* p = &data[dirOffset];
+    const unsigned char* last = p + dirSize;
+    const char* prev = NULL;
+    int prevLen = -1;
+    while (p + ZIP_CENTRAL_SIZE <= last && Read32(p) == ZIP_CENTRAL_SIG) {
+        int nameLen = Read16(p + 28);
+        size_t entryLen = ZIP_CENTRAL_SIZE + nameLen + Read16(p + 30) + Read16(p + 32);
+        if ((size_t)(last - p) < entryLen)
+            break;
+
+        const char* name = (const char*)p + ZIP_CENTRAL_SIZE;
+        p += entryLen;
+
+        int len = nameLen;
+        while (len > 0 && name[len - 1] != '/')
+            len--;
+        if (len == nameLen)
+            continue;	// A directory entry
+        if (len > 0)
+            len--;
+
+        if (len == prevLen && !memcmp(name, prev, len))
+            continue;
+        prev = name;
+        prevLen = len;
+
+        if ((len == 8 || (len > 8 && name[8] == '/')) && !memcmp(name, "META-INF", 8))
+            continue;
+        AddPackage(jar, name, len);
+    }
+
+    return !failed;
+}
+
+static ClassIndexEntry* g_sortEntries;
+static const char* g_sortStrings;
+
+static int ComparePackages(const void* a, const void* b)
+{
+    return strcmp(&g_sortStrings[g_sortEntries[*(const int*)a].name],
+                  &g_sortStrings[g_sortEntries[*(const int*)b].name]);
+}
+
+bool ClassIndex::Build()
+{
+    if (failed)
+        return false;
+
+    int* order = (int*)malloc((entryCount + 1) * sizeof(int));
+    if (!order)
+        return false;
+    for (int i = 0; i < entryCount; i++)
+        order[i] = i;
+    g_sortEntries = entries;
+    g_sortStrings = strings;
+    qsort(order, entryCount, sizeof(int), ComparePackages);
+
+    unsigned refCount = 0, unindexed = 0;
+    for (int i = 0; i < entryCount; i++)
+        refCount += entries[i].count;
+    for (int i = 0; i < jarCount; i++)
+        unindexed += newJars[i].indexed ? 0 : 1;
+    refCount += unindexed;
+
+    size_t jarOffset = Align(sizeof(ClassIndexHeader));
+    size_t packageOffset = jarOffset + jarCount * sizeof(ClassIndexJar);
+    size_t refOffset = packageOffset + entryCount * sizeof(ClassIndexPackage);
+    size_t stringOffset = refOffset + refCount * sizeof(unsigned);
+    size_t size = stringOffset + stringLen;
+    if (size > 0xFFFFFFFF) {
+        free(order);
+        return false;
+    }
+
+    unsigned char* block = (unsigned char*)calloc(1, size);
+    if (!block) {
+        free(order);
+        return false;
+    }
+
+    ClassIndexHeader* h = (ClassIndexHeader*)block;
+    h->magic = CLASS_INDEX_MAGIC;
+    h->version = CLASS_INDEX_VERSION;
+    h->size = (unsigned)size;
+    h->jars = jarCount;
+    h->packages = entryCount;
+    h->refs = refCount;
+    h->unindexed = unindexed;
+
+    // Offsets of strings are from the start of the block
+    ClassIndexJar* j = (ClassIndexJar*)&block[jarOffset];
+    for (int i = 0; i < jarCount; i++) {
+        j[i] = newJars[i];
+        j[i].path += (unsigned)stringOffset;
+    }
+
+    ClassIndexPackage* pk = (ClassIndexPackage*)&block[packageOffset];
+    unsigned* r = (unsigned*)&block[refOffset];
+    unsigned ref = 0;
+    for (int i = 0; i < entryCount; i++) {
+        ClassIndexEntry& e = entries[order[i]];
+        pk[i].name = e.name + (unsigned)stringOffset;
+        pk[i].first = ref;
+        pk[i].count = e.count;
+        for (int k = 0; k < e.count; k++)
+            r[ref++] = e.jars[k];
+    }
+    for (int i = 0; i < jarCount; i++) {
+        if (!newJars[i].indexed)
+            r[ref++] = i;
+    }
+    memcpy(&block[stringOffset], strings, stringLen);
+    free(order);
+
+    for (int i = 0; i < entryCount; i++)
+        free(entries[i].jars);
+    free(entries);
+    free(table);
+    free(newJars);
+    free(strings);
+    entries = NULL;
+    table = NULL;
+    newJars = NULL;
+    strings = NULL;
+    entryCount = entrySize = tableSize = jarCount = jarSize = stringLen = stringSize = 0;
+
+    free(owned);
+    owned = block;
+    if (!Attach(block, size)) {
+        owned = NULL;
+        free(block);
+        return false;
+    }
+    return true;
+}
+
+bool ClassIndex::Attach(const void* data, size_t size)
+{
+    const ClassIndexHeader* h = (const ClassIndexHeader*)data;
+    if (!h || size < sizeof(ClassIndexHeader) || h->magic != CLASS_INDEX_MAGIC ||
+        h->version != CLASS_INDEX_VERSION || h->size != size)
+        return false;
+
+    // Everything has to fit, and the last string must be terminated
+    size_t jarOffset = Align(sizeof(ClassIndexHeader));
+    size_t packageOffset = jarOffset + (size_t)h->jars * sizeof(ClassIndexJar);
+    size_t refOffset = packageOffset + (size_t)h->packages * sizeof(ClassIndexPackage);
+    size_t stringOffset = refOffset + (size_t)h->refs * sizeof(unsigned);
+    const unsigned char* block = (const unsigned char*)data;
+    if (h->jars > size || h->packages > size || h->refs > size || h->unindexed > h->refs ||
+        stringOffset > size || (stringOffset < size && block[size - 1] != 0))
+        return false;
+
+    const ClassIndexJar* j = (const ClassIndexJar*)&block[jarOffset];
+    const ClassIndexPackage* pk = (const ClassIndexPackage*)&block[packageOffset];
+    const unsigned* r = (const unsigned*)&block[refOffset];
+    for (unsigned i = 0; i < h->jars; i++) {
+        if (j[i].path < stringOffset || j[i].path >= size)
+            return false;
+    }
+    for (unsigned i = 0; i < h->packages; i++) {
+        if (pk[i].name < stringOffset || pk[i].name >= size || pk[i].first > h->refs ||
+            pk[i].count > h->refs - pk[i].first)
+            return false;
+    }
+    for (unsigned i = 0; i < h->refs; i++) {
+        if (r[i] >= h->jars)
+            return false;
+    }
+
+    header = h;
+    jars = j;
+    packages = pk;
+    refs = r;
+    base = (const char*)block;
+    if (owned != data) {
+        free(owned);
+        owned = NULL;
+    }
+    return true;
+}
+
+int ClassIndex::Find(const char* package, int len, const unsigned** found) const
+{
+    *found = NULL;
+    if (!header)
+        return 0;
+
+    int lo = 0, hi = (int)header->packages - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int c = CompareName(base + packages[mid].name, package, len);
+        if (c == 0) {
+            *found = &refs[packages[mid].first];
+            return (int)packages[mid].count;
+        }
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return 0;
+}
+
+int ClassIndex::GetUnindexed(const unsigned** found) const
+{
+    *found = header ? &refs[header->refs - header->unindexed] : NULL;
+    return header ? (int)header->unindexed : 0;
+}
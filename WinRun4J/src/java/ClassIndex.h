@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef CLASS_INDEX_H
+#define CLASS_INDEX_H
+
+#include <stddef.h>
+
+// Maps each package on the classpath to the jars that hold it, much like the
+// META-INF/INDEX.LIST the jar tool can generate, so a class is looked up in
+// the right jar instead of probing them in turn. Package names come from the
+// central directory at the end of each jar; the rest of the jar is not read.
+//
+// A built index is one block of memory: the header, the jars, the packages
+// sorted by name, the jar numbers of each package and then the strings. The
+// block is saved to the cache as is and read straight from a mapped view.
+// Once built it is never changed, so any number of threads can read it.
+
+#define CLASS_INDEX_MAGIC   0x584A3457	// "W4JX"
+#define CLASS_INDEX_VERSION 1
+
+struct ClassIndexHeader {
+	unsigned magic;
+	unsigned version;
+	unsigned size;			// Bytes in the block
+	unsigned jars;
+	unsigned packages;
+	unsigned refs;			// Jar numbers, the unindexed jars are last
+	unsigned unindexed;
+};
+
+struct ClassIndexJar {
+	unsigned path;			// Offset of the path
+	unsigned indexed;		// 0 for a directory or a jar that could not be read
+	unsigned long long size;	// Stamps of the jar, as given to AddJar
+	unsigned long long time;
+};
+
+struct ClassIndexPackage {
+	unsigned name;			// Offset of the name, eg. org/boris/winrun4j
+	unsigned first;			// First of its jar numbers
+	unsigned count;
+};
+
+struct ClassIndexEntry;
+
+class ClassIndex {
+public:
+	ClassIndex();
+	~ClassIndex();
+
+	// Adds a classpath entry, in classpath order, and returns its number
+	int AddJar(const char* path, unsigned long long size, unsigned long long time);
+
+	// Adds the packages of a jar from the whole file (only the central
+	// directory is touched). Returns false, leaving the jar unindexed, if the
+	// file is not a zip.
+	bool AddZip(int jar, const unsigned char* data, size_t size);
+
+	// Adds a package of a jar, eg. from a listing of a directory
+	void AddPackage(int jar, const char* name, int len);
+
+	// A directory or unreadable jar, which may hold any package
+	void SetUnindexed(int jar);
+
+	// Lays out the block. The jars and packages added are released.
+	bool Build();
+
+	// Reads a block built before (eg. a mapped cache file), which is checked
+	// but not copied, so it must outlive the index
+	bool Attach(const void* data, size_t size);
+
+	const void* GetData() const { return header; }
+	unsigned GetSize() const { return header ? header->size : 0; }
+
+	int GetJarCount() const { return header ? (int)header->jars : 0; }
+	const char* GetJar(int i) const { return base + jars[i].path; }
+	const ClassIndexJar& GetJarStamp(int i) const { return jars[i]; }
+	int GetPackageCount() const { return header ? (int)header->packages : 0; }
+
+	// Sets jars to the numbers of the jars holding package (eg. java/lang,
+	// or "" for the default package), in classpath order, and returns how
+	// many there are
+	int Find(const char* package, int len, const unsigned** jars) const;
+
+	// Entries that have to be searched for every package
+	int GetUnindexed(const unsigned** jars) const;
+
+private:
+	int Intern(const char* name, int len, unsigned hash);
+	int Store(const char* s, int len);
+
+	// Block being read
+	const ClassIndexHeader* header;
+	const ClassIndexJar* jars;
+	const ClassIndexPackage* packages;
+	const unsigned* refs;
+	const char* base;
+	void* owned;
+
+	// Index being built
+	ClassIndexJar* newJars;
+	int jarCount;
+	int jarSize;
+	ClassIndexEntry* entries;
+	int entryCount;
+	int entrySize;
+	int* table;
+	int tableSize;
+	char* strings;
+	int stringLen;
+	int stringSize;
+	bool failed;
+};
+
+#endif // CLASS_INDEX_H
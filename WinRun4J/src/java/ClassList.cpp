@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "ClassList.h"
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned HashName(const char* name, size_t len)
+{
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Hidden and anonymous classes (Foo$$Lambda/0x0800c02a00, LambdaForm$MH/123)
+// have a segment no source class can have, starting with a digit
+static bool IsLoadableName(const char* name, size_t len)
+{
+    if (len == 0 || name[0] == '[')
+        return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c == ';' || c == '.' || c == '[' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            return false;
+        if (c == '/' && (i + 1 == len || (name[i + 1] >= '0' && name[i + 1] <= '9')))
+            return false;
+    }
+    for (size_t i = 0; i + 8 <= len; i++) {
+        if (!memcmp(&name[i], "$$Lambda", 8))
+            return false;
+    }
+    return true;
+}
+
+ClassList::ClassList() : names(NULL), count(0), capacity(0), slots(NULL), slotCount(0)
+{
+}
+
+ClassList::~ClassList()
+{
+    for (int i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+    free(slots);
+}
+
+// Keeps the table no more than half full
+bool ClassList::Grow()
+{
+    if (count == capacity) {
+        int grown = capacity ? capacity * 2 : 256;
+        char** more = (char**)realloc(names, sizeof(char*) * grown);
+        if (!more)
+            return false;
+        names = more;
+        capacity = grown;
+    }
+
+    if ((count + 1) * 2 <= slotCount)
+        return true;
+
+    int grownSlots = slotCount ? slotCount * 2 : 512;
+    int* more = (int*)calloc(grownSlots, sizeof(int));
+    if (!more)
+        return false;
+    for (int i = 0; i < count; i++) {
+        unsigned s = HashName(names[i], strlen(names[i])) & (grownSlots - 1);
+        while (more[s])
+            s = (s + 1) & (grownSlots - 1);
+        more[s] = i + 1;
+    }
+    free(slots);
+    slots = more;
+    slotCount = grownSlots;
+    return true;
+}
+
+bool ClassList::Add(const char* name, size_t len)
+{
+    if (!name || !IsLoadableName(name, len) || !Grow())
+        return false;
+
+    unsigned s = HashName(name, len) & (slotCount - 1);
+    for (; slots[s]; s = (s + 1) & (slotCount - 1)) {
+        const char* other = names[slots[s] - 1];
+        if (!strncmp(other, name, len) && other[len] == 0)
+            return false;
+    }
+
+    char* copy = (char*)malloc(len + 1);
+    if (!copy)
+        return false;
+    memcpy(copy, name, len);
+    copy[len] = 0;
+    names[count++] = copy;
+    slots[s] = count;
+    return true;
+}
+
+bool ClassList::Record(const char* signature)
+{
+    size_t len = signature ? strlen(signature) : 0;
+    if (len < 3 || signature[0] != 'L' || signature[len - 1] != ';')
+        return false;
+    return Add(signature + 1, len - 2);
+}
+
+int ClassList::Parse(const char* data, size_t len)
+{
+    int added = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t start = i;
+        while (i < len && data[i] != '\n')
+            i++;
+        size_t end = i++;
+        while (start < end && (data[start] == ' ' || data[start] == '\t'))
+            start++;
+        while (end > start && (data[end - 1] == '\r' || data[end - 1] == ' ' || data[end - 1] == '\t'))
+            end--;
+        if (end > start && data[start] != '#' && Add(&data[start], end - start))
+            added++;
+    }
+    return added;
+}
+
+void ClassList::Format(StringBuilder& out) const
+{
+    out.Append("# Classes loaded at startup, in order\r\n");
+    for (int i = 0; i < count; i++) {
+        out.Append(names[i]);
+        out.Append("\r\n");
+    }
+}
+
+void ClassList::ToBinaryName(const char* name, char* out, size_t len)
+{
+    if (len == 0)
+        return;
+    size_t i = 0;
+    for (; name[i] && i + 1 < len; i++)
+        out[i] = name[i] == '/' ? '.' : name[i];
+    out[i] = 0;
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef CLASS_LIST_H
+#define CLASS_LIST_H
+
+#include <stddef.h>
+#include "../common/StringBuilder.h"
+
+// The classes a launch loaded, in the order it loaded them, as internal
+// names (java/lang/String), one per line. This file has no Windows or JNI
+// dependencies.
+
+class ClassList {
+public:
+	ClassList();
+	~ClassList();
+
+	// A class by its JVM signature (Ljava/lang/String;). Classes that cannot
+	// be loaded by name (arrays, lambdas and other hidden classes) and ones
+	// already listed are left out. False if it was not added.
+	bool Record(const char* signature);
+
+	// A class by its internal name, as read back from a list
+	bool Add(const char* name, size_t len);
+
+	// Lines of a saved list; blank lines and # comments are skipped
+	int Parse(const char* data, size_t len);
+	void Format(StringBuilder& out) const;
+
+	int GetCount() const { return count; }
+	const char* Get(int i) const { return i >= 0 && i < count ? names[i] : NULL; }
+
+	// The binary name Class.forName takes (java.lang.String)
+	static void ToBinaryName(const char* name, char* out, size_t len);
+
+private:
+	bool Grow();
+
+	char** names;
+	int count;
+	int capacity;
+	int* slots;         // Open addressed, index + 1 of each name
+	int slotCount;
+};
+
+#endif // CLASS_LIST_H
@@ -12,219 +12,558 @@
 #include "../common/Log.h"
 #include "../common/Dictionary.h"
 #include "../common/Runtime.h"
+#include "../common/Cache.h"
+#include "../common/StringBuilder.h"
+#include "ClassIndex.h"
+#include "Glob.h"
 
 #include <windows.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+
+#define CLASS_PATH_CACHE_EXT     "cpcache"
+#define CLASS_PATH_CACHE_MAGIC   MAKEFOURCC('W','4','J','P')
+#define CLASS_PATH_CACHE_VERSION 1
+#define CLASS_PATH_INDEX_EXT     "cpindex"
+
+// One classpath entry and its matches
+struct ClasspathEntry {
+    char         path[MAX_PATH];
+    int          task;
+    const char** matches;   // owned by the task's glob
+    int          count;
+    LONGLONG     ticks;
+};
+
+// A directory that was listed or a path that was tested, and its time then
+struct ClasspathInput {
+    const char* path;
+    bool        listed;
+    ULONGLONG   time;
+};
+
+// Entries that may list the same directory are expanded together
+struct ClasspathTask {
+    Glob*           glob;
+    ClasspathInput* inputs;
+    int             inputCount;
+    int             inputSize;
+    bool            failed;
+};
+
+struct ClasspathWork {
+    ClasspathEntry* entries;
+    int             entryCount;
+    ClasspathTask*  tasks;
+    int             taskCount;
+    volatile LONG   next;
+};
+
+// Package index of the classpath, built by the first lookup from Java so a
+// launch that never asks does not pay for it
+static char*            g_indexClasspath = NULL;
+static char             g_indexFile[MAX_PATH];
+static bool             g_hasIndexFile = false;
+static bool             g_indexLoaded = false;
+static ClassIndex*      g_classIndex = NULL;
+static CRITICAL_SECTION g_indexLock;
+
+// The last write time of a directory, which changes when an entry is added,
+// removed or renamed. Other paths only record that they exist (0).
+static ULONGLONG GetPathTime(const char* path, bool listed)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fad))
+        return CACHE_MISSING;
+    if (!listed)
+        return 0;
+    return ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+}
 
-namespace
+static ULONGLONG AddInput(ClasspathTask* task, const char* path, bool listed)
 {
-    bool g_classpathMaxWarned = false;
+    ULONGLONG time = GetPathTime(path, listed);
+    if (task->inputCount == task->inputSize) {
+        int size = task->inputSize ? task->inputSize * 2 : 16;
+        ClasspathInput* p = (ClasspathInput*)realloc(task->inputs, size * sizeof(ClasspathInput));
+        if (!p) {
+            task->failed = true;
+            return time;
+        }
+        task->inputs    = p;
+        task->inputSize = size;
+    }
+
+    ClasspathInput* input = &task->inputs[task->inputCount++];
+    input->path   = path;
+    input->listed = listed;
+    input->time   = time;
+    return time;
 }
 
-static void ExpandClassPathEntry(char* arg, char*** result, int* count)
+static bool ListDirectory(void* ctx, const char* dir, GlobListing& listing)
 {
-    Log::Info("Expanding Classpath: %s", arg);
+    // The time is taken first so that a change while listing is seen next time
+    if (AddInput((ClasspathTask*)ctx, dir, true) == CACHE_MISSING)
+        return false;
 
-    char fullpath[MAX_PATH];
-    GetFullPathNameA(arg, MAX_PATH, fullpath, NULL);
+    char search[MAX_PATH];
+    int len = (int)strlen(dir);
+    if (sprintf_s(search, sizeof(search), len && dir[len - 1] == '\\' ? "%s*" : "%s\\*", dir) < 0)
+        return false;
 
+    // Basic info and large fetches need Windows 7, fall back without them
     WIN32_FIND_DATAA fd;
-    WIN32_FIND_DATAA fdcheck;
-
-    // No wildcard -> direct file check
-    if (strchr(arg, '*') == NULL) {
-        HANDLE h = FindFirstFileA(fullpath, &fd);
-        if (h != INVALID_HANDLE_VALUE) {
+    HANDLE h = FindFirstFileExA(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE && GetLastError() == ERROR_INVALID_PARAMETER)
+        h = FindFirstFileA(search, &fd);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    do {
+        listing.Add(fd.cFileName, (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    } while (FindNextFileA(h, &fd));
+
+    FindClose(h);
+    return true;
+}
 
-            char* dup = _strdup(fullpath);
-            if (!dup) {
-                FindClose(h);
-                return;
-            }
+static bool PathExists(void* ctx, const char* path)
+{
+    return AddInput((ClasspathTask*)ctx, path, false) != CACHE_MISSING;
+}
 
-            char** newArr = (char**)realloc(*result, sizeof(char*) * (*count + 1));
-            if (!newArr) {
-                free(dup);
-                FindClose(h);
-                return;
-            }
+static void ExpandTask(ClasspathWork* work, int t)
+{
+    GlobProvider provider = { ListDirectory, PathExists, &work->tasks[t] };
+    Glob* glob = new Glob(provider);
+    work->tasks[t].glob = glob;
 
-            *result = newArr;
-            (*result)[(*count)++] = dup;
+    for (int i = 0; i < work->entryCount; i++) {
+        ClasspathEntry* e = &work->entries[i];
+        if (e->task != t)
+            continue;
 
-            FindClose(h);
-            return;
-        }
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        int n = glob->Collect(e->path);
+        e->matches = n ? (const char**)malloc(n * sizeof(const char*)) : NULL;
+        e->count = e->matches ? n : 0;
+        for (int j = 0; j < e->count; j++)
+            e->matches[j] = glob->GetMatch(j);
+        QueryPerformanceCounter(&end);
+        e->ticks = end.QuadPart - start.QuadPart;
     }
+}
 
-    int len  = (int)strlen(fullpath);
-    int prev = 0;
-    bool hasStar = false;
-    char search[MAX_PATH];
-
-    for (int i = 0; i <= len; i++) {
-
-        if (fullpath[i] == '/' || fullpath[i] == '\\' || fullpath[i] == 0) {
-
-            if (hasStar) {
-                char saved = fullpath[i];
-                fullpath[i] = 0;
+// Takes tasks until there are none left
+static DWORD WINAPI ExpandThreadProc(LPVOID param)
+{
+    ClasspathWork* work = (ClasspathWork*)param;
+    for (;;) {
+        int t = InterlockedIncrement(&work->next) - 1;
+        if (t >= work->taskCount)
+            break;
+        ExpandTask(work, t);
+    }
+    return 0;
+}
 
-                HANDLE h = FindFirstFileA(fullpath, &fd);
-                if (h == INVALID_HANDLE_VALUE) {
-                    fullpath[i] = saved;
-                    return;
-                }
+// Expands the entries on up to the given number of threads, the main thread
+// included, and returns the classpath
+static char* ExpandClassPath(ClasspathWork& work, int threads)
+{
+    if (threads > CLASS_PATH_MAX_THREADS)
+        threads = CLASS_PATH_MAX_THREADS;
+    if (threads > work.taskCount)
+        threads = work.taskCount;
+
+    HANDLE handles[CLASS_PATH_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        HANDLE h = CreateThread(NULL, 0, ExpandThreadProc, &work, 0, NULL);
+        if (h)
+            handles[started++] = h;
+    }
+    ExpandThreadProc(&work);
+    if (started) {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        for (int i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+    }
 
-                do {
-                    if (prev != 0)
-                        fullpath[prev] = 0;
+    // Merge in the configured order, a path is only added once. This glob
+    // lists nothing itself.
+    GlobProvider provider = { ListDirectory, PathExists, NULL };
+    Glob glob(provider);
+    int listings = 0;
+    for (int i = 0; i < work.taskCount; i++) {
+        if (work.tasks[i].glob)
+            listings += work.tasks[i].glob->GetListings();
+    }
 
-                    strcpy_s(search, fullpath);
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    for (int i = 0; i < work.entryCount; i++) {
+        ClasspathEntry* e = &work.entries[i];
+        int added = 0;
+        for (int j = 0; j < e->count; j++) {
+            if (glob.Add(e->matches[j]))
+                added++;
+        }
+        Log::Info("Expanded Classpath: %s (%d found, %d added, %.1f ms)", e->path, e->count, added,
+                  e->ticks * 1000.0 / freq.QuadPart);
+    }
+    Log::Info("Classpath: %d entries, %d directories listed on %d threads", glob.GetCount(), listings,
+              started + 1);
 
-                    if (prev != 0)
-                        fullpath[prev] = '\\';
+    // Build: "entry1;entry2;entry3;..."
+    StringBuilder classpath;
+    for (int j = 0; j < glob.GetCount(); j++) {
+        if (j > 0)
+            classpath.Append(';');
+        classpath.Append(glob.Get(j));
+    }
 
-                    strcat_s(search, "\\");
-                    strcat_s(search, fd.cFileName);
+    return classpath.Detach();
+}
 
-                    // Only append remainder if it contains NO wildcard
-                    if (i < len - 1 && strchr(fullpath + i + 1, '*') == NULL) {
+static void FreeWork(ClasspathWork& work)
+{
+    // The paths belong to the task globs
+    for (int i = 0; i < work.entryCount; i++)
+        free(work.entries[i].matches);
+    for (int i = 0; i < work.taskCount; i++) {
+        free(work.tasks[i].inputs);
+        delete work.tasks[i].glob;
+    }
+    free(work.entries);
+    free(work.tasks);
+}
 
-                        HANDLE h2 = FindFirstFileA(search, &fdcheck);
-                        if (h2 != INVALID_HANDLE_VALUE) {
-                            bool isDir = (fdcheck.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-                            FindClose(h2);
+/*
+ * Classpath cache file layout: header, inputs, the offsets of the entries
+ * and then the strings, as in the INI cache. The cache is current while the
+ * entries are the same and every input has the time it was recorded with,
+ * which takes one stat per directory instead of a listing.
+ */
+struct ClasspathCacheHeader {
+    DWORD magic;
+    DWORD version;
+    DWORD size;
+    DWORD inputs;
+    DWORD entries;
+    DWORD classpath;
+};
+
+struct ClasspathCacheInput {
+    DWORD     path;
+    DWORD     listed;
+    ULONGLONG time;
+};
+
+static char* LoadCache(const char* cacheFile, const ClasspathWork& work)
+{
+    DWORD size;
+    const BYTE* view = Cache::Map(cacheFile, size);
+    if (!view)
+        return NULL;
+
+    const ClasspathCacheHeader* header = (const ClasspathCacheHeader*)view;
+    bool current = size >= sizeof(ClasspathCacheHeader) && header->magic == CLASS_PATH_CACHE_MAGIC &&
+        header->version == CLASS_PATH_CACHE_VERSION && header->size == size && view[size - 1] == 0 &&
+        sizeof(ClasspathCacheHeader) + (ULONGLONG)header->inputs * sizeof(ClasspathCacheInput) +
+        (ULONGLONG)header->entries * sizeof(DWORD) <= size && header->entries == (DWORD)work.entryCount;
+
+    const ClasspathCacheInput* inputs = (const ClasspathCacheInput*)&header[1];
+    const DWORD* entries = current ? (const DWORD*)&inputs[header->inputs] : NULL;
+    for (DWORD i = 0; current && i < header->entries; i++) {
+        const char* path = Cache::GetString(view, size, entries[i]);
+        current = path && !strcmp(path, work.entries[i].path);
+    }
+    for (DWORD i = 0; current && i < header->inputs; i++) {
+        const char* path = Cache::GetString(view, size, inputs[i].path);
+        current = path && GetPathTime(path, inputs[i].listed != 0) == inputs[i].time;
+    }
 
-                            if (isDir) {
-                                strcat_s(search, "\\");
-                                strcat_s(search, &fullpath[i + 1]);
-                            } else {
-                                continue;
-                            }
-                        }
-                    }
+    const char* classpath = current ? Cache::GetString(view, size, header->classpath) : NULL;
+    char* result = classpath ? _strdup(classpath) : NULL;
+    if (result)
+        Log::Info("Classpath loaded from cache: %s (%d paths checked)", cacheFile, header->inputs);
+    Cache::Unmap(view);
+    return result;
+}
 
-                    ExpandClassPathEntry(search, result, count);
+static void SaveCache(const char* cacheFile, const ClasspathWork& work, const char* classpath)
+{
+    int count = 0;
+    for (int i = 0; i < work.taskCount; i++) {
+        // What was seen is not known, so neither is when it changes
+        if (work.tasks[i].failed || !work.tasks[i].glob)
+            return;
+        count += work.tasks[i].inputCount;
+    }
 
-                } while (FindNextFileA(h, &fd));
+    ClasspathCacheInput* inputs  = (ClasspathCacheInput*)calloc(count + 1, sizeof(ClasspathCacheInput));
+    DWORD*               entries = (DWORD*)malloc((work.entryCount + 1) * sizeof(DWORD));
+    CacheBlob            blob    = { 0 };
 
-                FindClose(h);
-                fullpath[i] = saved;
-                return;
-            }
+    if (!inputs || !entries) {
+        free(inputs);
+        free(entries);
+        return;
+    }
 
-            hasStar = false;
-            prev = i;
-        }
-        else if (fullpath[i] == '*') {
-            hasStar = true;
+    // Offsets are relative to the strings until they are moved past the tables
+    DWORD base = (DWORD)(sizeof(ClasspathCacheHeader) + count * sizeof(ClasspathCacheInput) +
+                         work.entryCount * sizeof(DWORD));
+    int n = 0;
+    for (int i = 0; i < work.taskCount; i++) {
+        for (int j = 0; j < work.tasks[i].inputCount; j++, n++) {
+            const ClasspathInput* input = &work.tasks[i].inputs[j];
+            inputs[n].path   = Cache::AddString(blob, input->path) + base;
+            inputs[n].listed = input->listed;
+            inputs[n].time   = input->time;
         }
     }
+    for (int i = 0; i < work.entryCount; i++)
+        entries[i] = Cache::AddString(blob, work.entries[i].path) + base;
+    DWORD cp = Cache::AddString(blob, classpath) + base;
+
+    // The final NUL terminates the last string
+    Cache::AddString(blob, "");
+    BYTE* data = blob.failed ? NULL : (BYTE*)malloc(base + blob.len);
+    if (data) {
+        ClasspathCacheHeader header = { CLASS_PATH_CACHE_MAGIC, CLASS_PATH_CACHE_VERSION, base + blob.len,
+                                        (DWORD)count, (DWORD)work.entryCount, cp };
+        memcpy(data, &header, sizeof(header));
+        memcpy(&data[sizeof(header)], inputs, count * sizeof(ClasspathCacheInput));
+        memcpy(&data[sizeof(header) + count * sizeof(ClasspathCacheInput)], entries, work.entryCount * sizeof(DWORD));
+        memcpy(&data[base], blob.data, blob.len);
+        if (Cache::Write(cacheFile, data, header.size))
+            Log::Info("Saved classpath cache: %s", cacheFile);
+    }
+
+    free(data);
+    free(blob.data);
+    free(entries);
+    free(inputs);
 }
 
-void Classpath::BuildClassPath(dictionary* ini, char*** args, UINT& count)
+// Size and last write time of a classpath entry, and whether it is a directory
+static bool GetEntryStamp(const char* path, ULONGLONG& size, ULONGLONG& time)
 {
-    char currentDir[MAX_PATH];
-    char* workingDirectory = iniparser_getstr(ini, (char*)WORKING_DIR);
-
-    // Temporarily switch to INI directory if no working directory is set
-    if (!workingDirectory) {
-        GetCurrentDirectoryA(MAX_PATH, currentDir);
-        SetCurrentDirectoryA(iniparser_getstr(ini, (char*)INI_DIR));
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fad)) {
+        size = CACHE_MISSING;
+        time = 0;
+        return false;
     }
+    size = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    time = ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    return (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
 
-    // Dynamic list of expanded classpath entries
-    char** entries = NULL;
-    int    entryCount = 0;
+// The saved index is used while it has the same entries with the same stamps
+static bool IsIndexCurrent(const ClassIndex& index, char** paths, int count)
+{
+    if (index.GetJarCount() != count)
+        return false;
+
+    for (int i = 0; i < count; i++) {
+        ULONGLONG size, time;
+        GetEntryStamp(paths[i], size, time);
+        const ClassIndexJar& jar = index.GetJarStamp(i);
+        if (strcmp(index.GetJar(i), paths[i]) || jar.size != size || jar.time != time)
+            return false;
+    }
+    return true;
+}
 
-    int max = dictionary_find_max(ini, CLASS_PATH);
-    for (int i = 0; i <= max; i++) {
-        char entryName[MAX_PATH];
-        _snprintf_s(entryName, MAX_PATH, _TRUNCATE, "%s.%d", CLASS_PATH, i);
+/*
+ * Reads the package index of the classpath from the cache, or builds it from
+ * the central directory of each jar when an entry was added, removed or
+ * changed. Directories cannot be indexed and are searched for any package.
+ */
+static ClassIndex* LoadIndex(const char* cacheFile, const char* classpath)
+{
+    LARGE_INTEGER start, end, freq;
+    QueryPerformanceCounter(&start);
+
+    char* cp = _strdup(classpath);
+    char** paths = (char**)malloc((strlen(classpath) / 2 + 2) * sizeof(char*));
+    ClassIndex* index = new ClassIndex();
+    if (!cp || !paths || !index) {
+        free(cp);
+        free(paths);
+        delete index;
+        return NULL;
+    }
 
-        char* entry = iniparser_getstr(ini, entryName);
-        if (!entry)
-            continue;
+    int count = 0;
+    char* ctx = NULL;
+    for (char* token = strtok_s(cp, ";", &ctx); token; token = strtok_s(NULL, ";", &ctx))
+        paths[count++] = token;
+
+    // The cached index is kept mapped, it is read in place
+    DWORD size;
+    const BYTE* view = cacheFile ? Cache::Map(cacheFile, size) : NULL;
+    bool cached = view && index->Attach(view, size) && IsIndexCurrent(*index, paths, count);
+    if (!cached) {
+        Cache::Unmap(view);
+        delete index;
+        index = new ClassIndex();
+
+        for (int i = 0; index && i < count; i++) {
+            ULONGLONG jarSize, jarTime;
+            bool dir = GetEntryStamp(paths[i], jarSize, jarTime);
+            int jar = index->AddJar(paths[i], jarSize, jarTime);
+            if (dir) {
+                index->SetUnindexed(jar);
+            } else if (jarSize != CACHE_MISSING) {
+                DWORD jarLen;
+                const BYTE* jarView = Cache::Map(paths[i], jarLen);
+                if (!index->AddZip(jar, jarView, jarLen))
+                    Log::Warning("Could not index classpath entry: %s", paths[i]);
+                Cache::Unmap(jarView);
+            }
+        }
 
-        ExpandClassPathEntry(entry, &entries, &entryCount);
+        if (!index || !index->Build()) {
+            Log::Warning("Could not build classpath index");
+            delete index;
+            index = NULL;
+        } else if (cacheFile) {
+            Cache::Write(cacheFile, index->GetData(), index->GetSize());
+        }
     }
 
-    // entries[] contains entryCount strings
-    // Build: "entry1;entry2;entry3;..."
-
-    char* classpath = NULL;
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&freq);
+    if (index) {
+        Log::Info("Classpath index %s: %d entries, %d packages (%.1f ms)", cached ? "loaded" : "built",
+                  index->GetJarCount(), index->GetPackageCount(),
+                  (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+    }
 
-    /* -------------------------------
-       1) Compute total length needed
-       ------------------------------- */
-    size_t totalLen = 0;
+    free(paths);
+    free(cp);
+    return index;
+}
 
-    for (int j = 0; j < entryCount; j++) {
-        totalLen += strlen(entries[j]);
-        if (j < entryCount - 1)
-            totalLen += 1;   // semicolon
+void Classpath::BuildClassPath(dictionary* ini, char*** args, UINT& count)
+{
+    // Entries are relative to the INI directory if no working directory is
+    // set. They are joined onto it rather than changing the current
+    // directory, as the VM may be looked for at the same time.
+    char* workingDirectory = iniparser_getstr(ini, (char*)WORKING_DIR);
+    char* baseDir = workingDirectory ? NULL : iniparser_getstr(ini, (char*)INI_DIR);
+
+    // Numbered classpath entries, already in order, as full paths
+    int    cpCount = iniparser_getnumbered(ini, CLASS_PATH, 0, NULL, 0);
+    char** cp      = (char**)malloc(sizeof(char*) * (cpCount + 1));
+    cpCount = cp ? iniparser_getnumbered(ini, CLASS_PATH, 0, cp, cpCount) : 0;
+
+    ClasspathWork work = { NULL, 0, NULL, 0, 0 };
+    work.entries = (ClasspathEntry*)calloc(cpCount + 1, sizeof(ClasspathEntry));
+    for (int i = 0; work.entries && i < cpCount; i++) {
+        ClasspathEntry* e = &work.entries[work.entryCount];
+        DWORD len = GetFullPathFrom(baseDir, cp[i], e->path, MAX_PATH);
+        if (len == 0 || len >= MAX_PATH) {
+            Log::Warning("Invalid classpath entry: %s", cp[i]);
+            continue;
+        }
+        work.entryCount++;
     }
+    free(cp);
+
+    // Entries that may list the same directory share a task (and its
+    // listings), so each directory is listed once, eg. lib\**\*.jar and
+    // lib\ext\*.jar
+    const char** patterns = (const char**)malloc((work.entryCount + 1) * sizeof(const char*));
+    int*         groups   = (int*)malloc((work.entryCount + 1) * sizeof(int));
+    if (patterns && groups) {
+        for (int i = 0; i < work.entryCount; i++)
+            patterns[i] = work.entries[i].path;
+        work.taskCount = Glob::Group(patterns, work.entryCount, groups);
+        for (int i = 0; i < work.entryCount; i++)
+            work.entries[i].task = groups[i];
+    } else {
+        // One task for everything still lists each directory once
+        work.taskCount = work.entryCount ? 1 : 0;
+    }
+    free(groups);
+    free(patterns);
+
+    work.tasks = (ClasspathTask*)calloc(work.taskCount + 1, sizeof(ClasspathTask));
+    if (!work.tasks)
+        work.taskCount = 0;
+
+    // Use the classpath from an earlier start while none of the directories
+    // it was expanded from have changed
+    char cacheFile[MAX_PATH];
+    bool useCache = iniparser_getboolean(ini, (char*)CLASS_PATH_CACHE, 0) != 0;
+    bool hasCacheFile = Cache::GetPath(iniparser_getstr(ini, (char*)MODULE_INI), CLASS_PATH_CACHE_EXT,
+                                       cacheFile, sizeof(cacheFile));
+    char* built = useCache && hasCacheFile ? LoadCache(cacheFile, work) : NULL;
+    if (!built) {
+        built = ExpandClassPath(work, iniparser_getint(ini, CLASS_PATH_THREADS, CLASS_PATH_DEFAULT_THREADS));
+        if (built && hasCacheFile) {
+            if (useCache)
+                SaveCache(cacheFile, work, built);
+            else
+                Cache::Delete(cacheFile);
+        }
+    }
+    FreeWork(work);
 
-    totalLen += 1; // null terminator
-
-    /* -------------------------------
-       2) Allocate and copy
-       ------------------------------- */
-    classpath = (char*)malloc(totalLen);
-    if (!classpath)
+    if (!built)
         return; // handle OOM
 
-    classpath[0] = 0; // start empty
-
-    for (int j = 0; j < entryCount; j++) {
-        strcat_s(classpath, totalLen, entries[j]);
-        if (j < entryCount - 1)
-            strcat_s(classpath, totalLen, ";");
-
-        free(entries[j]); // free original entry
+    Log::InfoLong("Generated Classpath: ", built);
+
+    // Keep the classpath to index the packages of when Java first asks. This
+    // runs once, before the VM has any threads that could ask.
+    g_hasIndexFile = Cache::GetPath(iniparser_getstr(ini, (char*)MODULE_INI), CLASS_PATH_INDEX_EXT,
+                                    g_indexFile, sizeof(g_indexFile));
+    if (iniparser_getboolean(ini, (char*)CLASS_PATH_INDEX, 0)) {
+        if (!g_indexClasspath)
+            InitializeCriticalSection(&g_indexLock);
+        free(g_indexClasspath);
+        g_indexClasspath = _strdup(built);
+    } else if (g_hasIndexFile) {
+        Cache::Delete(g_indexFile);
     }
 
-    free(entries);
-
-    char* built = _strdup(classpath ? classpath : "");
-    free(classpath);
-
-	size_t len = strlen(built);
-	size_t pos = 0;
-	const int log_chunk = MAX_LOG_LENGTH - 100;
-	while (pos < len) {
-		char buf[log_chunk + 1];
-		size_t remaining = len - pos;
-		size_t chunk = remaining < log_chunk ? remaining : log_chunk;
-		memcpy(buf, built + pos, chunk);
-		buf[chunk] = '\0';
-		Log::Info("Generated Classpath: %s", buf);
-		pos += chunk;
-	}
-
     // Build final -cp argument
-    size_t cpLen = strlen(built) + strlen(CLASS_PATH_ARG) + 2;
-    char* cpArg = (char*)malloc(cpLen);
-    strcpy_s(cpArg, cpLen, CLASS_PATH_ARG);
-    strcat_s(cpArg, cpLen, built);
+    StringBuilder cpArg(strlen(CLASS_PATH_ARG) + strlen(built));
+    cpArg.Append(CLASS_PATH_ARG);
+    cpArg.Append(built);
+    free(built);
 
     // Append to args (dynamic)
-    char** newArgs = (char**)realloc(*args, sizeof(char*) * (count + 1));
+    char* arg = cpArg.Detach();
+    char** newArgs = arg ? (char**)realloc(*args, sizeof(char*) * (count + 1)) : NULL;
     if (!newArgs) {
-        free(cpArg);
-        free(built);
+        free(arg);
         return;
     }
 
     *args = newArgs;
-    (*args)[count++] = cpArg;
+    (*args)[count++] = arg;
+}
 
-    free(built);
+const ClassIndex* Classpath::GetIndex()
+{
+    if (!g_indexClasspath)
+        return NULL;
 
-    // Restore working directory
-    if (!workingDirectory) {
-        SetCurrentDirectoryA(currentDir);
+    EnterCriticalSection(&g_indexLock);
+    if (!g_indexLoaded) {
+        g_classIndex = LoadIndex(g_hasIndexFile ? g_indexFile : NULL, g_indexClasspath);
+        g_indexLoaded = true;
     }
+    LeaveCriticalSection(&g_indexLock);
+    return g_classIndex;
 }
@@ -14,11 +14,24 @@
 #include "../common/Runtime.h"
 #include "../common/INI.h"
 
-#define CLASS_PATH     ":classpath"
-#define CLASS_PATH_ARG "-Djava.class.path="
+#define CLASS_PATH         ":classpath"
+#define CLASS_PATH_THREADS ":classpath.threads"
+#define CLASS_PATH_CACHE   ":classpath.cache"
+#define CLASS_PATH_INDEX   ":classpath.index"
+#define CLASS_PATH_ARG     "-Djava.class.path="
+
+// Classpath entries are expanded on this many threads at most
+#define CLASS_PATH_DEFAULT_THREADS 4
+#define CLASS_PATH_MAX_THREADS     16
+
+class ClassIndex;
 
 struct Classpath {
 	static void BuildClassPath(dictionary *ini, TCHAR*** args, UINT& count);
+
+	// Packages of the built classpath, NULL unless classpath.index is set.
+	// Loaded or built by the first call, which may be on any thread.
+	static const ClassIndex* GetIndex();
 };
 
 #endif // CLASSPATH_H
@@ -0,0 +1,496 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Glob.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GLOB_SEPARATOR  '\\'
+#define GLOB_MAX_DEPTH  32      // "**" stops here, in case of junction loops
+#define GLOB_BLOCK_SIZE 65536
+#define MIN_ENTRIES     16
+
+struct GlobDir {
+    char*     path;
+    unsigned  hash;
+    bool      ok;
+    GlobName* names;
+    int       count;
+    int       size;
+};
+
+struct GlobBlock {
+    GlobBlock* next;
+    int        used;
+    int        size;
+    char       data[1];
+};
+
+static inline bool IsSeparator(char c)
+{
+    return c == '\\' || c == '/';
+}
+
+// Paths compare without regard to case or the kind of separator
+static inline unsigned char Fold(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return (unsigned char)(c + 'a' - 'A');
+    return c == '/' ? '\\' : (unsigned char)c;
+}
+
+static int Compare(const char* a, const char* b)
+{
+    while (*a && Fold(*a) == Fold(*b)) {
+        a++;
+        b++;
+    }
+    return (int)Fold(*a) - (int)Fold(*b);
+}
+
+// FNV-1a, with the high bits folded in as the tables use the low ones
+static unsigned Hash(const char* s)
+{
+    unsigned hash = 2166136261u;
+    for (; *s; s++)
+        hash = (hash ^ Fold(*s)) * 16777619u;
+    return hash ^ (hash >> 16);
+}
+
+static int CompareNames(const void* a, const void* b)
+{
+    return Compare(((const GlobName*)a)->name, ((const GlobName*)b)->name);
+}
+
+// Case is only a tie break, so the order does not depend on the listing order
+static int ComparePaths(const void* a, const void* b)
+{
+    const char* pa = *(const char**)a;
+    const char* pb = *(const char**)b;
+    int c = Compare(pa, pb);
+    return c ? c : strcmp(pa, pb);
+}
+
+static bool Grow(void*& p, int& size, int count, size_t elem)
+{
+    if (count < size)
+        return true;
+    int n = size ? size * 2 : MIN_ENTRIES;
+    void* q = realloc(p, n * elem);
+    if (!q)
+        return false;
+    p    = q;
+    size = n;
+    return true;
+}
+
+void GlobListing::Add(const char* name, bool isDir)
+{
+    if (!strcmp(name, ".") || !strcmp(name, ".."))
+        return;
+
+    void* names = dir.names;
+    char* s = glob.Store(name, (int)strlen(name));
+    if (!s || !Grow(names, dir.size, dir.count, sizeof(GlobName)))
+        return;
+    dir.names = (GlobName*)names;
+    dir.names[dir.count].name = s;
+    dir.names[dir.count].dir  = isDir;
+    dir.count++;
+}
+
+Glob::Glob(const GlobProvider& provider)
+    : provider(provider), dirs(NULL), dirCount(0), dirSize(0), blocks(NULL),
+      path(NULL), pathSize(0), found(NULL), foundCount(0), foundSize(0),
+      paths(NULL), count(0), size(0), index(NULL), indexSize(0),
+      listings(0), hits(0)
+{
+}
+
+Glob::~Glob()
+{
+    for (int i = 0; i < dirSize; i++) {
+        if (dirs[i]) {
+            free(dirs[i]->names);
+            free(dirs[i]);
+        }
+    }
+    free(dirs);
+    while (blocks) {
+        GlobBlock* next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    free(path);
+    free(found);
+    free(paths);
+    free(index);
+}
+
+bool Glob::HasWildcards(const char* pattern)
+{
+    return pattern && strpbrk(pattern, "*?") != NULL;
+}
+
+bool Glob::Match(const char* pattern, const char* name)
+{
+    // On a mismatch go back to the last '*' and let it take one more character
+    const char* star = NULL;
+    const char* resume = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = ++pattern;
+            resume = name;
+        } else if (*pattern == '?' || (*pattern && Fold(*pattern) == Fold(*name))) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == 0;
+}
+
+char* Glob::Store(const char* s, int len)
+{
+    if (!blocks || blocks->used + len + 1 > blocks->size) {
+        int bsize = len + 1 > GLOB_BLOCK_SIZE ? len + 1 : GLOB_BLOCK_SIZE;
+        GlobBlock* b = (GlobBlock*)malloc(sizeof(GlobBlock) + bsize);
+        if (!b)
+            return NULL;
+        b->next = blocks;
+        b->used = 0;
+        b->size = bsize;
+        blocks  = b;
+    }
+    char* d = blocks->data + blocks->used;
+    memcpy(d, s, len);
+    d[len] = 0;
+    blocks->used += len + 1;
+    return d;
+}
+
+// Everything up to the separator before the first wildcard is a directory
+// that is used as it is
+int Glob::GetBase(const char* pattern)
+{
+    int base = pattern ? (int)strcspn(pattern, "*?") : 0;
+    while (base > 0 && !IsSeparator(pattern[base - 1]))
+        base--;
+    return base;
+}
+
+static bool SamePrefix(const char* a, const char* b, int len)
+{
+    for (int i = 0; i < len; i++) {
+        if (Fold(a[i]) != Fold(b[i]))
+            return false;
+    }
+    return true;
+}
+
+// A directory listed by two patterns is under both their bases, so one base
+// holds the other. Patterns without wildcards list nothing and only share
+// with those in the same directory.
+int Glob::Group(const char* const* patterns, int count, int* group)
+{
+    for (int i = 0; i < count; i++) {
+        int base = GetBase(patterns[i]);
+        bool wild = HasWildcards(patterns[i]);
+        group[i] = i;
+        for (int j = 0; j < i; j++) {
+            int other = GetBase(patterns[j]);
+            bool shared = wild && HasWildcards(patterns[j]) ?
+                SamePrefix(patterns[i], patterns[j], base < other ? base : other) :
+                base == other && SamePrefix(patterns[i], patterns[j], base);
+            if (!shared || group[j] == group[i])
+                continue;
+
+            // Join the groups under the lower number, the first pattern's
+            int from = group[i] > group[j] ? group[i] : group[j];
+            int to = group[i] > group[j] ? group[j] : group[i];
+            for (int k = 0; k <= i; k++) {
+                if (group[k] == from)
+                    group[k] = to;
+            }
+        }
+    }
+
+    // Each group is numbered by its first pattern, which comes before the rest
+    int groups = 0;
+    for (int i = 0; i < count; i++)
+        group[i] = group[i] == i ? groups++ : group[group[i]];
+    return groups;
+}
+
+int Glob::Expand(const char* pattern)
+{
+    int n = Collect(pattern);
+    int added = 0;
+    for (int i = 0; i < n; i++) {
+        if (Add(found[i]))
+            added++;
+    }
+    return added;
+}
+
+int Glob::Collect(const char* pattern)
+{
+    foundCount = 0;
+    if (!pattern || !*pattern)
+        return 0;
+
+    int len = (int)strlen(pattern);
+
+    if (!HasWildcards(pattern)) {
+        int n = provider.exists(provider.ctx, pattern) ? Append(0, pattern) : -1;
+        if (n >= 0)
+            Found(n);
+    } else {
+        int base = GetBase(pattern);
+        if (base == 0)
+            return 0;
+
+        // Split the rest into segments, "**" at the end matches everything below
+        char* rest = Store(pattern + base, len - base);
+        Segment* segs = (Segment*)malloc(sizeof(Segment) * (len - base + 2));
+        if (!rest || !segs) {
+            free(segs);
+            return 0;
+        }
+        int nseg = 0;
+        for (char* s = rest; *s; ) {
+            char* e = s;
+            while (*e && !IsSeparator(*e))
+                e++;
+            bool last = *e == 0;
+            *e = 0;
+            if (e > s) {
+                segs[nseg].text    = s;
+                segs[nseg].wild    = HasWildcards(s);
+                segs[nseg].recurse = !strcmp(s, "**");
+                nseg++;
+            }
+            s = last ? e : e + 1;
+        }
+        if (nseg && segs[nseg - 1].recurse) {
+            segs[nseg].text    = "*";
+            segs[nseg].wild    = true;
+            segs[nseg].recurse = false;
+            nseg++;
+        }
+
+        // The base without its trailing separator, unless it is a root
+        int dlen = base - 1;
+        if (dlen == 0 || (dlen == 2 && pattern[1] == ':'))
+            dlen++;
+        if (nseg && Reserve(dlen)) {
+            memcpy(path, pattern, dlen);
+            path[dlen] = 0;
+            Walk(dlen, segs, nseg, 0);
+        }
+        free(segs);
+    }
+
+    // The listings are sorted so the matches usually are too, "**" aside
+    int sorted = 1;
+    while (sorted < foundCount && ComparePaths(&found[sorted - 1], &found[sorted]) < 0)
+        sorted++;
+    if (sorted < foundCount)
+        qsort(found, foundCount, sizeof(const char*), ComparePaths);
+
+    return foundCount;
+}
+
+bool Glob::Reserve(int len)
+{
+    if (len + 1 <= pathSize)
+        return true;
+    int n = pathSize ? pathSize : 256;
+    while (n < len + 1)
+        n *= 2;
+    char* p = (char*)realloc(path, n);
+    if (!p)
+        return false;
+    path     = p;
+    pathSize = n;
+    return true;
+}
+
+// Appends a name to the path at len and returns the new length, or -1
+int Glob::Append(int len, const char* name)
+{
+    int nlen = (int)strlen(name);
+    bool sep = len > 0 && !IsSeparator(path[len - 1]);
+    int total = len + (sep ? 1 : 0) + nlen;
+    if (!Reserve(total))
+        return -1;
+    if (sep)
+        path[len++] = GLOB_SEPARATOR;
+    memcpy(path + len, name, nlen + 1);
+    return total;
+}
+
+void Glob::Walk(int len, const Segment* seg, int nseg, int depth)
+{
+    GlobDir* d = List(len);
+    if (!d)
+        return;
+
+    if (seg->recurse) {
+        // Nothing in between, then each subdirectory in turn
+        Walk(len, seg + 1, nseg - 1, depth);
+        if (depth >= GLOB_MAX_DEPTH)
+            return;
+        for (int i = 0; i < d->count; i++) {
+            if (d->names[i].dir) {
+                int n = Append(len, d->names[i].name);
+                if (n >= 0)
+                    Walk(n, seg, nseg, depth + 1);
+            }
+        }
+        return;
+    }
+
+    if (!seg->wild) {
+        // A name after a wildcard is found in the (sorted) listing
+        GlobName key = { seg->text, false };
+        const GlobName* e = (const GlobName*)bsearch(&key, d->names, d->count, sizeof(GlobName), CompareNames);
+        if (!e || (nseg > 1 && !e->dir))
+            return;
+        int n = Append(len, seg->text);
+        if (n < 0)
+            return;
+        if (nseg == 1)
+            Found(n);
+        else
+            Walk(n, seg + 1, nseg - 1, depth);
+        return;
+    }
+
+    for (int i = 0; i < d->count; i++) {
+        const GlobName* e = &d->names[i];
+        if ((nseg > 1 && !e->dir) || !Match(seg->text, e->name))
+            continue;
+        int n = Append(len, e->name);
+        if (n < 0)
+            continue;
+        if (nseg == 1)
+            Found(n);
+        else
+            Walk(n, seg + 1, nseg - 1, depth);
+    }
+}
+
+void Glob::Found(int len)
+{
+    void* p = found;
+    char* s = Store(path, len);
+    if (!s || !Grow(p, foundSize, foundCount, sizeof(const char*)))
+        return;
+    found = (const char**)p;
+    found[foundCount++] = s;
+}
+
+// Returns the listing of the directory at path[0..len), listing it on first use
+GlobDir* Glob::List(int len)
+{
+    path[len] = 0;
+    unsigned hash = Hash(path);
+
+    if (dirSize) {
+        for (int i = hash & (dirSize - 1); dirs[i]; i = (i + 1) & (dirSize - 1)) {
+            if (dirs[i]->hash == hash && !Compare(dirs[i]->path, path)) {
+                hits++;
+                return dirs[i]->ok ? dirs[i] : NULL;
+            }
+        }
+    }
+
+    // Keep the table at most half full
+    if ((dirCount + 1) * 2 > dirSize) {
+        int n = dirSize ? dirSize * 2 : 64;
+        GlobDir** t = (GlobDir**)calloc(n, sizeof(GlobDir*));
+        if (!t)
+            return NULL;
+        for (int i = 0; i < dirSize; i++) {
+            if (dirs[i]) {
+                int j = dirs[i]->hash & (n - 1);
+                while (t[j])
+                    j = (j + 1) & (n - 1);
+                t[j] = dirs[i];
+            }
+        }
+        free(dirs);
+        dirs    = t;
+        dirSize = n;
+    }
+
+    GlobDir* d = (GlobDir*)calloc(1, sizeof(GlobDir));
+    if (!d || !(d->path = Store(path, len))) {
+        free(d);
+        return NULL;
+    }
+    d->hash = hash;
+
+    listings++;
+    GlobListing listing(*this, *d);
+    d->ok = provider.list(provider.ctx, d->path, listing);
+    if (d->count > 1)
+        qsort(d->names, d->count, sizeof(GlobName), CompareNames);
+
+    int i = hash & (dirSize - 1);
+    while (dirs[i])
+        i = (i + 1) & (dirSize - 1);
+    dirs[i] = d;
+    dirCount++;
+
+    return d->ok ? d : NULL;
+}
+
+bool Glob::Add(const char* p)
+{
+    if ((count + 1) * 2 > indexSize) {
+        int n = indexSize ? indexSize * 2 : 64;
+        int* t = (int*)malloc(n * sizeof(int));
+        if (!t)
+            return false;
+        memset(t, -1, n * sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int j = Hash(paths[i]) & (n - 1);
+            while (t[j] >= 0)
+                j = (j + 1) & (n - 1);
+            t[j] = i;
+        }
+        free(index);
+        index     = t;
+        indexSize = n;
+    }
+
+    int i = Hash(p) & (indexSize - 1);
+    for (; index[i] >= 0; i = (i + 1) & (indexSize - 1)) {
+        if (!Compare(paths[index[i]], p))
+            return false;
+    }
+
+    void* a = paths;
+    if (!Grow(a, size, count, sizeof(const char*)))
+        return false;
+    paths = (const char**)a;
+    index[i] = count;
+    paths[count++] = p;
+    return true;
+}
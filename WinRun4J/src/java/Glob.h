@@ -0,0 +1,139 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef GLOB_H
+#define GLOB_H
+
+// Expands classpath patterns such as C:\app\lib\*.jar. A '*' or '?' may
+// appear in any segment and a "**" segment matches any number of nested
+// directories, eg. lib\**\*.jar. Names are matched without regard to case.
+//
+// Each directory is listed at most once for the life of a Glob, however many
+// patterns touch it. The matches of each pattern are sorted and a path that
+// was already matched (by an earlier pattern) is not added again. A Glob is
+// used by one thread at a time. Listings may come in any order.
+
+class Glob;
+class GlobListing;
+
+struct GlobProvider {
+	// Adds each entry of dir (no trailing separator) to the listing and
+	// returns false if the directory cannot be listed
+	bool (*list)(void* ctx, const char* dir, GlobListing& listing);
+	// Tests a path without wildcards
+	bool (*exists)(void* ctx, const char* path);
+	void* ctx;
+};
+
+struct GlobName {
+	const char* name;
+	bool dir;
+};
+
+struct GlobDir;
+struct GlobBlock;
+
+// The entries of one directory, sorted by name once listed
+class GlobListing {
+public:
+	void Add(const char* name, bool dir);
+
+private:
+	friend class Glob;
+	GlobListing(Glob& glob, GlobDir& dir) : glob(glob), dir(dir) {}
+	Glob& glob;
+	GlobDir& dir;
+};
+
+class Glob {
+public:
+	Glob(const GlobProvider& provider);
+	~Glob();
+
+	// Quick test for entries that have nothing to match
+	static bool HasWildcards(const char* pattern);
+
+	// Matches a single name against a pattern segment, without regard to case
+	static bool Match(const char* pattern, const char* name);
+
+	// Length of the directory at the start of pattern that has no wildcards,
+	// with its trailing separator, or 0 if there is none
+	static int GetBase(const char* pattern);
+
+	// Numbers the patterns so that any two that may list the same directory
+	// have the same group, and can share one Glob. Groups are numbered from
+	// 0 in order of their first pattern; returns how many there are.
+	static int Group(const char* const* patterns, int count, int* group);
+
+	// Appends the matches of pattern (a full path) and returns how many were
+	// new. A pattern without wildcards is added if it exists.
+	int Expand(const char* pattern);
+
+	// Finds the matches of pattern, sorted, without adding them. They are
+	// valid until the next call but the strings last as long as the Glob.
+	int Collect(const char* pattern);
+	const char* GetMatch(int i) const { return found[i]; }
+
+	// Adds a path (which is not copied) unless it is already in the result
+	bool Add(const char* path);
+
+	int GetCount() const { return count; }
+	const char* Get(int i) const { return paths[i]; }
+
+	int GetListings() const { return listings; }
+	int GetCacheHits() const { return hits; }
+
+private:
+	friend class GlobListing;
+
+	struct Segment {
+		const char* text;
+		bool wild;
+		bool recurse;	// "**"
+	};
+
+	void Walk(int len, const Segment* seg, int nseg, int depth);
+	bool Reserve(int len);
+	int Append(int len, const char* name);
+	void Found(int len);
+	GlobDir* List(int len);
+	char* Store(const char* s, int len);
+
+	GlobProvider provider;
+
+	// Directory listings by path
+	GlobDir** dirs;
+	int dirCount;
+	int dirSize;
+
+	// String storage for names and paths, freed with the Glob
+	GlobBlock* blocks;
+
+	// Path being walked
+	char* path;
+	int pathSize;
+
+	// Matches of the pattern being expanded
+	const char** found;
+	int foundCount;
+	int foundSize;
+
+	// Result in order, and an index of it by path
+	const char** paths;
+	int count;
+	int size;
+	int* index;
+	int indexSize;
+
+	int listings;
+	int hits;
+};
+
+#endif // GLOB_H
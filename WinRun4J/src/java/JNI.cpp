@@ -9,7 +9,9 @@
 *******************************************************************************/
 
 #include "JNI.h"
+#include "Classpath.h"
 #include "../common/Log.h"
+#include "../common/Timing.h"
 #include "../common/Runtime.h"
 
 #include <windows.h>
@@ -24,23 +26,18 @@ static jclass   g_classLoaderClass = NULL;
 static jobject  g_classLoader      = NULL;
 static jmethodID g_findClassMethod = NULL;
 
-// Cached java.lang.Class
-static jclass    CLASS_CLASS = NULL;
-static jmethodID CLASS_GETCTORS_METHOD = NULL;
+// JDK classes and members, filled once by Init
+static JNICache g_cache;
 
-void JNI::Init(JNIEnv* env)
+static void LogMissing(const char* kind, const char* name)
 {
-    jclass c = env->FindClass("java/lang/Class");
-    if (!c) {
-        Log::Error("Could not find Class class");
-        return;
-    }
-
-    CLASS_CLASS = (jclass)env->NewGlobalRef(c);
-    CLASS_GETCTORS_METHOD =
-        env->GetMethodID(CLASS_CLASS, "getConstructors", "()[Ljava/lang/reflect/Constructor;");
+    Log::Warning("Could not find %s %s", kind, name);
+}
 
-    if (!CLASS_GETCTORS_METHOD) {
+void JNI::Init(JNIEnv* env)
+{
+    g_cache.Init(env, &LogMissing);
+    if (!g_cache.classGetConstructors) {
         Log::Error("Could not find Class.getConstructors");
         return;
     }
@@ -48,6 +45,11 @@ void JNI::Init(JNIEnv* env)
     LoadEmbeddedClassloader(env);
 }
 
+const JNICache& JNI::GetCache()
+{
+    return g_cache;
+}
+
 jclass JNI::FindClass(JNIEnv* env, TCHAR* classStr)
 {
     if (!g_classLoader)
@@ -56,15 +58,20 @@ jclass JNI::FindClass(JNIEnv* env, TCHAR* classStr)
     jstring jname = env->NewStringUTF(classStr);
     jclass cl = (jclass)env->CallObjectMethod(g_classLoader, g_findClassMethod, jname);
 
-    if (cl && CLASS_GETCTORS_METHOD)
-        env->CallObjectMethod(cl, CLASS_GETCTORS_METHOD);
+    if (cl && g_cache.classGetConstructors)
+        env->CallObjectMethod(cl, g_cache.classGetConstructors);
 
     return cl;
 }
 
-jstring JNI::JNU_NewStringNative(JNIEnv *env, jclass stringClass, const char *str)
+jobject JNI::GetClassLoader()
 {
-    if (!str)
+    return g_classLoader;
+}
+
+jstring JNI::JNU_NewStringNative(JNIEnv *env, const char *str)
+{
+    if (!str || !g_cache.stringInitBytes)
         return NULL;
 
     if (env->EnsureLocalCapacity(2) < 0)
@@ -77,8 +84,7 @@ jstring JNI::JNU_NewStringNative(JNIEnv *env, jclass stringClass, const char *st
 
     env->SetByteArrayRegion(bytes, 0, len, (const jbyte*)str);
 
-    jmethodID ctor = env->GetMethodID(stringClass, "<init>", "([B)V");
-    jstring result = (jstring)env->NewObject(stringClass, ctor, bytes);
+    jstring result = (jstring)env->NewObject(g_cache.stringClass, g_cache.stringInitBytes, bytes);
 
     env->DeleteLocalRef(bytes);
     return result;
@@ -93,21 +99,25 @@ int JNI::RunMainClass(JNIEnv* env, TCHAR* mainClassStr, int argc, char* argv[])
 
     StrReplace(mainClassStr, '.', '/');
 
+    // The launch is up once main is found, whether or not it was
+    Timing::Begin("main.lookup");
     jclass mainClass = FindClass(env, mainClassStr);
+    jobjectArray args = mainClass ? CreateRunArgs(env, argc, argv) : NULL;
+    jmethodID mainMethod =
+        args ? env->GetStaticMethodID(mainClass, "main", "([Ljava/lang/String;)V") : NULL;
+    Timing::End("main.lookup");
+    Timing::Flush();
+
     if (!mainClass) {
         Log::Error("Could not find or initialize main class");
         return 2;
     }
 
-    jobjectArray args = CreateRunArgs(env, argc, argv);
     if (!args) {
         Log::Error("Could not create args");
         return 4;
     }
 
-    jmethodID mainMethod =
-        env->GetStaticMethodID(mainClass, "main", "([Ljava/lang/String;)V");
-
     if (!mainMethod) {
         Log::Error("Could not find main method");
         return 8;
@@ -170,21 +180,13 @@ jthrowable JNI::PrintStackTrace(JNIEnv* env)
     if (!thr)
         return NULL;
 
-    jclass throwable = env->FindClass("java/lang/Throwable");
-    jmethodID print0 = env->GetMethodID(throwable, "printStackTrace", "()V");
-
-    if (print0) {
-        env->CallVoidMethod(thr, print0);
-    } else {
-        env->ExceptionClear();
-        jmethodID print1 =
-            env->GetMethodID(throwable, "printStackTrace", "(Ljava/io/PrintStream;)V");
-
-        jclass sys = env->FindClass("java/lang/System");
-        jfieldID outField = env->GetStaticFieldID(sys, "out", "Ljava/io/PrintStream;");
-        jobject out = env->GetStaticObjectField(sys, outField);
-
-        env->CallVoidMethod(thr, print1, out);
+    // Java cannot be called with the exception pending
+    env->ExceptionClear();
+    if (g_cache.throwablePrintStackTrace) {
+        env->CallVoidMethod(thr, g_cache.throwablePrintStackTrace);
+    } else if (g_cache.throwablePrintStackTraceTo && g_cache.systemOut) {
+        jobject out = env->GetStaticObjectField(g_cache.systemClass, g_cache.systemOut);
+        env->CallVoidMethod(thr, g_cache.throwablePrintStackTraceTo, out);
     }
 
     env->ExceptionClear();
@@ -216,8 +218,7 @@ jobjectArray JNI::ListJars(JNIEnv* env, jobject self, jstring library)
     while (FindResourceA(hm, MAKEINTRESOURCEA(resId), RT_JAR_FILE))
         resId++;
 
-    jclass strClass = env->FindClass("java/lang/String");
-    jobjectArray arr = env->NewObjectArray(resId - 1, strClass, NULL);
+    jobjectArray arr = env->NewObjectArray(resId - 1, g_cache.stringClass, NULL);
 
     for (int i = 1; i < resId; i++) {
         HRSRC hs = FindResourceA(hm, MAKEINTRESOURCEA(i), RT_JAR_FILE);
@@ -312,21 +313,12 @@ void JNI::LoadEmbeddedClassloader(JNIEnv* env)
     if (!FindResourceA(NULL, MAKEINTRESOURCEA(1), RT_JAR_FILE))
         return;
 
-    jclass loaderClass = env->FindClass("java/lang/ClassLoader");
-    if (!loaderClass) {
-        Log::Error("Could not access ClassLoader");
-        return;
-    }
-
-    jmethodID getSys =
-        env->GetStaticMethodID(loaderClass, "getSystemClassLoader", "()Ljava/lang/ClassLoader;");
-
-    if (!getSys) {
+    if (!g_cache.classLoaderGetSystemClassLoader) {
         Log::Error("Could not access ClassLoader.getSystemClassLoader");
         return;
     }
 
-    jobject loader = env->CallStaticObjectMethod(loaderClass, getSys);
+    jobject loader = env->CallStaticObjectMethod(g_cache.classLoaderClass, g_cache.classLoaderGetSystemClassLoader);
     loader = env->NewGlobalRef(loader);
 
     /* jclass bb = */
@@ -350,7 +342,7 @@ void JNI::LoadEmbeddedClassloader(JNIEnv* env)
 
     g_classLoaderClass = (jclass)env->NewGlobalRef(cl);
 
-    env->CallObjectMethod(g_classLoaderClass, CLASS_GETCTORS_METHOD);
+    env->CallObjectMethod(g_classLoaderClass, g_cache.classGetConstructors);
 
     JNINativeMethod m[2];
     m[0].name      = (char*)"listJars";
@@ -394,52 +386,81 @@ void JNI::LoadEmbeddedClassloader(JNIEnv* env)
     }
 }
 
-void JNI::SetContextClassLoader(JNIEnv* env, jobject refObject)
+void JNI::LoadIndexedClassLoader(JNIEnv* env)
 {
-    jclass threadCls = env->FindClass("java/lang/Thread");
-    jmethodID currentThreadMid =
-        env->GetStaticMethodID(threadCls, "currentThread", "()Ljava/lang/Thread;");
-
-    jobject currentThread =
-        env->CallStaticObjectMethod(threadCls, currentThreadMid);
+    if (g_classLoader || !Classpath::GetIndex())
+        return;
 
-    jmethodID getCtx =
-        env->GetMethodID(threadCls, "getContextClassLoader", "()Ljava/lang/ClassLoader;");
+    // Part of the application's org.boris.winrun4j jar, which may be older
+    jclass c = env->FindClass("org/boris/winrun4j/IndexedClassLoader");
+    if (!c) {
+        ClearException(env);
+        Log::Warning("Classes are not loaded through the classpath index: no IndexedClassLoader");
+        return;
+    }
 
-    jobject ctx = env->CallObjectMethod(currentThread, getCtx);
-    if (ctx)
+    jmethodID ctor = env->GetMethodID(c, "<init>", "()V");
+    jmethodID load = env->GetMethodID(c, "loadClass", "(Ljava/lang/String;)Ljava/lang/Class;");
+    jobject o = ctor && load ? env->NewObject(c, ctor) : NULL;
+    if (!o) {
+        PrintStackTrace(env);
+        Log::Error("Could not create the indexed classloader");
+        env->DeleteLocalRef(c);
         return;
+    }
 
-    jclass refCls = env->GetObjectClass(refObject);
-    jmethodID getClassMid = env->GetMethodID(refCls, "getClass", "()Ljava/lang/Class;");
-    jobject clsObj = env->CallObjectMethod(refObject, getClassMid);
+    g_classLoaderClass = (jclass)env->NewGlobalRef(c);
+    g_classLoader      = env->NewGlobalRef(o);
+    g_findClassMethod  = load;
+    env->DeleteLocalRef(o);
+    env->DeleteLocalRef(c);
+
+    // So that the main thread looks up resources and services the same way
+    const JNICache& cache = g_cache;
+    if (cache.threadCurrentThread && cache.threadSetContextClassLoader) {
+        jobject thread = env->CallStaticObjectMethod(cache.threadClass, cache.threadCurrentThread);
+        if (thread) {
+            env->CallVoidMethod(thread, cache.threadSetContextClassLoader, g_classLoader);
+            env->DeleteLocalRef(thread);
+        }
+        ClearException(env);
+    }
+    Log::Info("Classes are loaded through the classpath index");
+}
+
+void JNI::SetContextClassLoader(JNIEnv* env, jobject refObject)
+{
+    const JNICache& c = g_cache;
+    if (!c.threadCurrentThread || !c.threadGetContextClassLoader || !c.threadSetContextClassLoader ||
+        !c.classGetClassLoader)
+        return;
 
-    jclass clsCls = env->GetObjectClass(clsObj);
-    jmethodID getLoaderMid =
-        env->GetMethodID(clsCls, "getClassLoader", "()Ljava/lang/ClassLoader;");
+    jobject currentThread = env->CallStaticObjectMethod(c.threadClass, c.threadCurrentThread);
 
-    jobject loader = env->CallObjectMethod(clsObj, getLoaderMid);
+    jobject ctx = env->CallObjectMethod(currentThread, c.threadGetContextClassLoader);
+    if (ctx)
+        return;
 
-    jmethodID setCtx =
-        env->GetMethodID(threadCls, "setContextClassLoader", "(Ljava/lang/ClassLoader;)V");
+    // The class of refObject, as refObject.getClass() would give
+    jclass refCls = env->GetObjectClass(refObject);
+    jobject loader = env->CallObjectMethod(refCls, c.classGetClassLoader);
 
-    env->CallVoidMethod(currentThread, setCtx, loader);
+    env->CallVoidMethod(currentThread, c.threadSetContextClassLoader, loader);
 }
 
 jobjectArray JNI::CreateRunArgs(JNIEnv *env, int argc, char* argv[])
 {
-    jclass stringClass = env->FindClass("java/lang/String");
-    if (!stringClass) {
+    if (!g_cache.stringClass) {
         Log::Error("Could not find String class");
         return NULL;
     }
 
-    jobjectArray arr = env->NewObjectArray(argc, stringClass, NULL);
+    jobjectArray arr = env->NewObjectArray(argc, g_cache.stringClass, NULL);
     if (!arr)
         return NULL;
 
     for (int i = 0; i < argc; i++) {
-        jstring s = JNU_NewStringNative(env, stringClass, argv[i]);
+        jstring s = JNU_NewStringNative(env, argv[i]);
         env->SetObjectArrayElement(arr, i, s);
     }
 
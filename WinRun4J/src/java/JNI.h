@@ -15,11 +15,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <jni.h>
+#include "JNICache.h"
 
 class JNI 
 {
 public:
 	static void Init(JNIEnv* env);
+	static const JNICache& GetCache();
 	static void ClearException(JNIEnv* env);
 	static jthrowable PrintStackTrace(JNIEnv* env);
 	static int RunMainClass(JNIEnv* env, TCHAR* mainClass, int argc, char* argv[]);
@@ -29,6 +31,14 @@ public:
 	static void SetContextClassLoader(JNIEnv* env, jobject refObject);
 	static jobjectArray CreateRunArgs(JNIEnv *env, int argc, char* argv[]);
 
+	// With classpath.index set and no embedded jars, finds classes through
+	// the package index once the natives it asks are registered
+	static void LoadIndexedClassLoader(JNIEnv* env);
+
+	// The embedded or indexed class loader, NULL if classes come from the
+	// system class loader
+	static jobject GetClassLoader();
+
 private:
 	static jstring NewString(JNIEnv *env, TCHAR * str);
 	static void LoadEmbeddedClassloader(JNIEnv* env);
@@ -36,6 +46,6 @@ private:
 	static jobject GetJar(JNIEnv* env, jobject self, jstring library, jstring jarName);
 	static jclass DefineClass(JNIEnv* env, const char* filename, const char* name, jobject loader);
 	static bool SetClassLoaderJars(JNIEnv* env, jobject classloader);
-	static jstring JNU_NewStringNative(JNIEnv *env, jclass aStringClass, const char *str);
+	static jstring JNU_NewStringNative(JNIEnv *env, const char *str);
 };
 #endif // JNI_UTILS_H
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "JNICache.h"
+
+typedef void (*Missing)(const char* kind, const char* name);
+
+static jclass CacheClass(JNIEnv* env, Missing missing, const char* name)
+{
+    jclass c = env->FindClass(name);
+    if (!c) {
+        env->ExceptionClear();
+        if (missing)
+            missing("class", name);
+        return NULL;
+    }
+
+    jclass ref = (jclass)env->NewGlobalRef(c);
+    env->DeleteLocalRef(c);
+    return ref;
+}
+
+static jmethodID CacheMethod(JNIEnv* env, Missing missing, jclass c, const char* name, const char* sig, bool isStatic = false)
+{
+    if (!c)
+        return NULL;
+
+    jmethodID m = isStatic ? env->GetStaticMethodID(c, name, sig) : env->GetMethodID(c, name, sig);
+    if (!m) {
+        env->ExceptionClear();
+        if (missing)
+            missing("method", name);
+    }
+    return m;
+}
+
+static jfieldID CacheField(JNIEnv* env, Missing missing, jclass c, const char* name, const char* sig, bool isStatic = false)
+{
+    if (!c)
+        return NULL;
+
+    jfieldID f = isStatic ? env->GetStaticFieldID(c, name, sig) : env->GetFieldID(c, name, sig);
+    if (!f) {
+        env->ExceptionClear();
+        if (missing)
+            missing("field", name);
+    }
+    return f;
+}
+
+void JNICache::Init(JNIEnv* env, void (*missing)(const char* kind, const char* name))
+{
+    JNICache& c = *this;
+
+    c.classClass           = CacheClass(env, missing, "java/lang/Class");
+    c.classGetConstructors = CacheMethod(env, missing, c.classClass, "getConstructors", "()[Ljava/lang/reflect/Constructor;");
+    c.classGetClassLoader  = CacheMethod(env, missing, c.classClass, "getClassLoader", "()Ljava/lang/ClassLoader;");
+    c.classForName         = CacheMethod(env, missing, c.classClass, "forName",
+                                         "(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;", true);
+
+    c.classLoaderClass                = CacheClass(env, missing, "java/lang/ClassLoader");
+    c.classLoaderGetSystemClassLoader = CacheMethod(env, missing, c.classLoaderClass, "getSystemClassLoader",
+                                                    "()Ljava/lang/ClassLoader;", true);
+
+    c.stringClass      = CacheClass(env, missing, "java/lang/String");
+    c.stringArrayClass = CacheClass(env, missing, "[Ljava/lang/String;");
+    c.stringInitBytes  = CacheMethod(env, missing, c.stringClass, "<init>", "([B)V");
+
+    c.throwableClass             = CacheClass(env, missing, "java/lang/Throwable");
+    c.throwablePrintStackTrace   = CacheMethod(env, missing, c.throwableClass, "printStackTrace", "()V");
+    c.throwablePrintStackTraceTo = CacheMethod(env, missing, c.throwableClass, "printStackTrace", "(Ljava/io/PrintStream;)V");
+
+    c.systemClass       = CacheClass(env, missing, "java/lang/System");
+    c.systemIn          = CacheField(env, missing, c.systemClass, "in", "Ljava/io/InputStream;", true);
+    c.systemOut         = CacheField(env, missing, c.systemClass, "out", "Ljava/io/PrintStream;", true);
+    c.systemErr         = CacheField(env, missing, c.systemClass, "err", "Ljava/io/PrintStream;", true);
+    c.systemSetIn       = CacheMethod(env, missing, c.systemClass, "setIn", "(Ljava/io/InputStream;)V", true);
+    c.systemSetOut      = CacheMethod(env, missing, c.systemClass, "setOut", "(Ljava/io/PrintStream;)V", true);
+    c.systemSetErr      = CacheMethod(env, missing, c.systemClass, "setErr", "(Ljava/io/PrintStream;)V", true);
+    c.systemSetProperty = CacheMethod(env, missing, c.systemClass, "setProperty",
+                                      "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;", true);
+
+    c.threadClass                 = CacheClass(env, missing, "java/lang/Thread");
+    c.threadCurrentThread         = CacheMethod(env, missing, c.threadClass, "currentThread", "()Ljava/lang/Thread;", true);
+    c.threadGetContextClassLoader = CacheMethod(env, missing, c.threadClass, "getContextClassLoader",
+                                                "()Ljava/lang/ClassLoader;");
+    c.threadSetContextClassLoader = CacheMethod(env, missing, c.threadClass, "setContextClassLoader",
+                                                "(Ljava/lang/ClassLoader;)V");
+
+    c.closeableClass = CacheClass(env, missing, "java/io/Closeable");
+    c.closeableClose = CacheMethod(env, missing, c.closeableClass, "close", "()V");
+
+    c.fileDescriptorClass   = CacheClass(env, missing, "java/io/FileDescriptor");
+    c.fileDescriptorInit    = CacheMethod(env, missing, c.fileDescriptorClass, "<init>", "()V");
+    c.fileDescriptorHandle  = CacheField(env, missing, c.fileDescriptorClass, "handle", "J");
+    c.fileInputStreamClass  = CacheClass(env, missing, "java/io/FileInputStream");
+    c.fileInputStreamInit   = CacheMethod(env, missing, c.fileInputStreamClass, "<init>", "(Ljava/io/FileDescriptor;)V");
+    c.fileOutputStreamClass = CacheClass(env, missing, "java/io/FileOutputStream");
+    c.fileOutputStreamInit  = CacheMethod(env, missing, c.fileOutputStreamClass, "<init>", "(Ljava/io/FileDescriptor;)V");
+    c.printStreamClass      = CacheClass(env, missing, "java/io/PrintStream");
+    c.printStreamInit       = CacheMethod(env, missing, c.printStreamClass, "<init>", "(Ljava/io/OutputStream;Z)V");
+}
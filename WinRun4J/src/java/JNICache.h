@@ -0,0 +1,61 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef JNI_CACHE_H
+#define JNI_CACHE_H
+
+#include <jni.h>
+
+// Classes and members of the JDK the launcher calls, looked up once in
+// JNI::Init. The classes are global refs, so they and their IDs can be used
+// from any thread; any that could not be found are NULL.
+struct JNICache {
+	jclass    classClass;
+	jmethodID classGetConstructors;
+	jmethodID classGetClassLoader;
+	jmethodID classForName;
+	jclass    classLoaderClass;
+	jmethodID classLoaderGetSystemClassLoader;
+	jclass    stringClass;
+	jclass    stringArrayClass;
+	jmethodID stringInitBytes;
+	jclass    throwableClass;
+	jmethodID throwablePrintStackTrace;
+	jmethodID throwablePrintStackTraceTo;
+	jclass    systemClass;
+	jfieldID  systemIn;
+	jfieldID  systemOut;
+	jfieldID  systemErr;
+	jmethodID systemSetIn;
+	jmethodID systemSetOut;
+	jmethodID systemSetErr;
+	jmethodID systemSetProperty;
+	jclass    threadClass;
+	jmethodID threadCurrentThread;
+	jmethodID threadGetContextClassLoader;
+	jmethodID threadSetContextClassLoader;
+	jclass    closeableClass;
+	jmethodID closeableClose;
+	jclass    fileDescriptorClass;
+	jmethodID fileDescriptorInit;
+	jfieldID  fileDescriptorHandle;
+	jclass    fileInputStreamClass;
+	jmethodID fileInputStreamInit;
+	jclass    fileOutputStreamClass;
+	jmethodID fileOutputStreamInit;
+	jclass    printStreamClass;
+	jmethodID printStreamInit;
+
+	// Looks every one up, passing each that could not be found to missing
+	// (if given) as "class", "method" or "field" and its name
+	void Init(JNIEnv* env, void (*missing)(const char* kind, const char* name));
+};
+
+#endif // JNI_CACHE_H
@@ -0,0 +1,268 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Preload.h"
+#include "ClassList.h"
+#include "JNI.h"
+#include "VM.h"
+#include "../common/Cache.h"
+#include "../common/INI.h"
+#include "../common/Log.h"
+#include "../common/Timing.h"
+#include <jvmti.h>
+
+namespace
+{
+    // Set while learning
+    HANDLE           g_stop = NULL;
+    CRITICAL_SECTION g_lock;
+    CRITICAL_SECTION g_saveLock;
+    CRITICAL_SECTION g_vmLock;      // Held while the learning thread calls the VM
+    bool             g_stopped = false;
+    jvmtiEnv*        g_jvmti = NULL;
+    jobject          g_systemLoader = NULL;
+    ClassList*       g_learned = NULL;
+    DWORD            g_learnMillis = 0;
+
+    char             g_listFile[MAX_PATH];
+}
+
+// The INI's path with .preload in place of .ini
+static bool GetListFile(dictionary* ini, char* path, size_t len)
+{
+    char* module = iniparser_getstr(ini, (char*)MODULE_INI);
+    if (!module || strcpy_s(path, len, module))
+        return false;
+    char* ext = strrchr(path, '.');
+    if (ext && !strchr(ext, '\\'))
+        *ext = 0;
+    return strcat_s(path, len, CLASS_PATH_PRELOAD_EXT) == 0;
+}
+
+static jobject GetSystemClassLoader(JNIEnv* env)
+{
+    const JNICache& c = JNI::GetCache();
+    jobject loader = c.classLoaderGetSystemClassLoader ?
+        env->CallStaticObjectMethod(c.classLoaderClass, c.classLoaderGetSystemClassLoader) : NULL;
+    if (env->ExceptionCheck())
+        JNI::ClearException(env);
+    return loader;
+}
+
+// Only classes the system class loader can find again by name are listed
+static void JNICALL ClassLoaded(jvmtiEnv* jvmti, JNIEnv* env, jthread /*thread*/, jclass klass)
+{
+    jobject loader = NULL;
+    if (jvmti->GetClassLoader(klass, &loader) != JVMTI_ERROR_NONE)
+        return;
+    EnterCriticalSection(&g_lock);
+    bool listed = g_systemLoader && (!loader || env->IsSameObject(loader, g_systemLoader));
+    LeaveCriticalSection(&g_lock);
+    if (loader)
+        env->DeleteLocalRef(loader);
+
+    char* signature = NULL;
+    if (!listed || jvmti->GetClassSignature(klass, &signature, NULL) != JVMTI_ERROR_NONE)
+        return;
+    EnterCriticalSection(&g_lock);
+    if (g_learned)
+        g_learned->Record(signature);
+    LeaveCriticalSection(&g_lock);
+    jvmti->Deallocate((unsigned char*)signature);
+}
+
+// Writes the list once, whichever of the learning time running out and the
+// VM exiting comes first. The VM is not called, so this is safe while it exits.
+static void SaveLearned()
+{
+    EnterCriticalSection(&g_saveLock);
+    EnterCriticalSection(&g_lock);
+    ClassList* learned = g_learned;
+    g_learned = NULL;
+    LeaveCriticalSection(&g_lock);
+
+    if (learned) {
+        StringBuilder out;
+        learned->Format(out);
+        if (Cache::Write(g_listFile, out.Get(), (DWORD)out.Length()))
+            Log::Info("Learned %d classes to preload: %s", learned->GetCount(), g_listFile);
+        delete learned;
+    }
+    LeaveCriticalSection(&g_saveLock);
+}
+
+static DWORD WINAPI LearnThreadProc(LPVOID /*param*/)
+{
+    if (WaitForSingleObject(g_stop, g_learnMillis) != WAIT_TIMEOUT)
+        return 0;
+
+    // Stop may have come since the wait, the VM is only called if it has not
+    EnterCriticalSection(&g_vmLock);
+    JNIEnv* env = g_stopped ? NULL : VM::GetJNIEnv(true);
+    if (env) {
+        g_jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_LOAD, NULL);
+        VM::DetachCurrentThread();
+    }
+    LeaveCriticalSection(&g_vmLock);
+    SaveLearned();
+    return 0;
+}
+
+static void StartLearning(JNIEnv* env, dictionary* ini)
+{
+    jvmtiEnv* jvmti = NULL;
+    JavaVM* jvm = VM::GetJavaVM();
+    if (!jvm || jvm->GetEnv((void**)&jvmti, JVMTI_VERSION_1_0) != JNI_OK || !jvmti) {
+        Log::Warning("Could not learn the classes to preload: no JVMTI");
+        return;
+    }
+    jobject loader = GetSystemClassLoader(env);
+    if (!loader) {
+        Log::Warning("Could not learn the classes to preload: no system class loader");
+        return;
+    }
+
+    InitializeCriticalSection(&g_lock);
+    InitializeCriticalSection(&g_saveLock);
+    InitializeCriticalSection(&g_vmLock);
+    g_systemLoader = env->NewGlobalRef(loader);
+    env->DeleteLocalRef(loader);
+    g_jvmti   = jvmti;
+    g_learned = new ClassList;
+
+    jvmtiEventCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.ClassLoad = &ClassLoaded;
+    if (jvmti->SetEventCallbacks(&callbacks, (jint)sizeof(callbacks)) != JVMTI_ERROR_NONE ||
+        jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_CLASS_LOAD, NULL) != JVMTI_ERROR_NONE) {
+        Log::Warning("Could not learn the classes to preload: class load events refused");
+        delete g_learned;
+        g_learned = NULL;
+        env->DeleteGlobalRef(g_systemLoader);
+        g_systemLoader = NULL;
+        return;
+    }
+
+    int seconds = iniparser_getint(ini, (char*)CLASS_PATH_PRELOAD_LEARN, CLASS_PATH_PRELOAD_DEFAULT_LEARN);
+    g_learnMillis = seconds > 0 ? (DWORD)seconds * 1000 : CLASS_PATH_PRELOAD_DEFAULT_LEARN * 1000;
+    g_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    HANDLE h = g_stop ? CreateThread(NULL, 0, LearnThreadProc, NULL, 0, NULL) : NULL;
+    if (h)
+        CloseHandle(h);
+    Log::Info("Learning the classes loaded in the first %lu seconds: %s", g_learnMillis / 1000, g_listFile);
+}
+
+// Loads each class without initializing it, so no static initializer runs
+// earlier or on another thread than it would have
+static int Replay(JNIEnv* env, const ClassList& list)
+{
+    const JNICache& c = JNI::GetCache();
+    jobject loader = c.classForName ? GetSystemClassLoader(env) : NULL;
+    if (!loader)
+        return 0;
+
+    int loaded = 0;
+    char name[MAX_PATH];
+    for (int i = 0; i < list.GetCount(); i++) {
+        ClassList::ToBinaryName(list.Get(i), name, sizeof(name));
+        jstring jname = env->NewStringUTF(name);
+        jobject cl = jname ?
+            env->CallStaticObjectMethod(c.classClass, c.classForName, jname, JNI_FALSE, loader) : NULL;
+        if (env->ExceptionCheck())
+            env->ExceptionClear();
+        else if (cl)
+            loaded++;
+        if (cl)
+            env->DeleteLocalRef(cl);
+        if (jname)
+            env->DeleteLocalRef(jname);
+    }
+    env->DeleteLocalRef(loader);
+    return loaded;
+}
+
+static DWORD WINAPI ReplayThreadProc(LPVOID param)
+{
+    ClassList* list = (ClassList*)param;
+    JNIEnv* env = VM::GetJNIEnv(true);
+    if (env) {
+        double start = Timing::Now();
+        Timing::Begin("preload");
+        int loaded = Replay(env, *list);
+        Timing::End("preload");
+        Log::Info("Preloaded %d of %d classes in %.1f ms", loaded, list->GetCount(), Timing::Now() - start);
+        VM::DetachCurrentThread();
+    }
+    delete list;
+    return 0;
+}
+
+void Preload::Start(JNIEnv* env, dictionary* ini)
+{
+    char* mode = iniparser_getstr(ini, (char*)CLASS_PATH_PRELOAD);
+    bool learn = mode && _stricmp(mode, "learn") == 0;
+    if (!env || (!learn && !iniparser_getboolean(ini, (char*)CLASS_PATH_PRELOAD, 0)))
+        return;
+
+    // The main class comes from the embedded or indexed class loader, so
+    // loading its classes through the system class loader would not help
+    if (JNI::GetClassLoader()) {
+        Log::Warning("Classes are not preloaded through a launcher class loader");
+        return;
+    }
+    if (!GetListFile(ini, g_listFile, sizeof(g_listFile)))
+        return;
+
+    if (!learn) {
+        DWORD size = 0;
+        const BYTE* view = Cache::Map(g_listFile, size);
+        if (view) {
+            ClassList* list = new ClassList;
+            list->Parse((const char*)view, size);
+            Cache::Unmap(view);
+            HANDLE h = CreateThread(NULL, 0, ReplayThreadProc, list, 0, NULL);
+            if (h)
+                CloseHandle(h);
+            else
+                delete list;
+            return;
+        }
+    }
+
+    StartLearning(env, ini);
+}
+
+void Preload::Stop(bool exiting)
+{
+    if (!g_stop)
+        return;
+    SetEvent(g_stop);
+
+    // While the VM exits its threads are held, so the learning thread is not
+    // waited for and the VM is not called; the process goes with it
+    if (!exiting) {
+        EnterCriticalSection(&g_vmLock);
+        if (!g_stopped) {
+            g_stopped = true;
+            JNIEnv* env = VM::GetJNIEnv(true);
+            if (env)
+                g_jvmti->SetEventNotificationMode(JVMTI_DISABLE, JVMTI_EVENT_CLASS_LOAD, NULL);
+
+            EnterCriticalSection(&g_lock);
+            jobject loader = g_systemLoader;
+            g_systemLoader = NULL;
+            LeaveCriticalSection(&g_lock);
+            if (env && loader)
+                env->DeleteGlobalRef(loader);
+        }
+        LeaveCriticalSection(&g_vmLock);
+    }
+    SaveLearned();
+}
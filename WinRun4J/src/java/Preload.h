@@ -0,0 +1,39 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+#include "../common/Runtime.h"
+#include "../common/Dictionary.h"
+#include <jni.h>
+
+// "learn" to record the classes loaded at startup to a list next to the INI,
+// "true" to load the classes on the list on a thread of their own while the
+// main class starts (learning the list first if there is none)
+#define CLASS_PATH_PRELOAD       ":classpath.preload"
+#define CLASS_PATH_PRELOAD_LEARN ":classpath.preload.learn"
+
+#define CLASS_PATH_PRELOAD_EXT   ".preload"
+
+// Seconds of startup recorded when learning
+#define CLASS_PATH_PRELOAD_DEFAULT_LEARN 10
+
+struct Preload {
+	// After JNI::Init, before the main class is run
+	static void Start(JNIEnv* env, dictionary* ini);
+
+	// Saves what has been learned so far if the VM is going before the
+	// learning time is up. Called on a thread of the VM while it is still
+	// running, or from its exit hook with exiting set.
+	static void Stop(bool exiting = false);
+};
+
+#endif // PRELOAD_H
@@ -10,8 +10,16 @@
 
 #include "VM.h"
 #include "JNI.h"
+#include "Preload.h"
+#include "VMInventory.h"
+#include "VMSizing.h"
+#include "../common/Cache.h"
 #include "../common/Log.h"
 #include "../common/INI.h"
+#include "../common/StringBuilder.h"
+#include "../common/Timing.h"
+#include "../launcher/LaunchServer.h"
+#include "../launcher/Placement.h"
 #include "../launcher/Service.h"
 
 #include <windows.h>
@@ -27,6 +35,27 @@
 #define JRE_VERSION_KEY          TEXT("CurrentVersion")
 #define JRE_LIB_KEY              TEXT("RuntimeLib")
 
+// Searched for registered VMs, in this order
+static const char* const vmRegistryRoots[] = {
+    JRE_REG_PATH,
+    JRE_REG_PATH_NEW,
+    IBM_JRE_REG_PATH,
+#ifndef X64
+    JRE_REG_PATH_WOW6432,
+    IBM_JRE_REG_PATH_WOW6432,
+#endif
+};
+
+// Runtimes that may be bundled in the INI directory, and the saved inventory
+#define VM_BUNDLED_JRE     "jre"
+#define VM_BUNDLED_RUNTIME "runtime"
+#define VM_INVENTORY_EXT   "vms"
+
+// Class data sharing archive and the hash of the inputs it was created from
+#define CDS_ARCHIVE_EXT "jsa"
+#define CDS_KEY_EXT     "cds"
+#define CDS_CLASS_PATH  "-Djava.class.path="
+
 namespace 
 {
     HINSTANCE g_hInstance  = 0;
@@ -65,109 +94,208 @@ void VM::DetachCurrentThread()
 char* VM::FindJavaVMLibrary(dictionary *ini)
 {
     int findSystemVmFirst = iniparser_getboolean(ini, (char*)VM_SYSFIRST, 0);
+    char* vmLocations = iniparser_getstr(ini, (char*)VM_LOCATION);
 
-    char* vmDefaultLocation = GetJavaVMLibrary(
-        iniparser_getstr(ini, (char*)VM_VERSION),
-        iniparser_getstr(ini, (char*)VM_VERSION_MIN),
-        iniparser_getstr(ini, (char*)VM_VERSION_MAX)
-    );
+    // The installed VMs are only needed if vm.location may not be used
+    char* vmDefaultLocation = NULL;
+    if (findSystemVmFirst || vmLocations == NULL) {
+        vmDefaultLocation = GetJavaVMLibrary(
+            ini,
+            iniparser_getstr(ini, (char*)VM_VERSION),
+            iniparser_getstr(ini, (char*)VM_VERSION_MIN),
+            iniparser_getstr(ini, (char*)VM_VERSION_MAX)
+        );
+    }
 
     if (findSystemVmFirst && vmDefaultLocation != NULL)
         return vmDefaultLocation;
 
-    char* vmLocations = iniparser_getstr(ini, (char*)VM_LOCATION);
     Log::Info("Configured vm.location: %s", vmLocations ? vmLocations : "(null)");
 
     if (vmLocations != NULL)
     {
-        char defWorkingDir[MAX_PATH];
+        // Relative to the INI directory unless a working directory is set.
+        // The path is joined rather than changing the current directory as
+        // the classpath may be expanded at the same time.
         char* workingDir = iniparser_getstr(ini, (char*)WORKING_DIR);
-
-        if (!workingDir) {
-            GetCurrentDirectoryA(MAX_PATH, defWorkingDir);
-            SetCurrentDirectoryA(iniparser_getstr(ini, (char*)INI_DIR));
-        }
+        char* baseDir = workingDir ? NULL : iniparser_getstr(ini, (char*)INI_DIR);
 
         char* ctx = NULL;
         char* vmLocation = strtok_s(vmLocations, "|", &ctx);
 
         while (vmLocation != NULL)
         {
-            DWORD fileAttr = GetFileAttributesA(vmLocation);
-            if (fileAttr != INVALID_FILE_ATTRIBUTES)
-            {
-                char vmFull[MAX_PATH];
-                GetFullPathNameA(vmLocation, MAX_PATH, vmFull, NULL);
-
-                if (!workingDir) {
-                    SetCurrentDirectoryA(defWorkingDir);
-                }
-
+            char vmFull[MAX_PATH];
+            DWORD len = GetFullPathFrom(baseDir, vmLocation, vmFull, MAX_PATH);
+            if (len > 0 && len < MAX_PATH && GetFileAttributesA(vmFull) != INVALID_FILE_ATTRIBUTES)
                 return _strdup(vmFull);
-            }
 
             Log::Info("vm.location item not found: %s", vmLocation);
             vmLocation = strtok_s(NULL, "|", &ctx);
         }
 
-        if (!workingDir) {
-            SetCurrentDirectoryA(defWorkingDir);
-        }
-
         return NULL;
     }
 
     return vmDefaultLocation;
 }
 
-// Find an appropriate VM library
-char* VM::GetJavaVMLibrary(LPSTR version, LPSTR min, LPSTR max)
+static void* OpenVMKey(void* /*ctx*/, const char* path)
+{
+    HKEY hKey;
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, path, 0, KEY_READ, &hKey) != ERROR_SUCCESS)
+        return NULL;
+    return hKey;
+}
+
+static void CloseVMKey(void* /*ctx*/, void* key)
 {
-    CHAR   filename[MAX_PATH];
-    HKEY   hKey, hVersionKey;
-    DWORD  numVersions = 255;
-    Version versions[255];
+    RegCloseKey((HKEY)key);
+}
 
-    FindVersions(versions, &numVersions);
+static bool EnumVMKey(void* /*ctx*/, void* key, int index, char* name, int len)
+{
+    DWORD length = len;
+    return RegEnumKeyExA((HKEY)key, index, name, &length, NULL, NULL, NULL, NULL) == ERROR_SUCCESS;
+}
 
-    Version* v = FindVersion(versions, numVersions, version, min, max);
-    if (!v)
-        return NULL;
+static bool GetVMValue(void* /*ctx*/, void* key, const char* name, char* value, int len)
+{
+    DWORD type, length = len - 1;
+    if (RegQueryValueExA((HKEY)key, name, NULL, &type, (LPBYTE)value, &length) != ERROR_SUCCESS ||
+        (type != REG_SZ && type != REG_EXPAND_SZ))
+        return false;
+    value[length] = 0;
+    return true;
+}
 
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, v->GetRegPath(), 0, KEY_READ, &hKey) != ERROR_SUCCESS)
-        return NULL;
+static ULONGLONG GetVMKeyTime(void* /*ctx*/, void* key)
+{
+    FILETIME ft;
+    if (RegQueryInfoKeyA((HKEY)key, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &ft) != ERROR_SUCCESS)
+        return 0;
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
 
-    if (RegOpenKeyExA(hKey, v->GetVersionStr(), 0, KEY_READ, &hVersionKey) != ERROR_SUCCESS) {
-        RegCloseKey(hKey);
-        return NULL;
-    }
+static ULONGLONG GetVMFileTime(void* /*ctx*/, const char* path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fad))
+        return VM_INVENTORY_MISSING;
+    return ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+}
 
-    DWORD length = sizeof(filename);
-    if (RegQueryValueExA(hVersionKey, "RuntimeLib", NULL, NULL, (LPBYTE)&filename, &length) != ERROR_SUCCESS) {
-        RegCloseKey(hVersionKey);
-        RegCloseKey(hKey);
-        return NULL;
+static bool ReadVMFile(void* /*ctx*/, const char* path, char* buf, int len)
+{
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD read = 0;
+    BOOL ok = ReadFile(hFile, buf, len - 1, &read, NULL);
+    CloseHandle(hFile);
+    buf[ok ? read : 0] = 0;
+    return ok != FALSE;
+}
+
+/*
+ * The VMs on this machine, from the cache while none of the registry keys
+ * and files they were found from have changed. Besides the registry this
+ * covers JAVA_HOME and the runtimes bundled beside the INI file.
+ */
+static VMInventory* LoadInventory(dictionary* ini)
+{
+    static const VMProvider provider = {
+        OpenVMKey, CloseVMKey, EnumVMKey, GetVMValue, GetVMKeyTime, GetVMFileTime, ReadVMFile, NULL
+    };
+
+    LARGE_INTEGER start, end, freq;
+    QueryPerformanceCounter(&start);
+
+    char javaHome[MAX_PATH];
+    DWORD len = GetEnvironmentVariableA("JAVA_HOME", javaHome, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH)
+        javaHome[0] = 0;
+
+    char bundled[2][MAX_PATH];
+    const char* bundledDirs[2];
+    int bundledCount = 0;
+    char* iniDir = iniparser_getstr(ini, (char*)INI_DIR);
+    for (int i = 0; iniDir && i < 2; i++) {
+        if (sprintf_s(bundled[i], MAX_PATH, "%s%s", iniDir, i ? VM_BUNDLED_RUNTIME : VM_BUNDLED_JRE) > 0)
+            bundledDirs[bundledCount++] = bundled[i];
     }
 
 #ifdef X64
-    HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        int len = (int)strlen(filename);
-        if (len > 14 && strcmp(&filename[len - 14], "client\\jvm.dll") == 0) {
-            const char replace[] = "server";
-            for (int i = 0; i < 6; i++) {
-                filename[len - 14 + i] = replace[i];
-            }
-        }
-    } else {
-        CloseHandle(hFile);
-    }
+    bool serverForClient = true;
+#else
+    bool serverForClient = false;
 #endif
+    VMSearch search = {
+        vmRegistryRoots, sizeof(vmRegistryRoots) / sizeof(vmRegistryRoots[0]),
+        javaHome, bundledDirs, bundledCount, serverForClient
+    };
 
-    RegCloseKey(hVersionKey);
-    RegCloseKey(hKey);
+    VMInventory* inventory = new VMInventory(provider);
+
+    // Bundled runtimes belong to the application, so each has its own
+    char cacheFile[MAX_PATH];
+    bool hasCacheFile = Cache::GetPath(iniparser_getstr(ini, (char*)MODULE_INI), VM_INVENTORY_EXT,
+                                       cacheFile, sizeof(cacheFile));
+    DWORD size;
+    const BYTE* view = hasCacheFile ? Cache::Map(cacheFile, size) : NULL;
+    bool cached = view && inventory->Load(view, size, search);
+    Cache::Unmap(view);
+
+    if (!cached) {
+        inventory->Build(search);
+        const void* data = hasCacheFile ? inventory->GetData() : NULL;
+        if (data)
+            Cache::Write(cacheFile, data, inventory->GetSize());
+    }
 
-    return _strdup(filename);
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&freq);
+    Log::Info("VM inventory %s: %d VMs (%.1f ms)", cached ? "loaded" : "built", inventory->GetCount(),
+              (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+    return inventory;
+}
+
+/*
+ * Find an appropriate VM library. Registered VMs are preferred as before;
+ * JAVA_HOME and bundled runtimes are only used when none of them fit.
+ */
+char* VM::GetJavaVMLibrary(dictionary* ini, LPSTR version, LPSTR min, LPSTR max)
+{
+    VMInventory* inventory = LoadInventory(ini);
+    if (!inventory)
+        return NULL;
+
+    int count = inventory->GetCount();
+    Version* versions = count ? new Version[count] : NULL;
+    int* found = count ? (int*)malloc(count * sizeof(int)) : NULL;
+    char* result = NULL;
+
+    for (int pass = 0; versions && found && !result && pass < 2; pass++) {
+        DWORD numVersions = 0;
+        for (int i = 0; i < count; i++) {
+            const VMInventoryEntry& e = inventory->Get(i);
+            if ((e.source == VM_SOURCE_REGISTRY) != (pass == 0))
+                continue;
+            versions[numVersions].Parse((LPSTR)e.version);
+            versions[numVersions].SetRegPath((char*)e.root);
+            found[numVersions++] = i;
+        }
+
+        Version* v = FindVersion(versions, numVersions, version, min, max);
+        if (v)
+            result = _strdup(inventory->Get(found[v - versions]).path);
+    }
+
+    free(found);
+    delete[] versions;
+    delete inventory;
+    return result;
 }
 
 Version* VM::FindVersion(Version* versions, DWORD numVersions, LPSTR version, LPSTR min, LPSTR max)
@@ -201,80 +329,6 @@ Version* VM::FindVersion(Version* versions, DWORD numVersions, LPSTR version, LP
     return maxVer;
 }
 
-void VM::FindVersions(Version* versions, DWORD* numVersions)
-{
-    HKEY  hKey;
-    DWORD length;
-    CHAR  version[MAX_PATH];
-    DWORD size = *numVersions;
-
-    *numVersions = 0;
-
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "Software\\JavaSoft\\Java Runtime Environment", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        for (; *numVersions < size; (*numVersions)++) {
-            length = MAX_PATH;
-            if (RegEnumKeyExA(hKey, *numVersions, version, &length, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-                break;
-
-            versions[*numVersions].Parse(version);
-            versions[*numVersions].SetRegPath("Software\\JavaSoft\\Java Runtime Environment");
-        }
-        RegCloseKey(hKey);
-    }
-
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "Software\\JavaSoft\\JRE", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        for (; *numVersions < size; (*numVersions)++) {
-            length = MAX_PATH;
-            if (RegEnumKeyExA(hKey, *numVersions, version, &length, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-                break;
-
-            versions[*numVersions].Parse(version);
-            versions[*numVersions].SetRegPath("Software\\JavaSoft\\JRE");
-        }
-        RegCloseKey(hKey);
-    }
-
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "Software\\IBM\\Java2 Runtime Environment", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        DWORD offset = *numVersions;
-        for (; *numVersions < size; (*numVersions)++) {
-            length = MAX_PATH;
-            if (RegEnumKeyExA(hKey, *numVersions - offset, version, &length, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-                break;
-
-            versions[*numVersions].Parse(version);
-            versions[*numVersions].SetRegPath("Software\\IBM\\Java2 Runtime Environment");
-        }
-        RegCloseKey(hKey);
-    }
-
-#ifndef X64
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "Software\\Wow6432Node\\JavaSoft\\Java Runtime Environment", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        for (; *numVersions < size; (*numVersions)++) {
-            length = MAX_PATH;
-            if (RegEnumKeyExA(hKey, *numVersions, version, &length, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-                break;
-
-            versions[*numVersions].Parse(version);
-            versions[*numVersions].SetRegPath("Software\\Wow6432Node\\JavaSoft\\Java Runtime Environment");
-        }
-        RegCloseKey(hKey);
-    }
-
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "Software\\Wow6432Node\\IBM\\Java2 Runtime Environment", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-        DWORD offset = *numVersions;
-        for (; *numVersions < size; (*numVersions)++) {
-            length = MAX_PATH;
-            if (RegEnumKeyExA(hKey, *numVersions - offset, version, &length, NULL, NULL, NULL, NULL) != ERROR_SUCCESS)
-                break;
-
-            versions[*numVersions].Parse(version);
-            versions[*numVersions].SetRegPath("Software\\Wow6432Node\\IBM\\Java2 Runtime Environment");
-        }
-        RegCloseKey(hKey);
-    }
-#endif
-}
-
 int Version::Compare(Version& other) 
 {
     for (int index = 0; index < 10; index++) {
@@ -308,10 +362,177 @@ void Version::Parse(LPSTR version)
     Parsed = true;
 }
 
-void VM::ExtractSpecificVMArgs(dictionary* ini, char*** args, UINT& count)
+// Folds the size and last write time of a file into the hash
+static ULONGLONG HashFileTime(const char* file, ULONGLONG hash)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    ULONGLONG stamp[2] = { CACHE_MISSING, 0 };
+
+    if (GetFileAttributesExA(file, GetFileExInfoStandard, &fad)) {
+        stamp[0] = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+        stamp[1] = ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    }
+    return Cache::Hash(stamp, sizeof(stamp), hash);
+}
+
+/*
+ * An archive only fits the VM and the exact args it was created with, and
+ * the VM refuses it once a jar on the classpath has changed. So the key
+ * covers the VM library, every arg (the classpath is already resolved) and
+ * the size and time of each classpath entry.
+ */
+static ULONGLONG HashArchiveInputs(const char* vmLibrary, char** args, UINT count)
+{
+    ULONGLONG hash = HashFileTime(vmLibrary, Cache::HashString(vmLibrary));
+
+    for (UINT i = 0; i < count; i++) {
+        hash = Cache::Hash(args[i], strlen(args[i]) + 1, hash);
+        if (strncmp(args[i], CDS_CLASS_PATH, sizeof(CDS_CLASS_PATH) - 1) != 0)
+            continue;
+
+        const char* p = args[i] + sizeof(CDS_CLASS_PATH) - 1;
+        while (*p) {
+            const char* end = strchr(p, ';');
+            size_t len = end ? (size_t)(end - p) : strlen(p);
+            if (len > 0 && len < MAX_PATH) {
+                char path[MAX_PATH];
+                memcpy(path, p, len);
+                path[len] = 0;
+                hash = HashFileTime(path, hash);
+            }
+            p += end ? len + 1 : len;
+        }
+    }
+    return hash;
+}
+
+// The memory and processors this process may use. A job object (which is how
+// containers and many schedulers confine a process) can limit both well below
+// what the machine has; affinity and CPU rate caps are set on the job too.
+static void GetVMBudget(VMBudget& budget, bool pinned)
 {
-    MEMORYSTATUS ms;
-    GlobalMemoryStatus(&ms);
+    memset(&budget, 0, sizeof(budget));
+
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof(ms);
+    if (GlobalMemoryStatusEx(&ms)) {
+        budget.physical = (unsigned)(ms.ullTotalPhys >> 20);
+        budget.available = (unsigned)(ms.ullAvailPhys >> 20);
+    }
+#ifndef X64
+    budget.address = 1530;
+#endif
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+    if (QueryInformationJobObject(NULL, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL)) {
+        DWORD flags = limits.BasicLimitInformation.LimitFlags;
+        ULONGLONG limit = 0;
+        if (flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY)
+            limit = limits.ProcessMemoryLimit;
+        if ((flags & JOB_OBJECT_LIMIT_JOB_MEMORY) && (!limit || limits.JobMemoryLimit < limit))
+            limit = limits.JobMemoryLimit;
+        budget.limit = (unsigned)(limit >> 20);
+    }
+
+    // Windows 8 and later
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate;
+    if (QueryInformationJobObject(NULL, JobObjectCpuRateControlInformation, &rate, sizeof(rate), NULL) &&
+        (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE)) {
+        if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP)
+            budget.cpuRate = rate.CpuRate;
+        else if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_MIN_MAX_RATE)
+            budget.cpuRate = rate.MaxRate;
+    }
+
+    // Processor groups are Windows 7 and later; before that all processors
+    // are in the one group GetSystemInfo reports
+    typedef DWORD (WINAPI *LPFNGetActiveProcessorCount)(WORD group);
+    typedef BOOL (WINAPI *LPFNGetProcessGroupAffinity)(HANDLE process, PUSHORT count, PUSHORT groups);
+    HINSTANCE hKernel32 = GetModuleHandleA("kernel32");
+    LPFNGetActiveProcessorCount lpfnGetActiveProcessorCount =
+        (LPFNGetActiveProcessorCount)GetProcAddress(hKernel32, "GetActiveProcessorCount");
+    LPFNGetProcessGroupAffinity lpfnGetProcessGroupAffinity =
+        (LPFNGetProcessGroupAffinity)GetProcAddress(hKernel32, "GetProcessGroupAffinity");
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    budget.machineCpus = si.dwNumberOfProcessors;
+    if (lpfnGetActiveProcessorCount)
+        budget.machineCpus = lpfnGetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+    // The masks are only for the one group the process runs in; they are
+    // zero if its threads are spread over several
+    DWORD_PTR processMask, systemMask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        for (; processMask; processMask &= processMask - 1)
+            budget.cpus++;
+    }
+
+    USHORT groups[64], groupCount = 64;
+    if (lpfnGetActiveProcessorCount && lpfnGetProcessGroupAffinity &&
+        lpfnGetProcessGroupAffinity(GetCurrentProcess(), &groupCount, groups) && groupCount > 1) {
+        budget.cpus = 0;
+        for (USHORT i = 0; i < groupCount; i++)
+            budget.cpus += lpfnGetActiveProcessorCount(groups[i]);
+    }
+
+    // Pinned by process.affinity and the like, the thread that starts the VM
+    // may have been moved to another group, which the process masks do not show
+    typedef BOOL (WINAPI *LPFNGetThreadGroupAffinity)(HANDLE thread, PGROUP_AFFINITY affinity);
+    LPFNGetThreadGroupAffinity lpfnGetThreadGroupAffinity =
+        (LPFNGetThreadGroupAffinity)GetProcAddress(hKernel32, "GetThreadGroupAffinity");
+    GROUP_AFFINITY ga;
+    if (pinned && lpfnGetThreadGroupAffinity && lpfnGetThreadGroupAffinity(GetCurrentThread(), &ga)) {
+        unsigned cpus = Placement::CountCpus(ga.Mask);
+        if (cpus && (!budget.cpus || cpus < budget.cpus))
+            budget.cpus = cpus;
+    }
+}
+
+// Adds the vm args of the sizing profile, if there is one
+static void AddProfileArgs(dictionary* ini, const VMBudget& budget, char** args, UINT count,
+                           char out[][VM_SIZING_ARG_LEN], int& outCount)
+{
+    outCount = 0;
+    char* name = iniparser_getstr(ini, (char*)VM_PROFILE);
+    if (!name)
+        return;
+
+    int profile = VMSizing::GetProfile(name);
+    VMSizes sizes;
+    if (profile == VM_PROFILE_NONE) {
+        Log::Warning("Unknown vm.profile: %s", name);
+        return;
+    }
+    if (!VMSizing::Compute(profile, budget, sizes)) {
+        Log::Warning("Could not size the VM for profile: %s", name);
+        return;
+    }
+
+    Log::Info("VM profile %s: %u MB of %u MB (limit %u MB), %u of %u processors (rate %u)",
+              name, sizes.memory, budget.physical, budget.limit, sizes.cpus, budget.machineCpus, budget.cpuRate);
+    outCount = VMSizing::Format(sizes, args, (int)count, out, VM_SIZING_MAX_ARGS);
+}
+
+// Whether the vm args already set up (or turn off) class data sharing
+static bool HasArchiveArg(char** args, UINT count)
+{
+    for (UINT i = 0; i < count; i++) {
+        if (strncmp(args[i], "-XX:SharedArchiveFile", 21) == 0 ||
+            strncmp(args[i], "-XX:ArchiveClassesAtExit", 24) == 0 ||
+            strncmp(args[i], "-XX:+AutoCreateSharedArchive", 28) == 0 ||
+            strcmp(args[i], "-Xshare:off") == 0)
+            return true;
+    }
+    return false;
+}
+
+void VM::ExtractSpecificVMArgs(dictionary* ini, char*** args, UINT& count, const char* vmLibrary)
+{
+    bool pinned = iniparser_getstr(ini, (char*)PROCESS_AFFINITY) || iniparser_getstr(ini, (char*)PROCESS_GROUP) ||
+                  iniparser_getstr(ini, (char*)PROCESS_NUMA_NODE);
+    VMBudget budget;
+    GetVMBudget(budget, pinned);
 
 #ifdef X64
     int overallMax = 8000;
@@ -319,7 +540,7 @@ void VM::ExtractSpecificVMArgs(dictionary* ini, char*** args, UINT& count)
     int overallMax = 1530;
 #endif
 
-    int availMax = (int)(ms.dwTotalPhys / 1024 / 1024) - 80;
+    int availMax = (int)VMSizing::GetMemory(budget) - 80;
 
     auto appendArg = [&](const char* value)
     {
@@ -407,20 +628,84 @@ void VM::ExtractSpecificVMArgs(dictionary* ini, char*** args, UINT& count)
 
     if (libPathsCount > 0) {
 
-        char libPathArg[4096];
-        libPathArg[0] = 0;
-
-        strcpy_s(libPathArg, "-Djava.library.path=");
+        StringBuilder libPathArg;
+        libPathArg.Append("-Djava.library.path=");
 
         for (UINT i = 0; i < libPathsCount; i++) {
-            strcat_s(libPathArg, libPaths[i]);
-            strcat_s(libPathArg, ";");
+            libPathArg.Append(libPaths[i]);
+            libPathArg.Append(';');
             free(libPaths[i]);
         }
 
         free(libPaths);
 
-        appendArg(libPathArg);
+        if (!libPathArg.Failed())
+            appendArg(libPathArg.Get());
+    }
+
+    // ------------------------------------------------------------
+    // Class data sharing: -XX:SharedArchiveFile or, when the archive
+    // is missing or out of date, -XX:ArchiveClassesAtExit
+    // ------------------------------------------------------------
+    if (vmLibrary && iniparser_getboolean(ini, (char*)VM_CDS_ARCHIVE, 0)) {
+        char* module = iniparser_getstr(ini, (char*)MODULE_INI);
+        char archive[MAX_PATH], keyFile[MAX_PATH];
+
+        if (HasArchiveArg(*args, count)) {
+            Log::Info("CDS archive set in vm args, vm.cds.archive ignored");
+        } else if (Cache::GetPath(module, CDS_ARCHIVE_EXT, archive, sizeof(archive)) &&
+                   Cache::GetPath(module, CDS_KEY_EXT, keyFile, sizeof(keyFile))) {
+            ULONGLONG key = HashArchiveInputs(vmLibrary, *args, count);
+
+            DWORD size;
+            const BYTE* view = Cache::Map(keyFile, size);
+            bool current = view && size == sizeof(key) && memcmp(view, &key, sizeof(key)) == 0;
+            Cache::Unmap(view);
+
+            // A run that did not exit normally leaves no archive behind
+            WIN32_FILE_ATTRIBUTE_DATA fad;
+            current = current && GetFileAttributesExA(archive, GetFileExInfoStandard, &fad) &&
+                      (fad.nFileSizeHigh || fad.nFileSizeLow);
+
+            char archiveArg[MAX_PATH + 32];
+            if (current) {
+                Log::Info("Using CDS archive: %s", archive);
+                sprintf_s(archiveArg, sizeof(archiveArg), "-XX:SharedArchiveFile=%s", archive);
+                appendArg(archiveArg);
+            } else {
+                Cache::Delete(archive);
+                if (Cache::Write(keyFile, &key, sizeof(key))) {
+                    Log::Info("Creating CDS archive on exit: %s", archive);
+                    sprintf_s(archiveArg, sizeof(archiveArg), "-XX:ArchiveClassesAtExit=%s", archive);
+                    appendArg(archiveArg);
+                }
+            }
+        }
+    }
+
+    // ------------------------------------------------------------
+    // Sizing profile: heap, metaspace and collector for the budget.
+    // Added after the CDS key is taken as -Xms follows free memory.
+    // ------------------------------------------------------------
+    char profileArgs[VM_SIZING_MAX_ARGS][VM_SIZING_ARG_LEN];
+    int profileCount;
+    AddProfileArgs(ini, budget, *args, count, profileArgs, profileCount);
+    for (int i = 0; i < profileCount; i++)
+        appendArg(profileArgs[i]);
+
+    // ------------------------------------------------------------
+    // Pinned processors: the VM sizes its thread pools from the
+    // process mask, which does not show a move to another group
+    // ------------------------------------------------------------
+    if (pinned) {
+        bool set = false;
+        for (UINT i = 0; i < count && !set; i++)
+            set = strncmp((*args)[i], "-XX:ActiveProcessorCount=", 25) == 0;
+        if (!set) {
+            char cpuArg[64];
+            _snprintf_s(cpuArg, sizeof(cpuArg), _TRUNCATE, "-XX:ActiveProcessorCount=%u", VMSizing::GetCpus(budget));
+            appendArg(cpuArg);
+        }
     }
 }
 
@@ -461,17 +746,29 @@ void VM::LoadRuntimeLibrary(TCHAR* libPath)
     }
 }
 
-int VM::StartJavaVM(TCHAR* libPath, TCHAR* vmArgs[], HINSTANCE hInstance)
+// Loads jvm.dll, if StartJavaVM has not already, so it can be loaded while
+// the launcher does other things
+bool VM::LoadJavaVMLibrary(TCHAR* libPath)
 {
-    g_hInstance = hInstance;
+    if (g_jniLibrary)
+        return true;
 
     LoadRuntimeLibrary(libPath);
 
     g_jniLibrary = LoadLibraryA(libPath);
     if (!g_jniLibrary) {
         Log::Error("ERROR: Could not load library: %s", libPath);
-        return -1;
+        return false;
     }
+    return true;
+}
+
+int VM::StartJavaVM(TCHAR* libPath, TCHAR* vmArgs[], HINSTANCE hInstance)
+{
+    g_hInstance = hInstance;
+
+    if (!LoadJavaVMLibrary(libPath))
+        return -1;
 
     JNI_createJavaVM createJavaVM =
         (JNI_createJavaVM)GetProcAddress(g_jniLibrary, "JNI_CreateJavaVM");
@@ -504,7 +801,9 @@ int VM::StartJavaVM(TCHAR* libPath, TCHAR* vmArgs[], HINSTANCE hInstance)
     init_args.nOptions           = numVMArgs + numHooks;
     init_args.ignoreUnrecognized = JNI_TRUE;
 
+    Timing::Begin("vm.create");
     int result = createJavaVM(&jvm, &env, &init_args);
+    Timing::End("vm.create");
 
     for (int i = 0; i < numVMArgs; i++) {
         free(options[i].optionString);
@@ -551,5 +850,8 @@ void VM::AbortHook()
 void VM::ExitHook(int status)
 {
     Log::Info("Application exited (%d).", status);
+    LaunchServer::Shutdown(status);
+    Preload::Stop(true);
+    Timing::Flush();
     Service::Shutdown(status);
 }
@@ -27,6 +27,9 @@
 #define HEAP_SIZE_MIN_PERCENT ":vm.heapsize.min.percent"
 #define HEAP_SIZE_PREFERRED   ":vm.heapsize.preferred"
 
+// Heap, metaspace and GC sizing profile (throughput, latency or footprint)
+#define VM_PROFILE ":vm.profile"
+
 // Java library path # keys
 #define JAVA_LIBRARY_PATH ":java.library.path"
 
@@ -34,6 +37,9 @@
 #define VM_LOCATION ":vm.location"
 #define VM_SYSFIRST ":vm.sysfirst"
 
+// Class data sharing archive kept in the cache directory
+#define VM_CDS_ARCHIVE ":vm.cds.archive"
+
 // VM args
 #define VM_ARG_HEAPSIZE "-Xmx"
 
@@ -57,9 +63,10 @@ private:
 // VM utilities
 struct VM {
 	static char* FindJavaVMLibrary(dictionary *ini);
-	static void ExtractSpecificVMArgs(dictionary* ini, TCHAR*** args, UINT& count);
-	static char* GetJavaVMLibrary(LPSTR version, LPSTR min, LPSTR max);
+	static void ExtractSpecificVMArgs(dictionary* ini, TCHAR*** args, UINT& count, const char* vmLibrary = NULL);
+	static char* GetJavaVMLibrary(dictionary* ini, LPSTR version, LPSTR min, LPSTR max);
 	static void LoadRuntimeLibrary(TCHAR* libPath);
+	static bool LoadJavaVMLibrary(TCHAR* libPath);
 	static int StartJavaVM(TCHAR* libPath, TCHAR* vmArgs[], HINSTANCE hInstance);
 	static int CleanupVM();
 	static JavaVM* GetJavaVM();
@@ -70,7 +77,6 @@ struct VM {
 	
 public:
 	static Version* FindVersion(Version* versions, DWORD numVersions, LPSTR version, LPSTR min, LPSTR max);
-	static void FindVersions(Version* versions, DWORD* numVersions);
 };
 
 #endif // VM_UTILS_H
@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "VMInventory.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_KEY  0
+#define INPUT_FILE 1
+
+#define MIN_ENTRIES 16
+#define MIN_INPUTS  32
+#define RELEASE_LEN 4096
+
+// Where a VM library may be under a Java home, JDK layouts last
+static const char* const homeLibraries[] = {
+    "bin\\server\\jvm.dll",
+    "bin\\client\\jvm.dll",
+    "jre\\bin\\server\\jvm.dll",
+    "jre\\bin\\client\\jvm.dll",
+    NULL
+};
+
+// Copies a string that is known to fit, or truncates it
+static void Copy(char* dest, const char* src, size_t len)
+{
+    size_t n = strlen(src);
+    if (n >= len)
+        n = len - 1;
+    memcpy(dest, src, n);
+    dest[n] = 0;
+}
+
+// Joins up to three parts into dest, false if they do not fit
+static bool Join(char* dest, size_t len, const char* a, const char* b, const char* c)
+{
+    size_t na = strlen(a), nb = strlen(b), nc = strlen(c);
+    if (na + nb + nc >= len)
+        return false;
+    memcpy(dest, a, na);
+    memcpy(&dest[na], b, nb);
+    memcpy(&dest[na + nb], c, nc + 1);
+    return true;
+}
+
+static bool EndsWith(const char* s, const char* suffix)
+{
+    size_t len = strlen(s), n = strlen(suffix);
+    return len >= n && !strcmp(&s[len - n], suffix);
+}
+
+// FNV-1a, with a separator after each string so that the parts are distinct
+static unsigned long long HashString(const char* s, unsigned long long hash)
+{
+    for (; s && *s; s++)
+        hash = (hash ^ (unsigned char)*s) * 1099511628211ULL;
+    return (hash ^ 0xFF) * 1099511628211ULL;
+}
+
+VMInventory::VMInventory(const VMProvider& provider) :
+    provider(provider), entries(NULL), count(0), size(0), inputs(NULL), inputCount(0), inputSize(0),
+    data(NULL), search(0), calls(0)
+{
+}
+
+VMInventory::~VMInventory()
+{
+    free(entries);
+    free(inputs);
+    free(data);
+}
+
+unsigned long long VMInventory::HashSearch(const VMSearch& search)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < search.rootCount; i++)
+        hash = HashString(search.roots[i], hash);
+    hash = HashString("|", hash);
+    hash = HashString(search.javaHome, hash);
+    for (int i = 0; i < search.bundledCount; i++)
+        hash = HashString(search.bundled[i], hash);
+    hash = HashString(search.serverForClient ? "|server" : "|", hash);
+    return hash;
+}
+
+bool VMInventory::AddEntry(const char* version, const char* path, const char* root, unsigned source)
+{
+    if (count == size) {
+        int n = size ? size * 2 : MIN_ENTRIES;
+        VMInventoryEntry* p = (VMInventoryEntry*)realloc(entries, n * sizeof(VMInventoryEntry));
+        if (!p)
+            return false;
+        entries = p;
+        size = n;
+    }
+
+    VMInventoryEntry& e = entries[count++];
+    memset(&e, 0, sizeof(e));
+    Copy(e.version, version, sizeof(e.version));
+    Copy(e.path, path, sizeof(e.path));
+    Copy(e.root, root, sizeof(e.root));
+    e.source = source;
+    return true;
+}
+
+bool VMInventory::AddInput(unsigned kind, const char* path, unsigned long long time)
+{
+    if (inputCount == inputSize) {
+        int n = inputSize ? inputSize * 2 : MIN_INPUTS;
+        VMInventoryInput* p = (VMInventoryInput*)realloc(inputs, n * sizeof(VMInventoryInput));
+        if (!p)
+            return false;
+        inputs = p;
+        inputSize = n;
+    }
+
+    VMInventoryInput& input = inputs[inputCount++];
+    memset(&input, 0, sizeof(input));
+    input.kind = kind;
+    Copy(input.path, path, sizeof(input.path));
+    input.time = time;
+    return true;
+}
+
+void* VMInventory::OpenKey(const char* path)
+{
+    calls++;
+    return provider.openKey(provider.ctx, path);
+}
+
+void VMInventory::CloseKey(void* key)
+{
+    calls++;
+    provider.closeKey(provider.ctx, key);
+}
+
+unsigned long long VMInventory::GetKeyTime(void* key)
+{
+    calls++;
+    return provider.getKeyTime(provider.ctx, key);
+}
+
+unsigned long long VMInventory::GetFileTime(const char* path)
+{
+    calls++;
+    return provider.getFileTime(provider.ctx, path);
+}
+
+unsigned long long VMInventory::Stamp(unsigned kind, const char* path)
+{
+    if (kind == INPUT_FILE)
+        return GetFileTime(path);
+
+    void* key = OpenKey(path);
+    if (!key)
+        return VM_INVENTORY_MISSING;
+    unsigned long long time = GetKeyTime(key);
+    CloseKey(key);
+    return time;
+}
+
+/*
+ * Each subkey of a root is a version with the path of its VM in RuntimeLib.
+ * Some 64 bit JREs register a client VM they do not ship, so when asked the
+ * server VM beside it is used instead.
+ */
+void VMInventory::SearchRoot(const char* root, bool serverForClient)
+{
+    void* key = OpenKey(root);
+    AddInput(INPUT_KEY, root, key ? GetKeyTime(key) : VM_INVENTORY_MISSING);
+    if (!key)
+        return;
+
+    char name[VM_INVENTORY_PATH], sub[VM_INVENTORY_PATH], lib[VM_INVENTORY_PATH];
+    for (int i = 0; calls++, provider.enumKey(provider.ctx, key, i, name, sizeof(name)); i++) {
+        void* versionKey = Join(sub, sizeof(sub), root, "\\", name) ? OpenKey(sub) : NULL;
+        if (!versionKey)
+            continue;
+
+        AddInput(INPUT_KEY, sub, GetKeyTime(versionKey));
+        calls++;
+        bool found = provider.getValue(provider.ctx, versionKey, "RuntimeLib", lib, sizeof(lib));
+        CloseKey(versionKey);
+        if (!found)
+            continue;
+
+        unsigned long long time = GetFileTime(lib);
+        if (serverForClient && time == VM_INVENTORY_MISSING && EndsWith(lib, "client\\jvm.dll")) {
+            memcpy(&lib[strlen(lib) - 14], "server", 6);
+            time = GetFileTime(lib);
+        }
+        AddInput(INPUT_FILE, lib, time);
+        AddEntry(name, lib, root, VM_SOURCE_REGISTRY);
+    }
+    CloseKey(key);
+}
+
+/*
+ * The first VM library found under a Java home. Its version is taken from
+ * the release file (JAVA_VERSION="17.0.2") that runtimes since Java 7 have.
+ * Every library looked for is an input, so one that appears is noticed.
+ */
+void VMInventory::SearchHome(const char* home, unsigned source)
+{
+    char lib[VM_INVENTORY_PATH];
+    size_t len = strlen(home);
+    const char* sep = len && (home[len - 1] == '\\' || home[len - 1] == '/') ? "" : "\\";
+
+    for (int i = 0; homeLibraries[i]; i++) {
+        if (!Join(lib, sizeof(lib), home, sep, homeLibraries[i]))
+            return;
+
+        unsigned long long time = GetFileTime(lib);
+        AddInput(INPUT_FILE, lib, time);
+        if (time == VM_INVENTORY_MISSING)
+            continue;
+
+        char release[VM_INVENTORY_PATH], text[RELEASE_LEN], version[64] = "0";
+        calls++;
+        if (Join(release, sizeof(release), home, sep, "release") &&
+            provider.readFile(provider.ctx, release, text, sizeof(text))) {
+            const char* v = strstr(text, "JAVA_VERSION=\"");
+            if (v) {
+                v += 14;
+                size_t n = strcspn(v, "\"\r\n");
+                if (n > 0 && n < sizeof(version)) {
+                    memcpy(version, v, n);
+                    version[n] = 0;
+                }
+            }
+        }
+        AddEntry(version, lib, home, source);
+        return;
+    }
+}
+
+void VMInventory::Build(const VMSearch& s)
+{
+    count = 0;
+    inputCount = 0;
+    search = HashSearch(s);
+
+    for (int i = 0; i < s.rootCount; i++)
+        SearchRoot(s.roots[i], s.serverForClient);
+    if (s.javaHome && *s.javaHome)
+        SearchHome(s.javaHome, VM_SOURCE_JAVA_HOME);
+    for (int i = 0; i < s.bundledCount; i++)
+        SearchHome(s.bundled[i], VM_SOURCE_BUNDLED);
+}
+
+bool VMInventory::Load(const void* saved, size_t len, const VMSearch& s)
+{
+    const VMInventoryHeader* h = (const VMInventoryHeader*)saved;
+    if (!h || len < sizeof(VMInventoryHeader) || h->magic != VM_INVENTORY_MAGIC ||
+        h->version != VM_INVENTORY_VERSION || h->size != len || h->search != HashSearch(s) ||
+        h->entries > len || h->inputs > len ||
+        sizeof(VMInventoryHeader) + (size_t)h->entries * sizeof(VMInventoryEntry) +
+        (size_t)h->inputs * sizeof(VMInventoryInput) != len)
+        return false;
+
+    const VMInventoryEntry* e = (const VMInventoryEntry*)&h[1];
+    const VMInventoryInput* in = (const VMInventoryInput*)&e[h->entries];
+
+    // Any change to what it was built from means searching again
+    for (unsigned i = 0; i < h->inputs; i++) {
+        if (memchr(in[i].path, 0, sizeof(in[i].path)) == NULL || Stamp(in[i].kind, in[i].path) != in[i].time)
+            return false;
+    }
+
+    count = 0;
+    inputCount = 0;
+    search = h->search;
+    for (unsigned i = 0; i < h->entries; i++) {
+        if (memchr(e[i].version, 0, sizeof(e[i].version)) == NULL || memchr(e[i].path, 0, sizeof(e[i].path)) == NULL ||
+            memchr(e[i].root, 0, sizeof(e[i].root)) == NULL || !AddEntry(e[i].version, e[i].path, e[i].root, e[i].source)) {
+            count = 0;
+            return false;
+        }
+    }
+    for (unsigned i = 0; i < h->inputs; i++) {
+        if (!AddInput(in[i].kind, in[i].path, in[i].time)) {
+            count = 0;
+            inputCount = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned VMInventory::GetSize() const
+{
+    return (unsigned)(sizeof(VMInventoryHeader) + count * sizeof(VMInventoryEntry) + inputCount * sizeof(VMInventoryInput));
+}
+
+const void* VMInventory::GetData()
+{
+    unsigned len = GetSize();
+    unsigned char* p = (unsigned char*)realloc(data, len);
+    if (!p)
+        return NULL;
+    data = p;
+
+    VMInventoryHeader* h = (VMInventoryHeader*)data;
+    memset(h, 0, sizeof(VMInventoryHeader));
+    h->magic = VM_INVENTORY_MAGIC;
+    h->version = VM_INVENTORY_VERSION;
+    h->size = len;
+    h->entries = count;
+    h->inputs = inputCount;
+    h->search = search;
+    if (count)
+        memcpy(&h[1], entries, count * sizeof(VMInventoryEntry));
+    if (inputCount)
+        memcpy(&data[sizeof(VMInventoryHeader) + count * sizeof(VMInventoryEntry)], inputs,
+               inputCount * sizeof(VMInventoryInput));
+    return data;
+}
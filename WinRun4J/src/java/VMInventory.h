@@ -0,0 +1,128 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef VM_INVENTORY_H
+#define VM_INVENTORY_H
+
+#include <stddef.h>
+
+// The Java VMs installed on a machine: the versions registered under each
+// registry root, the VM in JAVA_HOME and any runtimes bundled with the
+// application. Building it means enumerating the registry and reading the
+// RuntimeLib of every version, so the result is saved with the last write
+// time of each key and file it was read from. Checking those stamps on a
+// later start is enough to know it is still right.
+
+#define VM_INVENTORY_MAGIC   0x564A3457	// "W4JV"
+#define VM_INVENTORY_VERSION 1
+#define VM_INVENTORY_PATH    260
+#define VM_INVENTORY_MISSING ((unsigned long long)-1)
+
+#define VM_SOURCE_REGISTRY  0
+#define VM_SOURCE_JAVA_HOME 1
+#define VM_SOURCE_BUNDLED   2
+
+struct VMProvider {
+	// Opens a key under HKEY_LOCAL_MACHINE, NULL if it does not exist
+	void* (*openKey)(void* ctx, const char* path);
+	void (*closeKey)(void* ctx, void* key);
+	// Name of the subkey at index, false after the last one
+	bool (*enumKey)(void* ctx, void* key, int index, char* name, int len);
+	bool (*getValue)(void* ctx, void* key, const char* name, char* value, int len);
+	// Last write time of a key, which changes with its values and subkeys
+	unsigned long long (*getKeyTime)(void* ctx, void* key);
+	// Last write time of a file, VM_INVENTORY_MISSING if there is none
+	unsigned long long (*getFileTime)(void* ctx, const char* path);
+	// Reads the start of a small text file, terminated
+	bool (*readFile)(void* ctx, const char* path, char* buf, int len);
+	void* ctx;
+};
+
+// Where to look, which is saved with the inventory
+struct VMSearch {
+	const char* const* roots;		// Registry keys with a subkey per version
+	int rootCount;
+	const char* javaHome;			// May be NULL
+	const char* const* bundled;		// Runtime directories, eg. <app>\jre
+	int bundledCount;
+	bool serverForClient;			// Use the server VM for a missing client one
+};
+
+struct VMInventoryEntry {
+	char version[64];
+	char path[VM_INVENTORY_PATH];	// jvm.dll
+	char root[VM_INVENTORY_PATH];	// Registry root or directory it came from
+	unsigned source;
+	unsigned pad;
+};
+
+// A key or file read while building, with its stamp then
+struct VMInventoryInput {
+	unsigned kind;
+	char path[VM_INVENTORY_PATH];
+	unsigned long long time;
+};
+
+struct VMInventoryHeader {
+	unsigned magic;
+	unsigned version;
+	unsigned size;
+	unsigned entries;
+	unsigned inputs;
+	unsigned pad;
+	unsigned long long search;		// Hash of the VMSearch
+};
+
+class VMInventory {
+public:
+	VMInventory(const VMProvider& provider);
+	~VMInventory();
+
+	void Build(const VMSearch& search);
+
+	// Reads a saved inventory (which is copied) if it was built for the same
+	// search and none of its inputs have changed since
+	bool Load(const void* data, size_t size, const VMSearch& search);
+
+	// Lays out the inventory to save, valid until the next change
+	const void* GetData();
+	unsigned GetSize() const;
+
+	int GetCount() const { return count; }
+	const VMInventoryEntry& Get(int i) const { return entries[i]; }
+
+	// Provider calls made, to show what a check costs against a search
+	int GetCalls() const { return calls; }
+
+private:
+	bool AddEntry(const char* version, const char* path, const char* root, unsigned source);
+	bool AddInput(unsigned kind, const char* path, unsigned long long time);
+	void* OpenKey(const char* path);
+	void CloseKey(void* key);
+	unsigned long long GetKeyTime(void* key);
+	unsigned long long GetFileTime(const char* path);
+	unsigned long long Stamp(unsigned kind, const char* path);
+	void SearchRoot(const char* root, bool serverForClient);
+	void SearchHome(const char* home, unsigned source);
+	static unsigned long long HashSearch(const VMSearch& search);
+
+	VMProvider provider;
+	VMInventoryEntry* entries;
+	int count;
+	int size;
+	VMInventoryInput* inputs;
+	int inputCount;
+	int inputSize;
+	unsigned char* data;
+	unsigned long long search;
+	int calls;
+};
+
+#endif // VM_INVENTORY_H
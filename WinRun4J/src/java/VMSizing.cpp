@@ -0,0 +1,220 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "VMSizing.h"
+#include <stdio.h>
+#include <string.h>
+
+// Memory kept back for the VM itself (code cache, thread stacks, GC data)
+#define NATIVE_RESERVE 64
+#define MIN_HEAP       16
+
+// Above this the VM cannot use compressed object pointers
+#define OOPS_LIMIT 31744
+
+struct Profile {
+    const char* name;
+    unsigned heapPercent;		// Of the budget left after metaspace and reserve
+    unsigned minHeapPercent;	// Of the max heap
+    unsigned metaspace;			// Max metaspace
+    unsigned heapCap;			// Largest heap worth having, 0 for no cap
+    const char* gc;
+    unsigned pauseMillis;
+    bool shrinkHeap;
+};
+
+static const Profile profiles[] = {
+    { NULL, 0, 0, 0, 0, NULL, 0, false },
+    // Batch work: most of the memory, a fixed heap and the parallel collector
+    { "throughput", 75, 100, 512, 0, "-XX:+UseParallelGC", 0, false },
+    // Interactive: G1 with a pause goal and a fixed heap so it never grows mid run
+    { "latency", 60, 100, 384, 0, "-XX:+UseG1GC", 50, false },
+    // Small tools and many instances: a small heap that is given back when idle
+    { "footprint", 25, 12, 128, 1024, "-XX:+UseSerialGC", 0, true },
+};
+
+#define NUM_PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+int VMSizing::GetProfile(const char* name)
+{
+    if (!name)
+        return VM_PROFILE_NONE;
+    for (int i = 1; i < (int)NUM_PROFILES; i++) {
+        if (!strcmp(name, profiles[i].name))
+            return i;
+    }
+    return VM_PROFILE_NONE;
+}
+
+const char* VMSizing::GetProfileName(int profile)
+{
+    return profile > 0 && profile < (int)NUM_PROFILES ? profiles[profile].name : NULL;
+}
+
+// The smaller of installed memory and the job limit. Free memory is not used
+// here as it only says what other processes hold right now.
+unsigned VMSizing::GetMemory(const VMBudget& budget)
+{
+    unsigned memory = budget.physical;
+    if (budget.limit && (!memory || budget.limit < memory))
+        memory = budget.limit;
+    return memory;
+}
+
+// A rate cap is a share of the whole machine, so 25% of 16 processors is 4
+// whatever the affinity says
+unsigned VMSizing::GetCpus(const VMBudget& budget)
+{
+    unsigned cpus = budget.cpus ? budget.cpus : budget.machineCpus;
+    if (budget.cpuRate && budget.cpuRate < 10000 && budget.machineCpus) {
+        unsigned capped = (budget.machineCpus * budget.cpuRate + 9999) / 10000;
+        if (capped < cpus)
+            cpus = capped;
+    }
+    return cpus ? cpus : 1;
+}
+
+// HotSpot's own rule: all processors up to 8, then 5/8 of the rest
+static unsigned ParallelThreads(unsigned cpus)
+{
+    return cpus <= 8 ? cpus : 8 + (cpus - 8) * 5 / 8;
+}
+
+bool VMSizing::Compute(int profile, const VMBudget& budget, VMSizes& sizes)
+{
+    memset(&sizes, 0, sizeof(sizes));
+    if (profile <= VM_PROFILE_NONE || profile >= (int)NUM_PROFILES)
+        return false;
+
+    const Profile& p = profiles[profile];
+    sizes.memory = GetMemory(budget);
+    sizes.cpus = GetCpus(budget);
+    if (!sizes.memory)
+        return false;
+
+    // Metaspace is at most an eighth of the budget (or of the address space a
+    // 32 bit VM has) so small jobs still get a heap
+    unsigned space = budget.address && budget.address < sizes.memory ? budget.address : sizes.memory;
+    sizes.maxMetaspace = p.metaspace;
+    if (sizes.maxMetaspace > space / 8)
+        sizes.maxMetaspace = space / 8;
+    if (sizes.maxMetaspace < 32)
+        sizes.maxMetaspace = 32;
+
+    unsigned usable = sizes.memory > sizes.maxMetaspace + NATIVE_RESERVE + MIN_HEAP ?
+        sizes.memory - sizes.maxMetaspace - NATIVE_RESERVE : MIN_HEAP;
+    unsigned long long heap = (unsigned long long)usable * p.heapPercent / 100;
+
+    // A 32 bit VM reserves its metaspace and native memory from the same
+    // address space as the heap
+    if (budget.address) {
+        unsigned addressHeap = budget.address > sizes.maxMetaspace + NATIVE_RESERVE + MIN_HEAP ?
+            budget.address - sizes.maxMetaspace - NATIVE_RESERVE : MIN_HEAP;
+        if (heap > addressHeap)
+            heap = addressHeap;
+    }
+    if (p.heapCap && heap > p.heapCap)
+        heap = p.heapCap;
+    if (heap > OOPS_LIMIT)
+        heap = OOPS_LIMIT;
+    if (heap < MIN_HEAP)
+        heap = MIN_HEAP;
+    sizes.maxHeap = (unsigned)heap;
+
+    // Committing a fixed heap up front only helps if it will not be paged out
+    sizes.minHeap = (unsigned)(heap * p.minHeapPercent / 100);
+    if (budget.available && sizes.minHeap > budget.available / 2)
+        sizes.minHeap = budget.available / 2;
+    if (sizes.minHeap < MIN_HEAP / 2)
+        sizes.minHeap = MIN_HEAP / 2;
+    if (sizes.minHeap > sizes.maxHeap)
+        sizes.minHeap = sizes.maxHeap;
+
+    sizes.gc = p.gc;
+    sizes.pauseMillis = p.pauseMillis;
+    sizes.shrinkHeap = p.shrinkHeap;
+    sizes.parallelThreads = ParallelThreads(sizes.cpus);
+    if (profile == VM_PROFILE_LATENCY)
+        sizes.concThreads = (sizes.parallelThreads + 2) / 4;
+    return true;
+}
+
+// Whether an arg with this prefix is already set
+static bool HasArg(const char* const* args, int count, const char* prefix)
+{
+    size_t len = strlen(prefix);
+    for (int i = 0; i < count; i++) {
+        if (args[i] && !strncmp(args[i], prefix, len))
+            return true;
+    }
+    return false;
+}
+
+// A collector chosen by any -XX:+Use...GC
+static bool HasGC(const char* const* args, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (!args[i] || strncmp(args[i], "-XX:+Use", 8))
+            continue;
+        size_t len = strlen(args[i]);
+        if (len > 10 && !strcmp(&args[i][len - 2], "GC"))
+            return true;
+    }
+    return false;
+}
+
+// The args written so far and those they must not repeat
+struct ArgList {
+    char (*out)[VM_SIZING_ARG_LEN];
+    int count;
+    int max;
+    const char* const* args;
+    int argCount;
+};
+
+static void Add(ArgList& list, const char* prefix, unsigned value, const char* suffix)
+{
+    if (list.count < list.max && !HasArg(list.args, list.argCount, prefix))
+        snprintf(list.out[list.count++], VM_SIZING_ARG_LEN, "%s%u%s", prefix, value, suffix);
+}
+
+static void AddFlag(ArgList& list, const char* flag)
+{
+    if (list.count < list.max && !HasArg(list.args, list.argCount, flag))
+        snprintf(list.out[list.count++], VM_SIZING_ARG_LEN, "%s", flag);
+}
+
+int VMSizing::Format(const VMSizes& sizes, const char* const* args, int count,
+    char out[][VM_SIZING_ARG_LEN], int max)
+{
+    ArgList list = { out, 0, max, args, count };
+
+    Add(list, "-Xmx", sizes.maxHeap, "m");
+    Add(list, "-Xms", sizes.minHeap, "m");
+    Add(list, "-XX:MaxMetaspaceSize=", sizes.maxMetaspace, "m");
+    Add(list, "-XX:ActiveProcessorCount=", sizes.cpus, "");
+
+    // The rest only fit the collector the profile picked
+    if (sizes.gc && !HasGC(args, count)) {
+        AddFlag(list, sizes.gc);
+        if (sizes.pauseMillis)
+            Add(list, "-XX:MaxGCPauseMillis=", sizes.pauseMillis, "");
+        if (strcmp(sizes.gc, "-XX:+UseSerialGC"))
+            Add(list, "-XX:ParallelGCThreads=", sizes.parallelThreads, "");
+        if (sizes.concThreads)
+            Add(list, "-XX:ConcGCThreads=", sizes.concThreads, "");
+        if (sizes.shrinkHeap) {
+            Add(list, "-XX:MinHeapFreeRatio=", 10, "");
+            Add(list, "-XX:MaxHeapFreeRatio=", 20, "");
+        }
+    }
+
+    return list.count;
+}
@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef VM_SIZING_H
+#define VM_SIZING_H
+
+// Sizes the heap, metaspace and garbage collector of a VM from the memory
+// and processors the process may actually use, which in a job object (as
+// containers and some schedulers run processes) can be far less than the
+// machine has. A named profile decides how that budget is spent.
+
+#define VM_PROFILE_NONE       0
+#define VM_PROFILE_THROUGHPUT 1
+#define VM_PROFILE_LATENCY    2
+#define VM_PROFILE_FOOTPRINT  3
+
+#define VM_SIZING_MAX_ARGS 12
+#define VM_SIZING_ARG_LEN  64
+
+// What the process can use, in MB and processors; 0 where there is no limit
+struct VMBudget {
+	unsigned physical;		// Memory installed
+	unsigned available;		// Memory free now
+	unsigned limit;			// Job object process or job memory limit
+	unsigned address;		// Address space for heap, metaspace and the VM (32 bit)
+	unsigned machineCpus;	// Processors in all groups
+	unsigned cpus;			// Processors the affinity allows
+	unsigned cpuRate;		// Job CPU rate cap, in 1/100 of a percent of the machine
+};
+
+struct VMSizes {
+	unsigned memory;		// Effective budget
+	unsigned cpus;
+	unsigned maxHeap;
+	unsigned minHeap;
+	unsigned maxMetaspace;
+	const char* gc;			// eg. "-XX:+UseG1GC"
+	unsigned pauseMillis;	// 0 for the collector's default
+	unsigned parallelThreads;
+	unsigned concThreads;	// 0 where the collector has none
+	bool shrinkHeap;		// Give free heap back to the OS
+};
+
+struct VMSizing {
+	// VM_PROFILE_NONE if the name is not a profile
+	static int GetProfile(const char* name);
+	static const char* GetProfileName(int profile);
+
+	static unsigned GetMemory(const VMBudget& budget);
+	static unsigned GetCpus(const VMBudget& budget);
+
+	static bool Compute(int profile, const VMBudget& budget, VMSizes& sizes);
+
+	// The vm args for the sizes, leaving out any already set in args (so that
+	// explicit vm args and heap size keys win). Returns the number written.
+	static int Format(const VMSizes& sizes, const char* const* args, int count,
+		char out[][VM_SIZING_ARG_LEN], int max);
+};
+
+#endif // VM_SIZING_H
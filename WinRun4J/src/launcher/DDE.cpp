@@ -10,6 +10,7 @@
 
 #include "DDE.h"
 #include "../common/Log.h"
+#include "../common/Timing.h"
 #include "../java/VM.h"
 #include "../java/JNI.h"
 
@@ -36,6 +37,7 @@ static int         g_buffer_siz    = 0;
 #define DDE_WINDOW_CLASS   ":dde.window.class"
 #define DDE_SERVER_NAME    ":dde.server.name"
 #define DDE_TOPIC          ":dde.topic"
+#define FILE_ASSOCIATIONS  "FileAssociations"
 
 // Single instance
 #define DDE_EXECUTE_ACTIVATE "ACTIVATE"
@@ -232,6 +234,9 @@ bool DDE::NotifySingleInstance(dictionary* ini)
 
 void DDE::Execute(LPSTR lpExecuteStr)
 {
+    Timing::Mark("dde");
+    Timing::Flush();
+
     JNIEnv* env = VM::GetJNIEnv(true);
     if (!env)
         return;
@@ -391,22 +396,22 @@ int DDE::EnumFileAssocations(dictionary* ini, bool isRegister, int (*CallbackFun
         DDEInfo info;
         info.ini = ini;
 
-        sprintf_s(key, sizeof(key), "FileAssociations:file.%d.extension", i);
-        info.extension = iniparser_getstr(ini, key);
+        sprintf_s(key, sizeof(key), "file.%d.extension", i);
+        info.extension = iniparser_getsecstring(ini, FILE_ASSOCIATIONS, key, NULL);
         if (info.extension == NULL)
             break;
 
         Log::Info(isRegister ? "Registering %s" : "Unregistering %s", info.extension);
 
-        sprintf_s(key, sizeof(key), "FileAssociations:file.%d.name", i);
-        info.name = iniparser_getstr(ini, key);
+        sprintf_s(key, sizeof(key), "file.%d.name", i);
+        info.name = iniparser_getsecstring(ini, FILE_ASSOCIATIONS, key, NULL);
         if (info.name == NULL) {
             Log::Error("Name not specified for extension: %s", info.extension);
             return 1;
         }
 
-        sprintf_s(key, sizeof(key), "FileAssociations:file.%d.description", i);
-        info.description = iniparser_getstr(ini, key);
+        sprintf_s(key, sizeof(key), "file.%d.description", i);
+        info.description = iniparser_getsecstring(ini, FILE_ASSOCIATIONS, key, NULL);
         if (info.description == NULL) {
             Log::Warning("Description not specified for extension: %s", info.extension);
         }
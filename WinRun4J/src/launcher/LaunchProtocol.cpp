@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "LaunchProtocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_BUFFER 4096
+
+LaunchConnection::LaunchConnection(const LaunchStream& stream) :
+    stream(stream), buffer(NULL), size(0)
+{
+}
+
+LaunchConnection::~LaunchConnection()
+{
+    free(buffer);
+}
+
+bool LaunchConnection::ReadFully(void* buf, unsigned len)
+{
+    char* p = (char*)buf;
+    while (len > 0) {
+        int n = stream.read(stream.ctx, p, len > 0x10000 ? 0x10000 : (int)len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool LaunchConnection::Send(char type, const void* data, unsigned len)
+{
+    if (len > LAUNCH_MAX_CHUNK)
+        return false;
+
+    unsigned char header[5] = {
+        (unsigned char)len, (unsigned char)(len >> 8), (unsigned char)(len >> 16), (unsigned char)(len >> 24),
+        (unsigned char)type
+    };
+    return stream.write(stream.ctx, header, sizeof(header)) &&
+           (len == 0 || stream.write(stream.ctx, data, (int)len));
+}
+
+bool LaunchConnection::SendString(char type, const char* str)
+{
+    return Send(type, str, str ? (unsigned)strlen(str) : 0);
+}
+
+bool LaunchConnection::SendExit(int code)
+{
+    char text[16];
+    sprintf(text, "%d", code);
+    return SendString(LAUNCH_EXIT, text);
+}
+
+bool LaunchConnection::Receive(char& type, const char*& data, unsigned& len)
+{
+    unsigned char header[5];
+    if (!ReadFully(header, sizeof(header)))
+        return false;
+
+    len = header[0] | (header[1] << 8) | (header[2] << 16) | ((unsigned)header[3] << 24);
+    type = (char)header[4];
+    if (len > LAUNCH_MAX_CHUNK)
+        return false;
+
+    if (len + 1 > size) {
+        unsigned n = size ? size : MIN_BUFFER;
+        while (n < len + 1)
+            n *= 2;
+        char* p = (char*)realloc(buffer, n);
+        if (!p)
+            return false;
+        buffer = p;
+        size = n;
+    }
+
+    if (!ReadFully(buffer, len))
+        return false;
+    buffer[len] = 0;
+    data = buffer;
+    return true;
+}
+
+bool LaunchConnection::SendRequest(const LaunchRequest& request)
+{
+    char version[16];
+    sprintf(version, "%d", LAUNCH_PROTOCOL_VERSION);
+    if (!SendString(LAUNCH_HELLO, version))
+        return false;
+    for (int i = 0; i < request.argCount; i++) {
+        if (!SendString(LAUNCH_ARG, request.args[i]))
+            return false;
+    }
+    if (request.cwd && !SendString(LAUNCH_CWD, request.cwd))
+        return false;
+    for (int i = 0; i < request.envCount; i++) {
+        if (!SendString(LAUNCH_ENV, request.env[i]))
+            return false;
+    }
+    return Send(LAUNCH_RUN, NULL, 0);
+}
+
+// Appends a copy of a string to a growing list
+static bool Append(char**& list, int& count, const char* str, unsigned len)
+{
+    if ((count & (count - 1)) == 0) {
+        char** p = (char**)realloc(list, (count ? count * 2 : 1) * sizeof(char*));
+        if (!p)
+            return false;
+        list = p;
+    }
+    char* copy = (char*)malloc(len + 1);
+    if (!copy)
+        return false;
+    memcpy(copy, str, len + 1);
+    list[count++] = copy;
+    return true;
+}
+
+bool LaunchConnection::ReceiveRequest(LaunchRequest& request)
+{
+    memset(&request, 0, sizeof(request));
+
+    char type;
+    const char* data;
+    unsigned len;
+    if (!Receive(type, data, len) || type != LAUNCH_HELLO || atoi(data) != LAUNCH_PROTOCOL_VERSION)
+        return false;
+
+    while (Receive(type, data, len)) {
+        bool ok = true;
+        switch (type) {
+        case LAUNCH_ARG:
+            ok = Append(request.args, request.argCount, data, len);
+            break;
+        case LAUNCH_CWD:
+            free(request.cwd);
+            ok = (request.cwd = (char*)malloc(len + 1)) != NULL;
+            if (ok)
+                memcpy(request.cwd, data, len + 1);
+            break;
+        case LAUNCH_ENV:
+            ok = Append(request.env, request.envCount, data, len);
+            break;
+        case LAUNCH_RUN:
+            return true;
+        default:
+            ok = false;
+        }
+        if (!ok)
+            break;
+    }
+
+    FreeRequest(request);
+    return false;
+}
+
+void LaunchConnection::FreeRequest(LaunchRequest& request)
+{
+    for (int i = 0; i < request.argCount; i++)
+        free(request.args[i]);
+    for (int i = 0; i < request.envCount; i++)
+        free(request.env[i]);
+    free(request.args);
+    free(request.env);
+    free(request.cwd);
+    memset(&request, 0, sizeof(request));
+}
+
+bool LaunchConnection::ReceiveOutput(bool (*output)(void* ctx, char type, const void* data, unsigned len), void* ctx,
+                                     int& exitCode)
+{
+    char type;
+    const char* data;
+    unsigned len;
+    while (Receive(type, data, len)) {
+        if (type == LAUNCH_EXIT) {
+            exitCode = atoi(data);
+            return true;
+        }
+        if ((type == LAUNCH_STDOUT || type == LAUNCH_STDERR) && !output(ctx, type, data, len))
+            return false;
+    }
+    return false;
+}
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef LAUNCH_PROTOCOL_H
+#define LAUNCH_PROTOCOL_H
+
+// What a launcher and a launch server (which keeps a VM running to run the
+// main class of later launches) say to each other, much as nailgun does. Each
+// chunk is a 4 byte little endian length, a type byte and the data:
+//
+//   launcher: HELLO <version>, ARG..., CWD, ENV..., RUN, then STDIN... STDIN_EOF
+//   server:   STDOUT... and STDERR... as the main class writes, then EXIT <code>
+
+#define LAUNCH_PROTOCOL_VERSION 1
+#define LAUNCH_MAX_CHUNK        (16 * 1024 * 1024)
+
+#define LAUNCH_HELLO     'H'
+#define LAUNCH_ARG       'A'
+#define LAUNCH_CWD       'D'
+#define LAUNCH_ENV       'E'
+#define LAUNCH_RUN       'R'
+#define LAUNCH_STDIN     '0'
+#define LAUNCH_STDIN_EOF '.'
+#define LAUNCH_STDOUT    '1'
+#define LAUNCH_STDERR    '2'
+#define LAUNCH_EXIT      'X'
+
+struct LaunchStream {
+	// Up to len bytes, 0 at the end and -1 on an error
+	int (*read)(void* ctx, void* buf, int len);
+	// All of len bytes, false on an error
+	bool (*write)(void* ctx, const void* buf, int len);
+	void* ctx;
+};
+
+// One launch: the args for the main class, where it was run from and the
+// environment as "name=value" strings
+struct LaunchRequest {
+	char** args;
+	int argCount;
+	char* cwd;
+	char** env;
+	int envCount;
+};
+
+class LaunchConnection {
+public:
+	LaunchConnection(const LaunchStream& stream);
+	~LaunchConnection();
+
+	// Sending is not locked; a server with more than one thread writing
+	// output has to take turns itself
+	bool Send(char type, const void* data, unsigned len);
+	bool SendString(char type, const char* str);
+	bool SendExit(int code);
+	bool SendRequest(const LaunchRequest& request);
+
+	// The next chunk; its data stays valid until the next call, with a NUL
+	// after it. False at the end of the stream or on a bad chunk.
+	bool Receive(char& type, const char*& data, unsigned& len);
+
+	// Reads a request up to RUN, false if it is not one this version reads
+	bool ReceiveRequest(LaunchRequest& request);
+	static void FreeRequest(LaunchRequest& request);
+
+	// Passes STDOUT and STDERR chunks to output (with LAUNCH_STDOUT or
+	// LAUNCH_STDERR) until EXIT and gives its code, any int the main class
+	// exited with. False if the server went away before then.
+	bool ReceiveOutput(bool (*output)(void* ctx, char type, const void* data, unsigned len), void* ctx,
+		int& exitCode);
+
+private:
+	bool ReadFully(void* buf, unsigned len);
+
+	LaunchStream stream;
+	char* buffer;
+	unsigned size;
+};
+
+#endif // LAUNCH_PROTOCOL_H
@@ -0,0 +1,584 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Before windows.h, which would bring in the old winsock.h
+#include <winsock2.h>
+#include <afunix.h>
+
+#include "LaunchServer.h"
+#include "LaunchProtocol.h"
+#include "../common/Cache.h"
+#include "../common/Log.h"
+#include "../java/JNI.h"
+
+#define LAUNCH_SERVER_COMMAND "--WinRun4J:LaunchServer"
+#define SOCKET_EXT            "sock"
+#define DEFAULT_IDLE          900       // Seconds without a launch before the server exits
+#define DEFAULT_WAIT          30000     // Milliseconds to wait for a new server to listen
+#define PIPE_SIZE             65536
+
+namespace
+{
+    // The launch being served, for Shutdown
+    LaunchConnection* g_client = NULL;
+    CRITICAL_SECTION  g_sendLock;
+    HANDLE            g_outputs[2];
+    volatile LONG     g_forwarding = 0;
+}
+
+// A pipe between the main class and the launcher
+struct Pump {
+    SOCKET socket;
+    LaunchConnection* conn;
+    HANDLE pipe;
+    char type;
+};
+
+// System.in, out and err
+struct JavaStdio {
+    jobject in;
+    jobject out;
+    jobject err;
+};
+
+static int SocketRead(void* ctx, void* buf, int len)
+{
+    int n = recv((SOCKET)(UINT_PTR)ctx, (char*)buf, len, 0);
+    return n == SOCKET_ERROR ? -1 : n;
+}
+
+static bool SocketWrite(void* ctx, const void* buf, int len)
+{
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        int n = send((SOCKET)(UINT_PTR)ctx, p, len, 0);
+        if (n == SOCKET_ERROR)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// The socket is a file in the per-user cache directory, one per INI file
+static bool GetSocketAddress(dictionary* ini, sockaddr_un& addr)
+{
+    char path[MAX_PATH];
+    if (!Cache::GetPath(iniparser_getstr(ini, (char*)MODULE_INI), SOCKET_EXT, path, sizeof(path)) ||
+        strlen(path) >= sizeof(addr.sun_path))
+        return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy_s(addr.sun_path, sizeof(addr.sun_path), path);
+    return true;
+}
+
+static bool StartSockets()
+{
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        Log::Error("Could not start Windows sockets");
+        return false;
+    }
+    return true;
+}
+
+static SOCKET Connect(const sockaddr_un& addr)
+{
+    SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s != INVALID_SOCKET && connect(s, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        closesocket(s);
+        s = INVALID_SOCKET;
+    }
+    return s;
+}
+
+// Starts this launcher again as a server for the same INI file, with no console
+static bool StartServer(dictionary* ini)
+{
+    char module[MAX_PATH], cmdline[MAX_PATH * 2 + 64];
+    char* iniFile = iniparser_getstr(ini, (char*)MODULE_INI);
+    if (!iniFile || !GetModuleFileNameA(NULL, module, MAX_PATH))
+        return false;
+    sprintf_s(cmdline, sizeof(cmdline), "\"%s\" %s \"%s\"", module, LAUNCH_SERVER_COMMAND, iniFile);
+
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    if (!CreateProcessA(module, cmdline, NULL, NULL, FALSE, DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP,
+                        NULL, iniparser_getstr(ini, (char*)INI_DIR), &si, &pi)) {
+        Log::Error("Could not start the launch server: %d", GetLastError());
+        return false;
+    }
+
+    Log::Info("Started launch server (%d)", pi.dwProcessId);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    return true;
+}
+
+static bool WriteOutput(void* /*ctx*/, char type, const void* data, unsigned len)
+{
+    HANDLE h = GetStdHandle(type == LAUNCH_STDERR ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
+    DWORD written;
+
+    // Output with nowhere to go (no console) is dropped, as it would be here
+    if (h && h != INVALID_HANDLE_VALUE)
+        WriteFile(h, data, len, &written, NULL);
+    return true;
+}
+
+// Sends stdin to the server until it ends or the launch is over and the
+// socket closed. It has its own connection as the main thread is reading.
+static DWORD WINAPI ForwardInput(LPVOID param)
+{
+    LaunchStream stream = { SocketRead, SocketWrite, param };
+    LaunchConnection conn(stream);
+    HANDLE h = GetStdHandle(STD_INPUT_HANDLE);
+    char buf[4096];
+    DWORD n;
+    while (h && h != INVALID_HANDLE_VALUE && ReadFile(h, buf, sizeof(buf), &n, NULL) && n > 0) {
+        if (!conn.Send(LAUNCH_STDIN, buf, n))
+            return 0;
+    }
+    conn.Send(LAUNCH_STDIN_EOF, NULL, 0);
+    return 0;
+}
+
+// The server's VM is already running with its own INI, so only the args
+// of a launch reach it; vm args and -W overrides on the command line do not
+static void WarnNotForwarded(dictionary* ini)
+{
+    int vmargs = 0;
+    int overrides = iniparser_getint(ini, (char*)CMDLINE_UNSET, 0);
+    for (int i = 0; i < ini->n; i++) {
+        char* key = ini->key[i];
+        if (ini->origin[i] != DICT_ORIGIN_CMDLINE || !key || !_strnicmp(key, "WinRun4J:", 9))
+            continue;
+        if (!_strnicmp(key, VM_ARG ".", sizeof(VM_ARG)))
+            vmargs++;
+        else if (_strnicmp(key, PROG_ARG ".", sizeof(PROG_ARG)))
+            overrides++;
+    }
+
+    if (vmargs)
+        Log::Warning("%d vm args on the command line are not applied by the launch server", vmargs);
+    if (overrides)
+        Log::Warning("%d INI overrides on the command line are not applied by the launch server", overrides);
+}
+
+bool LaunchServer::Forward(dictionary* ini, int& exitCode)
+{
+    sockaddr_un addr;
+    if (!StartSockets() || !GetSocketAddress(ini, addr))
+        return false;
+
+    SOCKET s = Connect(addr);
+    if (s == INVALID_SOCKET && StartServer(ini)) {
+        int wait = iniparser_getint(ini, (char*)LAUNCH_SERVER_WAIT, DEFAULT_WAIT);
+        DWORD start = GetTickCount();
+        while (s == INVALID_SOCKET && (int)(GetTickCount() - start) < wait) {
+            Sleep(50);
+            s = Connect(addr);
+        }
+    }
+    if (s == INVALID_SOCKET) {
+        Log::Warning("No launch server, starting the VM here");
+        return false;
+    }
+
+    WarnNotForwarded(ini);
+
+    LaunchRequest request;
+    memset(&request, 0, sizeof(request));
+
+    UINT argc = 0;
+    INI::GetNumberedKeysFromIni(ini, ":arg", &request.args, argc);
+    request.argCount = (int)argc;
+
+    char cwd[MAX_PATH];
+    if (GetCurrentDirectoryA(MAX_PATH, cwd))
+        request.cwd = cwd;
+
+    char* block = GetEnvironmentStringsA();
+    for (char* p = block; p && *p; p += strlen(p) + 1)
+        request.envCount++;
+    request.env = (char**)malloc((request.envCount + 1) * sizeof(char*));
+    if (request.env) {
+        int i = 0;
+        for (char* p = block; p && *p; p += strlen(p) + 1)
+            request.env[i++] = p;
+    } else {
+        request.envCount = 0;
+    }
+
+    LaunchStream stream = { SocketRead, SocketWrite, (void*)(UINT_PTR)s };
+    LaunchConnection conn(stream);
+    bool sent = conn.SendRequest(request);
+    if (sent) {
+        HANDLE input = CreateThread(NULL, 0, ForwardInput, (LPVOID)(UINT_PTR)s, 0, NULL);
+        if (input)
+            CloseHandle(input);
+
+        if (!conn.ReceiveOutput(WriteOutput, NULL, exitCode)) {
+            Log::Error("Lost the connection to the launch server");
+            exitCode = 1;
+        }
+    } else {
+        Log::Warning("Could not send the launch to the server, starting the VM here");
+    }
+    closesocket(s);
+
+    for (int i = 0; i < request.argCount; i++)
+        free(request.args[i]);
+    free(request.args);
+    free(request.env);
+    if (block)
+        FreeEnvironmentStringsA(block);
+
+    return sent;
+}
+
+static DWORD WINAPI PumpOutput(LPVOID param)
+{
+    Pump* pump = (Pump*)param;
+    char buf[PIPE_SIZE / 4];
+    DWORD n;
+    bool connected = true;
+
+    // Keeps reading after the launcher has gone so the main class never blocks
+    while (ReadFile(pump->pipe, buf, sizeof(buf), &n, NULL) && n > 0) {
+        InterlockedIncrement(&g_forwarding);
+        EnterCriticalSection(&g_sendLock);
+        connected = connected && pump->conn->Send(pump->type, buf, n);
+        LeaveCriticalSection(&g_sendLock);
+        InterlockedDecrement(&g_forwarding);
+    }
+    return 0;
+}
+
+static DWORD WINAPI PumpInput(LPVOID param)
+{
+    Pump* pump = (Pump*)param;
+    LaunchStream stream = { SocketRead, SocketWrite, (void*)(UINT_PTR)pump->socket };
+    LaunchConnection conn(stream);
+    char type;
+    const char* data;
+    unsigned len;
+    DWORD written;
+    while (conn.Receive(type, data, len) && type != LAUNCH_STDIN_EOF) {
+        if (type == LAUNCH_STDIN && len && !WriteFile(pump->pipe, data, len, &written, NULL))
+            break;
+    }
+    CloseHandle(pump->pipe);
+    return 0;
+}
+
+/*
+ * A Java stream over one end of a pipe, as System.out is over the console:
+ * a FileDescriptor holding the handle, wrapped in a file stream (and a
+ * PrintStream for output). Java owns the handle from then on.
+ */
+static jobject NewStream(JNIEnv* env, HANDLE handle, bool output)
+{
+    const JNICache& c = JNI::GetCache();
+    if (!c.fileDescriptorInit || !c.fileDescriptorHandle)
+        return NULL;
+
+    jobject fd = env->NewObject(c.fileDescriptorClass, c.fileDescriptorInit);
+    if (!fd)
+        return NULL;
+    env->SetLongField(fd, c.fileDescriptorHandle, (jlong)(INT_PTR)handle);
+
+    jclass streamClass = output ? c.fileOutputStreamClass : c.fileInputStreamClass;
+    jmethodID init = output ? c.fileOutputStreamInit : c.fileInputStreamInit;
+    jobject stream = init ? env->NewObject(streamClass, init, fd) : NULL;
+    if (stream && output)
+        stream = c.printStreamInit ? env->NewObject(c.printStreamClass, c.printStreamInit, stream, JNI_TRUE) : NULL;
+
+    JNI::ClearException(env);
+    return stream;
+}
+
+static void CloseStream(JNIEnv* env, jobject stream)
+{
+    if (!stream)
+        return;
+    jmethodID close = JNI::GetCache().closeableClose;
+    if (close)
+        env->CallVoidMethod(stream, close);
+    JNI::ClearException(env);
+}
+
+static void GetStdio(JNIEnv* env, JavaStdio& stdio)
+{
+    const JNICache& c = JNI::GetCache();
+    stdio.in = c.systemIn ? env->GetStaticObjectField(c.systemClass, c.systemIn) : NULL;
+    stdio.out = c.systemOut ? env->GetStaticObjectField(c.systemClass, c.systemOut) : NULL;
+    stdio.err = c.systemErr ? env->GetStaticObjectField(c.systemClass, c.systemErr) : NULL;
+}
+
+static void SetStdio(JNIEnv* env, const JavaStdio& stdio)
+{
+    const JNICache& c = JNI::GetCache();
+    if (!c.systemSetIn || !c.systemSetOut || !c.systemSetErr)
+        return;
+    env->CallStaticVoidMethod(c.systemClass, c.systemSetIn, stdio.in);
+    env->CallStaticVoidMethod(c.systemClass, c.systemSetOut, stdio.out);
+    env->CallStaticVoidMethod(c.systemClass, c.systemSetErr, stdio.err);
+    JNI::ClearException(env);
+}
+
+// The launcher's directory, and user.dir which Java 8 resolves relative
+// files against (later versions read it once at startup)
+static void SetDirectory(JNIEnv* env, const char* cwd)
+{
+    if (!cwd || !SetCurrentDirectoryA(cwd))
+        return;
+
+    const JNICache& c = JNI::GetCache();
+    jstring name = env->NewStringUTF("user.dir");
+    jstring value = env->NewStringUTF(cwd);
+    if (c.systemSetProperty && name && value)
+        env->CallStaticObjectMethod(c.systemClass, c.systemSetProperty, name, value);
+    JNI::ClearException(env);
+}
+
+// Makes the environment of the process that of the launcher, for native
+// code; System.getenv keeps what the VM started with
+static void SetEnvironment(char** env, int count)
+{
+    char* block = GetEnvironmentStringsA();
+    for (char* p = block; p && *p; p += strlen(p) + 1) {
+        const char* eq = strchr(p, '=');
+        if (*p == '=' || !eq)
+            continue;
+        size_t len = eq - p + 1;
+        bool found = false;
+        for (int i = 0; i < count && !found; i++)
+            found = _strnicmp(env[i], p, len) == 0;
+        if (!found) {
+            p[len - 1] = 0;
+            SetEnvironmentVariableA(p, NULL);
+            p[len - 1] = '=';
+        }
+    }
+    if (block)
+        FreeEnvironmentStringsA(block);
+
+    for (int i = 0; i < count; i++) {
+        char* eq = strchr(env[i], '=');
+        if (!eq || eq == env[i])
+            continue;
+        *eq = 0;
+        SetEnvironmentVariableA(env[i], eq + 1);
+        *eq = '=';
+    }
+}
+
+// Runs the main class as JNI::RunMainClass does, but with an exit code for
+// an exception and its stack trace printed to the launcher's stderr
+static int RunMain(JNIEnv* env, char* mainClass, const LaunchRequest& request)
+{
+    jclass cls = JNI::FindClass(env, mainClass);
+    if (!cls) {
+        JNI::PrintStackTrace(env);
+        return 2;
+    }
+
+    jobjectArray args = JNI::CreateRunArgs(env, request.argCount, request.args);
+    if (!args)
+        return 4;
+
+    jmethodID main = env->GetStaticMethodID(cls, "main", "([Ljava/lang/String;)V");
+    if (!main) {
+        JNI::PrintStackTrace(env);
+        return 8;
+    }
+
+    env->CallStaticVoidMethod(cls, main, args);
+    return JNI::PrintStackTrace(env) ? 1 : 0;
+}
+
+static void Serve(JNIEnv* env, SOCKET s, char* mainClass)
+{
+    LaunchStream stream = { SocketRead, SocketWrite, (void*)(UINT_PTR)s };
+    LaunchConnection conn(stream);
+    LaunchRequest request;
+    if (!conn.ReceiveRequest(request)) {
+        Log::Warning("Ignoring a launch that could not be read");
+        closesocket(s);
+        return;
+    }
+
+    HANDLE inRead = NULL, inWrite = NULL, outRead = NULL, outWrite = NULL, errRead = NULL, errWrite = NULL;
+    JavaStdio original, redirected = { NULL, NULL, NULL };
+    bool ready = env->PushLocalFrame(32) == 0;
+    if (ready) {
+        ready = CreatePipe(&inRead, &inWrite, NULL, PIPE_SIZE) && CreatePipe(&outRead, &outWrite, NULL, PIPE_SIZE) &&
+                CreatePipe(&errRead, &errWrite, NULL, PIPE_SIZE) &&
+                (redirected.in = NewStream(env, inRead, false)) != NULL &&
+                (redirected.out = NewStream(env, outWrite, true)) != NULL &&
+                (redirected.err = NewStream(env, errWrite, true)) != NULL;
+    }
+    if (!ready) {
+        Log::Error("Could not redirect stdio for a launch");
+        HANDLE handles[] = { inRead, inWrite, outRead, outWrite, errRead, errWrite };
+        for (int i = 0; i < 6; i++) {
+            if (handles[i])
+                CloseHandle(handles[i]);
+        }
+        conn.SendExit(1);
+        closesocket(s);
+        env->PopLocalFrame(NULL);
+        LaunchConnection::FreeRequest(request);
+        return;
+    }
+
+    Pump outPump = { s, &conn, outRead, LAUNCH_STDOUT };
+    Pump errPump = { s, &conn, errRead, LAUNCH_STDERR };
+    Pump inPump = { s, NULL, inWrite, 0 };
+    g_outputs[0] = outRead;
+    g_outputs[1] = errRead;
+    g_client = &conn;
+    HANDLE pumps[3] = {
+        CreateThread(NULL, 0, PumpOutput, &outPump, 0, NULL),
+        CreateThread(NULL, 0, PumpOutput, &errPump, 0, NULL),
+        CreateThread(NULL, 0, PumpInput, &inPump, 0, NULL),
+    };
+
+    GetStdio(env, original);
+    SetStdio(env, redirected);
+    SetDirectory(env, request.cwd);
+    SetEnvironment(request.env, request.envCount);
+
+    Log::Info("Running launch with %d args in %s", request.argCount, request.cwd ? request.cwd : "");
+    int code = RunMain(env, mainClass, request);
+
+    // Closing the streams closes the write ends, which ends the output pumps
+    SetStdio(env, original);
+    CloseStream(env, redirected.out);
+    CloseStream(env, redirected.err);
+    CloseStream(env, redirected.in);
+    WaitForMultipleObjects(2, pumps, TRUE, INFINITE);
+
+    EnterCriticalSection(&g_sendLock);
+    conn.SendExit(code);
+    g_client = NULL;
+    LeaveCriticalSection(&g_sendLock);
+
+    // Which ends the input pump if it is still reading
+    closesocket(s);
+    WaitForSingleObject(pumps[2], INFINITE);
+    for (int i = 0; i < 3; i++)
+        CloseHandle(pumps[i]);
+    CloseHandle(outRead);
+    CloseHandle(errRead);
+
+    env->PopLocalFrame(NULL);
+    LaunchConnection::FreeRequest(request);
+}
+
+int LaunchServer::Run(JNIEnv* env, dictionary* ini, char* mainClass)
+{
+    sockaddr_un addr;
+    if (!mainClass) {
+        Log::Error("No main class specified");
+        return 1;
+    }
+    if (!StartSockets() || !GetSocketAddress(ini, addr)) {
+        Log::Error("Could not find a path for the launch server socket");
+        return 1;
+    }
+
+    // One server for each INI file. One that is just exiting is waited for,
+    // as the launcher that started this one found it gone.
+    char mutexName[64];
+    sprintf_s(mutexName, sizeof(mutexName), "WinRun4J.LaunchServer.%016llx", Cache::HashString(addr.sun_path));
+    HANDLE mutex = CreateMutexA(NULL, TRUE, mutexName);
+    if (!mutex)
+        return 1;
+    if (GetLastError() == ERROR_ALREADY_EXISTS && WaitForSingleObject(mutex, 5000) == WAIT_TIMEOUT) {
+        Log::Info("A launch server is already running");
+        CloseHandle(mutex);
+        return 0;
+    }
+
+    // A server that did not exit cleanly leaves its socket file behind
+    char dir[MAX_PATH];
+    GetFileDirectory(addr.sun_path, dir);
+    CreateDirectoryA(dir, NULL);
+    DeleteFileA(addr.sun_path);
+
+    SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET || bind(listener, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+        Log::Error("Could not listen on %s: %d", addr.sun_path, WSAGetLastError());
+        if (listener != INVALID_SOCKET)
+            closesocket(listener);
+        ReleaseMutex(mutex);
+        CloseHandle(mutex);
+        return 1;
+    }
+
+    InitializeCriticalSection(&g_sendLock);
+    StrReplace(mainClass, '.', '/');
+    int idle = iniparser_getint(ini, (char*)LAUNCH_SERVER_IDLE, DEFAULT_IDLE);
+    Log::Info("Launch server listening on %s", addr.sun_path);
+
+    // Launches are run one at a time as they share System.in, out and err
+    int served = 0;
+    for (;;) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(listener, &ready);
+        timeval timeout = { idle, 0 };
+        if (select(0, &ready, NULL, NULL, idle > 0 ? &timeout : NULL) <= 0)
+            break;
+
+        SOCKET client = accept(listener, NULL, NULL);
+        if (client == INVALID_SOCKET)
+            continue;
+        Serve(env, client, mainClass);
+        served++;
+    }
+
+    Log::Info("Launch server exiting after %d launches", served);
+    closesocket(listener);
+    DeleteFileA(addr.sun_path);
+    ReleaseMutex(mutex);
+    CloseHandle(mutex);
+    return 0;
+}
+
+void LaunchServer::Shutdown(int exitCode)
+{
+    if (!g_client)
+        return;
+
+    // Let what the main class wrote reach the launcher before the exit code
+    for (int i = 0; i < 100; i++) {
+        DWORD out = 0, err = 0;
+        PeekNamedPipe(g_outputs[0], NULL, 0, NULL, &out, NULL);
+        PeekNamedPipe(g_outputs[1], NULL, 0, NULL, &err, NULL);
+        if (!out && !err && !g_forwarding)
+            break;
+        Sleep(10);
+    }
+
+    EnterCriticalSection(&g_sendLock);
+    if (g_client) {
+        g_client->SendExit(exitCode);
+        g_client = NULL;
+    }
+    LeaveCriticalSection(&g_sendLock);
+}
@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef LAUNCH_SERVER_H
+#define LAUNCH_SERVER_H
+
+#include "../common/Runtime.h"
+#include "../common/INI.h"
+#include <jni.h>
+
+#define LAUNCH_SERVER_IDLE ":single.instance.server.idle"
+#define LAUNCH_SERVER_WAIT ":single.instance.server.wait"
+
+// With single.instance=server the first launch starts a server that keeps
+// the VM running, and every launch (that one included) has the server run
+// its main class, passing over args, directory, environment and stdio.
+class LaunchServer
+{
+public:
+	// Client: runs this launch in the server, starting one if need be. False
+	// if there is no server to be had, to start the VM here instead.
+	static bool Forward(dictionary* ini, int& exitCode);
+
+	// Server: runs launches one at a time until none come for a while
+	static int Run(JNIEnv* env, dictionary* ini, char* mainClass);
+
+	// The VM is exiting, eg. the main class called System.exit
+	static void Shutdown(int exitCode);
+};
+
+#endif // LAUNCH_SERVER_H
@@ -9,7 +9,12 @@
 *******************************************************************************/
 
 #include "Native.h"
+#include "../common/INI.h"
 #include "../common/Log.h"
+#include "../common/Snapshot.h"
+#include "../common/Timing.h"
+#include "../java/ClassIndex.h"
+#include "../java/Classpath.h"
 #include "../java/JNI.h"
 #include "../java/VM.h"
 #include "../libffi/ffi.h"
@@ -25,7 +30,7 @@ bool Native::RegisterNatives(JNIEnv *env)
 		return false;
 	}
 	
-	JNINativeMethod nm[12];
+	JNINativeMethod nm[15];
 	nm[0].name = "loadLibrary";
 	nm[0].signature = "(Ljava/lang/String;)J";
 	nm[0].fnPtr = (void*) LoadLibrary;
@@ -62,6 +67,15 @@ bool Native::RegisterNatives(JNIEnv *env)
 	nm[11].name = "getObject";
 	nm[11].signature = "(J)Ljava/lang/Object;";
 	nm[11].fnPtr = (void*) GetObject;
+	nm[12].name = "getINIProperties";
+	nm[12].signature = "()[[Ljava/lang/String;";
+	nm[12].fnPtr = (void*) GetINIProperties;
+	nm[13].name = "getClassPathJars";
+	nm[13].signature = "(Ljava/lang/String;)[Ljava/lang/String;";
+	nm[13].fnPtr = (void*) GetClassPathJars;
+	nm[14].name = "getStartupTimings";
+	nm[14].signature = "()Ljava/lang/String;";
+	nm[14].fnPtr = (void*) GetStartupTimings;
 
 	env->RegisterNatives(clazz, nm, 12);
 
@@ -70,6 +84,16 @@ bool Native::RegisterNatives(JNIEnv *env)
 		return false;
 	}
 
+	// Added in later versions, an application may have an older jar. Each is
+	// registered on its own so one that is missing does not stop the rest.
+	for(int i = 12; i < 15; i++) {
+		env->RegisterNatives(clazz, &nm[i], 1);
+		if(env->ExceptionCheck()) {
+			JNI::ClearException(env);
+			Log::Info("Native.%s is not in this version of the jar", nm[i].name);
+		}
+	}
+
 	Log::Info("Registering natives for FFI class");
 
 	jclass clazz2 = JNI::FindClass(env, "org/boris/winrun4j/FFI");
@@ -206,6 +230,122 @@ jobject Native::GetObject(JNIEnv* /*env*/, jobject /*self*/, jlong obj)
 	return (jobject) obj;
 }
 
+// Converts an ANSI INI string, growing the shared buffer as needed
+static jstring NewINIString(JNIEnv* env, const char* str, WCHAR*& buf, int& size)
+{
+	if(!str)
+		return NULL;
+	int len = (int) strlen(str);
+	if(len > size) {
+		WCHAR* p = (WCHAR*) realloc(buf, len * sizeof(WCHAR));
+		if(!p)
+			return NULL;
+		buf = p;
+		size = len;
+	}
+	int wlen = len ? MultiByteToWideChar(CP_ACP, 0, str, len, buf, size) : 0;
+	return env->NewString((const jchar*) buf, wlen);
+}
+
+/*
+ * Returns { keys, values } for the whole INI in one call, from the snapshot
+ * published once the VM started. Values may be null.
+ */
+jobjectArray Native::GetINIProperties(JNIEnv* env, jobject /*self*/)
+{
+	const IniSnapshot* s = INI::GetSnapshot();
+	if(!s)
+		return NULL;
+
+	jclass stringClass = JNI::GetCache().stringClass;
+	jclass arrayClass = JNI::GetCache().stringArrayClass;
+	if(!stringClass || !arrayClass)
+		return NULL;
+
+	jobjectArray res = env->NewObjectArray(2, arrayClass, NULL);
+	jobjectArray keys = env->NewObjectArray(s->n, stringClass, NULL);
+	jobjectArray vals = env->NewObjectArray(s->n, stringClass, NULL);
+	if(!res || !keys || !vals)
+		return NULL;
+
+	WCHAR* buf = NULL;
+	int size = 0;
+	for(int i = 0; i < s->n; i++) {
+		jstring k = NewINIString(env, s->key[i], buf, size);
+		jstring v = NewINIString(env, s->val[i], buf, size);
+		env->SetObjectArrayElement(keys, i, k);
+		env->SetObjectArrayElement(vals, i, v);
+		if(k)
+			env->DeleteLocalRef(k);
+		if(v)
+			env->DeleteLocalRef(v);
+		if(env->ExceptionCheck())
+			break;
+	}
+	free(buf);
+
+	env->SetObjectArrayElement(res, 0, keys);
+	env->SetObjectArrayElement(res, 1, vals);
+	env->DeleteLocalRef(keys);
+	env->DeleteLocalRef(vals);
+	return res;
+}
+
+/*
+ * Returns the classpath entries that may hold a package, from the index built
+ * with the classpath: the jars that have it, then any directories or jars
+ * that could not be indexed. NULL when there is no index.
+ */
+jobjectArray Native::GetClassPathJars(JNIEnv* env, jobject /*self*/, jstring packageName)
+{
+	const ClassIndex* index = Classpath::GetIndex();
+	if(!index || !packageName)
+		return NULL;
+
+	const char* str = env->GetStringUTFChars(packageName, NULL);
+	if(!str)
+		return NULL;
+	char* name = _strdup(str);
+	env->ReleaseStringUTFChars(packageName, str);
+	if(!name)
+		return NULL;
+	StrReplace(name, '.', '/');
+
+	const unsigned* jars;
+	const unsigned* unindexed;
+	int count = index->Find(name, (int) strlen(name), &jars);
+	int extra = index->GetUnindexed(&unindexed);
+	free(name);
+
+	jclass stringClass = JNI::GetCache().stringClass;
+	jobjectArray res = stringClass ? env->NewObjectArray(count + extra, stringClass, NULL) : NULL;
+	if(!res)
+		return NULL;
+
+	WCHAR* buf = NULL;
+	int size = 0;
+	for(int i = 0; i < count + extra; i++) {
+		jstring s = NewINIString(env, index->GetJar(i < count ? jars[i] : unindexed[i - count]), buf, size);
+		env->SetObjectArrayElement(res, i, s);
+		if(s)
+			env->DeleteLocalRef(s);
+		if(env->ExceptionCheck())
+			break;
+	}
+	free(buf);
+	return res;
+}
+
+jstring Native::GetStartupTimings(JNIEnv* env, jobject /*self*/)
+{
+	char* json = Timing::GetJSON();
+	if(!json)
+		return NULL;
+	jstring res = env->NewStringUTF(json);
+	free(json);
+	return res;
+}
+
 jint Native::FFIPrepare(JNIEnv* /*env*/, jobject /*self*/, jlong cif, jint abi, jint nargs, jlong rtype, jlong atypes)
 {
 	return ffi_prep_cif((ffi_cif *) cif, (ffi_abi) abi, nargs, (ffi_type *) rtype, (ffi_type **) atypes);
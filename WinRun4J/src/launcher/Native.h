@@ -31,6 +31,9 @@ private:
 	static jlong GetMethodID(JNIEnv* env, jobject self, jclass clazz, jstring name, jstring sig, jboolean isStatic);
 	static jlong GetObjectID(JNIEnv* env, jobject self, jobject obj);
 	static jobject GetObject(JNIEnv* env, jobject self, jlong obj);
+	static jobjectArray GetINIProperties(JNIEnv* env, jobject self);
+	static jobjectArray GetClassPathJars(JNIEnv* env, jobject self, jstring packageName);
+	static jstring GetStartupTimings(JNIEnv* env, jobject self);
 	static jint FFIPrepare(JNIEnv* env, jobject self, jlong cif, jint abi, jint nargs, jlong rtype, jlong atypes);
 	static void FFICall(JNIEnv* env, jobject self, jlong cif, jlong fn, jlong rvalue, jlong avalue);
 	static jlong FFIPrepareClosure(JNIEnv* env, jobject self, jlong cif, jlong objectId, jlong methodId);
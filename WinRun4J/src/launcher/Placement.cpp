@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Placement.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const errors[] = {
+    "ok",
+    "invalid affinity mask",
+    "no such processor group",
+    "no such NUMA node",
+    "NUMA node is not in the processor group",
+    "no processors left to run on",
+    "could not read the processor topology",
+    "could not set the affinity",
+};
+
+// All the processors of a group
+static unsigned long long GroupMask(unsigned cpus)
+{
+    return cpus >= 64 ? ~0ULL : (1ULL << cpus) - 1;
+}
+
+static bool ParseNumber(const char*& p, unsigned& value)
+{
+    if (*p < '0' || *p > '9')
+        return false;
+    char* end;
+    unsigned long n = strtoul(p, &end, 10);
+    if (n > 63)
+        return false;
+    value = (unsigned)n;
+    p = end;
+    return true;
+}
+
+bool Placement::IsRequested(const PlacementRequest& request)
+{
+    return (request.mask && *request.mask) || request.group >= 0 || request.node >= 0;
+}
+
+/*
+ * Either a hex mask ("0xFF00") or a list of processors and ranges within the
+ * group ("8-15" or "0,2,4-6"), which is easier to get right on big machines.
+ */
+bool Placement::ParseMask(const char* str, unsigned long long& mask)
+{
+    mask = 0;
+    if (!str)
+        return false;
+    while (*str == ' ')
+        str++;
+
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        const char* p = &str[2];
+        if (!*p)
+            return false;
+        for (int digits = 0; *p && *p != ' '; p++, digits++) {
+            int d;
+            if (*p >= '0' && *p <= '9')
+                d = *p - '0';
+            else if (*p >= 'a' && *p <= 'f')
+                d = *p - 'a' + 10;
+            else if (*p >= 'A' && *p <= 'F')
+                d = *p - 'A' + 10;
+            else
+                return false;
+            if (digits == 16)
+                return false;
+            mask = (mask << 4) | d;
+        }
+        return mask != 0;
+    }
+
+    const char* p = str;
+    for (;;) {
+        unsigned first, last;
+        if (!ParseNumber(p, first))
+            return false;
+        last = first;
+        if (*p == '-') {
+            p++;
+            if (!ParseNumber(p, last) || last < first)
+                return false;
+        }
+        for (unsigned i = first; i <= last; i++)
+            mask |= 1ULL << i;
+        while (*p == ' ')
+            p++;
+        if (!*p)
+            return true;
+        if (*p++ != ',')
+            return false;
+        while (*p == ' ')
+            p++;
+    }
+}
+
+unsigned Placement::CountCpus(unsigned long long mask)
+{
+    unsigned n = 0;
+    for (; mask; mask &= mask - 1)
+        n++;
+    return n;
+}
+
+/*
+ * A node decides the group (a node never spans groups) and its processors;
+ * a group on its own means all of it. The mask then narrows either, or the
+ * group the process is in if it is all there is.
+ */
+int Placement::Resolve(const PlacementRequest& request, const PlacementTopology& topology,
+                       PlacementResult& result)
+{
+    memset(&result, 0, sizeof(result));
+    result.node = -1;
+    if (!topology.groupCount || topology.groupCount > PLACEMENT_MAX_GROUPS ||
+        topology.nodeCount > PLACEMENT_MAX_NODES || topology.currentGroup >= topology.groupCount)
+        return PLACEMENT_NO_TOPOLOGY;
+
+    unsigned long long mask = ~0ULL;
+    if (request.mask && *request.mask && !ParseMask(request.mask, mask))
+        return PLACEMENT_BAD_MASK;
+
+    result.group = topology.currentGroup;
+    if (request.group >= 0) {
+        if ((unsigned)request.group >= topology.groupCount)
+            return PLACEMENT_BAD_GROUP;
+        result.group = request.group;
+    }
+
+    unsigned long long available = GroupMask(topology.groupCpus[result.group]);
+    if (request.node >= 0) {
+        if ((unsigned)request.node >= topology.nodeCount)
+            return PLACEMENT_BAD_NODE;
+        const PlacementNode& node = topology.nodes[request.node];
+        if (node.group >= topology.groupCount)
+            return PLACEMENT_BAD_NODE;
+        if (request.group >= 0 && node.group != (unsigned)request.group)
+            return PLACEMENT_NODE_GROUP;
+        result.group = node.group;
+        result.node = request.node;
+        available = node.mask;
+    }
+
+    result.mask = available & mask;
+    result.cpus = CountCpus(result.mask);
+    return result.cpus ? PLACEMENT_OK : PLACEMENT_EMPTY;
+}
+
+int Placement::Apply(const PlacementProvider& provider, const PlacementRequest& request,
+                     PlacementResult& result)
+{
+    PlacementTopology topology;
+    memset(&topology, 0, sizeof(topology));
+    if (!provider.getTopology(provider.ctx, topology)) {
+        memset(&result, 0, sizeof(result));
+        result.node = -1;
+        return PLACEMENT_NO_TOPOLOGY;
+    }
+
+    int error = Resolve(request, topology, result);
+    if (error)
+        return error;
+
+    return provider.setAffinity(provider.ctx, result.group, result.mask) ? PLACEMENT_OK : PLACEMENT_NOT_SET;
+}
+
+const char* Placement::GetError(int error)
+{
+    if (error < 0 || error >= (int)(sizeof(errors) / sizeof(errors[0])))
+        return "unknown error";
+    return errors[error];
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Keeps the process (and so the VM it starts) on a set of processors: a mask
+// within a processor group, a whole group or a NUMA node. Windows gives a
+// thread memory from the node of the processor it runs on, so pinning to a
+// node keeps the heap on that node too.
+
+#define PROCESS_AFFINITY  ":process.affinity"
+#define PROCESS_GROUP     ":process.group"
+#define PROCESS_NUMA_NODE ":process.numa.node"
+
+#define PLACEMENT_MAX_GROUPS 32
+#define PLACEMENT_MAX_NODES  64
+
+#define PLACEMENT_OK          0
+#define PLACEMENT_BAD_MASK    1
+#define PLACEMENT_BAD_GROUP   2
+#define PLACEMENT_BAD_NODE    3
+#define PLACEMENT_NODE_GROUP  4
+#define PLACEMENT_EMPTY       5
+#define PLACEMENT_NO_TOPOLOGY 6
+#define PLACEMENT_NOT_SET     7
+
+struct PlacementNode {
+	unsigned group;
+	unsigned long long mask;
+};
+
+struct PlacementTopology {
+	unsigned groupCount;
+	unsigned groupCpus[PLACEMENT_MAX_GROUPS];
+	unsigned nodeCount;
+	PlacementNode nodes[PLACEMENT_MAX_NODES];
+	unsigned currentGroup;		// Group the process runs in now
+};
+
+// What the INI asks for; NULL or -1 where a key is not set
+struct PlacementRequest {
+	const char* mask;			// "0x0F0F" or a list such as "0-7,16,18-19"
+	int group;
+	int node;
+};
+
+struct PlacementResult {
+	unsigned group;
+	unsigned long long mask;	// Processors within the group
+	int node;					// -1 if not pinned to a node
+	unsigned cpus;
+};
+
+struct PlacementProvider {
+	bool (*getTopology)(void* ctx, PlacementTopology& topology);
+	bool (*setAffinity)(void* ctx, unsigned group, unsigned long long mask);
+	void* ctx;
+};
+
+struct Placement {
+	static bool IsRequested(const PlacementRequest& request);
+	static bool ParseMask(const char* str, unsigned long long& mask);
+	static unsigned CountCpus(unsigned long long mask);
+
+	// Works out the processors a request comes to on this topology
+	static int Resolve(const PlacementRequest& request, const PlacementTopology& topology,
+		PlacementResult& result);
+
+	// Resolves the request and sets the affinity, returning PLACEMENT_OK or why not
+	static int Apply(const PlacementProvider& provider, const PlacementRequest& request,
+		PlacementResult& result);
+
+	static const char* GetError(int error);
+};
+
+#endif // PLACEMENT_H
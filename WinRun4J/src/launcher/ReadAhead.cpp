@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "ReadAhead.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool IsSeparator(char c)
+{
+    return c == '\\' || c == '/';
+}
+
+// Windows paths, so case and either slash are the same file
+static bool SamePath(const char* a, const char* b, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (IsSeparator(a[i]) && IsSeparator(b[i]))
+            continue;
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+    return a[len] == 0;
+}
+
+ReadAhead::ReadAhead(unsigned long long budget) : budget(budget), files(NULL), count(0), capacity(0)
+{
+}
+
+ReadAhead::~ReadAhead()
+{
+    for (int i = 0; i < count; i++)
+        free(files[i]);
+    free(files);
+}
+
+bool ReadAhead::AddPath(const char* path, size_t len)
+{
+    if (len == 0)
+        return false;
+    for (int i = 0; i < count; i++) {
+        if (SamePath(files[i], path, len))
+            return false;
+    }
+
+    if (count == capacity) {
+        int grown = capacity ? capacity * 2 : 16;
+        char** more = (char**)realloc(files, sizeof(char*) * grown);
+        if (!more)
+            return false;
+        files = more;
+        capacity = grown;
+    }
+
+    char* copy = (char*)malloc(len + 1);
+    if (!copy)
+        return false;
+    memcpy(copy, path, len);
+    copy[len] = 0;
+    files[count++] = copy;
+    return true;
+}
+
+bool ReadAhead::Add(const char* path)
+{
+    return path && AddPath(path, strlen(path));
+}
+
+int ReadAhead::AddList(const char* list, char separator)
+{
+    int added = 0;
+    const char* p = list;
+    while (p && *p) {
+        const char* end = strchr(p, separator);
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (AddPath(p, len))
+            added++;
+        p = end ? end + 1 : NULL;
+    }
+    return added;
+}
+
+int ReadAhead::AddVM(const char* vmlibrary)
+{
+    if (!vmlibrary || !Add(vmlibrary))
+        return 0;
+
+    // Up past jvm.dll, server and bin to the home of the runtime
+    size_t len = strlen(vmlibrary);
+    for (int up = 0; up < 3; up++) {
+        while (len > 0 && !IsSeparator(vmlibrary[len - 1]))
+            len--;
+        if (len == 0)
+            return 1;
+        if (up < 2)
+            len--;
+    }
+
+    int added = 1;
+    static const char* const images[] = { "lib\\modules", "lib\\rt.jar" };
+    for (int i = 0; i < 2; i++) {
+        size_t image = strlen(images[i]);
+        char* path = (char*)malloc(len + image + 1);
+        if (!path)
+            break;
+        memcpy(path, vmlibrary, len);
+        for (size_t j = 0; j <= image; j++)
+            path[len + j] = IsSeparator(images[i][j]) ? vmlibrary[len - 1] : images[i][j];
+        if (Add(path))
+            added++;
+        free(path);
+    }
+    return added;
+}
+
+void ReadAhead::Run(const ReadAheadProvider& provider, char* buffer, int size, ReadAheadResult& result) const
+{
+    memset(&result, 0, sizeof(result));
+    for (int i = 0; i < count && result.bytes < budget; i++) {
+        void* file = provider.open(provider.ctx, files[i]);
+        if (!file) {
+            result.missing++;
+            continue;
+        }
+
+        bool partial = false;
+        for (;;) {
+            unsigned long long left = budget - result.bytes;
+            int block = left < (unsigned long long)size ? (int)left : size;
+            if (block == 0) {
+                partial = true;
+                break;
+            }
+            int read = provider.read(provider.ctx, file, buffer, block);
+            if (read <= 0)
+                break;
+            result.bytes += read;
+        }
+        provider.close(provider.ctx, file);
+
+        if (partial)
+            result.partial++;
+        else
+            result.files++;
+    }
+}
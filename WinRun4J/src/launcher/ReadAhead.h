@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <stddef.h>
+
+// Reads the files the VM is about to need (jvm.dll, its runtime image and
+// the classpath jars) from start to end in large blocks, so that after a
+// reboot they come from the file cache rather than a page fault at a time.
+
+// Megabytes to read ahead, 0 (the default) to read nothing
+#define STARTUP_READ_AHEAD ":startup.readahead"
+
+#define READ_AHEAD_BLOCK (1024 * 1024)
+
+struct ReadAheadProvider {
+	// NULL if the file cannot be opened (eg. a directory on the classpath)
+	void* (*open)(void* ctx, const char* path);
+	// Bytes read, 0 at the end of the file or on an error
+	int (*read)(void* ctx, void* file, char* buffer, int size);
+	void (*close)(void* ctx, void* file);
+	void* ctx;
+};
+
+struct ReadAheadResult {
+	unsigned long long bytes;
+	int files;          // Read to the end
+	int partial;        // Stopped by the budget
+	int missing;        // Could not be opened
+};
+
+class ReadAhead {
+public:
+	ReadAhead(unsigned long long budget);
+	~ReadAhead();
+
+	// Files are read in the order they are added, each only once
+	bool Add(const char* path);
+
+	// Each entry of a list such as a classpath, eg. "a.jar;b.jar"
+	int AddList(const char* list, char separator);
+
+	// jvm.dll, then the runtime image next to it: bin\server\jvm.dll
+	// gives lib\modules, or lib\rt.jar before Java 9
+	int AddVM(const char* vmlibrary);
+
+	int GetCount() const { return count; }
+	const char* Get(int i) const { return i >= 0 && i < count ? files[i] : NULL; }
+
+	// Reads the files in order until the budget is spent, the last one
+	// read only as far as the budget goes
+	void Run(const ReadAheadProvider& provider, char* buffer, int size, ReadAheadResult& result) const;
+
+private:
+	bool AddPath(const char* path, size_t len);
+
+	unsigned long long budget;
+	char** files;
+	int count;
+	int capacity;
+};
+
+#endif // READ_AHEAD_H
@@ -11,6 +11,7 @@
 #include "Service.h"
 #include "../common/INI.h"
 #include "../common/Log.h"
+#include "../common/Timing.h"
 #include "../java/JNI.h"
 #include "../java/VM.h"
 #include "../WinRun4J.h"
@@ -86,6 +87,9 @@ void WINAPI ServiceCtrlHandler(DWORD opCode)
 
 void WINAPI ServiceStart(DWORD argc, LPTSTR* argv)
 {
+    Timing::Mark("service");
+    Timing::Flush();
+
     ZeroMemory(&g_serviceStatus, sizeof(g_serviceStatus));
     g_serviceStatus.dwServiceType             = SERVICE_WIN32;
     g_serviceStatus.dwCurrentState           = SERVICE_START_PENDING;
@@ -506,7 +510,7 @@ int Service::Main(int argc, char* argv[])
     // ------------------------------------------------------------
     // Prepare Java String[] args
     // ------------------------------------------------------------
-    jclass stringClass = env->FindClass("java/lang/String");
+    jclass stringClass = JNI::GetCache().stringClass;
     if (!stringClass) {
         Log::Error("Could not find java/lang/String");
         if (env->ExceptionCheck()) env->ExceptionClear();
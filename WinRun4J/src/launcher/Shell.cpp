@@ -13,6 +13,7 @@
 #include "../java/JNI.h"
 #include "../java/VM.h"
 #include "DDE.h"
+#include "LaunchServer.h"
 #include <tlhelp32.h>
 #include <psapi.h>
 
@@ -36,13 +37,18 @@ BOOL CALLBACK EnumWindowsProcSingleInstance(HWND hWnd, LPARAM lParam)
 	return TRUE;
 }
 
-int Shell::CheckSingleInstance(dictionary* ini)
+int Shell::CheckSingleInstance(dictionary* ini, int& exitCode)
 {
 	char* singleInstance = iniparser_getstr(ini, SINGLE_INSTANCE_OPTION);
 	if(singleInstance == NULL) {
 		return 0;
 	}
 
+	// The main class runs in the launch server, this process only passes stdio
+	if(strcmp(singleInstance, "server") == 0) {
+		return LaunchServer::Forward(ini, exitCode) ? 1 : 0;
+	}
+
 	// Check for single instance mode
 	bool processOnly = true;
 	bool dde = false;
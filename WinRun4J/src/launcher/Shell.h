@@ -17,7 +17,8 @@
 
 class Shell {
 public:
-	static int CheckSingleInstance(dictionary* ini);
+	// Non-zero if another instance takes this launch, which exits with exitCode
+	static int CheckSingleInstance(dictionary* ini, int& exitCode);
 };
 
 #endif // SHELL_H
\ No newline at end of file
@@ -209,17 +209,18 @@ void SplashScreen::ShowSplashImage(HINSTANCE hInstance, dictionary *ini)
 
 HBITMAP SplashScreen::LoadImageBitmap(dictionary* ini, char* fileName)
 {
-	// It assumed that the splash file is relative to the module directory so we temporarily set
-	// the current directory (unless a working directory has been set)
-	TCHAR current[MAX_PATH];
+	// It assumed that the splash file is relative to the module directory (unless a working
+	// directory has been set). The path is joined rather than changing the current directory
+	// as other startup phases may be running.
+	TCHAR path[MAX_PATH];
 	char* workingDirectory = iniparser_getstr(ini, WORKING_DIR);
-	if(workingDirectory == NULL) {
-		GetCurrentDirectory(MAX_PATH, current);
-		SetCurrentDirectory(iniparser_getstr(ini, INI_DIR));
-	}
+	char* baseDir = workingDirectory ? NULL : iniparser_getstr(ini, INI_DIR);
+	DWORD len = GetFullPathFrom(baseDir, fileName, path, MAX_PATH);
+	if(len == 0 || len >= MAX_PATH)
+		return NULL;
 
 	HBITMAP hbmp = NULL;
-	HANDLE hFile = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+	HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
 	if(hFile != INVALID_HANDLE_VALUE) {
 		DWORD dwFileSize = GetFileSize(hFile, 0);
 		HGLOBAL hgbl = GlobalAlloc(GMEM_FIXED, dwFileSize);
@@ -234,11 +235,6 @@ HBITMAP SplashScreen::LoadImageBitmap(dictionary* ini, char* fileName)
 		CloseHandle(hFile);
 	}
 
-	// Now set the working directory back
-	if(workingDirectory == NULL) {
-		SetCurrentDirectory(current);
-	}
-   
     return hbmp;
 }
 
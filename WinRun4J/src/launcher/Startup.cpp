@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#include "Startup.h"
+#include <stddef.h>
+
+namespace
+{
+    // What a phase's thread needs to run it and time it. The state is left to
+    // the thread that started it, which only reads the result once joined.
+    struct Task {
+        const StartupRunner* runner;
+        StartupPhase* phase;
+        double origin;
+        bool ok;
+    };
+}
+
+static void RunTask(void* arg)
+{
+    Task* task = (Task*)arg;
+    StartupPhase* phase = task->phase;
+    task->ok = phase->run(phase->arg);
+    phase->end = task->runner->now(task->runner->ctx) - task->origin;
+}
+
+bool Startup::IsValid(const StartupPhase* phases, int count)
+{
+    if (count < 0 || count > STARTUP_MAX_PHASES)
+        return false;
+    for (int i = 0; i < count; i++) {
+        if (!phases[i].run || (phases[i].deps >> i) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Skips a phase if one it depends on did not finish, and says if it can run
+static bool IsReady(StartupPhase* phases, int i)
+{
+    for (int d = 0; d < i; d++) {
+        if (!(phases[i].deps & (1u << d)))
+            continue;
+        if (phases[d].state == STARTUP_FAILED || phases[d].state == STARTUP_SKIPPED) {
+            phases[i].state = STARTUP_SKIPPED;
+            return false;
+        }
+        if (phases[d].state != STARTUP_DONE)
+            return false;
+    }
+    return true;
+}
+
+bool Startup::Run(const StartupRunner& runner, StartupPhase* phases, int count, bool parallel,
+                  StartupTiming& timing)
+{
+    timing.elapsed = timing.serial = 0;
+    if (!IsValid(phases, count))
+        return false;
+
+    for (int i = 0; i < count; i++) {
+        phases[i].state = STARTUP_PENDING;
+        phases[i].start = phases[i].end = 0;
+    }
+
+    Task tasks[STARTUP_MAX_PHASES];
+    void* threads[STARTUP_MAX_PHASES];
+    int running[STARTUP_MAX_PHASES];
+    int runningCount = 0;
+    double origin = runner.now(runner.ctx);
+
+    for (;;) {
+        // Start whatever can run now. One after another, each phase runs
+        // here in turn and those after it see it finished.
+        for (int i = 0; i < count; i++) {
+            if (phases[i].state != STARTUP_PENDING || !IsReady(phases, i))
+                continue;
+
+            tasks[i].runner = &runner;
+            tasks[i].phase = &phases[i];
+            tasks[i].origin = origin;
+            phases[i].state = STARTUP_RUNNING;
+            phases[i].start = runner.now(runner.ctx) - origin;
+
+            void* thread = parallel ? runner.start(runner.ctx, RunTask, &tasks[i]) : NULL;
+            if (thread) {
+                threads[runningCount] = thread;
+                running[runningCount++] = i;
+            } else {
+                RunTask(&tasks[i]);
+                phases[i].state = tasks[i].ok ? STARTUP_DONE : STARTUP_FAILED;
+            }
+        }
+
+        if (runningCount == 0)
+            break;
+
+        int done = runner.wait(runner.ctx, threads, runningCount);
+        if (done < 0 || done >= runningCount)
+            done = 0;
+        int i = running[done];
+        phases[i].state = tasks[i].ok ? STARTUP_DONE : STARTUP_FAILED;
+        runningCount--;
+        threads[done] = threads[runningCount];
+        running[done] = running[runningCount];
+    }
+
+    bool ok = true;
+    for (int i = 0; i < count; i++) {
+        if (phases[i].state == STARTUP_DONE || phases[i].state == STARTUP_FAILED) {
+            timing.serial += phases[i].end - phases[i].start;
+            if (phases[i].end > timing.elapsed)
+                timing.elapsed = phases[i].end;
+        }
+        ok = ok && phases[i].state == STARTUP_DONE;
+    }
+    return ok;
+}
+
+const char* Startup::GetStateName(int state)
+{
+    switch (state) {
+    case STARTUP_PENDING:
+        return "pending";
+    case STARTUP_RUNNING:
+        return "running";
+    case STARTUP_DONE:
+        return "done";
+    case STARTUP_FAILED:
+        return "failed";
+    case STARTUP_SKIPPED:
+        return "skipped";
+    }
+    return "unknown";
+}
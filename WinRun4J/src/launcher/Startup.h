@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+// Runs the phases of a launch before the VM is created (finding the VM,
+// loading jvm.dll, expanding the classpath, loading the splash image) at the
+// same time where they do not depend on each other.
+
+#define STARTUP_PARALLEL ":startup.parallel"
+
+#define STARTUP_MAX_PHASES 16
+
+#define STARTUP_PENDING 0
+#define STARTUP_RUNNING 1
+#define STARTUP_DONE    2
+#define STARTUP_FAILED  3
+#define STARTUP_SKIPPED 4   // A phase it depends on failed
+
+struct StartupPhase {
+	const char* name;
+	// Bit i is set if phase i has to finish first; only earlier phases
+	// can be depended on, so phases are always in an order they can run in
+	unsigned deps;
+	// False if the phases that depend on this one cannot run
+	bool (*run)(void* arg);
+	void* arg;
+
+	// Set by Startup::Run, in milliseconds from when it started
+	int state;
+	double start;
+	double end;
+};
+
+struct StartupRunner {
+	// Calls fn(arg) on a new thread, NULL if there is none to be had
+	void* (*start)(void* ctx, void (*fn)(void* arg), void* arg);
+	// Waits for one of the threads to return, releases it and gives its index
+	int (*wait)(void* ctx, void** threads, int count);
+	// Milliseconds from any fixed point
+	double (*now)(void* ctx);
+	void* ctx;
+};
+
+struct StartupTiming {
+	double elapsed;     // From the first phase starting to the last finishing
+	double serial;      // The phases' times added up, as one after another
+};
+
+class Startup {
+public:
+	// Runs the phases as their deps allow, on threads of their own if
+	// parallel and one after another in order if not. False if any failed
+	// or was skipped, or the phases are not valid.
+	static bool Run(const StartupRunner& runner, StartupPhase* phases, int count, bool parallel,
+		StartupTiming& timing);
+
+	static bool IsValid(const StartupPhase* phases, int count);
+	static const char* GetStateName(int state);
+};
+
+#endif // STARTUP_H
@@ -0,0 +1,318 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Builds the package index over 2000 synthetic jars (central directories
+// only), checks lookups against what was put in, and compares a lookup with
+// probing every jar in turn. Only needs ClassIndex.cpp, eg.
+//
+//     g++ -O2 test/ClassIndexBench.cpp src/java/ClassIndex.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/java/ClassIndex.h"
+
+#define NUM_JARS     2000
+#define JAR_PACKAGES 4
+#define PKG_CLASSES  20
+#define NUM_LOOKUPS  20000
+#define NUM_RUNS     10
+
+struct Zip {
+	unsigned char* data;
+	size_t len;
+	size_t size;
+};
+
+static void Put(Zip& z, const void* p, size_t len)
+{
+	if(z.len + len > z.size) {
+		z.size = (z.len + len) * 2;
+		z.data = (unsigned char*) realloc(z.data, z.size);
+	}
+	memcpy(&z.data[z.len], p, len);
+	z.len += len;
+}
+
+static void Put16(Zip& z, unsigned v)
+{
+	unsigned char b[2] = { (unsigned char) v, (unsigned char) (v >> 8) };
+	Put(z, b, 2);
+}
+
+static void Put32(Zip& z, unsigned v)
+{
+	Put16(z, v & 0xFFFF);
+	Put16(z, v >> 16);
+}
+
+static void Put64(Zip& z, unsigned long long v)
+{
+	Put32(z, (unsigned) v);
+	Put32(z, (unsigned) (v >> 32));
+}
+
+// A central directory entry; the local headers are never read
+static void PutEntry(Zip& z, const char* name)
+{
+	Put32(z, 0x02014b50);
+	for(int i = 0; i < 6; i++)
+		Put32(z, 0);
+	Put16(z, (unsigned) strlen(name));
+	Put16(z, 0);
+	Put16(z, 0);
+	for(int i = 0; i < 3; i++)
+		Put32(z, 0);
+	Put(z, name, strlen(name));
+}
+
+static void PutEnd(Zip& z, size_t dirOffset, int entries, bool zip64)
+{
+	size_t dirSize = z.len - dirOffset;
+	if(zip64) {
+		size_t rec = z.len;
+		Put32(z, 0x06064b50);
+		Put64(z, 44);
+		Put32(z, 0);
+		Put32(z, 0);
+		Put32(z, 0);
+		Put64(z, entries);
+		Put64(z, entries);
+		Put64(z, dirSize);
+		Put64(z, dirOffset);
+		Put32(z, 0x07064b50);
+		Put32(z, 0);
+		Put64(z, rec);
+		Put32(z, 1);
+	}
+	Put32(z, 0x06054b50);
+	Put32(z, 0);
+	Put16(z, zip64 ? 0xFFFF : entries);
+	Put16(z, zip64 ? 0xFFFF : entries);
+	Put32(z, zip64 ? 0xFFFFFFFF : (unsigned) dirSize);
+	Put32(z, zip64 ? 0xFFFFFFFF : (unsigned) dirOffset);
+	Put16(z, 7);
+	Put(z, "comment", 7);
+}
+
+// Jar j holds com/example/j, com/example/j/impl, a package shared with the
+// next jar and, for every tenth jar, the default package
+static void PackageName(char* buf, int jar, int p)
+{
+	if(p == 0)
+		sprintf(buf, "com/example/m%04d", jar);
+	else if(p == 1)
+		sprintf(buf, "com/example/m%04d/impl", jar);
+	else if(p == 2)
+		sprintf(buf, "org/shared/s%04d", jar / 2);
+	else
+		buf[0] = 0;
+}
+
+static Zip MakeJar(int jar)
+{
+	Zip z = { NULL, 0, 0 };
+	Put(z, "PK\3\4 local headers", 19);
+	size_t dirOffset = z.len;
+	int entries = 0;
+	PutEntry(z, "META-INF/");
+	PutEntry(z, "META-INF/MANIFEST.MF");
+	PutEntry(z, "META-INF/services/a.b.C");
+	entries += 3;
+	char pkg[64], name[128];
+	for(int p = 0; p < JAR_PACKAGES; p++) {
+		if(p == 3 && jar % 10)
+			continue;
+		PackageName(pkg, jar, p);
+		if(*pkg) {
+			sprintf(name, "%s/", pkg);
+			PutEntry(z, name);
+			entries++;
+		}
+		for(int c = 0; c < PKG_CLASSES; c++) {
+			sprintf(name, "%s%sC%02d.class", pkg, *pkg ? "/" : "", c);
+			PutEntry(z, name);
+			entries++;
+		}
+	}
+	PutEnd(z, dirOffset, entries, jar == 7);
+	return z;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static ClassIndex* BuildIndex(Zip* zips)
+{
+	ClassIndex* index = new ClassIndex();
+	char path[64];
+	for(int i = 0; i < NUM_JARS; i++) {
+		sprintf(path, "C:\\app\\lib\\m%04d.jar", i);
+		int jar = index->AddJar(path, zips[i].len, i);
+		index->AddZip(jar, zips[i].data, zips[i].len);
+	}
+	index->AddJar("C:\\app\\classes", 0, 0);
+	index->SetUnindexed(NUM_JARS);
+	int bad = index->AddJar("C:\\app\\broken.jar", 5, 0);
+	index->AddZip(bad, (const unsigned char*) "PK...", 5);
+	if(!index->Build()) {
+		delete index;
+		return NULL;
+	}
+	return index;
+}
+
+static int CheckIndex(const ClassIndex& index)
+{
+	int errors = 0;
+	const unsigned* jars;
+	char pkg[64];
+
+	if(index.GetJarCount() != NUM_JARS + 2 || strcmp(index.GetJar(5), "C:\\app\\lib\\m0005.jar") ||
+		index.GetJarStamp(5).time != 5) {
+		printf("FAIL %d jars\n", index.GetJarCount());
+		errors++;
+	}
+
+	for(int j = 0; j < NUM_JARS; j++) {
+		PackageName(pkg, j, 0);
+		if(index.Find(pkg, (int) strlen(pkg), &jars) != 1 || jars[0] != (unsigned) j) {
+			printf("FAIL %s\n", pkg);
+			errors++;
+		}
+		PackageName(pkg, j, 2);
+		if(index.Find(pkg, (int) strlen(pkg), &jars) != 2 || jars[0] != (unsigned) (j & ~1) ||
+			jars[1] != (unsigned) (j | 1)) {
+			printf("FAIL shared %s\n", pkg);
+			errors++;
+		}
+	}
+
+	int n = index.Find("", 0, &jars);
+	if(n != NUM_JARS / 10 || jars[0] != 0 || jars[n - 1] != NUM_JARS - 10) {
+		printf("FAIL default package in %d jars\n", n);
+		errors++;
+	}
+	if(index.Find("META-INF", 8, &jars) || index.Find("META-INF/services", 17, &jars) ||
+		index.Find("com/example", 11, &jars) || index.Find("com/example/m00051", 17, &jars) != 1) {
+		printf("FAIL found a package that is not there\n");
+		errors++;
+	}
+	if(index.GetPackageCount() != NUM_JARS * 2 + NUM_JARS / 2 + 1) {
+		printf("FAIL %d packages\n", index.GetPackageCount());
+		errors++;
+	}
+	n = index.GetUnindexed(&jars);
+	if(n != 2 || jars[0] != NUM_JARS || jars[1] != NUM_JARS + 1) {
+		printf("FAIL %d unindexed\n", n);
+		errors++;
+	}
+	return errors;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+
+	Zip* zips = (Zip*) malloc(NUM_JARS * sizeof(Zip));
+	for(int i = 0; i < NUM_JARS; i++)
+		zips[i] = MakeJar(i);
+
+	ClassIndex* index = BuildIndex(zips);
+	if(!index) {
+		printf("FAILED: could not build the index\n");
+		return 1;
+	}
+	errors += CheckIndex(*index);
+
+	// As if mapped from the cache
+	unsigned size = index->GetSize();
+	unsigned char* copy = (unsigned char*) malloc(size);
+	memcpy(copy, index->GetData(), size);
+	{
+		ClassIndex read;
+		if(!read.Attach(copy, size)) {
+			printf("FAIL attach\n");
+			errors++;
+		} else {
+			errors += CheckIndex(read);
+		}
+	}
+	{
+		ClassIndex bad;
+		copy[size - 1] = 'x';
+		if(bad.Attach(copy, size) || bad.Attach(copy, size - 1) || bad.GetJarCount()) {
+			printf("FAIL attached a broken index\n");
+			errors++;
+		}
+	}
+	free(copy);
+
+	double t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		ClassIndex* i = BuildIndex(zips);
+		if(!i || i->GetSize() != size)
+			errors++;
+		delete i;
+	}
+	double t1 = Now();
+
+	// Lookups of packages spread over the classpath, with the index and by
+	// asking each jar in turn as the class loader would without one
+	char (*names)[64] = (char (*)[64]) malloc(NUM_LOOKUPS * sizeof(*names));
+	for(int i = 0; i < NUM_LOOKUPS; i++)
+		PackageName(names[i], (i * 7919) % NUM_JARS, i % 3);
+
+	double t2 = Now();
+	int found = 0;
+	for(int i = 0; i < NUM_LOOKUPS; i++) {
+		const unsigned* jars;
+		found += index->Find(names[i], (int) strlen(names[i]), &jars);
+	}
+	double t3 = Now();
+	int probed = 0;
+	char pkg[64];
+	for(int i = 0; i < NUM_LOOKUPS; i++) {
+		for(int j = 0; j < NUM_JARS; j++) {
+			for(int p = 0; p < 3; p++) {
+				PackageName(pkg, j, p);
+				if(!strcmp(pkg, names[i])) {
+					probed++;
+					break;
+				}
+			}
+		}
+	}
+	double t4 = Now();
+
+	if(found != probed) {
+		printf("FAIL index found %d, probing found %d\n", found, probed);
+		errors++;
+	}
+	printf("%d jars, %d packages, %u bytes: build %.3f ms\n", NUM_JARS, index->GetPackageCount(), size,
+		(t1 - t0) * 1e3 / NUM_RUNS);
+	printf("%d lookups: index %.1f ns, probing each jar %.1f us\n", NUM_LOOKUPS,
+		(t3 - t2) * 1e9 / NUM_LOOKUPS, (t4 - t3) * 1e6 / NUM_LOOKUPS);
+
+	free(names);
+	delete index;
+	for(int i = 0; i < NUM_JARS; i++)
+		free(zips[i].data);
+	free(zips);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Checks which loaded classes go on a preload list and that a saved list
+// reads back the same, then times recording the class loads of a large
+// application (as the JVMTI callback does) and reading its list back.
+// Only needs ClassList.cpp and StringBuilder.cpp, eg.
+//
+//     g++ -O2 test/ClassListBench.cpp src/java/ClassList.cpp src/common/StringBuilder.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/java/ClassList.h"
+
+#define NUM_CLASSES 20000
+#define NUM_RUNS    20
+
+static int CheckList()
+{
+	int errors = 0;
+	ClassList list;
+
+	static const char* const recorded[] = {
+		"Ljava/lang/String;",
+		"Lcom/acme/app/Main;",
+		"Lcom/acme/app/Main$1;",
+		"Lcom/acme/app/Main$Inner;",
+		"Ljava/lang/String;",
+		"[Ljava/lang/String;",
+		"Lcom/acme/app/Main$$Lambda$14/0x0000000800c02a00;",
+		"Lcom/acme/app/Main$$Lambda/0x0000000800c02a00;",
+		"Ljava/lang/invoke/LambdaForm$MH/1234567;",
+		"com/acme/NoSignature",
+		"L;",
+		NULL,
+	};
+	for(int i = 0; i < (int)(sizeof(recorded) / sizeof(recorded[0])); i++)
+		list.Record(recorded[i]);
+
+	static const char* const expected[] = { "java/lang/String", "com/acme/app/Main", "com/acme/app/Main$1",
+		"com/acme/app/Main$Inner" };
+	bool same = list.GetCount() == 4;
+	for(int i = 0; same && i < 4; i++)
+		same = strcmp(list.Get(i), expected[i]) == 0;
+	if(!same) {
+		printf("FAIL recorded %d classes:\n", list.GetCount());
+		for(int i = 0; i < list.GetCount(); i++)
+			printf("  %s\n", list.Get(i));
+		errors++;
+	}
+
+	StringBuilder out;
+	list.Format(out);
+	ClassList read;
+	const char* text = out.Get();
+	int added = read.Parse(text, strlen(text));
+	same = added == list.GetCount() && read.GetCount() == list.GetCount();
+	for(int i = 0; same && i < list.GetCount(); i++)
+		same = strcmp(read.Get(i), list.Get(i)) == 0;
+	if(!same) {
+		printf("FAIL read back %d of %d classes\n", read.GetCount(), list.GetCount());
+		errors++;
+	}
+
+	// Edited by hand: blank lines, comments, spaces and no line end at the end
+	static const char edited[] = "# kept\n\n  com/acme/A  \r\n\tcom/acme/B\r\n# com/acme/C\ncom/acme/A\ncom/acme/D";
+	ClassList hand;
+	hand.Parse(edited, strlen(edited));
+	if(hand.GetCount() != 3 || strcmp(hand.Get(0), "com/acme/A") || strcmp(hand.Get(2), "com/acme/D")) {
+		printf("FAIL parsed %d classes by hand\n", hand.GetCount());
+		errors++;
+	}
+
+	char name[64];
+	ClassList::ToBinaryName("com/acme/app/Main$Inner", name, sizeof(name));
+	if(strcmp(name, "com.acme.app.Main$Inner")) {
+		printf("FAIL binary name %s\n", name);
+		errors++;
+	}
+	ClassList::ToBinaryName("com/acme/app/Main", name, 9);
+	if(strcmp(name, "com.acme")) {
+		printf("FAIL cut binary name %s\n", name);
+		errors++;
+	}
+	return errors;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = CheckList();
+
+	// Some classes are loaded by more than one loader, and so seen twice
+	char** signatures = (char**)malloc(sizeof(char*) * NUM_CLASSES);
+	for(int i = 0; signatures && i < NUM_CLASSES; i++) {
+		char sig[128];
+		int c = i % (NUM_CLASSES - 1000);
+		sprintf(sig, "Lcom/acme/module%d/pkg%d/Class%d$Inner;", c % 37, c % 101, c);
+		signatures[i] = (char*)malloc(strlen(sig) + 1);
+		strcpy(signatures[i], sig);
+	}
+	if(!signatures)
+		return 1;
+
+	StringBuilder saved;
+	int count = 0;
+	double t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		ClassList list;
+		for(int i = 0; i < NUM_CLASSES; i++)
+			list.Record(signatures[i]);
+		count = list.GetCount();
+		if(r == 0)
+			list.Format(saved);
+	}
+	double t1 = Now();
+	printf("record %d class loads (%d classes): %.2f ms, %.0f ns each\n", NUM_CLASSES, count,
+		(t1 - t0) * 1000 / NUM_RUNS, (t1 - t0) * 1e9 / NUM_RUNS / NUM_CLASSES);
+
+	t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		ClassList list;
+		list.Parse(saved.Get(), saved.Length());
+		if(list.GetCount() != count) {
+			printf("FAIL read back %d of %d classes\n", list.GetCount(), count);
+			errors++;
+			break;
+		}
+	}
+	t1 = Now();
+	printf("read a list of %d classes (%d KB): %.2f ms\n", count, (int)(saved.Length() / 1024),
+		(t1 - t0) * 1000 / NUM_RUNS);
+
+	for(int i = 0; i < NUM_CLASSES; i++)
+		free(signatures[i]);
+	free(signatures);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
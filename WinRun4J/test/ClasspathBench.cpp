@@ -0,0 +1,308 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Expands a launch's classpath entries over a stand-in file system that
+// charges LIST_MS for each directory listed, as a network share might. The
+// entries are grouped into tasks with Glob::Group and run on one thread and
+// then on four, each task on its own Glob and the matches merged in order,
+// as Classpath.cpp does. Checks both give the same classpath and that each
+// directory is listed once.
+//
+// Each task also records the last write time of the directories it listed
+// and whether the paths it tested exist, as the classpath cache does, and the
+// check a warm start makes (one stat per record, which is not charged for) is
+// timed against the expansion. Adding a jar or creating a missing directory
+// has to fail the check. Only needs Glob.cpp, eg.
+//
+//     g++ -O2 -pthread test/ClasspathBench.cpp src/java/Glob.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/java/Glob.h"
+
+#define LIST_MS     20
+#define MAX_ENTRIES 16
+#define MAX_THREADS 4
+#define NUM_CHECKS  10000
+#define MISSING     0xFFFFFFFFFFFFFFFFULL
+
+struct TreeDir {
+	const char* path;
+	const char* names;		// Separated by '|', directories end in '\'
+};
+
+// The last directory is missing until it is created
+static const TreeDir tree[] = {
+	{ "C:\\app", "app.jar|lib\\|plugins\\|readme.txt" },
+	{ "C:\\app\\lib", "core.jar|util.jar|log.jar|ext\\" },
+	{ "C:\\app\\lib\\ext", "ext-a.jar|ext-b.jar" },
+	{ "C:\\app\\plugins", "p1.jar|p2.jar|p3.jar|notes.txt" },
+	{ "\\\\server\\share\\lib", "shared.jar|xml.jar|xslt.jar" },
+	{ "\\\\tools\\java", "tool.jar" },
+	{ "C:\\app\\missing", "" },
+};
+
+#define NUM_DIRS (sizeof(tree) / sizeof(tree[0]))
+
+static unsigned long long dirTime[NUM_DIRS] = { 100, 101, 102, 103, 104, 105, 106 };
+static bool dirMissing[NUM_DIRS] = { false, false, false, false, false, false, true };
+
+// A directory that was listed or a path that was tested, and its time then
+struct Input {
+	std::string path;
+	bool listed;
+	unsigned long long time;
+};
+
+// Eight entries over six directories
+static const char* const entries[] = {
+	"C:\\app\\lib\\*.jar",
+	"C:\\app\\lib\\ext\\*.jar",
+	"C:\\app\\app.jar",
+	"C:\\app\\plugins\\*.jar",
+	"\\\\server\\share\\lib\\*.jar",
+	"\\\\server\\share\\lib\\x*.jar",
+	"\\\\tools\\java\\*.jar",
+	"C:\\app\\missing\\*.jar",
+};
+
+#define NUM_ENTRIES (int) (sizeof(entries) / sizeof(entries[0]))
+
+static std::atomic<int> listCalls;
+
+static int FindDir(const char* path)
+{
+	for(size_t i = 0; i < NUM_DIRS; i++) {
+		if(!dirMissing[i] && !strcmp(tree[i].path, path))
+			return (int) i;
+	}
+	return -1;
+}
+
+static bool Exists(const char* path)
+{
+	const char* sep = strrchr(path, '\\');
+	std::string dir(path, sep - path);
+	int d = FindDir(dir.c_str());
+	std::string name = std::string("|") + tree[d < 0 ? 0 : d].names + "|";
+	return d >= 0 && name.find(std::string("|") + (sep + 1) + "|") != std::string::npos;
+}
+
+// The last write time of a listed directory, other paths only exist (0)
+static unsigned long long GetPathTime(const char* path, bool listed)
+{
+	if(!listed)
+		return Exists(path) ? 0 : MISSING;
+	int d = FindDir(path);
+	return d < 0 ? MISSING : dirTime[d];
+}
+
+static unsigned long long AddInput(void* ctx, const char* path, bool listed)
+{
+	Input input = { path, listed, GetPathTime(path, listed) };
+	((std::vector<Input>*) ctx)->push_back(input);
+	return input.time;
+}
+
+static bool TreeList(void* ctx, const char* dir, GlobListing& listing)
+{
+	// The time is taken first so that a change while listing is seen next time
+	if(AddInput(ctx, dir, true) == MISSING)
+		return false;
+
+	listCalls++;
+	std::this_thread::sleep_for(std::chrono::milliseconds(LIST_MS));
+	const TreeDir* d = &tree[FindDir(dir)];
+
+	char name[64];
+	for(const char* p = d->names; *p;) {
+		size_t len = strcspn(p, "|");
+		bool isDir = p[len - 1] == '\\';
+		memcpy(name, p, len - isDir);
+		name[len - isDir] = 0;
+		listing.Add(name, isDir);
+		p += p[len] ? len + 1 : len;
+	}
+	return true;
+}
+
+static bool TreeExists(void* ctx, const char* path)
+{
+	return AddInput(ctx, path, false) != MISSING;
+}
+
+// The tasks of a launch and the matches of each entry, until they are merged
+struct Work {
+	int group[MAX_ENTRIES];
+	int taskCount;
+	Glob* globs[MAX_ENTRIES];
+	const char** matches[MAX_ENTRIES];
+	int counts[MAX_ENTRIES];
+	std::vector<Input> inputs[MAX_ENTRIES];
+	std::atomic<int> next;
+};
+
+static void ExpandTask(Work& work, int t)
+{
+	GlobProvider provider = { TreeList, TreeExists, &work.inputs[t] };
+	work.globs[t] = new Glob(provider);
+	for(int i = 0; i < NUM_ENTRIES; i++) {
+		if(work.group[i] != t)
+			continue;
+		int n = work.globs[t]->Collect(entries[i]);
+		work.matches[i] = (const char**) malloc((n + 1) * sizeof(const char*));
+		work.counts[i] = n;
+		for(int j = 0; j < n; j++)
+			work.matches[i][j] = work.globs[t]->GetMatch(j);
+	}
+}
+
+static void ExpandThread(Work* work)
+{
+	for(;;) {
+		int t = work->next++;
+		if(t >= work->taskCount)
+			break;
+		ExpandTask(*work, t);
+	}
+}
+
+// Expands the entries on up to threads threads, the calling one included,
+// and gives what the tasks listed and tested to save with the classpath
+static std::string Expand(int threads, double& ms, std::vector<Input>& inputs)
+{
+	Work work;
+	memset(work.globs, 0, sizeof(work.globs));
+	work.taskCount = Glob::Group(entries, NUM_ENTRIES, work.group);
+	work.next = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::thread pool[MAX_THREADS];
+	int started = 0;
+	for(int i = 1; i < threads && i < work.taskCount; i++)
+		pool[started++] = std::thread(ExpandThread, &work);
+	ExpandThread(&work);
+	for(int i = 0; i < started; i++)
+		pool[i].join();
+
+	// This glob lists nothing itself
+	GlobProvider provider = { TreeList, TreeExists, NULL };
+	Glob merged(provider);
+	for(int i = 0; i < NUM_ENTRIES; i++) {
+		for(int j = 0; j < work.counts[i]; j++)
+			merged.Add(work.matches[i][j]);
+	}
+	std::string classpath;
+	for(int i = 0; i < merged.GetCount(); i++) {
+		if(i)
+			classpath += ';';
+		classpath += merged.Get(i);
+	}
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	inputs.clear();
+	for(int i = 0; i < work.taskCount; i++)
+		inputs.insert(inputs.end(), work.inputs[i].begin(), work.inputs[i].end());
+	for(int i = 0; i < NUM_ENTRIES; i++)
+		free(work.matches[i]);
+	for(int i = 0; i < work.taskCount; i++)
+		delete work.globs[i];
+	return classpath;
+}
+
+// The saved classpath is current while every input has the time it was saved with
+static bool IsCurrent(const std::vector<Input>& inputs)
+{
+	for(size_t i = 0; i < inputs.size(); i++) {
+		if(GetPathTime(inputs[i].path.c_str(), inputs[i].listed) != inputs[i].time)
+			return false;
+	}
+	return true;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+
+	int group[MAX_ENTRIES];
+	int tasks = Glob::Group(entries, NUM_ENTRIES, group);
+
+	listCalls = 0;
+	double serialMs;
+	std::vector<Input> inputs;
+	std::string serial = Expand(1, serialMs, inputs);
+	int serialListings = listCalls;
+
+	listCalls = 0;
+	double parallelMs;
+	std::string parallel = Expand(MAX_THREADS, parallelMs, inputs);
+	int parallelListings = listCalls;
+
+	const char* expected = "C:\\app\\lib\\core.jar;C:\\app\\lib\\log.jar;C:\\app\\lib\\util.jar;"
+		"C:\\app\\lib\\ext\\ext-a.jar;C:\\app\\lib\\ext\\ext-b.jar;C:\\app\\app.jar;"
+		"C:\\app\\plugins\\p1.jar;C:\\app\\plugins\\p2.jar;C:\\app\\plugins\\p3.jar;"
+		"\\\\server\\share\\lib\\shared.jar;\\\\server\\share\\lib\\xml.jar;\\\\server\\share\\lib\\xslt.jar;"
+		"\\\\tools\\java\\tool.jar";
+	if(serial != expected || parallel != serial) {
+		printf("FAIL classpath\n  one thread: %s\n  %d threads: %s\n", serial.c_str(), MAX_THREADS, parallel.c_str());
+		errors++;
+	}
+
+	// lib, lib\ext, plugins, the share and the tools; the missing directory
+	// is only found to be missing
+	if(serialListings != 5 || parallelListings != 5) {
+		printf("FAIL %d and %d listings, expected 5\n", serialListings, parallelListings);
+		errors++;
+	}
+
+	printf("%d entries, %d tasks, %d listings at %d ms\n", NUM_ENTRIES, tasks, parallelListings, LIST_MS);
+	printf("one thread: %.0f ms; %d threads: %.0f ms\n", serialMs, MAX_THREADS, parallelMs);
+
+	// The six directories and app.jar
+	if(inputs.size() != 7 || !IsCurrent(inputs)) {
+		printf("FAIL %d inputs recorded, current %d\n", (int) inputs.size(), IsCurrent(inputs));
+		errors++;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int i = 0; i < NUM_CHECKS; i++) {
+		if(!IsCurrent(inputs))
+			errors++;
+	}
+	double checkMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("warm start: %d stats, %.4f ms; cold: %d listings, %.0f ms\n", (int) inputs.size(),
+		checkMs / NUM_CHECKS, parallelListings, parallelMs);
+
+	// A jar added to lib\ext, and the missing directory created
+	dirTime[2]++;
+	if(IsCurrent(inputs)) {
+		printf("FAIL saved classpath used after a jar was added\n");
+		errors++;
+	}
+	dirTime[2]--;
+	dirMissing[NUM_DIRS - 1] = false;
+	if(IsCurrent(inputs)) {
+		printf("FAIL saved classpath used after a missing directory was created\n");
+		errors++;
+	}
+	dirMissing[NUM_DIRS - 1] = true;
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
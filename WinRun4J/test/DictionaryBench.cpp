@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Measures dictionary insert/lookup cost as the number of keys grows. With
+// the hashed index the per-operation time should stay flat up to 50k keys.
+// The allocation columns come from dictionary_getstats: the insert count is
+// arena blocks plus index/array growth, and rewriting every value with one
+// of the same length should not allocate at all. The section walk uses the
+// section table rather than matching key prefixes. The merge compares
+// dictionary_merge with setting the keys of one layer over another one by
+// one, and checks the policies and origins.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/Dictionary.h"
+
+static double Now()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double) t.QuadPart / (double) freq.QuadPart;
+}
+
+static void MakeKey(char* buf, size_t size, int i)
+{
+	switch(i % 3) {
+	case 0: sprintf_s(buf, size, ":classpath.%d", i); break;
+	case 1: sprintf_s(buf, size, ":vmarg.%d", i); break;
+	default: sprintf_s(buf, size, "Override:key.%d", i); break;
+	}
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	static const int checkpoints[] = { 1000, 10000, 50000 };
+	char key[64];
+	char val[64];
+	int errors = 0;
+
+	printf("%8s %14s %14s %14s %14s\n", "keys", "insert ns/op", "lookup ns/op",
+		"insert allocs", "rewrite allocs");
+
+	for(int c = 0; c < 3; c++) {
+		int n = checkpoints[c];
+		dictionary_stats s0, s1, s2;
+		dictionary_getstats(&s0);
+		dictionary* d = dictionary_new(0);
+
+		double t0 = Now();
+		for(int i = 0; i < n; i++) {
+			MakeKey(key, sizeof(key), i);
+			sprintf_s(val, sizeof(val), "value-%d", i);
+			dictionary_set(d, key, val);
+		}
+		double t1 = Now();
+		for(int i = 0; i < n; i++) {
+			MakeKey(key, sizeof(key), i);
+			char* v = dictionary_get(d, key, NULL);
+			if(v == NULL || atoi(v + 6) != i)
+				errors++;
+		}
+		double t2 = Now();
+		dictionary_getstats(&s1);
+
+		// Rewrite every value as the variable expansion pass would
+		for(int i = 0; i < n; i++) {
+			MakeKey(key, sizeof(key), i);
+			sprintf_s(val, sizeof(val), "VALUE-%d", i);
+			dictionary_set(d, key, val);
+		}
+		dictionary_getstats(&s2);
+		if(s2.inplace - s1.inplace != n)
+			errors++;
+
+		printf("%8d %14.1f %14.1f %14d %14d\n", n, (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n,
+			s1.allocs - s0.allocs, s2.allocs - s1.allocs);
+
+		// Unset every other key and check the survivors are still reachable
+		for(int i = 0; i < n; i += 2) {
+			MakeKey(key, sizeof(key), i);
+			dictionary_unset(d, key);
+		}
+		for(int i = 0; i < n; i++) {
+			MakeKey(key, sizeof(key), i);
+			char* v = dictionary_get(d, key, NULL);
+			if((i % 2 == 0) != (v == NULL))
+				errors++;
+		}
+		if(d->n != n / 2)
+			errors++;
+
+		dictionary_del(d);
+	}
+
+	// Walk every section through the section table; each key should be
+	// visited once whatever the number of sections
+	const int nkeys = 50000, nsec = 1000;
+	dictionary* d = dictionary_new(0);
+	for(int i = 0; i < nkeys; i++) {
+		sprintf_s(key, sizeof(key), "Section%d:key.%d", i % nsec, i);
+		dictionary_set(d, key, key);
+	}
+	double t0 = Now();
+	int visited = 0;
+	dictionary_iter it;
+	for(int s = 0; s < iniparser_getnsec(d); s++) {
+		for(int ok = iniparser_secfirst(d, iniparser_getsecname(d, s), &it); ok; ok = iniparser_secnext(d, &it))
+			visited++;
+	}
+	double t1 = Now();
+	if(visited != nkeys || iniparser_getnsec(d) != nsec)
+		errors++;
+	printf("\n%d sections walked in %.1f ns/key\n", nsec, (t1 - t0) * 1e9 / nkeys);
+	dictionary_del(d);
+
+	// Merge a layer with half its keys already present in the base
+	dictionary* base = dictionary_new(0);
+	dictionary* layer = dictionary_new(0);
+	dictionary_setorigin(base, DICT_ORIGIN_EMBEDDED);
+	dictionary_setorigin(layer, DICT_ORIGIN_FILE);
+	for(int i = 0; i < nkeys; i++) {
+		MakeKey(key, sizeof(key), i);
+		dictionary_set(base, key, (char*) "base");
+		MakeKey(key, sizeof(key), i + nkeys / 2);
+		dictionary_set(layer, key, (char*) "layer");
+	}
+
+	dictionary* a = dictionary_new(0);
+	dictionary_merge(a, base, DICT_MERGE_OVERRIDE);
+	t0 = Now();
+	for(int i = 0; i < layer->n; i++)
+		dictionary_set(a, layer->key[i], layer->val[i]);
+	t1 = Now();
+
+	dictionary* b = dictionary_new(0);
+	dictionary_merge(b, base, DICT_MERGE_OVERRIDE);
+	double t2 = Now();
+	int taken = dictionary_merge(b, layer, DICT_MERGE_OVERRIDE);
+	double t3 = Now();
+
+	if(taken != nkeys || a->n != b->n || b->n != nkeys + nkeys / 2)
+		errors++;
+	for(int i = 0; i < b->n; i++) {
+		bool fromLayer = !strcmp(b->val[i], "layer");
+		if(strcmp(dictionary_get(a, b->key[i], NULL), b->val[i]) ||
+			b->origin[i] != (fromLayer ? DICT_ORIGIN_FILE : DICT_ORIGIN_EMBEDDED))
+			errors++;
+	}
+
+	// Keeping existing values only adds the keys the base does not have
+	dictionary* c = dictionary_new(0);
+	dictionary_merge(c, base, DICT_MERGE_OVERRIDE);
+	taken = dictionary_merge(c, layer, DICT_MERGE_KEEP);
+	MakeKey(key, sizeof(key), nkeys / 2);
+	if(taken != nkeys / 2 || c->n != b->n || strcmp(dictionary_get(c, key, NULL), "base") ||
+		dictionary_getorigin(c, key) != DICT_ORIGIN_EMBEDDED)
+		errors++;
+	MakeKey(key, sizeof(key), nkeys);
+	if(dictionary_getorigin(c, key) != DICT_ORIGIN_FILE)
+		errors++;
+
+	printf("%d keys merged in %.1f ns/key, set one by one in %.1f ns/key\n", nkeys,
+		(t3 - t2) * 1e9 / nkeys, (t1 - t0) * 1e9 / nkeys);
+	dictionary_del(a);
+	dictionary_del(b);
+	dictionary_del(c);
+	dictionary_del(base);
+	dictionary_del(layer);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
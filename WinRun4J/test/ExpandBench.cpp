@@ -0,0 +1,168 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Checks the variable expander against a stand-in environment and registry
+// and measures it on a large set of values. Only needs Expand.cpp, so it can
+// also be built elsewhere, eg.
+//
+//     g++ -O2 test/ExpandBench.cpp src/common/Expand.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/common/Expand.h"
+
+#define NUM_VALUES 100000
+
+struct StandIn {
+	const char* const* vars;	// name, value pairs, NULL terminated
+	int calls;
+};
+
+static const char* const envVars[] = {
+	"APP", "MyApp",
+	"HOME", "C:\\Users\\me",
+	"EMPTY", "",
+	"LONG", "0123456789012345678901234567890123456789012345678901234567890123456789"
+		"0123456789012345678901234567890123456789012345678901234567890123456789"
+		"0123456789012345678901234567890123456789012345678901234567890123456789"
+		"0123456789012345678901234567890123456789012345678901234567890123456789",
+	NULL
+};
+
+static const char* const regVars[] = {
+	"HKLM\\Software\\MyApp:dir", "C:\\Program Files\\MyApp",
+	"HKCU\\Software\\MyApp:version", "1.2",
+	"HKCU\\Software\\MyApp:key", "HKLM\\Software\\MyApp:dir",
+	NULL
+};
+
+static int StandInLookup(const char* const* vars, const char* name, char* buf, int size)
+{
+	for(int i = 0; vars[i]; i += 2) {
+		if(!strcmp(vars[i], name)) {
+			int len = (int) strlen(vars[i + 1]);
+			if(len < size)
+				memcpy(buf, vars[i + 1], len + 1);
+			return len;
+		}
+	}
+	return -1;
+}
+
+static StandIn env = { envVars, 0 };
+static StandIn reg = { regVars, 0 };
+
+static int EnvLookup(void* /*ctx*/, const char* name, char* buf, int size)
+{
+	env.calls++;
+	return StandInLookup(env.vars, name, buf, size);
+}
+
+static int RegLookup(void* /*ctx*/, const char* name, char* buf, int size)
+{
+	reg.calls++;
+	return StandInLookup(reg.vars, name, buf, size);
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static int Check(Expander& e, const char* value, const char* expected)
+{
+	const char* result = e.Expand(value);
+	if((result == NULL) != (expected == NULL) || (result && strcmp(result, expected))) {
+		printf("FAIL [%s] -> [%s], expected [%s]\n", value, result ? result : "NULL", expected ? expected : "NULL");
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	ExpandProvider provider = { EnvLookup, RegLookup, NULL };
+	int errors = 0;
+
+	{
+		Expander e(provider);
+		errors += Check(e, "plain value", NULL);
+		errors += Check(e, "%APP%", "MyApp");
+		errors += Check(e, "%HOME%\\%APP%\\%APP%.log", "C:\\Users\\me\\MyApp\\MyApp.log");
+		errors += Check(e, "[%EMPTY%]", "[]");
+		errors += Check(e, "%UNDEFINED%", NULL);
+		errors += Check(e, "%UNDEFINED%-%APP%", "%UNDEFINED%-MyApp");
+		errors += Check(e, "100%", NULL);
+		errors += Check(e, "100%% %APP%", "100%% MyApp");
+		errors += Check(e, "50% of %APP%", NULL); // " of " is taken as a name, as Windows does
+		errors += Check(e, "%LONG%", envVars[7]);
+		errors += Check(e, "$REG{HKLM\\Software\\MyApp:dir}\\lib", "C:\\Program Files\\MyApp\\lib");
+		errors += Check(e, "$REG{HKLM\\Software\\MyApp:dir};$REG{HKCU\\Software\\MyApp:version}",
+			"C:\\Program Files\\MyApp;1.2");
+		errors += Check(e, "$REG{HKLM\\Software\\%APP%:dir}", "C:\\Program Files\\MyApp");
+		errors += Check(e, "$REG{$REG{HKCU\\Software\\MyApp:key}}", "C:\\Program Files\\MyApp");
+		errors += Check(e, "$REG{HKLM\\Software\\Missing:dir}", NULL);
+		errors += Check(e, "$REG{HKLM\\Software\\MyApp:dir", NULL);
+		errors += Check(e, "%HOME%;$REG{HKCU\\Software\\MyApp:version}", "C:\\Users\\me;1.2");
+
+		// Each distinct name is looked up once however often it is used
+		// (LONG takes two calls as it does not fit the first buffer)
+		if(e.GetLookups() != 10 || env.calls != 7 || reg.calls != 4) {
+			printf("FAIL lookups %d, env calls %d, reg calls %d\n", e.GetLookups(), env.calls, reg.calls);
+			errors++;
+		}
+	}
+
+	{
+		ExpandProvider envOnly = { EnvLookup, NULL, NULL };
+		Expander e(envOnly);
+		errors += Check(e, "$REG{HKLM\\Software\\%APP%:dir}", "$REG{HKLM\\Software\\MyApp:dir}");
+	}
+
+	// Mostly plain values with some references, as in a large INI
+	char** values = (char**) malloc(NUM_VALUES * sizeof(char*));
+	for(int i = 0; i < NUM_VALUES; i++) {
+		char buf[256];
+		switch(i % 10) {
+		case 0: sprintf(buf, "%%HOME%%\\lib\\jar-%d.jar", i); break;
+		case 1: sprintf(buf, "$REG{HKLM\\Software\\MyApp:dir}\\lib\\jar-%d.jar", i); break;
+		default: sprintf(buf, "lib\\plain-%d.jar", i); break;
+		}
+		values[i] = (char*) malloc(strlen(buf) + 1);
+		strcpy(values[i], buf);
+	}
+
+	env.calls = reg.calls = 0;
+	Expander e(provider);
+	int expanded = 0;
+	double t0 = Now();
+	for(int i = 0; i < NUM_VALUES; i++) {
+		if(e.Expand(values[i]))
+			expanded++;
+	}
+	double t1 = Now();
+
+	if(expanded != NUM_VALUES / 5 || env.calls != 1 || reg.calls != 1)
+		errors++;
+	printf("%d values, %d expanded in %.1f ns/value, %d lookups, %d cached\n", NUM_VALUES, expanded,
+		(t1 - t0) * 1e9 / NUM_VALUES, e.GetLookups(), e.GetCacheHits());
+
+	for(int i = 0; i < NUM_VALUES; i++)
+		free(values[i]);
+	free(values);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Checks the classpath glob against a synthetic tree of 5000 jars and
+// measures a launch's worth of patterns over it. Only needs Glob.cpp, so it
+// can also be built elsewhere, eg.
+//
+//     g++ -O2 test/GlobBench.cpp src/java/Glob.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/java/Glob.h"
+
+#define NUM_MODULES  50
+#define MODULE_JARS  90
+#define EXT_JARS     9
+#define LIB_JARS     50
+#define NUM_JARS     (LIB_JARS + NUM_MODULES * (MODULE_JARS + EXT_JARS))
+#define NUM_RUNS     100
+
+struct TreeEntry {
+	char name[32];
+	bool dir;
+};
+
+struct TreeDir {
+	char path[64];
+	TreeEntry* entries;
+	int count;
+};
+
+static TreeDir tree[1 + NUM_MODULES * 2];
+static int treeCount;
+static int listCalls;
+
+static int FoldCompare(const char* a, const char* b)
+{
+	for(;; a++, b++) {
+		int ca = *a == '/' ? '\\' : (*a >= 'A' && *a <= 'Z' ? *a + 32 : *a);
+		int cb = *b == '/' ? '\\' : (*b >= 'A' && *b <= 'Z' ? *b + 32 : *b);
+		if(ca != cb || !ca)
+			return ca - cb;
+	}
+}
+
+static TreeDir* AddDir(const char* path, int count)
+{
+	TreeDir* d = &tree[treeCount++];
+	strcpy(d->path, path);
+	d->entries = (TreeEntry*) malloc(count * sizeof(TreeEntry));
+	d->count = 0;
+	return d;
+}
+
+static void AddEntry(TreeDir* d, const char* name, bool dir)
+{
+	strcpy(d->entries[d->count].name, name);
+	d->entries[d->count].dir = dir;
+	d->count++;
+}
+
+// Listed in reverse so the glob has to do the sorting
+static void BuildTree()
+{
+	char path[64], name[32];
+	TreeDir* lib = AddDir("C:\\app\\lib", LIB_JARS + NUM_MODULES + 1);
+	for(int m = NUM_MODULES - 1; m >= 0; m--) {
+		sprintf(name, "mod%02d", m);
+		AddEntry(lib, name, true);
+
+		sprintf(path, "C:\\app\\lib\\mod%02d", m);
+		TreeDir* mod = AddDir(path, MODULE_JARS + 2);
+		AddEntry(mod, "readme.txt", false);
+		AddEntry(mod, "ext", true);
+		for(int i = MODULE_JARS - 1; i >= 0; i--) {
+			sprintf(name, "mod%02d-%03d.jar", m, i);
+			AddEntry(mod, name, false);
+		}
+
+		sprintf(path, "C:\\app\\lib\\mod%02d\\ext", m);
+		TreeDir* ext = AddDir(path, EXT_JARS);
+		for(int i = EXT_JARS - 1; i >= 0; i--) {
+			sprintf(name, "EXT-%02d-%d.JAR", m, i);
+			AddEntry(ext, name, false);
+		}
+	}
+	for(int i = LIB_JARS - 1; i >= 0; i--) {
+		sprintf(name, "core-%03d.jar", i);
+		AddEntry(lib, name, false);
+	}
+	AddEntry(lib, "core.jar.bak", false);
+}
+
+static TreeDir* FindDir(const char* path)
+{
+	for(int i = 0; i < treeCount; i++) {
+		if(!FoldCompare(tree[i].path, path))
+			return &tree[i];
+	}
+	return NULL;
+}
+
+static bool TreeList(void* /*ctx*/, const char* dir, GlobListing& listing)
+{
+	listCalls++;
+	TreeDir* d = FindDir(dir);
+	if(!d)
+		return false;
+	listing.Add(".", true);
+	listing.Add("..", true);
+	for(int i = 0; i < d->count; i++)
+		listing.Add(d->entries[i].name, d->entries[i].dir);
+	return true;
+}
+
+static bool TreeExists(void* /*ctx*/, const char* path)
+{
+	char dir[64];
+	const char* sep = strrchr(path, '\\');
+	if(!sep || sep - path >= (int) sizeof(dir))
+		return false;
+	memcpy(dir, path, sep - path);
+	dir[sep - path] = 0;
+	TreeDir* d = FindDir(dir);
+	for(int i = 0; d && i < d->count; i++) {
+		if(!FoldCompare(d->entries[i].name, sep + 1))
+			return true;
+	}
+	return false;
+}
+
+static const GlobProvider provider = { TreeList, TreeExists, NULL };
+
+// A launch's worth of classpath entries
+static const char* const patterns[] = {
+	"C:\\app\\lib\\*.jar",
+	"C:\\app\\lib\\*\\*.jar",
+	"C:\\app\\lib\\**\\*.jar",
+	"C:\\app\\lib\\mod07\\ext\\ext-07-1.jar",
+	"c:/APP/lib/mod01/*.jar",
+	"C:\\app\\missing\\*.jar",
+	"C:\\app\\lib\\mod0?\\ext",
+	NULL
+};
+static const int expectedAdded[] = { LIB_JARS, NUM_MODULES * MODULE_JARS, NUM_MODULES * EXT_JARS, 0, 0, 0, 10 };
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static int CheckMatch(const char* pattern, const char* name, bool expected)
+{
+	if(Glob::Match(pattern, name) != expected) {
+		printf("FAIL match [%s] [%s], expected %s\n", pattern, name, expected ? "true" : "false");
+		return 1;
+	}
+	return 0;
+}
+
+static int CheckGroups(const char* const* p, int count, const int* expected, int groups)
+{
+	int g[8];
+	int n = Glob::Group(p, count, g);
+	int errors = n != groups;
+	for(int i = 0; i < count; i++)
+		errors += g[i] != expected[i];
+	if(errors) {
+		printf("FAIL %d groups for %s..., expected %d\n", n, p[0], groups);
+		return 1;
+	}
+	return 0;
+}
+
+static int CompareStrings(const void* a, const void* b)
+{
+	return strcmp(*(const char**) a, *(const char**) b);
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+
+	errors += CheckMatch("*.jar", "a.jar", true);
+	errors += CheckMatch("*.jar", "A.JAR", true);
+	errors += CheckMatch("*.jar", "a.jar2", false);
+	errors += CheckMatch("*.jar", "jar", false);
+	errors += CheckMatch("a?c", "abc", true);
+	errors += CheckMatch("a?c", "ac", false);
+	errors += CheckMatch("*", "", true);
+	errors += CheckMatch("a*b*c", "axxbyybc", true);
+	errors += CheckMatch("a*b", "abc", false);
+	errors += CheckMatch("**", "x", true);
+
+	// Patterns that may list the same directory are grouped, however far apart
+	static const int launchGroups[] = { 0, 0, 0, 1, 0, 2, 0 };
+	static const char* const joined[] = { "C:\\a\\x\\*.jar", "C:\\b\\*.jar", "C:\\*\\*.jar", "C:\\c\\d.jar" };
+	static const int joinedGroups[] = { 0, 0, 0, 1 };
+	static const char* const apart[] = { "C:\\a\\*.jar", "C:\\ab\\*.jar", "C:\\ab\\c\\d.jar", "c:/A/c.jar" };
+	static const int apartGroups[] = { 0, 1, 2, 0 };
+	errors += CheckGroups(patterns, 7, launchGroups, 3);
+	errors += CheckGroups(joined, 4, joinedGroups, 2);
+	errors += CheckGroups(apart, 4, apartGroups, 3);
+
+	BuildTree();
+
+	{
+		Glob g(provider);
+		int start = 0;
+		for(int i = 0; patterns[i]; i++) {
+			int added = g.Expand(patterns[i]);
+			if(added != expectedAdded[i]) {
+				printf("FAIL %s added %d, expected %d\n", patterns[i], added, expectedAdded[i]);
+				errors++;
+			}
+
+			// Each pattern's matches are in order
+			for(int j = start + 1; j < start + added; j++) {
+				if(FoldCompare(g.Get(j - 1), g.Get(j)) >= 0) {
+					printf("FAIL %s not sorted at %s\n", patterns[i], g.Get(j));
+					errors++;
+					break;
+				}
+			}
+			start += added;
+		}
+
+		if(g.GetCount() != NUM_JARS + 10 || strcmp(g.Get(0), "C:\\app\\lib\\core-000.jar") ||
+			strcmp(g.Get(LIB_JARS), "C:\\app\\lib\\mod00\\mod00-000.jar") ||
+			strcmp(g.Get(g.GetCount() - 1), "C:\\app\\lib\\mod09\\ext")) {
+			printf("FAIL %d paths, first %s\n", g.GetCount(), g.GetCount() ? g.Get(0) : "-");
+			errors++;
+		}
+
+		// No path twice
+		const char** sorted = (const char**) malloc(g.GetCount() * sizeof(char*));
+		for(int i = 0; i < g.GetCount(); i++)
+			sorted[i] = g.Get(i);
+		qsort(sorted, g.GetCount(), sizeof(char*), CompareStrings);
+		for(int i = 1; i < g.GetCount(); i++) {
+			if(!strcmp(sorted[i - 1], sorted[i])) {
+				printf("FAIL duplicate %s\n", sorted[i]);
+				errors++;
+			}
+		}
+		free(sorted);
+
+		// Each directory listed once: lib, the modules and their ext
+		// directories, and the missing one
+		if(g.GetListings() != treeCount + 1 || listCalls != treeCount + 1) {
+			printf("FAIL %d listings, %d list calls, expected %d\n", g.GetListings(), listCalls, treeCount + 1);
+			errors++;
+		}
+		printf("%d patterns, %d paths, %d directories listed, %d cached\n", 7, g.GetCount(),
+			g.GetListings(), g.GetCacheHits());
+	}
+
+	double t0 = Now();
+	int total = 0;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		Glob g(provider);
+		for(int i = 0; patterns[i]; i++)
+			g.Expand(patterns[i]);
+		total += g.GetCount();
+	}
+	double t1 = Now();
+
+	if(total != NUM_RUNS * (NUM_JARS + 10))
+		errors++;
+	printf("%d jars: %.3f ms/launch, %.1f ns/path\n", NUM_JARS, (t1 - t0) * 1e3 / NUM_RUNS,
+		(t1 - t0) * 1e9 / total);
+
+	for(int i = 0; i < treeCount; i++)
+		free(tree[i].entries);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
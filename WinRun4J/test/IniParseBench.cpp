@@ -0,0 +1,212 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Compares INI parse throughput of the single-pass parser against the
+// previous line-by-line loader (reproduced below as LegacyLoad) on a
+// generated INI, from memory and from disk, and checks both produce the
+// same dictionary. Also checks that lines longer than the old 1024 byte
+// limit are kept whole.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/Dictionary.h"
+
+#define LEGACYLINESZ 1024
+#define BENCH_FILE   "IniParseBench.ini"
+
+static double Now()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double) t.QuadPart / (double) freq.QuadPart;
+}
+
+// ------------------------------------------------------------
+// Previous loader: sgets/fgets into a fixed buffer + sscanf_s
+// ------------------------------------------------------------
+
+static void LegacyAddEntry(dictionary* d, char* sec, char* key, char* val)
+{
+	char longkey[2 * LEGACYLINESZ + 1];
+	if(key != NULL)
+		sprintf_s(longkey, sizeof(longkey), "%s:%s", sec, key);
+	else
+		strcpy_s(longkey, sizeof(longkey), sec);
+	dictionary_set(d, longkey, val);
+}
+
+static void LegacyParseLine(char* sec, char* lin, dictionary* d)
+{
+	char key[LEGACYLINESZ + 1];
+	char val[LEGACYLINESZ + 1];
+	char* wher = strskp(lin);
+	if(*wher == ';' || *wher == '#' || *wher == 0)
+		return;
+	if(sscanf_s(wher, "[%[^]]", sec, LEGACYLINESZ + 1) == 1) {
+		LegacyAddEntry(d, sec, NULL, NULL);
+	} else if(sscanf_s(wher, "%[^=] = \"%[^\"]\"", key, (unsigned) sizeof(key), val, (unsigned) sizeof(val)) == 2
+		|| sscanf_s(wher, "%[^=] = '%[^\']'", key, (unsigned) sizeof(key), val, (unsigned) sizeof(val)) == 2
+		|| sscanf_s(wher, "%[^=] = %[^;#]", key, (unsigned) sizeof(key), val, (unsigned) sizeof(val)) == 2) {
+		strcpy_s(key, sizeof(key), strcrop(key));
+		if(!strcmp(val, "\"\"") || !strcmp(val, "''"))
+			val[0] = 0;
+		else
+			strcpy_s(val, sizeof(val), strcrop(val));
+		LegacyAddEntry(d, sec, key, val);
+		if(!strcmp(sec, "WinRun4J"))
+			LegacyAddEntry(d, (char*) "", key, val);
+	}
+}
+
+static dictionary* LegacyLoad(char* ininame, bool isbuffer)
+{
+	char sec[LEGACYLINESZ + 1];
+	char lin[LEGACYLINESZ + 1];
+	FILE* ini = NULL;
+	int pos = 0;
+
+	memset(lin, 0, sizeof(lin));
+	memset(sec, 0, sizeof(sec));
+	if(!isbuffer && fopen_s(&ini, ininame, "r") != 0)
+		return NULL;
+
+	dictionary* d = dictionary_new(0);
+	while((isbuffer ? sgets(ininame, &pos, lin, LEGACYLINESZ) : fgets(lin, LEGACYLINESZ, ini)) != NULL) {
+		LegacyParseLine(sec, lin, d);
+		memset(lin, 0, sizeof(lin));
+	}
+	if(ini)
+		fclose(ini);
+	return d;
+}
+
+// ------------------------------------------------------------
+// Benchmark
+// ------------------------------------------------------------
+
+static char* GenerateIni(int sections, int keysPerSection)
+{
+	size_t size = (size_t) sections * keysPerSection * 96 + 4096;
+	char* buf = (char*) malloc(size);
+	size_t pos = 0;
+
+	pos += sprintf_s(buf + pos, size - pos,
+		"; generated\r\n[WinRun4J]\r\nmain.class=org.example.Main\r\nlog.level = info ; comment\r\n"
+		"working.directory = \"C:\\Program Files\\App\"\r\n\r\n");
+	for(int s = 0; s < sections; s++) {
+		pos += sprintf_s(buf + pos, size - pos, "[Section%d]\r\n", s);
+		for(int k = 0; k < keysPerSection; k++) {
+			switch(k % 4) {
+			case 0: pos += sprintf_s(buf + pos, size - pos, "classpath.%d=lib\\jar-%d-%d.jar\r\n", k, s, k); break;
+			case 1: pos += sprintf_s(buf + pos, size - pos, "  vmarg.%d = -Dprop.%d=%d   # trailing\r\n", k, k, s); break;
+			case 2: pos += sprintf_s(buf + pos, size - pos, "arg.%d = 'quoted ; value %d'\r\n", k, k); break;
+			default: pos += sprintf_s(buf + pos, size - pos, "# comment line %d\r\nkey.%d\t=\tplain value %d\r\n", k, k, k); break;
+			}
+		}
+	}
+	return buf;
+}
+
+static int Compare(dictionary* a, dictionary* b)
+{
+	int errors = a->n == b->n ? 0 : 1;
+	for(int i = 0; i < a->n; i++) {
+		char* va = a->val[i];
+		char* vb = dictionary_get(b, a->key[i], (char*) "<missing>");
+		if((va == NULL) != (vb == NULL) || (va && strcmp(va, vb))) {
+			if(errors++ < 5)
+				printf("mismatch %s: [%s] vs [%s]\n", a->key[i], va ? va : "NULL", vb ? vb : "NULL");
+		}
+	}
+	return errors;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	const int runs = 20;
+	int errors = 0;
+	char* text = GenerateIni(200, 100);
+	size_t len = strlen(text);
+
+	FILE* f = NULL;
+	fopen_s(&f, BENCH_FILE, "wb");
+	fwrite(text, 1, len, f);
+	fclose(f);
+
+	double t[4] = { 0, 0, 0, 0 };
+	for(int r = 0; r < runs; r++) {
+		double t0 = Now();
+		dictionary* legacyBuf = LegacyLoad(text, true);
+		double t1 = Now();
+		dictionary* newBuf = iniparser_load(text, true);
+		double t2 = Now();
+		dictionary* legacyFile = LegacyLoad((char*) BENCH_FILE, false);
+		double t3 = Now();
+		dictionary* newFile = iniparser_load((char*) BENCH_FILE);
+		double t4 = Now();
+
+		t[0] += t1 - t0;
+		t[1] += t2 - t1;
+		t[2] += t3 - t2;
+		t[3] += t4 - t3;
+
+		if(r == 0)
+			errors += Compare(legacyBuf, newBuf) + Compare(newBuf, legacyBuf) + Compare(legacyFile, newFile);
+
+		dictionary_del(legacyBuf);
+		dictionary_del(newBuf);
+		dictionary_del(legacyFile);
+		dictionary_del(newFile);
+	}
+
+	double mb = (double) len * runs / (1024 * 1024);
+	printf("%zu bytes x %d runs\n", len, runs);
+	printf("%-18s %10s\n", "loader", "MB/s");
+	printf("%-18s %10.1f\n", "legacy buffer", mb / t[0]);
+	printf("%-18s %10.1f\n", "single-pass buffer", mb / t[1]);
+	printf("%-18s %10.1f\n", "legacy file", mb / t[2]);
+	printf("%-18s %10.1f\n", "single-pass mapped", mb / t[3]);
+
+	// An empty quoted value is empty (the old loader kept the quotes when
+	// the line ended in a newline)
+	dictionary* d = iniparser_load((char*) "[WinRun4J]\r\nempty=\"\"\r\n", true);
+	char* v = iniparser_getstr(d, ":empty");
+	if(!v || *v)
+		errors++;
+	dictionary_del(d);
+
+	// A value longer than the old line buffer must survive intact
+	size_t longLen = 10000;
+	char* longIni = (char*) malloc(longLen + 32);
+	strcpy_s(longIni, longLen + 32, "[WinRun4J]\nclasspath.1=");
+	size_t off = strlen(longIni);
+	memset(longIni + off, 'x', longLen);
+	longIni[off + longLen] = 0;
+	d = iniparser_load(longIni, true);
+	v = iniparser_getstr(d, ":classpath.1");
+	if(!v || strlen(v) != longLen)
+		errors++;
+	dictionary_del(d);
+	free(longIni);
+
+	remove(BENCH_FILE);
+	free(text);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
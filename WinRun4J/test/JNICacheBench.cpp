@@ -0,0 +1,165 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Creates a VM and fills the launcher's JNICache from it, checks that every
+// class and member was found and is the same as a lookup by name, then times
+// the calls made for each argument, stack trace and launch server request,
+// looking the classes and members up each time (as they used to be) and
+// with the cache. Needs a JDK to build and run against, eg.
+//
+//     g++ -O2 test/JNICacheBench.cpp src/java/JNICache.cpp -I$JAVA_HOME/include
+//         -I$JAVA_HOME/include/linux -L$JAVA_HOME/lib/server -ljvm
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <jni.h>
+
+#include "../src/java/JNICache.h"
+
+#define NUM_CALLS 100000
+
+static int g_missing = 0;
+
+static void Missing(const char* kind, const char* name)
+{
+#ifndef _WIN32
+	// Only the Windows FileDescriptor has a handle
+	if(strcmp(name, "handle") == 0)
+		return;
+#endif
+	printf("FAIL could not find %s %s\n", kind, name);
+	g_missing++;
+}
+
+// The lookups a run argument, a context class loader, the launch server's
+// standard streams and a stack trace each made before they were cached
+static int LookUp(JNIEnv* env, const JNICache& c)
+{
+	int same = 0;
+	jclass s = env->FindClass("java/lang/String");
+	same += env->GetMethodID(s, "<init>", "([B)V") == c.stringInitBytes;
+	env->DeleteLocalRef(s);
+
+	jclass t = env->FindClass("java/lang/Thread");
+	same += env->GetStaticMethodID(t, "currentThread", "()Ljava/lang/Thread;") == c.threadCurrentThread;
+	same += env->GetMethodID(t, "getContextClassLoader", "()Ljava/lang/ClassLoader;") == c.threadGetContextClassLoader;
+	env->DeleteLocalRef(t);
+
+	jclass y = env->FindClass("java/lang/System");
+	same += env->GetStaticFieldID(y, "out", "Ljava/io/PrintStream;") == c.systemOut;
+	same += env->GetStaticFieldID(y, "err", "Ljava/io/PrintStream;") == c.systemErr;
+	env->DeleteLocalRef(y);
+
+	jclass e = env->FindClass("java/lang/Throwable");
+	same += env->GetMethodID(e, "printStackTrace", "()V") == c.throwablePrintStackTrace;
+	env->DeleteLocalRef(e);
+	return same;
+}
+
+// The same calls made with what they found, as JNI::CreateRunArgs does
+static jstring NewArg(JNIEnv* env, jclass stringClass, jmethodID init, const char* str)
+{
+	jsize len = (jsize) strlen(str);
+	jbyteArray bytes = env->NewByteArray(len);
+	if(!bytes)
+		return NULL;
+	env->SetByteArrayRegion(bytes, 0, len, (const jbyte*) str);
+	jstring res = (jstring) env->NewObject(stringClass, init, bytes);
+	env->DeleteLocalRef(bytes);
+	return res;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	JavaVMInitArgs args;
+	memset(&args, 0, sizeof(args));
+	args.version = JNI_VERSION_1_2;
+	JavaVM* jvm = NULL;
+	JNIEnv* env = NULL;
+	if(JNI_CreateJavaVM(&jvm, (void**) &env, &args) != JNI_OK || !env) {
+		printf("FAIL could not create a VM\n");
+		return 1;
+	}
+
+	int errors = 0;
+	JNICache c;
+	memset(&c, 0, sizeof(c));
+	c.Init(env, &Missing);
+	errors += g_missing;
+	if(!c.stringClass || !c.threadClass || !c.systemClass || !c.throwableClass) {
+		printf("FAIL could not look up the JDK classes\n");
+		return 1;
+	}
+	if(LookUp(env, c) != 6) {
+		printf("FAIL members looked up again are not the same as the cached ones\n");
+		errors++;
+	}
+
+	double t0 = Now();
+	for(int i = 0; i < NUM_CALLS; i++)
+		LookUp(env, c);
+	double t1 = Now();
+	printf("look up 4 classes and 6 members: %.0f ns each time\n", (t1 - t0) * 1e9 / NUM_CALLS);
+
+	// Each argument looked up String and its constructor
+	t0 = Now();
+	for(int i = 0; i < NUM_CALLS; i++) {
+		jclass s = env->FindClass("java/lang/String");
+		jmethodID init = env->GetMethodID(s, "<init>", "([B)V");
+		jstring arg = NewArg(env, s, init, "-Dapp.arg=value");
+		env->DeleteLocalRef(arg);
+		env->DeleteLocalRef(s);
+	}
+	t1 = Now();
+	printf("new argument, looked up: %.0f ns\n", (t1 - t0) * 1e9 / NUM_CALLS);
+
+	t0 = Now();
+	for(int i = 0; i < NUM_CALLS; i++) {
+		jstring arg = NewArg(env, c.stringClass, c.stringInitBytes, "-Dapp.arg=value");
+		env->DeleteLocalRef(arg);
+	}
+	t1 = Now();
+	printf("new argument, cached: %.0f ns\n", (t1 - t0) * 1e9 / NUM_CALLS);
+
+	// A launch server request reads the standard streams before running
+	t0 = Now();
+	for(int i = 0; i < NUM_CALLS; i++) {
+		jobject out = env->GetStaticObjectField(c.systemClass, c.systemOut);
+		jobject err = env->GetStaticObjectField(c.systemClass, c.systemErr);
+		jobject thread = env->CallStaticObjectMethod(c.threadClass, c.threadCurrentThread);
+		jobject loader = thread ? env->CallObjectMethod(thread, c.threadGetContextClassLoader) : NULL;
+		if(!out || !err || !thread)
+			errors++;
+		env->DeleteLocalRef(out);
+		env->DeleteLocalRef(err);
+		env->DeleteLocalRef(thread);
+		if(loader)
+			env->DeleteLocalRef(loader);
+	}
+	t1 = Now();
+	printf("streams and context class loader, cached: %.0f ns\n", (t1 - t0) * 1e9 / NUM_CALLS);
+
+	if(env->ExceptionCheck()) {
+		env->ExceptionDescribe();
+		errors++;
+	}
+	jvm->DestroyJavaVM();
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,368 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Sends launches through the launch server protocol in memory, checks what
+// arrives (and that bad or cut off streams are refused), then times whole
+// launches against a server thread over a Unix domain socket where there is
+// one. Only needs LaunchProtocol.cpp, eg.
+//
+//     g++ -O2 test/LaunchProtocolBench.cpp src/launcher/LaunchProtocol.cpp -lpthread
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/launcher/LaunchProtocol.h"
+
+#define NUM_RUNS    100000
+#define NUM_LAUNCHES 2000
+
+// A stream over a block of memory; reads come a few bytes at a time to
+// exercise partial reads
+struct Memory {
+	char* data;
+	int size;
+	int capacity;
+	int pos;
+	int limit;
+};
+
+static int MemoryRead(void* ctx, void* buf, int len)
+{
+	Memory* m = (Memory*) ctx;
+	int end = m->limit < m->size ? m->limit : m->size;
+	int n = end - m->pos;
+	if(n > len)
+		n = len;
+	if(n > 7)
+		n = 7;
+	memcpy(buf, m->data + m->pos, n);
+	m->pos += n;
+	return n;
+}
+
+static bool MemoryWrite(void* ctx, const void* buf, int len)
+{
+	Memory* m = (Memory*) ctx;
+	if(m->size + len > m->capacity) {
+		int n = m->capacity ? m->capacity : 256;
+		while(n < m->size + len)
+			n *= 2;
+		char* p = (char*) realloc(m->data, n);
+		if(!p)
+			return false;
+		m->data = p;
+		m->capacity = n;
+	}
+	memcpy(m->data + m->size, buf, len);
+	m->size += len;
+	return true;
+}
+
+static void Reset(Memory& m)
+{
+	m.size = m.pos = 0;
+	m.limit = 0x7FFFFFFF;
+}
+
+static char* args[] = { (char*) "--verbose", (char*) "", (char*) "file with spaces.txt" };
+static char* env[] = { (char*) "PATH=C:\\Windows;C:\\Windows\\System32", (char*) "JAVA_OPTS=", (char*) "LANG=en_US.UTF-8" };
+static char cwd[] = "C:\\Users\\someone\\work";
+
+static bool SameRequest(const LaunchRequest& a, const LaunchRequest& b)
+{
+	if(a.argCount != b.argCount || a.envCount != b.envCount || !a.cwd != !b.cwd || (a.cwd && strcmp(a.cwd, b.cwd)))
+		return false;
+	for(int i = 0; i < a.argCount; i++) {
+		if(strcmp(a.args[i], b.args[i]))
+			return false;
+	}
+	for(int i = 0; i < a.envCount; i++) {
+		if(strcmp(a.env[i], b.env[i]))
+			return false;
+	}
+	return true;
+}
+
+struct Collected {
+	char out[256];
+	char err[256];
+};
+
+static bool Collect(void* ctx, char type, const void* data, unsigned len)
+{
+	Collected* c = (Collected*) ctx;
+	char* dest = type == LAUNCH_STDOUT ? c->out : c->err;
+	size_t used = strlen(dest);
+	if(used + len >= sizeof(c->out))
+		return false;
+	memcpy(dest + used, data, len);
+	dest[used + len] = 0;
+	return true;
+}
+
+static int CheckMemory()
+{
+	int errors = 0;
+	Memory m;
+	memset(&m, 0, sizeof(m));
+	Reset(m);
+	LaunchStream stream = { MemoryRead, MemoryWrite, &m };
+	LaunchConnection writer(stream), reader(stream);
+
+	LaunchRequest sent = { args, 3, cwd, env, 3 }, received;
+	if(!writer.SendRequest(sent) || !reader.ReceiveRequest(received) || !SameRequest(sent, received)) {
+		printf("FAIL request did not come through\n");
+		errors++;
+	}
+	LaunchConnection::FreeRequest(received);
+
+	// No directory and nothing else
+	Reset(m);
+	LaunchRequest bare = { NULL, 0, NULL, NULL, 0 };
+	if(!writer.SendRequest(bare) || !reader.ReceiveRequest(received) || !SameRequest(bare, received)) {
+		printf("FAIL empty request did not come through\n");
+		errors++;
+	}
+	LaunchConnection::FreeRequest(received);
+
+	// Cut off anywhere before RUN is not a request
+	Reset(m);
+	writer.SendRequest(sent);
+	int whole = m.size;
+	for(int cut = 0; cut < whole; cut++) {
+		m.pos = 0;
+		m.limit = cut;
+		if(reader.ReceiveRequest(received)) {
+			printf("FAIL request cut at %d of %d was read\n", cut, whole);
+			errors++;
+			LaunchConnection::FreeRequest(received);
+			break;
+		}
+	}
+
+	// Another version, or something that is not a launcher
+	Reset(m);
+	writer.SendString(LAUNCH_HELLO, "99");
+	writer.Send(LAUNCH_RUN, NULL, 0);
+	if(reader.ReceiveRequest(received)) {
+		printf("FAIL read a request from version 99\n");
+		errors++;
+	}
+	Reset(m);
+	MemoryWrite(&m, "GET / HTTP/1.1\r\n\r\n", 18);
+	if(reader.ReceiveRequest(received)) {
+		printf("FAIL read a request from HTTP\n");
+		errors++;
+	}
+	Reset(m);
+	unsigned char huge[5] = { 0xFF, 0xFF, 0xFF, 0x7F, LAUNCH_STDOUT };
+	MemoryWrite(&m, huge, sizeof(huge));
+	char type;
+	const char* data;
+	unsigned len;
+	if(reader.Receive(type, data, len) || writer.Send(LAUNCH_STDOUT, huge, LAUNCH_MAX_CHUNK + 1)) {
+		printf("FAIL chunk over the limit went through\n");
+		errors++;
+	}
+
+	// Output in order, stdin ignored, then the exit code
+	Reset(m);
+	writer.SendString(LAUNCH_STDOUT, "hello ");
+	writer.SendString(LAUNCH_STDERR, "oops");
+	writer.SendString(LAUNCH_STDIN, "ignored");
+	writer.SendString(LAUNCH_STDOUT, "world");
+	writer.SendExit(-42);
+	Collected c;
+	memset(&c, 0, sizeof(c));
+	int code = 0;
+	bool exited = reader.ReceiveOutput(Collect, &c, code);
+	if(!exited || code != -42 || strcmp(c.out, "hello world") || strcmp(c.err, "oops")) {
+		printf("FAIL output came to %d, \"%s\", \"%s\"\n", code, c.out, c.err);
+		errors++;
+	}
+
+	// System.exit(-1) is an exit code like any other
+	Reset(m);
+	writer.SendExit(-1);
+	code = 0;
+	if(!reader.ReceiveOutput(Collect, &c, code) || code != -1) {
+		printf("FAIL exit -1 came to %d\n", code);
+		errors++;
+	}
+
+	// A server that goes away
+	Reset(m);
+	writer.SendString(LAUNCH_STDOUT, "partial");
+	memset(&c, 0, sizeof(c));
+	if(reader.ReceiveOutput(Collect, &c, code)) {
+		printf("FAIL lost server not noticed\n");
+		errors++;
+	}
+
+	free(m.data);
+	return errors;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void TimeMemory()
+{
+	Memory m;
+	memset(&m, 0, sizeof(m));
+	LaunchStream stream = { MemoryRead, MemoryWrite, &m };
+	LaunchConnection writer(stream), reader(stream);
+	LaunchRequest sent = { args, 3, cwd, env, 3 }, received;
+
+	int ok = 0;
+	double t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		Reset(m);
+		writer.SendRequest(sent);
+		if(reader.ReceiveRequest(received))
+			ok++;
+		LaunchConnection::FreeRequest(received);
+	}
+	double t1 = Now();
+	printf("request in memory: %.1f ns (%d bytes, %d read)\n", (t1 - t0) * 1e9 / NUM_RUNS, m.size, ok);
+	free(m.data);
+}
+
+#ifdef __linux__
+
+static int SocketRead(void* ctx, void* buf, int len)
+{
+	return (int) read((int) (long) ctx, buf, len);
+}
+
+static bool SocketWrite(void* ctx, const void* buf, int len)
+{
+	const char* p = (const char*) buf;
+	while(len > 0) {
+		ssize_t n = write((int) (long) ctx, p, len);
+		if(n <= 0)
+			return false;
+		p += n;
+		len -= (int) n;
+	}
+	return true;
+}
+
+// A server as LaunchServer::Run has it: one launch at a time, echoing the
+// args to stdout and stdin to stderr, with the arg count as the exit code
+static void* Serve(void* param)
+{
+	int listener = (int) (long) param;
+	for(;;) {
+		int s = accept(listener, NULL, NULL);
+		if(s < 0)
+			return NULL;
+		LaunchStream stream = { SocketRead, SocketWrite, (void*) (long) s };
+		LaunchConnection conn(stream);
+		LaunchRequest request;
+		if(conn.ReceiveRequest(request)) {
+			for(int i = 0; i < request.argCount; i++)
+				conn.SendString(LAUNCH_STDOUT, request.args[i]);
+			char type;
+			const char* data;
+			unsigned len;
+			while(conn.Receive(type, data, len) && type == LAUNCH_STDIN)
+				conn.Send(LAUNCH_STDERR, data, len);
+			conn.SendExit(request.argCount);
+			LaunchConnection::FreeRequest(request);
+		}
+		close(s);
+	}
+}
+
+static int CheckSocket()
+{
+	int errors = 0;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/LaunchProtocolBench.%d.sock", (int) getpid());
+	unlink(addr.sun_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0 || bind(listener, (sockaddr*) &addr, sizeof(addr)) || listen(listener, 16)) {
+		printf("no Unix domain sockets, skipping launches\n");
+		if(listener >= 0)
+			close(listener);
+		return 0;
+	}
+	pthread_t server;
+	pthread_create(&server, NULL, Serve, (void*) (long) listener);
+
+	LaunchRequest request = { args, 3, cwd, env, 3 };
+	int launched = 0;
+	timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(int r = 0; r < NUM_LAUNCHES; r++) {
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(connect(s, (sockaddr*) &addr, sizeof(addr))) {
+			printf("FAIL connect: launch %d\n", r);
+			errors++;
+			close(s);
+			break;
+		}
+		LaunchStream stream = { SocketRead, SocketWrite, (void*) (long) s };
+		LaunchConnection conn(stream);
+		Collected c;
+		memset(&c, 0, sizeof(c));
+		bool sent = conn.SendRequest(request) && conn.SendString(LAUNCH_STDIN, "typed") &&
+			conn.Send(LAUNCH_STDIN_EOF, NULL, 0);
+		int code = 0;
+		bool exited = sent && conn.ReceiveOutput(Collect, &c, code);
+		if(!exited || code != 3 || strcmp(c.out, "--verbosefile with spaces.txt") || strcmp(c.err, "typed")) {
+			if(!errors)
+				printf("FAIL launch %d came to %d, \"%s\", \"%s\"\n", r, code, c.out, c.err);
+			errors++;
+		} else {
+			launched++;
+		}
+		close(s);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	printf("launch over a Unix domain socket: %.1f us (%d launched)\n", elapsed * 1e6 / NUM_LAUNCHES, launched);
+
+	shutdown(listener, SHUT_RDWR);
+	close(listener);
+	pthread_join(server, NULL);
+	unlink(addr.sun_path);
+	return errors;
+}
+
+#endif
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = CheckMemory();
+	TimeMemory();
+#ifdef __linux__
+	errors += CheckSocket();
+#endif
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
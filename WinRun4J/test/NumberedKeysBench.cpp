@@ -0,0 +1,149 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Reads numbered key lists (classpath.N, vmarg.N, arg.N, java.library.path.N)
+// from an INI holding 10k numbered entries, comparing the previous approach
+// (scan for the max then probe every number, growing the array per hit,
+// reproduced below as LegacyGetNumbered) against iniparser_getnumbered.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/Dictionary.h"
+
+#define NUM_ENTRIES 10000
+
+static const char* bases[] = { ":classpath", ":vmarg", ":arg", ":java.library.path" };
+
+static double Now()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double) t.QuadPart / (double) freq.QuadPart;
+}
+
+static int LegacyFindMax(dictionary* d, const char* keyName)
+{
+	int maxIndex = 0;
+	size_t baseLen = strlen(keyName);
+	for(int i = 0; i < d->n; i++) {
+		const char* key = d->key[i];
+		if(strncmp(key, keyName, baseLen) != 0 || key[baseLen] != '.')
+			continue;
+		const char* numStr = key + baseLen + 1;
+		char* end = NULL;
+		long idx = strtol(numStr, &end, 10);
+		if(end == numStr || *end != '\0')
+			continue;
+		if(idx > maxIndex)
+			maxIndex = (int) idx;
+	}
+	return maxIndex;
+}
+
+static char** LegacyGetNumbered(dictionary* d, const char* keyName, int* count)
+{
+	char entryName[MAX_PATH];
+	char** entries = NULL;
+	int max = LegacyFindMax(d, keyName);
+	*count = 0;
+	for(int i = 1; i <= max; i++) {
+		sprintf_s(entryName, sizeof(entryName), "%s.%d", keyName, i);
+		char* entry = iniparser_getstr(d, entryName);
+		if(entry == NULL)
+			continue;
+		entries = (char**) realloc(entries, sizeof(char*) * (*count + 1));
+		entries[(*count)++] = entry;
+	}
+	return entries;
+}
+
+static char** GetNumbered(dictionary* d, const char* keyName, int* count)
+{
+	*count = iniparser_getnumbered(d, keyName, 1, NULL, 0);
+	char** entries = (char**) malloc(sizeof(char*) * (*count + 1));
+	*count = iniparser_getnumbered(d, keyName, 1, entries, *count);
+	return entries;
+}
+
+// Numbered keys spread over the four bases, written out of order and with
+// gaps, alongside some ordinary keys
+static char* GenerateIni()
+{
+	size_t size = NUM_ENTRIES * 64 + 4096;
+	char* buf = (char*) malloc(size);
+	size_t pos = 0;
+
+	pos += sprintf_s(buf + pos, size - pos, "main.class=org.example.Main\nlog.level=info\n");
+	for(int i = 0; i < NUM_ENTRIES; i++) {
+		int n = (i * 7919) % NUM_ENTRIES;
+		const char* base = bases[n % 4];
+		int number = n / 4 + 1;
+		if(number % 50 == 0)
+			continue;
+		pos += sprintf_s(buf + pos, size - pos, "%s.%d=value %d\n", base + 1, number, n);
+		if(i % 100 == 0)
+			pos += sprintf_s(buf + pos, size - pos, "key.%d.name=plain\n", i);
+	}
+	return buf;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	const int runs = 50;
+	int errors = 0;
+	char* text = GenerateIni();
+	dictionary* d = iniparser_load(text, true);
+
+	printf("%-20s %8s %14s %14s\n", "base", "values", "legacy us", "indexed us");
+	for(int b = 0; b < 4; b++) {
+		int legacyCount = 0, count = 0;
+		char** legacy = NULL;
+		char** entries = NULL;
+
+		double t0 = Now();
+		for(int r = 0; r < runs; r++) {
+			free(legacy);
+			legacy = LegacyGetNumbered(d, bases[b], &legacyCount);
+		}
+		double t1 = Now();
+		for(int r = 0; r < runs; r++) {
+			free(entries);
+			entries = GetNumbered(d, bases[b], &count);
+		}
+		double t2 = Now();
+
+		if(count != legacyCount)
+			errors++;
+		for(int i = 0; i < count && i < legacyCount; i++) {
+			if(strcmp(entries[i], legacy[i]))
+				errors++;
+		}
+		if(dictionary_find_max(d, bases[b]) != LegacyFindMax(d, bases[b]))
+			errors++;
+
+		printf("%-20s %8d %14.1f %14.1f\n", bases[b], count, (t1 - t0) * 1e6 / runs, (t2 - t1) * 1e6 / runs);
+		free(legacy);
+		free(entries);
+	}
+
+	dictionary_del(d);
+	free(text);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Times the phases of a made up launch, checks the JSON line and CSV rows
+// they come out as, then times recording a phase and formatting a launch.
+// Only needs PhaseTimes.cpp and StringBuilder.cpp, eg.
+//
+//     g++ -O2 test/PhaseTimesBench.cpp src/common/PhaseTimes.cpp src/common/StringBuilder.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/common/PhaseTimes.h"
+
+#define NUM_RUNS 1000000
+
+static const PhaseLaunch launch = { 4242, "2024-05-01T10:00:00.000Z", "C:\\Program Files\\My \"App\"\\app.exe" };
+
+static void BuildLaunch(PhaseTimes& times)
+{
+	times.Add("process", -12.5, 12.5);
+	times.Begin("ini", 0.25);
+	times.Begin("expand", 1);
+	times.End("expand", 1.5);
+	times.Begin("expand", 2);
+	times.End("expand", 2.25);
+	times.End("ini", 3);
+	times.Begin("vm.find", 3);
+	times.Begin("classpath", 3.125);
+	times.End("classpath", 7);
+	times.End("vm.find", 5);
+	times.Begin("vm.create", 8);
+	times.End("vm.create", 58);
+}
+
+static int Check(const char* what, const StringBuilder& out, const char* expected)
+{
+	if(strcmp(out.Get(), expected) == 0)
+		return 0;
+	printf("FAIL %s:\n  got      %s\n  expected %s\n", what, out.Get(), expected);
+	return 1;
+}
+
+static int CheckTimes()
+{
+	int errors = 0;
+	PhaseTimes times;
+	BuildLaunch(times);
+
+	const PhaseTime* expand = times.Find("expand");
+	if(!expand || expand->start != 1 || expand->duration != 0.75 || expand->runs != 2) {
+		printf("FAIL expand did not add up\n");
+		errors++;
+	}
+
+	// Begin while running and End while not are ignored
+	times.Begin("vm.create", 100);
+	times.End("vm.create", 110);
+	times.End("vm.create", 120);
+	times.End("nothing", 120);
+	const PhaseTime* create = times.Find("vm.create");
+	if(!create || create->start != 8 || create->duration != 60 || times.Find("nothing")) {
+		printf("FAIL vm.create came to %.3f from %.3f\n", create ? create->duration : -1, create ? create->start : -1);
+		errors++;
+	}
+
+	// Only the first callback counts
+	times.Mark("dde", 200);
+	times.Mark("dde", 300);
+	times.Begin("main.lookup", 150);
+	const PhaseTime* dde = times.Find("dde");
+	if(!dde || dde->start != 200 || dde->duration != 0) {
+		printf("FAIL dde mark moved\n");
+		errors++;
+	}
+
+	StringBuilder json;
+	times.Format(json, PHASE_TIMES_JSON, launch, false, false);
+	errors += Check("json", json,
+		"{\"pid\":4242,\"started\":\"2024-05-01T10:00:00.000Z\","
+		"\"module\":\"C:\\\\Program Files\\\\My \\\"App\\\"\\\\app.exe\",\"phases\":{"
+		"\"process\":{\"start\":-12.500,\"ms\":12.500},"
+		"\"ini\":{\"start\":0.250,\"ms\":2.750},"
+		"\"expand\":{\"start\":1.000,\"ms\":0.750},"
+		"\"vm.find\":{\"start\":3.000,\"ms\":2.000},"
+		"\"classpath\":{\"start\":3.125,\"ms\":3.875},"
+		"\"vm.create\":{\"start\":8.000,\"ms\":60.000},"
+		"\"dde\":{\"start\":200.000,\"ms\":0.000}}}\r\n");
+
+	// A flush writes what has finished; a phase still running then, or run
+	// again since, is written by the next one
+	StringBuilder first;
+	times.Format(first, PHASE_TIMES_CSV, launch, true, false);
+	times.SetWritten();
+	times.End("main.lookup", 160);
+	times.Begin("expand", 170);
+	times.End("expand", 171);
+	if(times.GetUnwritten() != 2) {
+		printf("FAIL %d phases left to write\n", times.GetUnwritten());
+		errors++;
+	}
+	StringBuilder csv;
+	times.Format(csv, PHASE_TIMES_CSV, launch, true, true);
+	times.SetWritten();
+	errors += Check("csv", csv,
+		"pid,started,module,phase,start,ms\r\n"
+		"4242,2024-05-01T10:00:00.000Z,\"C:\\Program Files\\My \"\"App\"\"\\app.exe\",expand,1.000,1.750\r\n"
+		"4242,2024-05-01T10:00:00.000Z,\"C:\\Program Files\\My \"\"App\"\"\\app.exe\",main.lookup,150.000,10.000\r\n");
+	if(strstr(first.Get(), "main.lookup") || times.GetUnwritten() != 0) {
+		printf("FAIL running phase written, or %d phases left\n", times.GetUnwritten());
+		errors++;
+	}
+
+	// Control characters in a module name stay on one line
+	PhaseTimes empty;
+	PhaseLaunch odd = { 1, NULL, "a\nb" };
+	StringBuilder line;
+	empty.Format(line, PHASE_TIMES_JSON, odd, false, false);
+	errors += Check("escapes", line, "{\"pid\":1,\"started\":\"\",\"module\":\"a\\u000ab\",\"phases\":{}}\r\n");
+
+	// Phases past the limit are dropped, not written over
+	PhaseTimes full;
+	static char names[PHASE_TIMES_MAX + 8][8];
+	for(int i = 0; i < PHASE_TIMES_MAX + 8; i++) {
+		sprintf(names[i], "p%d", i);
+		full.Mark(names[i], i);
+	}
+	if(full.GetCount() != PHASE_TIMES_MAX || full.Find(names[PHASE_TIMES_MAX]) || !full.Find("p0")) {
+		printf("FAIL %d phases kept of %d\n", full.GetCount(), PHASE_TIMES_MAX + 8);
+		errors++;
+	}
+	return errors;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = CheckTimes();
+
+	static const char* phases[] = { "ini", "expand", "vm.find", "vm.load", "classpath", "vm.args",
+		"vm.create", "jni.init", "main.lookup" };
+	const int count = sizeof(phases) / sizeof(phases[0]);
+
+	PhaseTimes times;
+	double t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		times.Begin(phases[r % count], r);
+		times.End(phases[r % count], r + 0.5);
+	}
+	double t1 = Now();
+	printf("begin and end of one of %d phases: %.1f ns\n", count, (t1 - t0) * 1e9 / NUM_RUNS);
+
+	size_t bytes = 0;
+	t0 = Now();
+	for(int r = 0; r < NUM_RUNS / 10; r++) {
+		StringBuilder out;
+		times.Format(out, PHASE_TIMES_JSON, launch, false, false);
+		bytes += out.Length();
+	}
+	t1 = Now();
+	printf("json line for %d phases: %.1f ns (%d bytes)\n", count, (t1 - t0) * 1e9 / (NUM_RUNS / 10),
+		(int) (bytes / (NUM_RUNS / 10)));
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
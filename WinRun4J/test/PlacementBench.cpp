@@ -0,0 +1,269 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Resolves affinity, group and NUMA node settings against a two socket, 128
+// core machine (two groups of 64, four nodes of 32), checks bad settings are
+// refused, then applies placements for real through sched_setaffinity where
+// there is one, standing in for the Windows calls. Only needs Placement.cpp, eg.
+//
+//     g++ -O2 test/PlacementBench.cpp src/launcher/Placement.cpp
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/launcher/Placement.h"
+
+#define NUM_RUNS 1000000
+
+static PlacementTopology machine;
+static unsigned setGroup;
+static unsigned long long setMask;
+
+static void BuildMachine()
+{
+	memset(&machine, 0, sizeof(machine));
+	machine.groupCount = 2;
+	machine.groupCpus[0] = 64;
+	machine.groupCpus[1] = 64;
+	machine.nodeCount = 4;
+	for(unsigned n = 0; n < 4; n++) {
+		machine.nodes[n].group = n / 2;
+		machine.nodes[n].mask = n % 2 ? 0xFFFFFFFF00000000ULL : 0x00000000FFFFFFFFULL;
+	}
+	machine.currentGroup = 0;
+}
+
+static bool GetFakeTopology(void* /*ctx*/, PlacementTopology& topology)
+{
+	topology = machine;
+	return true;
+}
+
+static bool SetFakeAffinity(void* /*ctx*/, unsigned group, unsigned long long mask)
+{
+	setGroup = group;
+	setMask = mask;
+	return true;
+}
+
+static int CheckParse()
+{
+	static const struct { const char* str; bool ok; unsigned long long mask; } cases[] = {
+		{ "0xFF00", true, 0xFF00 },
+		{ "0x0f0F", true, 0x0F0F },
+		{ "0xFFFFFFFFFFFFFFFF", true, ~0ULL },
+		{ "0x1FFFFFFFFFFFFFFFF", false, 0 },
+		{ "0x", false, 0 },
+		{ "0x0", false, 0 },
+		{ "0xG1", false, 0 },
+		{ "8-15", true, 0xFF00 },
+		{ "0,2,4-6", true, 0x75 },
+		{ " 0 , 63 ", true, 0x8000000000000001ULL },
+		{ "0-63", true, ~0ULL },
+		{ "64", false, 0 },
+		{ "7-3", false, 0 },
+		{ "1,,2", false, 0 },
+		{ "1-", false, 0 },
+		{ "node0", false, 0 },
+		{ "", false, 0 },
+	};
+
+	int errors = 0;
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		unsigned long long mask;
+		bool ok = Placement::ParseMask(cases[i].str, mask);
+		if(ok != cases[i].ok || (ok && mask != cases[i].mask)) {
+			printf("FAIL parse \"%s\": %d 0x%llx\n", cases[i].str, ok, mask);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+static int CheckResolve()
+{
+	static const struct {
+		const char* what;
+		PlacementRequest request;
+		int error;
+		unsigned group;
+		unsigned long long mask;
+		int node;
+	} cases[] = {
+		{ "mask in the current group", { "0-3", -1, -1 }, PLACEMENT_OK, 0, 0xF, -1 },
+		{ "whole second group", { NULL, 1, -1 }, PLACEMENT_OK, 1, ~0ULL, -1 },
+		{ "mask in the second group", { "0x3", 1, -1 }, PLACEMENT_OK, 1, 0x3, -1 },
+		{ "third node", { NULL, -1, 2 }, PLACEMENT_OK, 1, 0xFFFFFFFFULL, 2 },
+		{ "half of the fourth node", { "48-63", -1, 3 }, PLACEMENT_OK, 1, 0xFFFF000000000000ULL, 3 },
+		{ "node with its group", { NULL, 0, 1 }, PLACEMENT_OK, 0, 0xFFFFFFFF00000000ULL, 1 },
+		{ "node in another group", { NULL, 0, 2 }, PLACEMENT_NODE_GROUP, 0, 0, -1 },
+		{ "mask outside the node", { "0-31", -1, 1 }, PLACEMENT_EMPTY, 0, 0, -1 },
+		{ "no such group", { NULL, 2, -1 }, PLACEMENT_BAD_GROUP, 0, 0, -1 },
+		{ "no such node", { NULL, -1, 4 }, PLACEMENT_BAD_NODE, 0, 0, -1 },
+		{ "bad mask", { "0-3x", -1, -1 }, PLACEMENT_BAD_MASK, 0, 0, -1 },
+	};
+
+	int errors = 0;
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		PlacementResult r;
+		int error = Placement::Resolve(cases[i].request, machine, r);
+		if(error != cases[i].error || (!error && (r.group != cases[i].group || r.mask != cases[i].mask ||
+			r.node != cases[i].node || r.cpus != Placement::CountCpus(cases[i].mask)))) {
+			printf("FAIL %s: %s, group %u mask 0x%llx node %d\n", cases[i].what, Placement::GetError(error),
+				r.group, r.mask, r.node);
+			errors++;
+		}
+	}
+
+	// Some machines have fewer processors in a group than bits in a mask
+	PlacementTopology small = machine;
+	small.groupCount = 1;
+	small.groupCpus[0] = 12;
+	small.nodeCount = 0;
+	PlacementRequest all = { NULL, 0, -1 };
+	PlacementResult r;
+	if(Placement::Resolve(all, small, r) || r.mask != 0xFFF || r.cpus != 12) {
+		printf("FAIL group of 12 came to 0x%llx\n", r.mask);
+		errors++;
+	}
+
+	PlacementRequest none = { NULL, -1, -1 };
+	PlacementRequest empty = { "", -1, -1 };
+	if(Placement::IsRequested(none) || Placement::IsRequested(empty)) {
+		printf("FAIL placement requested with no keys set\n");
+		errors++;
+	}
+
+	PlacementProvider fake = { GetFakeTopology, SetFakeAffinity, NULL };
+	PlacementRequest node = { NULL, -1, 3 };
+	if(Placement::Apply(fake, node, r) || setGroup != 1 || setMask != 0xFFFFFFFF00000000ULL) {
+		printf("FAIL applying node 3 set group %u mask 0x%llx\n", setGroup, setMask);
+		errors++;
+	}
+	return errors;
+}
+
+#ifdef __linux__
+
+// The machine as Linux sees it: one group of the online processors and one
+// node, with sched_setaffinity doing what SetProcessAffinityMask would
+static bool GetLinuxTopology(void* /*ctx*/, PlacementTopology& topology)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(n <= 0)
+		return false;
+	topology.groupCount = 1;
+	topology.groupCpus[0] = n > 64 ? 64 : (unsigned) n;
+	topology.nodeCount = 1;
+	topology.nodes[0].group = 0;
+	topology.nodes[0].mask = topology.groupCpus[0] >= 64 ? ~0ULL : (1ULL << topology.groupCpus[0]) - 1;
+	return true;
+}
+
+static bool SetLinuxAffinity(void* /*ctx*/, unsigned group, unsigned long long mask)
+{
+	if(group != 0)
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int i = 0; i < 64; i++) {
+		if(mask & (1ULL << i))
+			CPU_SET(i, &set);
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+static unsigned long long GetLinuxAffinity()
+{
+	cpu_set_t set;
+	unsigned long long mask = 0;
+	if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for(int i = 0; i < 64; i++) {
+			if(CPU_ISSET(i, &set))
+				mask |= 1ULL << i;
+		}
+	}
+	return mask;
+}
+
+static int CheckLinux()
+{
+	int errors = 0;
+	PlacementProvider provider = { GetLinuxTopology, SetLinuxAffinity, NULL };
+	unsigned long long before = GetLinuxAffinity();
+
+	PlacementRequest first = { "0", -1, -1 };
+	PlacementRequest node = { NULL, -1, 0 };
+	PlacementRequest missing = { NULL, -1, 1 };
+	PlacementResult r;
+	int error = Placement::Apply(provider, first, r);
+	if(error || GetLinuxAffinity() != 1) {
+		printf("FAIL pinning to processor 0: %s, affinity 0x%llx\n", Placement::GetError(error), GetLinuxAffinity());
+		errors++;
+	}
+	error = Placement::Apply(provider, node, r);
+	if(error || GetLinuxAffinity() != r.mask) {
+		printf("FAIL pinning to node 0: %s, affinity 0x%llx\n", Placement::GetError(error), GetLinuxAffinity());
+		errors++;
+	}
+	if(Placement::Apply(provider, missing, r) != PLACEMENT_BAD_NODE) {
+		printf("FAIL pinned to a node that is not there\n");
+		errors++;
+	}
+	printf("sched_setaffinity: node 0 is 0x%llx\n", GetLinuxAffinity());
+
+	SetLinuxAffinity(NULL, 0, before);
+	return errors;
+}
+
+#endif
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+	BuildMachine();
+
+	errors += CheckParse();
+	errors += CheckResolve();
+#ifdef __linux__
+	errors += CheckLinux();
+#endif
+
+	PlacementRequest request = { "48-55,60", -1, 3 };
+	double t0 = Now();
+	unsigned cpus = 0;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		PlacementResult result;
+		if(!Placement::Resolve(request, machine, result))
+			cpus += result.cpus;
+	}
+	double t1 = Now();
+	printf("resolve \"%s\" on node %d: %.1f ns (%u processors)\n", request.mask, request.node,
+		(t1 - t0) * 1e9 / NUM_RUNS, cpus / NUM_RUNS);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Checks the files a read ahead picks (a VM's runtime image, classpath
+// entries, each once) and how a budget cuts it short, then reads a made up
+// VM and classpath from disk in 1 MB blocks and in 4 KB ones, as page faults
+// would. On Linux the files are dropped from the cache first, where the file
+// system allows it, so the first read is cold. Only needs ReadAhead.cpp, eg.
+//
+//     g++ -O2 test/ReadAheadBench.cpp src/launcher/ReadAhead.cpp
+//     ./a.out /var/tmp
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/launcher/ReadAhead.h"
+
+#define NUM_FILES 24
+#define FILE_SIZE (4 * 1024 * 1024)
+
+// Files that are only sizes, read from memory
+struct MemoryFile {
+	const char* name;
+	int size;
+	int pos;
+};
+
+static MemoryFile memoryFiles[] = {
+	{ "C:\\jdk\\bin\\server\\jvm.dll", 3 * READ_AHEAD_BLOCK + 100, 0 },
+	{ "C:\\jdk\\lib\\modules", 10 * READ_AHEAD_BLOCK, 0 },
+	{ "C:\\app\\a.jar", 1000, 0 },
+	{ "C:\\app\\b.jar", 2 * READ_AHEAD_BLOCK, 0 },
+};
+
+static void* OpenMemory(void* /*ctx*/, const char* path)
+{
+	for(size_t i = 0; i < sizeof(memoryFiles) / sizeof(memoryFiles[0]); i++) {
+		if(strcmp(memoryFiles[i].name, path) == 0) {
+			memoryFiles[i].pos = 0;
+			return &memoryFiles[i];
+		}
+	}
+	return NULL;
+}
+
+static int ReadMemory(void* /*ctx*/, void* file, char* /*buffer*/, int size)
+{
+	MemoryFile* f = (MemoryFile*)file;
+	int read = f->size - f->pos < size ? f->size - f->pos : size;
+	f->pos += read;
+	return read;
+}
+
+static void CloseMemory(void* /*ctx*/, void* /*file*/)
+{
+}
+
+static const ReadAheadProvider memoryProvider = { OpenMemory, ReadMemory, CloseMemory, NULL };
+
+static int CheckFiles(const ReadAhead& readAhead, const char* const* expected, int count)
+{
+	bool same = readAhead.GetCount() == count;
+	for(int i = 0; same && i < count; i++)
+		same = strcmp(readAhead.Get(i), expected[i]) == 0;
+	if(same)
+		return 0;
+	printf("FAIL got %d files, expected %d:\n", readAhead.GetCount(), count);
+	for(int i = 0; i < readAhead.GetCount(); i++)
+		printf("  %s\n", readAhead.Get(i));
+	return 1;
+}
+
+static int CheckResult(const char* what, const ReadAheadResult& r, unsigned long long bytes, int files,
+	int partial, int missing)
+{
+	if(r.bytes == bytes && r.files == files && r.partial == partial && r.missing == missing)
+		return 0;
+	printf("FAIL %s: %llu bytes, %d files, %d partial, %d missing\n", what, r.bytes, r.files, r.partial, r.missing);
+	return 1;
+}
+
+static int CheckReadAhead()
+{
+	int errors = 0;
+
+	ReadAhead windows(0);
+	windows.AddVM("C:\\jdk\\bin\\server\\jvm.dll");
+	windows.AddList("C:\\app\\a.jar;;C:\\app\\classes;C:/APP/A.JAR;C:\\app\\b.jar;", ';');
+	windows.Add("C:\\JDK\\bin\\server\\jvm.dll");
+	static const char* const windowsFiles[] = { "C:\\jdk\\bin\\server\\jvm.dll", "C:\\jdk\\lib\\modules",
+		"C:\\jdk\\lib\\rt.jar", "C:\\app\\a.jar", "C:\\app\\classes", "C:\\app\\b.jar" };
+	errors += CheckFiles(windows, windowsFiles, 6);
+
+	ReadAhead posix(0);
+	posix.AddVM("/opt/jdk/bin/server/libjvm.so");
+	static const char* const posixFiles[] = { "/opt/jdk/bin/server/libjvm.so", "/opt/jdk/lib/modules",
+		"/opt/jdk/lib/rt.jar" };
+	errors += CheckFiles(posix, posixFiles, 3);
+
+	// Nothing to go up to
+	ReadAhead bare(0);
+	bare.AddVM("server\\jvm.dll");
+	bare.AddVM(NULL);
+	bare.AddList(NULL, ';');
+	static const char* const bareFiles[] = { "server\\jvm.dll" };
+	errors += CheckFiles(bare, bareFiles, 1);
+
+	// rt.jar and classes are not there; everything else fits
+	char buffer[16];
+	ReadAheadResult result;
+	ReadAhead all(100ULL * READ_AHEAD_BLOCK);
+	all.AddVM(memoryFiles[0].name);
+	all.AddList("C:\\app\\a.jar;C:\\app\\classes;C:\\app\\b.jar", ';');
+	all.Run(memoryProvider, buffer, READ_AHEAD_BLOCK, result);
+	errors += CheckResult("all", result, 15ULL * READ_AHEAD_BLOCK + 1100, 4, 0, 2);
+
+	// The budget runs out part way through the modules
+	ReadAhead some(5ULL * READ_AHEAD_BLOCK);
+	some.AddVM(memoryFiles[0].name);
+	some.AddList("C:\\app\\a.jar", ';');
+	some.Run(memoryProvider, buffer, READ_AHEAD_BLOCK, result);
+	errors += CheckResult("budget", result, 5ULL * READ_AHEAD_BLOCK, 1, 1, 0);
+	if(memoryFiles[1].pos != 2 * READ_AHEAD_BLOCK - 100) {
+		printf("FAIL modules read to %d\n", memoryFiles[1].pos);
+		errors++;
+	}
+
+	return errors;
+}
+
+static void* OpenDisk(void* /*ctx*/, const char* path)
+{
+	return fopen(path, "rb");
+}
+
+static int ReadDisk(void* /*ctx*/, void* file, char* buffer, int size)
+{
+	return (int)fread(buffer, 1, size, (FILE*)file);
+}
+
+static void CloseDisk(void* /*ctx*/, void* file)
+{
+	fclose((FILE*)file);
+}
+
+static const ReadAheadProvider diskProvider = { OpenDisk, ReadDisk, CloseDisk, NULL };
+
+static void DropFromCache(const char* path)
+{
+#ifdef __linux__
+	int fd = open(path, O_RDONLY);
+	if(fd >= 0) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#else
+	(void)path;
+#endif
+}
+
+// Wall time, reading is mostly waiting
+static double Now()
+{
+#ifdef __linux__
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void TimeRead(const char* what, ReadAhead& readAhead, char* buffer, int block)
+{
+	for(int i = 0; i < readAhead.GetCount(); i++)
+		DropFromCache(readAhead.Get(i));
+
+	ReadAheadResult result;
+	double t0 = Now();
+	readAhead.Run(diskProvider, buffer, block, result);
+	double cold = Now() - t0;
+	t0 = Now();
+	readAhead.Run(diskProvider, buffer, block, result);
+	double warm = Now() - t0;
+	printf("%s: %.0f MB, %.1f ms cold, %.1f ms cached\n", what, (double)result.bytes / (1024 * 1024),
+		cold * 1000, warm * 1000);
+}
+
+int main(int argc, char* argv[])
+{
+	int errors = CheckReadAhead();
+
+	const char* dir = argc > 1 ? argv[1] : ".";
+	char* buffer = (char*)malloc(READ_AHEAD_BLOCK);
+	char* data = (char*)malloc(FILE_SIZE);
+	char path[1024];
+	ReadAhead readAhead(64ULL * 1024 * 1024);
+	for(int i = 0; buffer && data && i < NUM_FILES; i++) {
+		for(int j = 0; j < FILE_SIZE; j++)
+			data[j] = (char)(i * 31 + j * 7);
+		sprintf(path, "%s/readahead-%d.jar", dir, i);
+		FILE* f = fopen(path, "wb");
+		if(!f) {
+			printf("Could not write %s\n", path);
+			break;
+		}
+		fwrite(data, 1, FILE_SIZE, f);
+		fclose(f);
+		readAhead.Add(path);
+	}
+
+	if(readAhead.GetCount() == NUM_FILES) {
+		TimeRead("1 MB blocks", readAhead, buffer, READ_AHEAD_BLOCK);
+		TimeRead("4 KB blocks", readAhead, buffer, 4096);
+	}
+	for(int i = 0; i < readAhead.GetCount(); i++)
+		remove(readAhead.Get(i));
+	free(data);
+	free(buffer);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Checks that a snapshot holds the same keys and values as the dictionary it
+// was taken from and starts with the members INI.getPropertyKeys reads, then
+// compares lookups in the snapshot with lookups in the dictionary.
+
+#include <windows.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/Dictionary.h"
+#include "../src/common/Snapshot.h"
+
+#define NUM_KEYS 50000
+
+static double Now()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (double) t.QuadPart / (double) freq.QuadPart;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+	char key[64], val[64];
+
+	if(offsetof(IniSnapshot, n) != offsetof(dictionary, n) ||
+		offsetof(IniSnapshot, val) != offsetof(dictionary, val) ||
+		offsetof(IniSnapshot, key) != offsetof(dictionary, key)) {
+		printf("FAIL snapshot layout does not match dictionary\n");
+		errors++;
+	}
+
+	dictionary* d = dictionary_new(0);
+	for(int i = 0; i < NUM_KEYS; i++) {
+		sprintf_s(key, sizeof(key), i % 3 ? ":vmarg.%d" : "Section%d:key", i);
+		sprintf_s(val, sizeof(val), "value-%d", i);
+		dictionary_set(d, key, i % 100 ? val : NULL);
+	}
+
+	IniSnapshot* s = Snapshot::Create(d);
+	if(!s || s->n != d->n) {
+		printf("FAIL snapshot has %d keys, expected %d\n", s ? s->n : -1, d->n);
+		return 1;
+	}
+	for(int i = 0; i < s->n; i++) {
+		if(s->hash[i] != dictionary_hash(s->key[i]) || (i && s->hash[i - 1] > s->hash[i]))
+			errors++;
+	}
+	for(int i = 0; i < d->n; i++) {
+		const char* v = Snapshot::Get(s, d->key[i]);
+		if((v == NULL) != (d->val[i] == NULL) || (v && strcmp(v, d->val[i])))
+			errors++;
+	}
+	if(Snapshot::Get(s, ":missing") || Snapshot::Get(s, "") || Snapshot::Get(s, NULL))
+		errors++;
+
+	// Look the keys up in random order
+	char** keys = (char**) malloc(d->n * sizeof(char*));
+	for(int i = 0; i < d->n; i++)
+		keys[i] = d->key[i];
+	srand(1);
+	for(int i = d->n - 1; i > 0; i--) {
+		int j = (int) ((((unsigned) rand() << 15) ^ (unsigned) rand()) % (unsigned) (i + 1));
+		char* k = keys[i];
+		keys[i] = keys[j];
+		keys[j] = k;
+	}
+
+	double t0 = Now();
+	int found = 0;
+	for(int i = 0; i < d->n; i++) {
+		if(Snapshot::Get(s, keys[i]))
+			found++;
+	}
+	double t1 = Now();
+	for(int i = 0; i < d->n; i++) {
+		if(dictionary_get(d, keys[i], NULL))
+			found--;
+	}
+	double t2 = Now();
+	free(keys);
+	if(found != 0)
+		errors++;
+	printf("%d keys in %d bytes, snapshot lookup %.1f ns, dictionary lookup %.1f ns\n",
+		s->n, s->size, (t1 - t0) * 1e9 / d->n, (t2 - t1) * 1e9 / d->n);
+
+	// A replacement sees later changes, the one it replaced does not
+	dictionary_set(d, (char*) ":vmarg.1", (char*) "changed");
+	IniSnapshot* s2 = Snapshot::Create(d, s);
+	if(!s2 || s2->prev != s || strcmp(Snapshot::Get(s2, ":vmarg.1"), "changed") ||
+		strcmp(Snapshot::Get(s, ":vmarg.1"), "value-1"))
+		errors++;
+
+	Snapshot::Free(s2 ? s2 : s);
+	dictionary_del(d);
+
+	IniSnapshot* empty = Snapshot::Create(NULL);
+	if(!empty || empty->n != 0 || Snapshot::Get(empty, ":main.class"))
+		errors++;
+	Snapshot::Free(empty);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
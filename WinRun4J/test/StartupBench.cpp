@@ -0,0 +1,320 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Runs the launcher's startup phases as sleeps of about the length they take
+// on a cold start (finding the VM, loading jvm.dll after it, expanding the
+// classpath, the vm args after both, the splash image on its own), one after
+// another and at the same time, checking deps are kept to and failures skip
+// what depends on them. Only needs Startup.cpp, eg.
+//
+//     g++ -O2 test/StartupBench.cpp src/launcher/Startup.cpp -lpthread
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/launcher/Startup.h"
+
+#define NUM_RUNS 5
+
+#ifdef _WIN32
+
+struct Thread {
+	void (*fn)(void*);
+	void* arg;
+};
+
+static DWORD WINAPI ThreadProc(LPVOID param)
+{
+	Thread* t = (Thread*) param;
+	t->fn(t->arg);
+	free(t);
+	return 0;
+}
+
+static void* StartThread(void* /*ctx*/, void (*fn)(void*), void* arg)
+{
+	Thread* t = (Thread*) malloc(sizeof(Thread));
+	t->fn = fn;
+	t->arg = arg;
+	HANDLE h = CreateThread(NULL, 0, ThreadProc, t, 0, NULL);
+	if(!h)
+		free(t);
+	return h;
+}
+
+static int WaitThread(void* /*ctx*/, void** threads, int count)
+{
+	DWORD r = WaitForMultipleObjects(count, (HANDLE*) threads, FALSE, INFINITE) - WAIT_OBJECT_0;
+	if(r >= (DWORD) count) {
+		r = 0;
+		WaitForSingleObject(threads[0], INFINITE);
+	}
+	CloseHandle(threads[r]);
+	return (int) r;
+}
+
+static double Now(void* /*ctx*/)
+{
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return count.QuadPart * 1000.0 / freq.QuadPart;
+}
+
+static void SleepMillis(int ms)
+{
+	Sleep(ms);
+}
+
+static long Increment(volatile long* value)
+{
+	return InterlockedIncrement(value);
+}
+
+#else
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+struct Thread {
+	pthread_t thread;
+	void (*fn)(void*);
+	void* arg;
+	bool done;
+};
+
+static void* ThreadProc(void* param)
+{
+	Thread* t = (Thread*) param;
+	t->fn(t->arg);
+	pthread_mutex_lock(&lock);
+	t->done = true;
+	pthread_cond_broadcast(&finished);
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+static void* StartThread(void* /*ctx*/, void (*fn)(void*), void* arg)
+{
+	Thread* t = (Thread*) calloc(1, sizeof(Thread));
+	t->fn = fn;
+	t->arg = arg;
+	if(pthread_create(&t->thread, NULL, ThreadProc, t)) {
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+static int WaitThread(void* /*ctx*/, void** threads, int count)
+{
+	int r = -1;
+	pthread_mutex_lock(&lock);
+	while(r < 0) {
+		for(int i = 0; i < count && r < 0; i++) {
+			if(((Thread*) threads[i])->done)
+				r = i;
+		}
+		if(r < 0)
+			pthread_cond_wait(&finished, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+	pthread_join(((Thread*) threads[r])->thread, NULL);
+	free(threads[r]);
+	return r;
+}
+
+static double Now(void* /*ctx*/)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void SleepMillis(int ms)
+{
+	usleep(ms * 1000);
+}
+
+static long Increment(volatile long* value)
+{
+	return __sync_add_and_fetch(value, 1);
+}
+
+#endif
+
+static void* NoThread(void* /*ctx*/, void (*/*fn*/)(void*), void* /*arg*/)
+{
+	return NULL;
+}
+
+struct Work {
+	int millis;
+	bool ok;
+	int order;
+};
+
+static volatile long ranCount;
+
+static bool DoWork(void* arg)
+{
+	Work* w = (Work*) arg;
+	SleepMillis(w->millis);
+	w->order = (int) Increment(&ranCount);
+	return w->ok;
+}
+
+enum { SPLASH, FIND_VM, LOAD_VM, CLASSPATH, VM_ARGS, NUM_PHASES };
+
+static Work work[NUM_PHASES];
+
+static void BuildPhases(StartupPhase* phases)
+{
+	static const struct { const char* name; unsigned deps; int millis; } launch[NUM_PHASES] = {
+		{ "splash", 0, 15 },
+		{ "find vm", 0, 20 },
+		{ "load vm", 1 << FIND_VM, 40 },
+		{ "classpath", 0, 30 },
+		{ "vm args", (1 << FIND_VM) | (1 << CLASSPATH), 10 },
+	};
+	memset(phases, 0, NUM_PHASES * sizeof(StartupPhase));
+	for(int i = 0; i < NUM_PHASES; i++) {
+		work[i].millis = launch[i].millis;
+		work[i].ok = true;
+		work[i].order = 0;
+		phases[i].name = launch[i].name;
+		phases[i].deps = launch[i].deps;
+		phases[i].run = DoWork;
+		phases[i].arg = &work[i];
+	}
+	ranCount = 0;
+}
+
+static int CheckDeps(const StartupPhase* phases, const char* what)
+{
+	int errors = 0;
+	for(int i = 0; i < NUM_PHASES; i++) {
+		for(int d = 0; d < i; d++) {
+			if((phases[i].deps & (1u << d)) && phases[i].start < phases[d].end) {
+				printf("FAIL %s: %s started at %.1f before %s ended at %.1f\n", what, phases[i].name,
+					phases[i].start, phases[d].name, phases[d].end);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+static int CheckRuns()
+{
+	int errors = 0;
+	StartupRunner threads = { StartThread, WaitThread, Now, NULL };
+	StartupRunner inline_ = { NoThread, WaitThread, Now, NULL };
+	StartupPhase phases[NUM_PHASES];
+	StartupTiming timing;
+
+	// One after another keeps the order they are listed in
+	BuildPhases(phases);
+	if(!Startup::Run(threads, phases, NUM_PHASES, false, timing)) {
+		printf("FAIL serial run\n");
+		errors++;
+	}
+	for(int i = 0; i < NUM_PHASES; i++) {
+		if(work[i].order != i + 1) {
+			printf("FAIL serial: %s ran %d\n", phases[i].name, work[i].order);
+			errors++;
+		}
+	}
+	errors += CheckDeps(phases, "serial");
+
+	BuildPhases(phases);
+	if(!Startup::Run(threads, phases, NUM_PHASES, true, timing)) {
+		printf("FAIL parallel run\n");
+		errors++;
+	}
+	errors += CheckDeps(phases, "parallel");
+	if(timing.elapsed >= timing.serial) {
+		printf("FAIL parallel took %.1f ms of %.1f\n", timing.elapsed, timing.serial);
+		errors++;
+	}
+
+	// No threads to be had runs them here
+	BuildPhases(phases);
+	if(!Startup::Run(inline_, phases, NUM_PHASES, true, timing) || ranCount != NUM_PHASES) {
+		printf("FAIL with no threads ran %ld\n", ranCount);
+		errors++;
+	}
+	errors += CheckDeps(phases, "no threads");
+
+	// No VM skips what needs one, but not the classpath or splash
+	static const int expected[NUM_PHASES] = {
+		STARTUP_DONE, STARTUP_FAILED, STARTUP_SKIPPED, STARTUP_DONE, STARTUP_SKIPPED
+	};
+	for(int parallel = 0; parallel < 2; parallel++) {
+		BuildPhases(phases);
+		work[FIND_VM].ok = false;
+		if(Startup::Run(threads, phases, NUM_PHASES, parallel != 0, timing)) {
+			printf("FAIL run with no VM succeeded\n");
+			errors++;
+		}
+		for(int i = 0; i < NUM_PHASES; i++) {
+			if(phases[i].state != expected[i]) {
+				printf("FAIL no VM: %s %s\n", phases[i].name, Startup::GetStateName(phases[i].state));
+				errors++;
+			}
+		}
+	}
+
+	// Depending on a later phase (or itself) could never run
+	BuildPhases(phases);
+	phases[FIND_VM].deps = 1 << LOAD_VM;
+	StartupPhase self = phases[SPLASH];
+	self.deps = 1;
+	if(Startup::IsValid(phases, NUM_PHASES) || Startup::IsValid(&self, 1) ||
+		Startup::Run(threads, phases, NUM_PHASES, true, timing) || ranCount != 0) {
+		printf("FAIL phases depending on later ones were run\n");
+		errors++;
+	}
+	return errors;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = CheckRuns();
+
+	StartupRunner threads = { StartThread, WaitThread, Now, NULL };
+	StartupPhase phases[NUM_PHASES];
+	StartupTiming timing;
+	double serial = 0, parallel = 0, sum = 0;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		BuildPhases(phases);
+		Startup::Run(threads, phases, NUM_PHASES, false, timing);
+		serial += timing.elapsed;
+		BuildPhases(phases);
+		Startup::Run(threads, phases, NUM_PHASES, true, timing);
+		parallel += timing.elapsed;
+		sum += timing.serial;
+	}
+	printf("startup phases: %.1f ms one after another, %.1f ms at once (%.1f ms saved)\n",
+		serial / NUM_RUNS, parallel / NUM_RUNS, (sum - parallel) / NUM_RUNS);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
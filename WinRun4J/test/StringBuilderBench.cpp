@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Joins a classpath of 3000 jars (about 300 KB) with the string builder and
+// with repeated strcat, as the classpath used to be built, and checks that
+// both give the same string. Only needs StringBuilder.cpp, eg.
+//
+//     g++ -O2 test/StringBuilderBench.cpp src/common/StringBuilder.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/common/StringBuilder.h"
+
+#define NUM_JARS 3000
+#define NUM_RUNS 10
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static char* JoinStrcat(char** jars, int count)
+{
+	size_t total = 1;
+	for(int i = 0; i < count; i++)
+		total += strlen(jars[i]) + 1;
+
+	char* cp = (char*) malloc(total);
+	cp[0] = 0;
+	for(int i = 0; i < count; i++) {
+		strcat(cp, jars[i]);
+		if(i < count - 1)
+			strcat(cp, ";");
+	}
+	return cp;
+}
+
+static char* JoinBuilder(char** jars, int count)
+{
+	StringBuilder sb;
+	for(int i = 0; i < count; i++) {
+		if(i > 0)
+			sb.Append(';');
+		sb.Append(jars[i]);
+	}
+	return sb.Detach();
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+
+	{
+		StringBuilder sb;
+		if(strcmp(sb.Get(), "") || sb.Length() != 0)
+			errors++;
+		sb.Append("-Djava.library.path=");
+		sb.Append("lib", 3);
+		sb.Append(';');
+		sb.Append((const char*) NULL);
+		if(strcmp(sb.Get(), "-Djava.library.path=lib;") || sb.Length() != 24 || sb.Failed())
+			errors++;
+		char* s = sb.Detach();
+		if(!s || strcmp(s, "-Djava.library.path=lib;") || sb.Length() != 0 || strcmp(sb.Get(), ""))
+			errors++;
+		free(s);
+
+		const char* parts[] = { "a", "bc", "", "d" };
+		sb.Join(parts, 4, ';');
+		if(strcmp(sb.Get(), "a;bc;;d"))
+			errors++;
+		s = StringBuilder().Detach();
+		if(!s || *s)
+			errors++;
+		free(s);
+		if(errors)
+			printf("FAIL basic checks\n");
+	}
+
+	char** jars = (char**) malloc(NUM_JARS * sizeof(char*));
+	for(int i = 0; i < NUM_JARS; i++) {
+		char buf[256];
+		sprintf(buf, "C:\\Program Files\\Some Vendor\\Some Application\\plugins\\org.example.module%04d\\lib\\module-%04d-1.2.3.jar", i, i);
+		jars[i] = (char*) malloc(strlen(buf) + 1);
+		strcpy(jars[i], buf);
+	}
+
+	double t0 = Now();
+	char* a = NULL;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		free(a);
+		a = JoinStrcat(jars, NUM_JARS);
+	}
+	double t1 = Now();
+	char* b = NULL;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		free(b);
+		b = JoinBuilder(jars, NUM_JARS);
+	}
+	double t2 = Now();
+
+	if(!a || !b || strcmp(a, b)) {
+		printf("FAIL joined classpaths differ\n");
+		errors++;
+	}
+	printf("%d jars, %d bytes: strcat %.3f ms, builder %.3f ms\n", NUM_JARS, b ? (int) strlen(b) : 0,
+		(t1 - t0) * 1e3 / NUM_RUNS, (t2 - t1) * 1e3 / NUM_RUNS);
+
+	free(a);
+	free(b);
+	for(int i = 0; i < NUM_JARS; i++)
+		free(jars[i]);
+	free(jars);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Searches a fake registry and file system for VMs, checks what is found and
+// that a saved inventory is only used while nothing it was read from has
+// changed, and compares the calls a check makes with a search. Only needs
+// VMInventory.cpp, eg.
+//
+//     g++ -O2 test/VMInventoryBench.cpp src/java/VMInventory.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/java/VMInventory.h"
+
+#define MAX_KEYS  64
+#define MAX_FILES 64
+#define NUM_RUNS  10000
+
+struct FakeKey {
+	char path[128];
+	char runtimeLib[128];
+	unsigned long long time;
+};
+
+struct FakeFile {
+	char path[128];
+	const char* text;
+	unsigned long long time;
+};
+
+static FakeKey keys[MAX_KEYS];
+static int keyCount;
+static FakeFile files[MAX_FILES];
+static int fileCount;
+
+static void AddKey(const char* path, const char* runtimeLib)
+{
+	FakeKey& k = keys[keyCount++];
+	strcpy(k.path, path);
+	strcpy(k.runtimeLib, runtimeLib ? runtimeLib : "");
+	k.time = 100 + keyCount;
+}
+
+static void AddFile(const char* path, const char* text)
+{
+	FakeFile& f = files[fileCount++];
+	strcpy(f.path, path);
+	f.text = text;
+	f.time = 1000 + fileCount;
+}
+
+static FakeKey* FindKey(const char* path)
+{
+	for(int i = 0; i < keyCount; i++) {
+		if(!strcmp(keys[i].path, path))
+			return &keys[i];
+	}
+	return NULL;
+}
+
+static FakeFile* FindFile(const char* path)
+{
+	for(int i = 0; i < fileCount; i++) {
+		if(!strcmp(files[i].path, path))
+			return &files[i];
+	}
+	return NULL;
+}
+
+static void* OpenKey(void* /*ctx*/, const char* path)
+{
+	return FindKey(path);
+}
+
+static void CloseKey(void* /*ctx*/, void* /*key*/)
+{
+}
+
+// Subkeys are the keys one level below, in the order they were added
+static bool EnumKey(void* /*ctx*/, void* key, int index, char* name, int len)
+{
+	const char* parent = ((FakeKey*) key)->path;
+	size_t n = strlen(parent);
+	for(int i = 0; i < keyCount; i++) {
+		const char* p = keys[i].path;
+		if(strncmp(p, parent, n) || p[n] != '\\' || strchr(&p[n + 1], '\\'))
+			continue;
+		if(index-- == 0) {
+			if((int) strlen(&p[n + 1]) >= len)
+				return false;
+			strcpy(name, &p[n + 1]);
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool GetValue(void* /*ctx*/, void* key, const char* name, char* value, int len)
+{
+	FakeKey* k = (FakeKey*) key;
+	if(strcmp(name, "RuntimeLib") || !*k->runtimeLib || (int) strlen(k->runtimeLib) >= len)
+		return false;
+	strcpy(value, k->runtimeLib);
+	return true;
+}
+
+static unsigned long long GetKeyTime(void* /*ctx*/, void* key)
+{
+	return ((FakeKey*) key)->time;
+}
+
+static unsigned long long GetFileTime(void* /*ctx*/, const char* path)
+{
+	FakeFile* f = FindFile(path);
+	return f ? f->time : VM_INVENTORY_MISSING;
+}
+
+static bool ReadFile(void* /*ctx*/, const char* path, char* buf, int len)
+{
+	FakeFile* f = FindFile(path);
+	if(!f || !f->text)
+		return false;
+	strncpy(buf, f->text, len - 1);
+	buf[len - 1] = 0;
+	return true;
+}
+
+static const VMProvider provider = { OpenKey, CloseKey, EnumKey, GetValue, GetKeyTime, GetFileTime, ReadFile, NULL };
+
+static const char* const roots[] = {
+	"Software\\JavaSoft\\Java Runtime Environment",
+	"Software\\JavaSoft\\JRE",
+	"Software\\IBM\\Java2 Runtime Environment",
+};
+static const char* const bundled[] = { "C:\\app\\jre", "C:\\app\\runtime" };
+
+static void BuildMachine()
+{
+	AddKey(roots[0], NULL);
+	AddKey("Software\\JavaSoft\\Java Runtime Environment\\1.8", "C:\\jre8\\bin\\server\\jvm.dll");
+	AddKey("Software\\JavaSoft\\Java Runtime Environment\\1.8.0_292", "C:\\jre8\\bin\\server\\jvm.dll");
+	AddKey(roots[1], NULL);
+	AddKey("Software\\JavaSoft\\JRE\\11", "C:\\jdk11\\bin\\client\\jvm.dll");
+	AddKey("Software\\JavaSoft\\JRE\\11.0.2", "C:\\jdk11\\bin\\client\\jvm.dll");
+	AddKey("Software\\JavaSoft\\JRE\\17.0.1", "C:\\jdk17\\bin\\server\\jvm.dll");
+	AddKey("Software\\JavaSoft\\JRE\\broken", NULL);
+	AddFile("C:\\jre8\\bin\\server\\jvm.dll", NULL);
+	AddFile("C:\\jdk11\\bin\\server\\jvm.dll", NULL);
+	AddFile("C:\\jdk17\\bin\\server\\jvm.dll", NULL);
+	AddFile("C:\\jdk21\\bin\\server\\jvm.dll", NULL);
+	AddFile("C:\\jdk21\\release", "IMPLEMENTOR=\"Eclipse Adoptium\"\nJAVA_VERSION=\"21.0.2\"\n");
+	AddFile("C:\\app\\runtime\\jre\\bin\\client\\jvm.dll", NULL);
+}
+
+static int Check(const VMInventory& inv)
+{
+	static const struct { const char* version; const char* path; unsigned source; } expected[] = {
+		{ "1.8", "C:\\jre8\\bin\\server\\jvm.dll", VM_SOURCE_REGISTRY },
+		{ "1.8.0_292", "C:\\jre8\\bin\\server\\jvm.dll", VM_SOURCE_REGISTRY },
+		{ "11", "C:\\jdk11\\bin\\server\\jvm.dll", VM_SOURCE_REGISTRY },
+		{ "11.0.2", "C:\\jdk11\\bin\\server\\jvm.dll", VM_SOURCE_REGISTRY },
+		{ "17.0.1", "C:\\jdk17\\bin\\server\\jvm.dll", VM_SOURCE_REGISTRY },
+		{ "21.0.2", "C:\\jdk21\\bin\\server\\jvm.dll", VM_SOURCE_JAVA_HOME },
+		{ "0", "C:\\app\\runtime\\jre\\bin\\client\\jvm.dll", VM_SOURCE_BUNDLED },
+	};
+	int n = sizeof(expected) / sizeof(expected[0]);
+
+	int errors = 0;
+	if(inv.GetCount() != n) {
+		printf("FAIL found %d VMs, expected %d\n", inv.GetCount(), n);
+		return 1;
+	}
+	for(int i = 0; i < n; i++) {
+		const VMInventoryEntry& e = inv.Get(i);
+		if(strcmp(e.version, expected[i].version) || strcmp(e.path, expected[i].path) ||
+			e.source != expected[i].source) {
+			printf("FAIL %d: %s %s %u\n", i, e.version, e.path, e.source);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+	BuildMachine();
+
+	VMSearch search = { roots, 3, "C:\\jdk21", bundled, 2, true };
+
+	VMInventory built(provider);
+	built.Build(search);
+	errors += Check(built);
+	int searchCalls = built.GetCalls();
+
+	size_t size = built.GetSize();
+	unsigned char* saved = (unsigned char*) malloc(size);
+	memcpy(saved, built.GetData(), size);
+
+	// Nothing changed
+	VMInventory loaded(provider);
+	if(!loaded.Load(saved, size, search)) {
+		printf("FAIL saved inventory not used\n");
+		errors++;
+	} else {
+		errors += Check(loaded);
+	}
+	int checkCalls = loaded.GetCalls();
+
+	// Each of these has to make the saved inventory stale
+	struct Change {
+		const char* what;
+		unsigned long long* time;
+	} changes[] = {
+		{ "new version under a root", &FindKey(roots[1])->time },
+		{ "RuntimeLib changed", &FindKey("Software\\JavaSoft\\JRE\\17.0.1")->time },
+		{ "VM replaced", &FindFile("C:\\jdk17\\bin\\server\\jvm.dll")->time },
+		{ "VM in JAVA_HOME replaced", &FindFile("C:\\jdk21\\bin\\server\\jvm.dll")->time },
+	};
+	for(size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+		unsigned long long old = *changes[i].time;
+		*changes[i].time = old + 1;
+		VMInventory inv(provider);
+		if(inv.Load(saved, size, search)) {
+			printf("FAIL saved inventory used after: %s\n", changes[i].what);
+			errors++;
+		}
+		*changes[i].time = old;
+	}
+
+	// A root or a bundled runtime appearing, or another JAVA_HOME
+	{
+		AddKey(roots[2], NULL);
+		VMInventory inv(provider);
+		if(inv.Load(saved, size, search)) {
+			printf("FAIL saved inventory used after a root was added\n");
+			errors++;
+		}
+		keyCount--;
+
+		AddFile("C:\\app\\jre\\bin\\server\\jvm.dll", NULL);
+		if(inv.Load(saved, size, search)) {
+			printf("FAIL saved inventory used after a runtime was bundled\n");
+			errors++;
+		}
+		fileCount--;
+
+		VMSearch other = search;
+		other.javaHome = "C:\\jdk17";
+		VMSearch x86 = search;
+		x86.serverForClient = false;
+		if(inv.Load(saved, size, other) || inv.Load(saved, size, x86) || inv.Load(saved, size - 1, search)) {
+			printf("FAIL saved inventory used for another search\n");
+			errors++;
+		}
+
+		// A 32 bit launcher keeps the client VM it was given
+		inv.Build(x86);
+		if(inv.GetCount() != built.GetCount() || strcmp(inv.Get(2).path, "C:\\jdk11\\bin\\client\\jvm.dll")) {
+			printf("FAIL server VM used for a missing client one on 32 bit\n");
+			errors++;
+		}
+	}
+
+	double t0 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		VMInventory inv(provider);
+		inv.Build(search);
+	}
+	double t1 = Now();
+	for(int r = 0; r < NUM_RUNS; r++) {
+		VMInventory inv(provider);
+		if(!inv.Load(saved, size, search))
+			errors++;
+	}
+	double t2 = Now();
+
+	printf("%d VMs, %d bytes saved\n", built.GetCount(), (int) size);
+	printf("search: %d registry/file calls, %.2f us; check: %d calls, %.2f us\n", searchCalls,
+		(t1 - t0) * 1e6 / NUM_RUNS, checkCalls, (t2 - t1) * 1e6 / NUM_RUNS);
+
+	free(saved);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+
+// Sizes each profile for a plain machine and for processes confined by job
+// objects, checks the results stay inside the budget and that explicit vm
+// args are left alone, and times sizing a VM. Only needs VMSizing.cpp, eg.
+//
+//     g++ -O2 test/VMSizingBench.cpp src/java/VMSizing.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/java/VMSizing.h"
+
+#define NUM_RUNS 1000000
+
+struct Machine {
+	const char* what;
+	VMBudget budget;
+	unsigned memory;
+	unsigned cpus;
+};
+
+static const Machine machines[] = {
+	{ "workstation", { 16384, 9000, 0, 0, 8, 8, 0 }, 16384, 8 },
+	{ "job with 2 GB and 25% of 16 cpus", { 65536, 40000, 2048, 0, 16, 16, 2500 }, 2048, 4 },
+	{ "job with 256 MB, 2 cpus by affinity", { 8192, 4000, 256, 0, 8, 2, 0 }, 256, 2 },
+	{ "two processor groups", { 262144, 200000, 0, 0, 128, 128, 0 }, 262144, 128 },
+	{ "32 bit", { 8192, 6000, 0, 1530, 4, 4, 0 }, 8192, 4 },
+	{ "low on free memory", { 4096, 300, 0, 0, 2, 2, 0 }, 4096, 2 },
+};
+
+#define NUM_MACHINES (sizeof(machines) / sizeof(machines[0]))
+
+static const char* FindArg(char args[][VM_SIZING_ARG_LEN], int n, const char* prefix)
+{
+	for(int i = 0; i < n; i++) {
+		if(!strncmp(args[i], prefix, strlen(prefix)))
+			return args[i];
+	}
+	return NULL;
+}
+
+static int CheckMachine(const Machine& m)
+{
+	int errors = 0;
+	if(VMSizing::GetMemory(m.budget) != m.memory || VMSizing::GetCpus(m.budget) != m.cpus) {
+		printf("FAIL %s: budget %u MB, %u cpus\n", m.what, VMSizing::GetMemory(m.budget),
+			VMSizing::GetCpus(m.budget));
+		errors++;
+	}
+
+	for(int p = VM_PROFILE_THROUGHPUT; p <= VM_PROFILE_FOOTPRINT; p++) {
+		VMSizes s;
+		if(!VMSizing::Compute(p, m.budget, s)) {
+			printf("FAIL %s: %s not sized\n", m.what, VMSizing::GetProfileName(p));
+			errors++;
+			continue;
+		}
+		if(s.maxHeap + s.maxMetaspace > s.memory || s.minHeap > s.maxHeap ||
+			(m.budget.address && s.maxHeap + s.maxMetaspace + 64 > m.budget.address) ||
+			(m.budget.available && s.minHeap > m.budget.available / 2 && s.minHeap > 8) ||
+			s.parallelThreads > s.cpus || !s.gc) {
+			printf("FAIL %s: %s heap %u-%u MB, metaspace %u MB, %u gc threads\n", m.what,
+				VMSizing::GetProfileName(p), s.minHeap, s.maxHeap, s.maxMetaspace, s.parallelThreads);
+			errors++;
+		}
+
+		char args[VM_SIZING_MAX_ARGS][VM_SIZING_ARG_LEN];
+		int n = VMSizing::Format(s, NULL, 0, args, VM_SIZING_MAX_ARGS);
+		char expected[VM_SIZING_ARG_LEN];
+		sprintf(expected, "-XX:ActiveProcessorCount=%u", m.cpus);
+		const char* cpus = FindArg(args, n, "-XX:ActiveProcessorCount=");
+		if(!cpus || strcmp(cpus, expected) || !FindArg(args, n, s.gc) || !FindArg(args, n, "-Xmx")) {
+			printf("FAIL %s: %s args\n", m.what, VMSizing::GetProfileName(p));
+			errors++;
+		}
+		if(p == VM_PROFILE_FOOTPRINT && FindArg(args, n, "-XX:ParallelGCThreads=")) {
+			printf("FAIL %s: gc threads for the serial collector\n", m.what);
+			errors++;
+		}
+		if(p == VM_PROFILE_LATENCY && !FindArg(args, n, "-XX:ConcGCThreads=")) {
+			printf("FAIL %s: no concurrent gc threads\n", m.what);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+// Explicit vm args and the heap size keys win over the profile
+static int CheckExplicit()
+{
+	int errors = 0;
+	VMSizes s;
+	VMSizing::Compute(VM_PROFILE_LATENCY, machines[0].budget, s);
+
+	const char* set[] = { "-Xmx512m", "-XX:+UseZGC", "-Djava.class.path=a.jar" };
+	char args[VM_SIZING_MAX_ARGS][VM_SIZING_ARG_LEN];
+	int n = VMSizing::Format(s, set, 3, args, VM_SIZING_MAX_ARGS);
+	if(FindArg(args, n, "-Xmx") || FindArg(args, n, "-XX:+UseG1GC") || FindArg(args, n, "-XX:MaxGCPauseMillis") ||
+		FindArg(args, n, "-XX:ConcGCThreads") || !FindArg(args, n, "-Xms") || n != 3) {
+		printf("FAIL explicit args overridden (%d args)\n", n);
+		errors++;
+	}
+
+	if(VMSizing::Format(s, NULL, 0, args, 2) != 2 || VMSizing::GetProfile("fast") != VM_PROFILE_NONE ||
+		VMSizing::GetProfile("footprint") != VM_PROFILE_FOOTPRINT || VMSizing::Compute(VM_PROFILE_NONE, machines[0].budget, s)) {
+		printf("FAIL profile names or arg limit\n");
+		errors++;
+	}
+	return errors;
+}
+
+static double Now()
+{
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	int errors = 0;
+	for(size_t i = 0; i < NUM_MACHINES; i++)
+		errors += CheckMachine(machines[i]);
+	errors += CheckExplicit();
+
+	for(size_t i = 0; i < NUM_MACHINES; i++) {
+		printf("%s:\n", machines[i].what);
+		for(int p = VM_PROFILE_THROUGHPUT; p <= VM_PROFILE_FOOTPRINT; p++) {
+			VMSizes s;
+			char args[VM_SIZING_MAX_ARGS][VM_SIZING_ARG_LEN];
+			VMSizing::Compute(p, machines[i].budget, s);
+			int n = VMSizing::Format(s, NULL, 0, args, VM_SIZING_MAX_ARGS);
+			printf("  %-10s", VMSizing::GetProfileName(p));
+			for(int a = 0; a < n; a++)
+				printf(" %s", args[a]);
+			printf("\n");
+		}
+	}
+
+	double t0 = Now();
+	unsigned total = 0;
+	for(int r = 0; r < NUM_RUNS; r++) {
+		VMSizes s;
+		char args[VM_SIZING_MAX_ARGS][VM_SIZING_ARG_LEN];
+		VMSizing::Compute(1 + r % 3, machines[r % NUM_MACHINES].budget, s);
+		total += VMSizing::Format(s, NULL, 0, args, VM_SIZING_MAX_ARGS);
+	}
+	double t1 = Now();
+	printf("sizing and formatting: %.1f ns (%u args)\n", (t1 - t0) * 1e9 / NUM_RUNS, total);
+
+	if(errors)
+		printf("FAILED: %d errors\n", errors);
+
+	return errors ? 1 : 0;
+}
@@ -45,6 +45,9 @@ public class INI
     public static final String SERVICE_PWD = ":service.password";
     public static final String SERVICE_LOAD_ORDER_GROUP = ":service.loadordergroup";
 
+    // All keys and values, fetched once
+    private static Map<String, String> properties;
+
     /**
      * Gets a property from the INI file.
      * 
@@ -82,6 +85,51 @@ public class INI
      * @return String.
      */
     public static String[] getPropertyKeys() {
+        Map<String, String> props = loadProperties();
+        return props.keySet().toArray(new String[props.size()]);
+    }
+
+    /**
+     * Get the set of properties as a map.
+     * 
+     * @return Map.
+     */
+    public static Map<String, String> getProperties() {
+        return new HashMap<String, String>(loadProperties());
+    }
+
+    /**
+     * Fetches every key and value from the launcher in one native call the
+     * first time, falling back to reading the keys and values one by one
+     * when the launcher does not provide it (eg. native methods disabled).
+     */
+    private static synchronized Map<String, String> loadProperties() {
+        if (properties != null)
+            return properties;
+
+        Map<String, String> props = new HashMap<String, String>();
+        String[][] kv = null;
+        try {
+            kv = Native.getINIProperties();
+        } catch (UnsatisfiedLinkError e) {
+        }
+
+        if (kv != null) {
+            for (int i = 0; i < kv[0].length; i++) {
+                props.put(kv[0][i], kv[1][i]);
+            }
+        } else {
+            String[] keys = readPropertyKeys();
+            for (int i = 0; i < keys.length; i++) {
+                props.put(keys[i], getProperty(keys[i]));
+            }
+        }
+
+        properties = props;
+        return props;
+    }
+
+    private static String[] readPropertyKeys() {
         long d = NativeHelper.call(0, "INI_GetDictionary");
         if (d == 0) {
             return new String[0];
@@ -100,30 +148,15 @@ public class INI
         return res;
     }
 
-    /**
-     * Get the set of properties as a map.
-     * 
-     * @return Map.
-     */
-    public static Map<String, String> getProperties() {
-        Map<String, String> props = new HashMap<String, String>();
-        String[] keys = getPropertyKeys();
-
-        for (int i = 0; i < keys.length; i++) {
-            props.put(keys[i], getProperty(keys[i]));
-        }
-
-        return props;
-    }
-
     /**
      * Grab numbered entries from the properties.
      */
     public static String[] getNumberedEntries(String baseKey) {
+        Map<String, String> props = loadProperties();
         ArrayList l = new ArrayList();
         int i = 1;
         while (true) {
-            String v = getProperty(baseKey + "." + i);
+            String v = props.get(baseKey + "." + i);
             if (v != null)
                 l.add(v);
             i++;
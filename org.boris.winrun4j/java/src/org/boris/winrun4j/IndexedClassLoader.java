@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * This program and the accompanying materials
+ * are made available under the terms of the Common Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/cpl-v10.html
+ *
+ * Contributors:
+ *     Peter Smith
+ *******************************************************************************/
+package org.boris.winrun4j;
+
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.net.URL;
+import java.security.CodeSource;
+import java.security.SecureClassLoader;
+import java.security.cert.Certificate;
+import java.util.HashMap;
+import java.util.jar.JarEntry;
+import java.util.jar.JarFile;
+
+/**
+ * Loads the classes of the classpath from the jars the launcher's package
+ * index says hold their package, rather than asking every jar in turn. The
+ * launcher finds the main class through it when classpath.index is set.
+ * Classes of the JDK and of this library, and anything not found through the
+ * index, are loaded by the system class loader.
+ */
+public class IndexedClassLoader extends SecureClassLoader
+{
+    private static final String LIBRARY_PACKAGE = "org.boris.winrun4j.";
+
+    // Open jars by classpath entry, Boolean.FALSE for ones that could not be opened
+    private HashMap jars = new HashMap();
+    private HashMap sources = new HashMap();
+
+    public IndexedClassLoader() {
+        super(ClassLoader.getSystemClassLoader());
+    }
+
+    protected synchronized Class loadClass(String name, boolean resolve) throws ClassNotFoundException {
+        name = name.replace('/', '.');
+        Class c = findLoadedClass(name);
+        if (c == null) {
+            try {
+                // The bootstrap loader, and the extension or platform loader above the system one
+                ClassLoader above = getParent().getParent();
+                c = above != null ? above.loadClass(name) : Class.forName(name, false, null);
+            } catch (ClassNotFoundException e) {
+            }
+        }
+        if (c == null && !name.startsWith(LIBRARY_PACKAGE))
+            c = findIndexed(name);
+        if (c == null)
+            c = getParent().loadClass(name);
+        if (resolve)
+            resolveClass(c);
+        return c;
+    }
+
+    private Class findIndexed(String name) {
+        int dot = name.lastIndexOf('.');
+        if (dot < 0)
+            return null;
+        String pkg = name.substring(0, dot);
+
+        String[] entries;
+        try {
+            entries = Native.getClassPathJars(pkg);
+        } catch (UnsatisfiedLinkError e) {
+            return null;
+        }
+        if (entries == null)
+            return null;
+
+        String path = name.replace('.', '/').concat(".class");
+        for (int i = 0; i < entries.length; i++) {
+            byte[] b = read(entries[i], path);
+            if (b == null)
+                continue;
+            if (getPackage(pkg) == null) {
+                try {
+                    definePackage(pkg, null, null, null, null, null, null, null);
+                } catch (IllegalArgumentException e) {
+                }
+            }
+            return defineClass(name, b, 0, b.length, getSource(entries[i]));
+        }
+        return null;
+    }
+
+    private byte[] read(String entry, String path) {
+        File f = new File(entry);
+        InputStream is = null;
+        try {
+            if (f.isDirectory()) {
+                File cf = new File(f, path);
+                if (!cf.isFile())
+                    return null;
+                is = new FileInputStream(cf);
+            } else {
+                JarFile jar = getJar(entry);
+                JarEntry je = jar != null ? jar.getJarEntry(path) : null;
+                if (je == null)
+                    return null;
+                is = jar.getInputStream(je);
+            }
+            ByteArrayOutputStream bos = new ByteArrayOutputStream();
+            byte[] buf = new byte[4096];
+            int len = 0;
+            while ((len = is.read(buf)) > 0) {
+                bos.write(buf, 0, len);
+            }
+            return bos.toByteArray();
+        } catch (IOException e) {
+            return null;
+        } finally {
+            if (is != null) {
+                try {
+                    is.close();
+                } catch (IOException e) {
+                }
+            }
+        }
+    }
+
+    private JarFile getJar(String entry) {
+        Object jar = jars.get(entry);
+        if (jar == null) {
+            try {
+                jar = new JarFile(entry);
+            } catch (IOException e) {
+                jar = Boolean.FALSE;
+            }
+            jars.put(entry, jar);
+        }
+        return jar instanceof JarFile ? (JarFile) jar : null;
+    }
+
+    private CodeSource getSource(String entry) {
+        CodeSource cs = (CodeSource) sources.get(entry);
+        if (cs == null) {
+            URL url = null;
+            try {
+                url = new File(entry).toURI().toURL();
+            } catch (IOException e) {
+            }
+            cs = new CodeSource(url, (Certificate[]) null);
+            sources.put(entry, cs);
+        }
+        return cs;
+    }
+}
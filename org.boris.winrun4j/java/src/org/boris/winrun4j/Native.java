@@ -77,4 +77,26 @@ public class Native
      * Gets a method id.
      */
     public static native long getMethodId(Class clazz, String name, String sig, boolean isStatic);
+
+    /**
+     * Gets every INI key and value in one call, as { keys, values }.
+     */
+    static native String[][] getINIProperties();
+
+    /**
+     * Gets the classpath entries that may hold classes of a package (eg.
+     * "org.boris.winrun4j"), in classpath order, so a class loader can go
+     * straight to the right jar. Directories and jars that could not be
+     * indexed are always included. Returns null unless the launcher was
+     * started with classpath.index=true, when the main class is loaded
+     * through {@link IndexedClassLoader}.
+     */
+    public static native String[] getClassPathJars(String packageName);
+
+    /**
+     * Gets the times of the launch phases so far as one JSON line, eg.
+     * {"pid":..,"started":..,"module":..,"phases":{"ini":{"start":..,"ms":..},..}},
+     * in milliseconds from when the launcher started.
+     */
+    public static native String getStartupTimings();
 }